@@ -0,0 +1,467 @@
+#include "address.h"
+#include "log.h"
+#include "config.h"
+#include "util.h"
+
+#include <map>
+#include <sstream>
+#include <netdb.h>
+#include <string.h>
+#include <stddef.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_resolver_cache_ttl =
+    sylar::Config::Lookup("address.resolver.cache_ttl", (uint64_t)60000
+            , "how long Address::Lookup results are cached in ms, 0 disables the cache");
+
+static sylar::ConfigVar<uint32_t>::ptr g_resolver_cache_size =
+    sylar::Config::Lookup("address.resolver.cache_size", (uint32_t)4096
+            , "most names kept in the Address::Lookup cache");
+
+namespace {
+
+/**
+ * @brief Resolved names, shared by every thread
+ */
+class ResolverCache {
+public:
+    typedef RWMutex RWMutexType;
+
+    bool get(const std::string& key, std::vector<Address::ptr>& result) {
+        uint64_t now = GetCurrentMS();
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_entries.find(key);
+        if(it == m_entries.end() || it->second.expire <= now) {
+            return false;
+        }
+        // hand out copies, callers are free to setPort() on them
+        for(auto& i : it->second.addrs) {
+            result.push_back(Address::Create(i->getAddr(), i->getAddrLen()));
+        }
+        return true;
+    }
+
+    void put(const std::string& key, const std::vector<Address::ptr>& addrs, uint64_t ttl) {
+        uint64_t now = GetCurrentMS();
+        RWMutexType::WriteLock lock(m_mutex);
+        if(m_entries.size() >= g_resolver_cache_size->getValue()) {
+            for(auto it = m_entries.begin(); it != m_entries.end();) {
+                if(it->second.expire <= now) {
+                    m_entries.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+            if(m_entries.size() >= g_resolver_cache_size->getValue()) {
+                m_entries.clear();
+            }
+        }
+        Entry& e = m_entries[key];
+        e.expire = now + ttl;
+        e.addrs.clear();
+        for(auto& i : addrs) {
+            e.addrs.push_back(Address::Create(i->getAddr(), i->getAddrLen()));
+        }
+    }
+
+    void clear() {
+        RWMutexType::WriteLock lock(m_mutex);
+        m_entries.clear();
+    }
+private:
+    struct Entry {
+        uint64_t expire = 0;
+        std::vector<Address::ptr> addrs;
+    };
+    RWMutexType m_mutex;
+    std::map<std::string, Entry> m_entries;
+};
+
+ResolverCache& GetResolverCache() {
+    static ResolverCache s_cache;
+    return s_cache;
+}
+
+}
+
+Address::ptr Address::Create(const sockaddr* addr, socklen_t addrlen) {
+    if(addr == nullptr) {
+        return nullptr;
+    }
+
+    Address::ptr result;
+    switch(addr->sa_family) {
+        case AF_INET:
+            result.reset(new IPv4Address(*(const sockaddr_in*)addr));
+            break;
+        case AF_INET6:
+            result.reset(new IPv6Address(*(const sockaddr_in6*)addr));
+            break;
+        case AF_UNIX: {
+                UnixAddress::ptr unix_addr(new UnixAddress);
+                memcpy(unix_addr->getAddr(), addr
+                        , std::min((size_t)addrlen, sizeof(sockaddr_un)));
+                unix_addr->setAddrLen(addrlen);
+                result = unix_addr;
+            }
+            break;
+        default:
+            result.reset(new UnknownAddress(*addr));
+            break;
+    }
+    return result;
+}
+
+bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host,
+                     int family, int type, int protocol) {
+    std::stringstream key;
+    key << host << '|' << family << '|' << type << '|' << protocol;
+    uint64_t ttl = g_resolver_cache_ttl->getValue();
+    if(ttl && GetResolverCache().get(key.str(), result)) {
+        return true;
+    }
+
+    addrinfo hints, *results, *next;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = 0;
+    hints.ai_family = family;
+    hints.ai_socktype = type;
+    hints.ai_protocol = protocol;
+
+    std::string node;
+    const char* service = NULL;
+
+    // [ipv6]:service
+    if(!host.empty() && host[0] == '[') {
+        const char* endipv6 = (const char*)memchr(host.c_str() + 1, ']', host.size() - 1);
+        if(endipv6) {
+            if(*(endipv6 + 1) == ':') {
+                service = endipv6 + 2;
+            }
+            node = host.substr(1, endipv6 - host.c_str() - 1);
+        }
+    }
+
+    // node:service, a second ':' means a bare IPv6 address
+    if(node.empty()) {
+        service = (const char*)memchr(host.c_str(), ':', host.size());
+        if(service) {
+            if(!memchr(service + 1, ':', host.c_str() + host.size() - service - 1)) {
+                node = host.substr(0, service - host.c_str());
+                ++service;
+            } else {
+                service = NULL;
+            }
+        }
+    }
+
+    if(node.empty()) {
+        node = host;
+    }
+    int error = getaddrinfo(node.c_str(), service, &hints, &results);
+    if(error) {
+        SYLAR_LOG_DEBUG(g_logger) << "Address::Lookup getaddress(" << host << ", "
+            << family << ", " << type << ") err=" << error << " errstr="
+            << gai_strerror(error);
+        return false;
+    }
+
+    std::vector<Address::ptr> found;
+    next = results;
+    while(next) {
+        found.push_back(Create(next->ai_addr, (socklen_t)next->ai_addrlen));
+        next = next->ai_next;
+    }
+    freeaddrinfo(results);
+    if(found.empty()) {
+        return false;
+    }
+    if(ttl) {
+        GetResolverCache().put(key.str(), found, ttl);
+    }
+    result.insert(result.end(), found.begin(), found.end());
+    return true;
+}
+
+Address::ptr Address::LookupAny(const std::string& host,
+                                int family, int type, int protocol) {
+    std::vector<Address::ptr> result;
+    if(Lookup(result, host, family, type, protocol)) {
+        return result[0];
+    }
+    return nullptr;
+}
+
+std::shared_ptr<IPAddress> Address::LookupAnyIPAddress(const std::string& host,
+                                int family, int type, int protocol) {
+    std::vector<Address::ptr> result;
+    if(Lookup(result, host, family, type, protocol)) {
+        for(auto& i : result) {
+            IPAddress::ptr v = std::dynamic_pointer_cast<IPAddress>(i);
+            if(v) {
+                return v;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void Address::ClearLookupCache() {
+    GetResolverCache().clear();
+}
+
+int Address::getFamily() const {
+    return getAddr()->sa_family;
+}
+
+std::string Address::toString() const {
+    std::stringstream ss;
+    insert(ss);
+    return ss.str();
+}
+
+bool Address::operator<(const Address& rhs) const {
+    socklen_t minlen = std::min(getAddrLen(), rhs.getAddrLen());
+    int result = memcmp(getAddr(), rhs.getAddr(), minlen);
+    if(result < 0) {
+        return true;
+    } else if(result > 0) {
+        return false;
+    } else if(getAddrLen() < rhs.getAddrLen()) {
+        return true;
+    }
+    return false;
+}
+
+bool Address::operator==(const Address& rhs) const {
+    return getAddrLen() == rhs.getAddrLen()
+        && memcmp(getAddr(), rhs.getAddr(), getAddrLen()) == 0;
+}
+
+bool Address::operator!=(const Address& rhs) const {
+    return !(*this == rhs);
+}
+
+IPAddress::ptr IPAddress::Create(const char* address, uint16_t port) {
+    addrinfo hints, *results;
+    memset(&hints, 0, sizeof(addrinfo));
+    hints.ai_flags = AI_NUMERICHOST;
+    hints.ai_family = AF_UNSPEC;
+
+    int error = getaddrinfo(address, NULL, &hints, &results);
+    if(error) {
+        SYLAR_LOG_DEBUG(g_logger) << "IPAddress::Create(" << address
+            << ", " << port << ") error=" << error
+            << " errstr=" << gai_strerror(error);
+        return nullptr;
+    }
+
+    IPAddress::ptr result = std::dynamic_pointer_cast<IPAddress>(
+            Address::Create(results->ai_addr, (socklen_t)results->ai_addrlen));
+    if(result) {
+        result->setPort(port);
+    }
+    freeaddrinfo(results);
+    return result;
+}
+
+IPv4Address::ptr IPv4Address::Create(const char* address, uint16_t port) {
+    IPv4Address::ptr rt(new IPv4Address);
+    rt->m_addr.sin_port = htons(port);
+    int result = inet_pton(AF_INET, address, &rt->m_addr.sin_addr);
+    if(result <= 0) {
+        SYLAR_LOG_DEBUG(g_logger) << "IPv4Address::Create(" << address << ", "
+                << port << ") rt=" << result;
+        return nullptr;
+    }
+    return rt;
+}
+
+IPv4Address::IPv4Address(const sockaddr_in& address) {
+    m_addr = address;
+}
+
+IPv4Address::IPv4Address(uint32_t address, uint16_t port) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin_family = AF_INET;
+    m_addr.sin_port = htons(port);
+    m_addr.sin_addr.s_addr = htonl(address);
+}
+
+const sockaddr* IPv4Address::getAddr() const {
+    return (const sockaddr*)&m_addr;
+}
+
+sockaddr* IPv4Address::getAddr() {
+    return (sockaddr*)&m_addr;
+}
+
+socklen_t IPv4Address::getAddrLen() const {
+    return sizeof(m_addr);
+}
+
+std::ostream& IPv4Address::insert(std::ostream& os) const {
+    uint32_t addr = ntohl(m_addr.sin_addr.s_addr);
+    os << ((addr >> 24) & 0xff) << "."
+       << ((addr >> 16) & 0xff) << "."
+       << ((addr >> 8) & 0xff) << "."
+       << (addr & 0xff);
+    os << ":" << ntohs(m_addr.sin_port);
+    return os;
+}
+
+uint16_t IPv4Address::getPort() const {
+    return ntohs(m_addr.sin_port);
+}
+
+void IPv4Address::setPort(uint16_t v) {
+    m_addr.sin_port = htons(v);
+}
+
+IPv6Address::ptr IPv6Address::Create(const char* address, uint16_t port) {
+    IPv6Address::ptr rt(new IPv6Address);
+    rt->m_addr.sin6_port = htons(port);
+    int result = inet_pton(AF_INET6, address, &rt->m_addr.sin6_addr);
+    if(result <= 0) {
+        SYLAR_LOG_DEBUG(g_logger) << "IPv6Address::Create(" << address << ", "
+                << port << ") rt=" << result;
+        return nullptr;
+    }
+    return rt;
+}
+
+IPv6Address::IPv6Address() {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin6_family = AF_INET6;
+}
+
+IPv6Address::IPv6Address(const sockaddr_in6& address) {
+    m_addr = address;
+}
+
+IPv6Address::IPv6Address(const uint8_t address[16], uint16_t port) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin6_family = AF_INET6;
+    m_addr.sin6_port = htons(port);
+    memcpy(&m_addr.sin6_addr.s6_addr, address, 16);
+}
+
+const sockaddr* IPv6Address::getAddr() const {
+    return (const sockaddr*)&m_addr;
+}
+
+sockaddr* IPv6Address::getAddr() {
+    return (sockaddr*)&m_addr;
+}
+
+socklen_t IPv6Address::getAddrLen() const {
+    return sizeof(m_addr);
+}
+
+std::ostream& IPv6Address::insert(std::ostream& os) const {
+    char buf[INET6_ADDRSTRLEN] = {0};
+    inet_ntop(AF_INET6, &m_addr.sin6_addr, buf, sizeof(buf));
+    os << "[" << buf << "]:" << ntohs(m_addr.sin6_port);
+    return os;
+}
+
+uint16_t IPv6Address::getPort() const {
+    return ntohs(m_addr.sin6_port);
+}
+
+void IPv6Address::setPort(uint16_t v) {
+    m_addr.sin6_port = htons(v);
+}
+
+static const size_t MAX_PATH_LEN = sizeof(((sockaddr_un*)0)->sun_path) - 1;
+
+UnixAddress::UnixAddress() {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sun_family = AF_UNIX;
+    m_length = offsetof(sockaddr_un, sun_path) + MAX_PATH_LEN;
+}
+
+UnixAddress::UnixAddress(const std::string& path) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sun_family = AF_UNIX;
+    m_length = path.size() + 1;
+
+    if(!path.empty() && path[0] == '\0') {
+        // abstract addresses aren't NUL terminated
+        --m_length;
+    }
+
+    if(m_length > sizeof(m_addr.sun_path)) {
+        SYLAR_LOG_ERROR(g_logger) << "UnixAddress path too long: " << path;
+        m_length = sizeof(m_addr.sun_path);
+    }
+    memcpy(m_addr.sun_path, path.c_str(), m_length);
+    m_length += offsetof(sockaddr_un, sun_path);
+}
+
+void UnixAddress::setAddrLen(socklen_t v) {
+    m_length = v;
+}
+
+const sockaddr* UnixAddress::getAddr() const {
+    return (const sockaddr*)&m_addr;
+}
+
+sockaddr* UnixAddress::getAddr() {
+    return (sockaddr*)&m_addr;
+}
+
+socklen_t UnixAddress::getAddrLen() const {
+    return m_length;
+}
+
+std::string UnixAddress::getPath() const {
+    std::stringstream ss;
+    if(m_length > offsetof(sockaddr_un, sun_path)
+            && m_addr.sun_path[0] == '\0') {
+        ss << "\\0" << std::string(m_addr.sun_path + 1,
+                m_length - offsetof(sockaddr_un, sun_path) - 1);
+    } else {
+        ss << m_addr.sun_path;
+    }
+    return ss.str();
+}
+
+std::ostream& UnixAddress::insert(std::ostream& os) const {
+    return os << getPath();
+}
+
+UnknownAddress::UnknownAddress(int family) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sa_family = family;
+}
+
+UnknownAddress::UnknownAddress(const sockaddr& addr) {
+    m_addr = addr;
+}
+
+const sockaddr* UnknownAddress::getAddr() const {
+    return &m_addr;
+}
+
+sockaddr* UnknownAddress::getAddr() {
+    return &m_addr;
+}
+
+socklen_t UnknownAddress::getAddrLen() const {
+    return sizeof(m_addr);
+}
+
+std::ostream& UnknownAddress::insert(std::ostream& os) const {
+    os << "[UnknownAddress family=" << m_addr.sa_family << "]";
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const Address& addr) {
+    return addr.insert(os);
+}
+
+}
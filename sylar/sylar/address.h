@@ -0,0 +1,214 @@
+#ifndef __SYLAR_ADDRESS_H__
+#define __SYLAR_ADDRESS_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+namespace sylar {
+
+class IPAddress;
+
+/**
+ * @brief Socket address base class
+ */
+class Address {
+public:
+    typedef std::shared_ptr<Address> ptr;
+
+    /**
+     * @brief Wrap a sockaddr in the matching subclass
+     * @return nullptr if addr is null
+     */
+    static Address::ptr Create(const sockaddr* addr, socklen_t addrlen);
+
+    /**
+     * @brief Resolve host into every address it maps to
+     * @details host may be "www.example.com", "www.example.com:80",
+     *          "1.2.3.4:80", "[::1]:80" or carry a service name
+     *          ("host:http"). Successful lookups are kept in a process wide
+     *          cache for address.resolver.cache_ttl ms, so hot names don't go
+     *          through getaddrinfo() (and the DNS round trip behind it)
+     *          every time.
+     * @param[out] result Resolved addresses are appended here
+     * @param[in] family AF_INET, AF_INET6 or AF_UNSPEC
+     * @param[in] type SOCK_STREAM, SOCK_DGRAM or 0 for any
+     * @param[in] protocol IPPROTO_TCP, IPPROTO_UDP or 0 for any
+     */
+    static bool Lookup(std::vector<Address::ptr>& result, const std::string& host,
+            int family = AF_INET, int type = 0, int protocol = 0);
+
+    /**
+     * @brief First address host resolves to
+     */
+    static Address::ptr LookupAny(const std::string& host,
+            int family = AF_INET, int type = 0, int protocol = 0);
+
+    /**
+     * @brief First IP address host resolves to
+     */
+    static std::shared_ptr<IPAddress> LookupAnyIPAddress(const std::string& host,
+            int family = AF_INET, int type = 0, int protocol = 0);
+
+    /**
+     * @brief Drop every cached lookup
+     */
+    static void ClearLookupCache();
+
+    virtual ~Address() {}
+
+    int getFamily() const;
+
+    virtual const sockaddr* getAddr() const = 0;
+    virtual sockaddr* getAddr() = 0;
+    virtual socklen_t getAddrLen() const = 0;
+
+    /**
+     * @brief Write the readable form of the address
+     */
+    virtual std::ostream& insert(std::ostream& os) const = 0;
+
+    std::string toString() const;
+
+    bool operator<(const Address& rhs) const;
+    bool operator==(const Address& rhs) const;
+    bool operator!=(const Address& rhs) const;
+};
+
+/**
+ * @brief IPv4/IPv6 address
+ */
+class IPAddress : public Address {
+public:
+    typedef std::shared_ptr<IPAddress> ptr;
+
+    /**
+     * @brief Numeric address (no DNS), "192.168.1.1" or "fe80::1"
+     * @return nullptr if address isn't a valid IP
+     */
+    static IPAddress::ptr Create(const char* address, uint16_t port = 0);
+
+    virtual uint16_t getPort() const = 0;
+    virtual void setPort(uint16_t v) = 0;
+};
+
+/**
+ * @brief IPv4 address
+ */
+class IPv4Address : public IPAddress {
+public:
+    typedef std::shared_ptr<IPv4Address> ptr;
+
+    /**
+     * @brief From dotted decimal, "192.168.1.1"
+     * @return nullptr if address isn't valid
+     */
+    static IPv4Address::ptr Create(const char* address, uint16_t port = 0);
+
+    IPv4Address(const sockaddr_in& address);
+
+    /**
+     * @param[in] address Address in host byte order
+     * @param[in] port Port in host byte order
+     */
+    IPv4Address(uint32_t address = INADDR_ANY, uint16_t port = 0);
+
+    const sockaddr* getAddr() const override;
+    sockaddr* getAddr() override;
+    socklen_t getAddrLen() const override;
+    std::ostream& insert(std::ostream& os) const override;
+
+    uint16_t getPort() const override;
+    void setPort(uint16_t v) override;
+private:
+    sockaddr_in m_addr;
+};
+
+/**
+ * @brief IPv6 address
+ */
+class IPv6Address : public IPAddress {
+public:
+    typedef std::shared_ptr<IPv6Address> ptr;
+
+    /**
+     * @brief From text form, "fe80::1"
+     * @return nullptr if address isn't valid
+     */
+    static IPv6Address::ptr Create(const char* address, uint16_t port = 0);
+
+    /**
+     * @brief Any address (::)
+     */
+    IPv6Address();
+    IPv6Address(const sockaddr_in6& address);
+
+    /**
+     * @param[in] address 16 bytes in network byte order
+     * @param[in] port Port in host byte order
+     */
+    IPv6Address(const uint8_t address[16], uint16_t port = 0);
+
+    const sockaddr* getAddr() const override;
+    sockaddr* getAddr() override;
+    socklen_t getAddrLen() const override;
+    std::ostream& insert(std::ostream& os) const override;
+
+    uint16_t getPort() const override;
+    void setPort(uint16_t v) override;
+private:
+    sockaddr_in6 m_addr;
+};
+
+/**
+ * @brief Unix domain socket address
+ * @details A path starting with '\0' is an abstract address.
+ */
+class UnixAddress : public Address {
+public:
+    typedef std::shared_ptr<UnixAddress> ptr;
+
+    /**
+     * @brief Unnamed address, to be filled in by accept/getsockname
+     */
+    UnixAddress();
+    UnixAddress(const std::string& path);
+
+    const sockaddr* getAddr() const override;
+    sockaddr* getAddr() override;
+    socklen_t getAddrLen() const override;
+    void setAddrLen(socklen_t v);
+    std::string getPath() const;
+    std::ostream& insert(std::ostream& os) const override;
+private:
+    sockaddr_un m_addr;
+    socklen_t m_length;
+};
+
+/**
+ * @brief Address of a family we don't know about
+ */
+class UnknownAddress : public Address {
+public:
+    typedef std::shared_ptr<UnknownAddress> ptr;
+    UnknownAddress(int family);
+    UnknownAddress(const sockaddr& addr);
+    const sockaddr* getAddr() const override;
+    sockaddr* getAddr() override;
+    socklen_t getAddrLen() const override;
+    std::ostream& insert(std::ostream& os) const override;
+private:
+    sockaddr m_addr;
+};
+
+std::ostream& operator<<(std::ostream& os, const Address& addr);
+
+}
+
+#endif
@@ -0,0 +1,860 @@
+#include "binary_log.h"
+#include "config.h"
+#include "thread.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<std::string>::ptr g_binary_file =
+    sylar::Config::Lookup("log.binary.file", std::string()
+            , "file the binary loggers write to, none if empty");
+
+static sylar::ConfigVar<uint32_t>::ptr g_binary_ring_size =
+    sylar::Config::Lookup("log.binary.ring_size", (uint32_t)(1024 * 1024)
+            , "bytes of each thread's binary log ring");
+
+static sylar::ConfigVar<std::string>::ptr g_binary_overflow =
+    sylar::Config::Lookup("log.binary.overflow", std::string("block")
+            , "block|drop when a thread's binary log ring is full");
+
+static sylar::ConfigVar<uint32_t>::ptr g_binary_flush_interval =
+    sylar::Config::Lookup("log.binary.flush_interval", (uint32_t)100
+            , "ms between writes of the binary log");
+
+static const char s_magic[8] = {'S', 'Y', 'L', 'B', 'L', 'O', 'G', '1'};
+
+/// record types of the file, after the magic and the tick rate
+enum RecordType {
+    RECORD_FORMAT = 'F',
+    RECORD_LOGGER = 'L',
+    RECORD_THREAD = 'T',
+    RECORD_SYNC = 'S',
+    RECORD_BATCH = 'B',
+    RECORD_DROPPED = 'D'
+};
+
+struct RecordHeader {
+    uint32_t type;
+    /// bytes after the header
+    uint32_t size;
+};
+
+namespace {
+
+struct FormatDefine {
+    std::string file;
+    uint32_t line;
+    std::string fmt;
+    std::vector<uint8_t> types;
+};
+
+struct LoggerDefine {
+    std::string name;
+    std::string pattern;
+};
+
+/**
+ * @brief Everything shared by the producers and the writer
+ */
+struct BinaryLogState {
+    std::mutex mutex;
+    /// wakes the writer early
+    std::condition_variable writerCond;
+    /// a round is done
+    std::condition_variable doneCond;
+
+    std::vector<FormatDefine> formats;
+    std::vector<LoggerDefine> loggers;
+    std::list<BinaryLog::Ring*> rings;
+
+    int fd = -1;
+    Thread::ptr thread;
+    bool stopping = false;
+    bool wakeup = false;
+    uint64_t roundsStarted = 0;
+    uint64_t roundsDone = 0;
+    size_t writtenFormats = 0;
+    size_t writtenLoggers = 0;
+
+    std::atomic<bool> dropOnOverflow{false};
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> blocked{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+// never destroyed, threads may log while statics go away
+BinaryLogState& GetState() {
+    static BinaryLogState* s_state = new BinaryLogState;
+    return *s_state;
+}
+
+void put_u32(std::string& out, uint32_t v) {
+    out.append((const char*)&v, sizeof(v));
+}
+
+void put_u64(std::string& out, uint64_t v) {
+    out.append((const char*)&v, sizeof(v));
+}
+
+void put_str(std::string& out, const std::string& v) {
+    put_u32(out, v.size());
+    out.append(v);
+}
+
+void put_record(std::string& out, RecordType type, const std::string& body) {
+    put_u32(out, type);
+    put_u32(out, body.size());
+    out.append(body);
+}
+
+bool write_all(int fd, std::vector<iovec>& iovs) {
+    iovec* iov = iovs.data();
+    int iovcnt = iovs.size();
+    while(iovcnt > 0) {
+        ssize_t n = ::writev(fd, iov, std::min(iovcnt, IOV_MAX));
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while(iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if(n > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+uint64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Ticks() per nanosecond, measured once
+ */
+double ticks_per_ns() {
+    static double s_rate = 0;
+    if(s_rate == 0) {
+        uint64_t t0 = BinaryLog::Ticks();
+        uint64_t n0 = monotonic_ns();
+        usleep(10 * 1000);
+        uint64_t t1 = BinaryLog::Ticks();
+        uint64_t n1 = monotonic_ns();
+        s_rate = n1 > n0 ? (double)(t1 - t0) / (n1 - n0) : 1;
+    }
+    return s_rate;
+}
+
+/**
+ * @brief Drain every ring into the file once
+ */
+void write_round(BinaryLogState& s) {
+    std::vector<std::pair<BinaryLog::Ring*, uint64_t> > heads;
+    std::string defs;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        // heads before the definitions, a record can't get ahead of its
+        // call site's definition
+        for(auto& i : s.rings) {
+            heads.push_back(std::make_pair(i, i->head.load(std::memory_order_acquire)));
+        }
+        for(; s.writtenFormats < s.formats.size(); ++s.writtenFormats) {
+            auto& f = s.formats[s.writtenFormats];
+            std::string body;
+            put_u32(body, s.writtenFormats + 1);
+            put_u32(body, f.line);
+            put_str(body, f.file);
+            put_str(body, f.fmt);
+            put_str(body, std::string(f.types.begin(), f.types.end()));
+            put_record(defs, RECORD_FORMAT, body);
+        }
+        for(; s.writtenLoggers < s.loggers.size(); ++s.writtenLoggers) {
+            auto& l = s.loggers[s.writtenLoggers];
+            std::string body;
+            put_u32(body, s.writtenLoggers + 1);
+            put_str(body, l.name);
+            put_str(body, l.pattern);
+            put_record(defs, RECORD_LOGGER, body);
+        }
+        for(auto& i : s.rings) {
+            if(!i->defined) {
+                std::string body;
+                put_u32(body, i->tid);
+                put_str(body, i->threadName);
+                put_record(defs, RECORD_THREAD, body);
+                i->defined = true;
+            }
+        }
+    }
+
+    std::string sync;
+    put_u32(sync, RECORD_SYNC);
+    put_u32(sync, 16);
+    put_u64(sync, BinaryLog::Ticks());
+    put_u64(sync, realtime_ns());
+
+    std::vector<iovec> iovs;
+    iovs.push_back({(void*)defs.data(), defs.size()});
+    iovs.push_back({(void*)sync.data(), sync.size()});
+    // batch and drop headers, reserved up front so they don't move
+    std::vector<char> headers(heads.size() * 32);
+    uint64_t records = 0;
+    uint64_t dropped = 0;
+    for(size_t n = 0; n < heads.size(); ++n) {
+        BinaryLog::Ring* ring = heads[n].first;
+        uint64_t head = heads[n].second;
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        char* hdr = &headers[n * 32];
+        if(head != tail) {
+            RecordHeader rh = {RECORD_BATCH, (uint32_t)(4 + head - tail)};
+            memcpy(hdr, &rh, sizeof(rh));
+            memcpy(hdr + sizeof(rh), &ring->tid, 4);
+            iovs.push_back({hdr, sizeof(rh) + 4});
+            size_t off = tail % ring->capacity;
+            size_t len = head - tail;
+            size_t first = std::min(len, ring->capacity - off);
+            iovs.push_back({ring->data + off, first});
+            if(first < len) {
+                iovs.push_back({ring->data, len - first});
+            }
+            for(uint64_t p = tail; p < head;) {
+                const char* e = ring->data + p % ring->capacity;
+                uint32_t size;
+                uint32_t format;
+                memcpy(&size, e, 4);
+                memcpy(&format, e + 4, 4);
+                records += format != 0;
+                p += size;
+            }
+        }
+        uint64_t d = ring->dropped.load(std::memory_order_relaxed);
+        if(d != ring->reportedDropped) {
+            RecordHeader rh = {RECORD_DROPPED, 12};
+            uint64_t delta = d - ring->reportedDropped;
+            memcpy(hdr + 12, &rh, sizeof(rh));
+            memcpy(hdr + 20, &ring->tid, 4);
+            memcpy(hdr + 24, &delta, 8);
+            iovs.push_back({hdr + 12, 20});
+            ring->reportedDropped = d;
+            dropped += delta;
+        }
+    }
+
+    size_t total = 0;
+    for(auto& i : iovs) {
+        total += i.iov_len;
+    }
+    if(!write_all(s.fd, iovs)) {
+        SYLAR_LOG_ERROR(g_logger) << "BinaryLog write failed, errno=" << errno
+            << " errstr=" << strerror(errno);
+    }
+    s.records += records;
+    s.dropped += dropped;
+    s.bytes += total;
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for(auto& i : heads) {
+        i.first->tail.store(i.second, std::memory_order_release);
+    }
+    for(auto it = s.rings.begin(); it != s.rings.end();) {
+        BinaryLog::Ring* ring = *it;
+        if(ring->retired.load(std::memory_order_acquire)
+                && ring->head.load(std::memory_order_acquire) == ring->tail.load(std::memory_order_relaxed)
+                && ring->dropped.load(std::memory_order_relaxed) == ring->reportedDropped) {
+            it = s.rings.erase(it);
+            delete ring;
+        } else {
+            ++it;
+        }
+    }
+}
+
+void writer_run() {
+    BinaryLogState& s = GetState();
+    while(true) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(s.mutex);
+            if(!s.stopping && !s.wakeup) {
+                uint32_t interval = g_binary_flush_interval->getValue();
+                s.writerCond.wait_for(lock, std::chrono::milliseconds(interval ? interval : 1));
+            }
+            s.wakeup = false;
+            stopping = s.stopping;
+            ++s.roundsStarted;
+        }
+        write_round(s);
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.roundsDone = s.roundsStarted;
+        }
+        s.doneCond.notify_all();
+        if(stopping) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Retires the thread's ring when the thread exits
+ */
+struct RingHolder {
+    BinaryLog::Ring* ring = nullptr;
+    ~RingHolder();
+};
+
+static thread_local bool t_ring_dead = false;
+
+}
+
+std::atomic<bool> BinaryLog::s_running{false};
+thread_local BinaryLog::Ring* BinaryLog::t_ring = nullptr;
+
+BinaryLog::Ring::Ring(size_t capacity_, uint32_t tid_, const std::string& thread_name)
+    :capacity((std::max(capacity_, (size_t)4096) + 7) & ~(size_t)7)
+    ,tid(tid_)
+    ,threadName(thread_name)
+    ,head(0)
+    ,dropped(0)
+    ,tail(0)
+    ,retired(false) {
+    data = (char*)malloc(capacity);
+    // fault the pages in now rather than on the logging path
+    memset(data, 0, capacity);
+}
+
+BinaryLog::Ring::~Ring() {
+    free(data);
+}
+
+bool BinaryLog::Ring::waitForRoom(uint64_t end) {
+    BinaryLogState& s = GetState();
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    // never fits, or the ring is full and may stay full
+    if(end - pos > capacity || s.dropOnOverflow.load(std::memory_order_relaxed)) {
+        dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+    ++s.blocked;
+    std::unique_lock<std::mutex> lock(s.mutex);
+    while(true) {
+        if(!s_running.load(std::memory_order_relaxed)) {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        s.wakeup = true;
+        s.writerCond.notify_one();
+        s.doneCond.wait_for(lock, std::chrono::milliseconds(10));
+        cachedTail = tail.load(std::memory_order_acquire);
+        if(end - cachedTail <= capacity) {
+            return true;
+        }
+    }
+}
+
+RingHolder::~RingHolder() {
+    t_ring_dead = true;
+    BinaryLog::Ring* r = ring;
+    if(!r) {
+        return;
+    }
+    BinaryLogState& s = GetState();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if(s.thread) {
+        // the writer frees it once drained
+        r->retired.store(true, std::memory_order_release);
+    } else {
+        s.rings.remove(r);
+        delete r;
+    }
+}
+
+BinaryLog::Ring* BinaryLog::CreateRing() {
+    static thread_local RingHolder t_holder;
+    if(t_ring_dead) {
+        return nullptr;
+    }
+    Ring* ring = new Ring(g_binary_ring_size->getValue(), GetThreadId(), Thread::GetName());
+    BinaryLogState& s = GetState();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.rings.push_back(ring);
+    }
+    t_holder.ring = ring;
+    t_ring = ring;
+    return ring;
+}
+
+std::string BinaryLog::Stats::toString() const {
+    std::stringstream ss;
+    ss << "records=" << records
+       << " dropped=" << dropped
+       << " blocked=" << blocked
+       << " bytes=" << bytes
+       << " rounds=" << rounds;
+    return ss.str();
+}
+
+bool BinaryLog::Open(const std::string& path) {
+    Close();
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        SYLAR_LOG_ERROR(g_logger) << "BinaryLog open " << path << " failed, errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    std::string header(s_magic, sizeof(s_magic));
+    double rate = ticks_per_ns();
+    header.append((const char*)&rate, sizeof(rate));
+    if(::write(fd, header.data(), header.size()) != (ssize_t)header.size()) {
+        SYLAR_LOG_ERROR(g_logger) << "BinaryLog write " << path << " failed, errno=" << errno
+            << " errstr=" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    BinaryLogState& s = GetState();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.fd = fd;
+    s.stopping = false;
+    s.wakeup = false;
+    s.writtenFormats = 0;
+    s.writtenLoggers = 0;
+    for(auto& i : s.rings) {
+        // whatever was logged while closed is left out
+        i->defined = false;
+        i->tail.store(i->head.load(std::memory_order_acquire), std::memory_order_release);
+        i->reportedDropped = i->dropped.load(std::memory_order_relaxed);
+    }
+    s_running = true;
+    s.thread.reset(new Thread(&writer_run, "binary_log"));
+    return true;
+}
+
+void BinaryLog::Close() {
+    BinaryLogState& s = GetState();
+    Thread::ptr thread;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if(!s.thread) {
+            return;
+        }
+        s_running = false;
+        s.stopping = true;
+        thread = s.thread;
+    }
+    s.writerCond.notify_one();
+    thread->join();
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.thread.reset();
+    ::close(s.fd);
+    s.fd = -1;
+    for(auto it = s.rings.begin(); it != s.rings.end();) {
+        if((*it)->retired) {
+            delete *it;
+            it = s.rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void BinaryLog::Flush() {
+    BinaryLogState& s = GetState();
+    std::unique_lock<std::mutex> lock(s.mutex);
+    if(!s.thread) {
+        return;
+    }
+    // the round after the next one to start has seen everything logged
+    // before this call
+    uint64_t target = s.roundsStarted + 1;
+    s.wakeup = true;
+    s.writerCond.notify_one();
+    s.doneCond.wait(lock, [&s, target](){
+        return s.roundsDone >= target || !s.thread;
+    });
+}
+
+BinaryLog::Stats BinaryLog::GetStats() {
+    BinaryLogState& s = GetState();
+    Stats stats;
+    stats.records = s.records;
+    stats.dropped = s.dropped;
+    stats.blocked = s.blocked;
+    stats.bytes = s.bytes;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    stats.rounds = s.roundsDone;
+    return stats;
+}
+
+uint32_t BinaryLog::RegisterLogger(const std::string& name, const std::string& pattern) {
+    BinaryLogState& s = GetState();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.loggers.push_back(LoggerDefine{name, pattern});
+    return s.loggers.size();
+}
+
+uint32_t BinaryLog::RegisterFormat(const char* file, int line, const char* fmt
+                                   ,const std::vector<uint8_t>& types) {
+    BinaryLogState& s = GetState();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.formats.push_back(FormatDefine{file, (uint32_t)line, fmt, types});
+    return s.formats.size();
+}
+
+namespace {
+
+struct BinaryLogIniter {
+    BinaryLogIniter() {
+        GetState().dropOnOverflow = AsyncLogAppender::OverflowFromString(g_binary_overflow->getValue())
+                                    == AsyncLogAppender::Overflow::DROP;
+        g_binary_overflow->addListener([](const std::string& old_value, const std::string& new_value){
+            GetState().dropOnOverflow = AsyncLogAppender::OverflowFromString(new_value)
+                                        == AsyncLogAppender::Overflow::DROP;
+        });
+        g_binary_file->addListener([](const std::string& old_value, const std::string& new_value){
+            if(new_value.empty()) {
+                BinaryLog::Close();
+            } else if(new_value != old_value || !BinaryLog::IsOpen()) {
+                BinaryLog::Open(new_value);
+            }
+        });
+    }
+
+    ~BinaryLogIniter() {
+        BinaryLog::Close();
+    }
+};
+
+BinaryLogIniter s_binary_log_init;
+
+/**
+ * @brief Bounds checked reads from the file
+ */
+class Cursor {
+public:
+    Cursor(const char* p, size_t size)
+        :m_p(p)
+        ,m_end(p + size) {
+    }
+
+    bool ok() const { return m_ok; }
+    size_t left() const { return m_end - m_p; }
+    const char* pos() const { return m_p; }
+
+    template<class T>
+    T get() {
+        T v = T();
+        if(left() < sizeof(T)) {
+            m_ok = false;
+            m_p = m_end;
+            return v;
+        }
+        memcpy(&v, m_p, sizeof(T));
+        m_p += sizeof(T);
+        return v;
+    }
+
+    std::string str() {
+        uint32_t len = get<uint32_t>();
+        if(left() < len) {
+            m_ok = false;
+            m_p = m_end;
+            return std::string();
+        }
+        std::string v(m_p, len);
+        m_p += len;
+        return v;
+    }
+
+    void skip(size_t n) {
+        m_p += std::min(n, left());
+    }
+private:
+    const char* m_p;
+    const char* m_end;
+    bool m_ok = true;
+};
+
+struct ReaderLogger {
+    Logger::ptr logger;
+    LogFormatter::ptr formatter;
+};
+
+struct PendingEntry {
+    uint64_t tsc;
+    uint32_t tid;
+    const char* data;
+};
+
+}
+
+std::string BinaryLogReader::FormatMessage(const std::string& fmt, const std::vector<Value>& args) {
+    std::string out;
+    size_t arg = 0;
+    std::vector<char> buf(64);
+    auto next = [&args, &arg]() -> const Value* {
+        return arg < args.size() ? &args[arg++] : nullptr;
+    };
+    for(size_t i = 0; i < fmt.size(); ++i) {
+        if(fmt[i] != '%') {
+            out.push_back(fmt[i]);
+            continue;
+        }
+        if(i + 1 < fmt.size() && fmt[i + 1] == '%') {
+            out.push_back('%');
+            ++i;
+            continue;
+        }
+        // %[flags][width][.precision][length]conversion, one at a time
+        std::string spec = "%";
+        size_t j = i + 1;
+        while(j < fmt.size() && strchr("-+ #0'", fmt[j])) {
+            spec.push_back(fmt[j++]);
+        }
+        for(int part = 0; part < 2; ++part) {
+            if(part == 1) {
+                if(j >= fmt.size() || fmt[j] != '.') {
+                    break;
+                }
+                spec.push_back(fmt[j++]);
+            }
+            if(j < fmt.size() && fmt[j] == '*') {
+                const Value* v = next();
+                spec += std::to_string(v ? (int64_t)v->u : 0);
+                ++j;
+            }
+            while(j < fmt.size() && isdigit((unsigned char)fmt[j])) {
+                spec.push_back(fmt[j++]);
+            }
+        }
+        while(j < fmt.size() && strchr("hlLqjzt", fmt[j])) {
+            ++j;
+        }
+        if(j >= fmt.size()) {
+            out.append(fmt, i, std::string::npos);
+            break;
+        }
+        char conv = fmt[j];
+        i = j;
+        if(conv == 'n') {
+            continue;
+        }
+        const Value* v = next();
+        if(!v) {
+            continue;
+        }
+        int n = 0;
+        for(int retry = 0; retry < 2; ++retry) {
+            switch(v->type) {
+                case BinaryLog::INT:
+                case BinaryLog::UINT:
+                    if(conv == 'c') {
+                        n = snprintf(&buf[0], buf.size(), (spec + "c").c_str(), (int)v->u);
+                    } else if(strchr("diouxX", conv)) {
+                        n = snprintf(&buf[0], buf.size(), (spec + "ll" + conv).c_str(), (long long)v->u);
+                    } else {
+                        n = snprintf(&buf[0], buf.size(), (spec + (v->type == BinaryLog::INT ? "lld" : "llu")).c_str()
+                                     , (long long)v->u);
+                    }
+                    break;
+                case BinaryLog::DOUBLE:
+                    n = snprintf(&buf[0], buf.size(), (spec + (strchr("fFeEgGaA", conv) ? conv : 'g')).c_str(), v->d);
+                    break;
+                case BinaryLog::STRING:
+                    n = snprintf(&buf[0], buf.size(), (spec + "s").c_str(), v->s.c_str());
+                    break;
+                default:
+                    n = snprintf(&buf[0], buf.size(), (spec + "p").c_str(), (void*)(uintptr_t)v->u);
+                    break;
+            }
+            if(n < 0 || (size_t)n < buf.size()) {
+                break;
+            }
+            buf.resize(n + 1);
+        }
+        if(n > 0) {
+            out.append(&buf[0], n);
+        }
+    }
+    return out;
+}
+
+bool BinaryLogReader::decode(const std::string& path, std::ostream& out) {
+    std::ifstream ifs(path, std::ios::binary);
+    if(!ifs) {
+        m_error = "can't open " + path;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if(data.size() < sizeof(s_magic) + sizeof(double)
+            || memcmp(data.data(), s_magic, sizeof(s_magic))) {
+        m_error = path + " is not a binary log";
+        return false;
+    }
+    double rate;
+    memcpy(&rate, data.data() + sizeof(s_magic), sizeof(rate));
+    if(rate <= 0) {
+        rate = 1;
+    }
+
+    std::map<uint32_t, FormatDefine> formats;
+    std::map<uint32_t, ReaderLogger> loggers;
+    std::map<uint32_t, std::string> threads;
+    std::vector<PendingEntry> pending;
+    uint64_t sync_tsc = 0;
+    uint64_t sync_ns = 0;
+    LogEvent::ptr event(new LogEvent(nullptr, LogLevel::level::UNKNOWN, "", 0, 0, 0, 0, 0, ""));
+    LogStream text;
+    std::vector<Value> args;
+
+    // entries between two sync points, in time order
+    auto write_pending = [&]() {
+        std::stable_sort(pending.begin(), pending.end(), [](const PendingEntry& a, const PendingEntry& b){
+            return a.tsc < b.tsc;
+        });
+        for(auto& e : pending) {
+            BinaryLog::EntryHeader h;
+            memcpy(&h, e.data, sizeof(h));
+            auto fit = formats.find(h.format);
+            auto lit = loggers.find(h.logger >> 4);
+            if(fit == formats.end() || lit == loggers.end()) {
+                m_error = "record without a definition";
+                continue;
+            }
+            auto& f = fit->second;
+            Cursor c(e.data + sizeof(h), h.size - sizeof(h));
+            args.resize(f.types.size());
+            for(size_t i = 0; i < f.types.size(); ++i) {
+                Value& v = args[i];
+                v.type = f.types[i];
+                if(v.type == BinaryLog::STRING) {
+                    v.s = c.str();
+                } else if(v.type == BinaryLog::DOUBLE) {
+                    v.d = c.get<double>();
+                } else {
+                    v.u = c.get<uint64_t>();
+                }
+            }
+            if(!c.ok()) {
+                m_error = "corrupt record";
+                continue;
+            }
+
+            int64_t ns = (int64_t)sync_ns - (int64_t)(((int64_t)sync_tsc - (int64_t)e.tsc) / rate);
+            auto& l = lit->second;
+            LogLevel::level level = (LogLevel::level)(h.logger & 0xf);
+            event->reset(l.logger, level, f.file.c_str(), f.line, 0, e.tid, h.fiber
+                         , ns / 1000000000, threads[e.tid], ns % 1000000000 / 1000);
+            event->getSS() << FormatMessage(f.fmt, args);
+            text.reset();
+            l.formatter->format(text, l.logger, level, event);
+            out.write(text.data(), text.size());
+            ++m_records;
+        }
+        pending.clear();
+    };
+
+    Cursor c(data.data() + sizeof(s_magic) + sizeof(double), data.size() - sizeof(s_magic) - sizeof(double));
+    while(c.left() > 0) {
+        RecordHeader rh;
+        rh.type = c.get<uint32_t>();
+        rh.size = c.get<uint32_t>();
+        if(!c.ok() || c.left() < rh.size) {
+            m_error = path + " is cut short";
+            break;
+        }
+        Cursor body(c.pos(), rh.size);
+        c.skip(rh.size);
+        switch(rh.type) {
+            case RECORD_FORMAT: {
+                uint32_t id = body.get<uint32_t>();
+                FormatDefine& f = formats[id];
+                f.line = body.get<uint32_t>();
+                f.file = body.str();
+                f.fmt = body.str();
+                std::string types = body.str();
+                f.types.assign(types.begin(), types.end());
+                break;
+            }
+            case RECORD_LOGGER: {
+                uint32_t id = body.get<uint32_t>();
+                ReaderLogger& l = loggers[id];
+                l.logger.reset(new Logger(body.str()));
+                l.formatter.reset(new LogFormatter(body.str()));
+                if(l.formatter->isError()) {
+                    l.formatter = l.logger->getFormatter();
+                }
+                break;
+            }
+            case RECORD_THREAD: {
+                uint32_t tid = body.get<uint32_t>();
+                threads[tid] = body.str();
+                break;
+            }
+            case RECORD_SYNC:
+                write_pending();
+                sync_tsc = body.get<uint64_t>();
+                sync_ns = body.get<uint64_t>();
+                break;
+            case RECORD_BATCH: {
+                uint32_t tid = body.get<uint32_t>();
+                while(body.left() >= sizeof(BinaryLog::EntryHeader)) {
+                    BinaryLog::EntryHeader h;
+                    memcpy(&h, body.pos(), sizeof(h));
+                    if(h.size < 8 || h.size > body.left()) {
+                        m_error = "corrupt batch";
+                        break;
+                    }
+                    if(h.format != 0) {
+                        pending.push_back(PendingEntry{h.tsc, tid, body.pos()});
+                    }
+                    body.skip(h.size);
+                }
+                break;
+            }
+            case RECORD_DROPPED:
+                body.get<uint32_t>();
+                m_dropped += body.get<uint64_t>();
+                break;
+            default:
+                break;
+        }
+    }
+    write_pending();
+    return m_error.empty();
+}
+
+}
@@ -0,0 +1,358 @@
+#ifndef __SYLAR_BINARY_LOG_H__
+#define __SYLAR_BINARY_LOG_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#include "log.h"
+
+namespace sylar {
+
+/**
+ * @brief Deferred binary logging for the hottest paths
+ * @details A logger switched to binary mode (Logger::setBinary, or
+ *          "binary: true" in the logs config) no longer formats its
+ *          SYLAR_LOG_FMT_* records. Every call site registers its file,
+ *          line, format string and argument types once. After that a call
+ *          copies a small header (format id, TSC time stamp, logger,
+ *          level, fiber) and the raw arguments into a ring owned by the
+ *          calling thread. Strings are copied, everything else is 8 bytes.
+ *
+ *          One writer thread drains the rings every
+ *          log.binary.flush_interval ms into the file given to Open() (or
+ *          log.binary.file). Every definition the records need goes into
+ *          the same file, with clock sync points. BinaryLogReader (and
+ *          the binlog_decode tool) turns the file back into text, using
+ *          each logger's LogFormatter pattern. Records are sorted by
+ *          time between sync points.
+ *
+ *          When a thread's ring (log.binary.ring_size) is full,
+ *          log.binary.overflow decides: "block" waits for the writer,
+ *          "drop" counts the record as lost. The format must be the same
+ *          on every call of a site, a literal in practice.
+ */
+class BinaryLog {
+public:
+    /**
+     * @brief How an argument is stored
+     */
+    enum ArgType {
+        INT = 1,        ///< signed integer, 8 bytes
+        UINT = 2,       ///< unsigned integer, 8 bytes
+        DOUBLE = 3,     ///< 8 bytes
+        STRING = 4,     ///< 4 byte length, then the bytes
+        POINTER = 5     ///< 8 bytes
+    };
+
+    /**
+     * @brief Fixed part of a record in a ring and in the file
+     */
+    struct EntryHeader {
+        /// bytes including the header, a multiple of 8
+        uint32_t size;
+        /// 0 marks padding up to the end of the ring
+        uint32_t format;
+        uint64_t tsc;
+        /// logger id << 4 | level
+        uint32_t logger;
+        uint32_t fiber;
+    };
+
+    /**
+     * @brief Single producer, single consumer byte ring of one thread
+     */
+    struct Ring {
+        Ring(size_t capacity, uint32_t tid, const std::string& thread_name);
+        ~Ring();
+
+        /**
+         * @brief Room for size bytes, nullptr if the record is dropped
+         */
+        char* reserve(size_t size) {
+            uint64_t pos = head.load(std::memory_order_relaxed);
+            size_t off = pos % capacity;
+            size_t contiguous = capacity - off;
+            size_t need = size <= contiguous ? size : contiguous + size;
+            if(pos + need - cachedTail > capacity) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if(pos + need - cachedTail > capacity && !waitForRoom(pos + need)) {
+                    return nullptr;
+                }
+            }
+            if(size > contiguous) {
+                // pad out to the end, the record starts over at 0
+                EntryHeader pad = {(uint32_t)contiguous, 0, 0, 0, 0};
+                memcpy(data + off, &pad, sizeof(uint32_t) * 2);
+                pos += contiguous;
+                off = 0;
+            }
+            writePos = pos;
+            return data + off;
+        }
+
+        void commit(size_t size) {
+            head.store(writePos + size, std::memory_order_release);
+        }
+
+        /**
+         * @brief Slow path of reserve(), per log.binary.overflow
+         */
+        bool waitForRoom(uint64_t end);
+
+        char* data;
+        size_t capacity;
+        uint32_t tid;
+        std::string threadName;
+
+        /// producer side, a cache line away from the rest (no aligned new in C++11)
+        char pad0[64];
+        std::atomic<uint64_t> head;
+        uint64_t cachedTail = 0;
+        uint64_t writePos = 0;
+        std::atomic<uint64_t> dropped;
+
+        /// consumer side
+        char pad1[64];
+        std::atomic<uint64_t> tail;
+        uint64_t reportedDropped = 0;
+        /// the thread's name is in the file
+        bool defined = false;
+        /// the thread is gone, free once drained
+        std::atomic<bool> retired;
+    };
+
+    /**
+     * @brief Writer statistics
+     */
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t dropped = 0;
+        /// records that waited for room in a full ring
+        uint64_t blocked = 0;
+        uint64_t bytes = 0;
+        uint64_t rounds = 0;
+        std::string toString() const;
+    };
+
+    /**
+     * @brief Start writing to path, truncating it
+     * @details Definitions registered before are written first.
+     */
+    static bool Open(const std::string& path);
+
+    /**
+     * @brief Write out what is in the rings, then stop the writer
+     */
+    static void Close();
+
+    static bool IsOpen() { return s_running.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Wait until records logged so far are in the file
+     */
+    static void Flush();
+
+    static Stats GetStats();
+
+    /**
+     * @brief Define a logger for the file
+     * @return Id for Logger::getBinaryId()
+     */
+    static uint32_t RegisterLogger(const std::string& name, const std::string& pattern);
+
+    /**
+     * @brief Define a call site
+     * @return Format id, starting at 1
+     */
+    static uint32_t RegisterFormat(const char* file, int line, const char* fmt
+                                   ,const std::vector<uint8_t>& types);
+
+    /**
+     * @brief Time stamp in the file's clock: the TSC where there is one
+     */
+    static uint64_t Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+    }
+
+    /**
+     * @brief Encoding of one argument type, by overloads on the decayed type
+     */
+    template<class T, class Enable = void>
+    struct Arg;
+
+    /**
+     * @brief Record a SYLAR_LOG_FMT_* call
+     * @param[in] Site A type unique to the call site (the macro passes a
+     *            lambda), its format id is registered on the first call
+     */
+    template<class Site, class... Args>
+    static void Write(uint32_t logger, LogLevel::level level, Site, const char* file, int line
+                      ,const char* fmt, const Args&... args) {
+        static const uint32_t s_format = RegisterFormat(file, line, fmt, Types<Args...>());
+        if(!s_running.load(std::memory_order_relaxed)) {
+            return;
+        }
+        Ring* ring = t_ring;
+        if(!ring && !(ring = CreateRing())) {
+            return;
+        }
+        size_t size = (sizeof(EntryHeader) + ArgsSize(args...) + 7) & ~(size_t)7;
+        char* p = ring->reserve(size);
+        if(!p) {
+            return;
+        }
+        EntryHeader h;
+        h.size = size;
+        h.format = s_format;
+        h.tsc = Ticks();
+        h.logger = logger << 4 | (uint32_t)level;
+        h.fiber = GetFiberId();
+        memcpy(p, &h, sizeof(h));
+        Encode(p + sizeof(h), args...);
+        ring->commit(size);
+    }
+private:
+    template<class... Args>
+    static std::vector<uint8_t> Types() {
+        return std::vector<uint8_t>{(uint8_t)Arg<typename std::decay<Args>::type>::type...};
+    }
+
+    static size_t ArgsSize() { return 0; }
+    template<class T, class... Rest>
+    static size_t ArgsSize(const T& v, const Rest&... rest) {
+        return Arg<typename std::decay<T>::type>::size(v) + ArgsSize(rest...);
+    }
+
+    static void Encode(char*) {}
+    template<class T, class... Rest>
+    static void Encode(char* p, const T& v, const Rest&... rest) {
+        Encode(Arg<typename std::decay<T>::type>::encode(p, v), rest...);
+    }
+
+    static Ring* CreateRing();
+private:
+    static std::atomic<bool> s_running;
+    static thread_local Ring* t_ring;
+};
+
+template<class T>
+struct BinaryLog::Arg<T, typename std::enable_if<std::is_integral<T>::value
+            || std::is_enum<T>::value>::type> {
+    static const uint8_t type = std::is_signed<T>::value || std::is_enum<T>::value ? INT : UINT;
+    static size_t size(T) { return 8; }
+    static char* encode(char* p, T v) {
+        uint64_t x = type == INT ? (uint64_t)(int64_t)v : (uint64_t)v;
+        memcpy(p, &x, 8);
+        return p + 8;
+    }
+};
+
+template<class T>
+struct BinaryLog::Arg<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static const uint8_t type = DOUBLE;
+    static size_t size(T) { return 8; }
+    static char* encode(char* p, T v) {
+        double d = v;
+        memcpy(p, &d, 8);
+        return p + 8;
+    }
+};
+
+template<class T>
+struct BinaryLog::Arg<T*, typename std::enable_if<std::is_same<typename std::remove_cv<T>::type
+            , char>::value>::type> {
+    static const uint8_t type = STRING;
+    static size_t size(const char* v) { return 4 + (v ? strlen(v) : 6); }
+    static char* encode(char* p, const char* v) {
+        if(!v) {
+            v = "(null)";
+        }
+        uint32_t len = strlen(v);
+        memcpy(p, &len, 4);
+        memcpy(p + 4, v, len);
+        return p + 4 + len;
+    }
+};
+
+template<class T>
+struct BinaryLog::Arg<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type
+            , char>::value>::type> {
+    static const uint8_t type = POINTER;
+    static size_t size(const void*) { return 8; }
+    static char* encode(char* p, const void* v) {
+        uint64_t x = (uintptr_t)v;
+        memcpy(p, &x, 8);
+        return p + 8;
+    }
+};
+
+/**
+ * @brief Turns a BinaryLog file back into text
+ */
+class BinaryLogReader {
+public:
+    /**
+     * @brief Decode the file at path onto out
+     * @return false if it isn't a binary log, or is cut short; what could
+     *         be decoded is written either way
+     */
+    bool decode(const std::string& path, std::ostream& out);
+
+    /// records written out, and records the writer reported as dropped
+    uint64_t getRecords() const { return m_records; }
+    uint64_t getDropped() const { return m_dropped; }
+    const std::string& getError() const { return m_error; }
+
+    /**
+     * @brief printf with the arguments of a record
+     */
+    struct Value {
+        uint8_t type = 0;
+        uint64_t u = 0;
+        double d = 0;
+        std::string s;
+    };
+    static std::string FormatMessage(const std::string& fmt, const std::vector<Value>& args);
+private:
+    uint64_t m_records = 0;
+    uint64_t m_dropped = 0;
+    std::string m_error;
+};
+
+/**
+ * @brief SYLAR_LOG_FMT_* once the level check has passed
+ * @details A binary logger logs as text while no BinaryLog is open
+ *          (log.binary.file empty, before Open(), after Close()).
+ * @param[in] site Unique to the call site, for BinaryLog::Write
+ */
+template<class Site, class... Args>
+void LogFormat(Logger* logger, LogLevel::level level, Site site, const char* file, int line
+               ,const char* fmt, const Args&... args) {
+    uint32_t binary_id = logger->getBinaryId();
+    if(binary_id && BinaryLog::IsOpen()) {
+        BinaryLog::Write(binary_id, level, site, file, line, fmt, args...);
+    } else {
+        LogEventWrap(logger->shared_from_this(), level, file, line, 0, GetThreadId(), GetFiberId())
+            .getEvent()->format(fmt, args...);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,717 @@
+#include "bytearray.h"
+#include "config.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <endian.h>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_pool_max_blocks =
+    sylar::Config::Lookup("bytearray.pool.max_blocks", (uint32_t)64
+            , "free ByteArray blocks kept per thread and block size");
+
+static uint32_t s_pool_max_blocks = 64;
+
+namespace {
+
+struct _ByteArrayIniter {
+    _ByteArrayIniter() {
+        s_pool_max_blocks = g_pool_max_blocks->getValue();
+        g_pool_max_blocks->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            s_pool_max_blocks = new_value;
+        });
+    }
+};
+
+static _ByteArrayIniter s_init;
+
+/**
+ * @brief Free blocks of one thread, by block size
+ * @details A block may go back to another thread's pool than the one it came
+ *          from, that's fine, it's only memory.
+ */
+struct BlockPool {
+    ~BlockPool();
+    char* alloc(size_t size);
+    void release(char* ptr, size_t size);
+
+    std::unordered_map<size_t, std::vector<char*> > blocks;
+};
+
+static thread_local BlockPool t_pool;
+// thread_local objects die in reverse order of construction, a ByteArray
+// living in a longer lived one may still free blocks after t_pool is gone
+static thread_local bool t_pool_dead = false;
+
+BlockPool::~BlockPool() {
+    t_pool_dead = true;
+    for(auto& i : blocks) {
+        for(auto p : i.second) {
+            free(p);
+        }
+    }
+}
+
+char* BlockPool::alloc(size_t size) {
+    auto it = blocks.find(size);
+    if(it != blocks.end() && !it->second.empty()) {
+        char* p = it->second.back();
+        it->second.pop_back();
+        return p;
+    }
+    return (char*)malloc(size);
+}
+
+void BlockPool::release(char* ptr, size_t size) {
+    std::vector<char*>& v = blocks[size];
+    if(v.size() < s_pool_max_blocks) {
+        v.push_back(ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+template<class T>
+static inline T ByteSwap(T value) {
+    switch(sizeof(T)) {
+        case sizeof(uint16_t):
+            return (T)__builtin_bswap16((uint16_t)value);
+        case sizeof(uint32_t):
+            return (T)__builtin_bswap32((uint32_t)value);
+        case sizeof(uint64_t):
+            return (T)__builtin_bswap64((uint64_t)value);
+    }
+    return value;
+}
+
+static inline uint32_t EncodeZigzag32(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline uint64_t EncodeZigzag64(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int32_t DecodeZigzag32(uint32_t v) {
+    return (int32_t)((v >> 1) ^ -(v & 1));
+}
+
+static inline int64_t DecodeZigzag64(uint64_t v) {
+    return (int64_t)((v >> 1) ^ -(v & 1));
+}
+
+}
+
+ByteArray::Node::Node(size_t s)
+    :ptr(t_pool_dead ? (char*)malloc(s) : t_pool.alloc(s))
+    ,next(nullptr)
+    ,size(s) {
+}
+
+ByteArray::Node::Node()
+    :ptr(nullptr)
+    ,next(nullptr)
+    ,size(0) {
+}
+
+ByteArray::Node::~Node() {
+    if(!ptr) {
+        return;
+    }
+    if(t_pool_dead) {
+        free(ptr);
+    } else {
+        t_pool.release(ptr, size);
+    }
+}
+
+ByteArray::ByteArray(size_t base_size)
+    :m_baseSize(base_size)
+    ,m_position(0)
+    ,m_capacity(base_size)
+    ,m_size(0)
+    ,m_littleEndian(false)
+    ,m_root(new Node(base_size))
+    ,m_cur(m_root)
+    ,m_tail(m_root) {
+}
+
+ByteArray::~ByteArray() {
+    Node* tmp = m_root;
+    while(tmp) {
+        m_cur = tmp;
+        tmp = tmp->next;
+        delete m_cur;
+    }
+}
+
+bool ByteArray::isLittleEndian() const {
+    return m_littleEndian;
+}
+
+void ByteArray::setIsLittleEndian(bool val) {
+    m_littleEndian = val;
+}
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+#define XX(value) if(!m_littleEndian) { value = ByteSwap(value); }
+#else
+#define XX(value) if(m_littleEndian) { value = ByteSwap(value); }
+#endif
+
+void ByteArray::writeFint8(int8_t value) {
+    write(&value, sizeof(value));
+}
+
+void ByteArray::writeFuint8(uint8_t value) {
+    write(&value, sizeof(value));
+}
+
+void ByteArray::writeFint16(int16_t value) {
+    XX(value);
+    write(&value, sizeof(value));
+}
+
+void ByteArray::writeFuint16(uint16_t value) {
+    XX(value);
+    write(&value, sizeof(value));
+}
+
+void ByteArray::writeFint32(int32_t value) {
+    XX(value);
+    write(&value, sizeof(value));
+}
+
+void ByteArray::writeFuint32(uint32_t value) {
+    XX(value);
+    write(&value, sizeof(value));
+}
+
+void ByteArray::writeFint64(int64_t value) {
+    XX(value);
+    write(&value, sizeof(value));
+}
+
+void ByteArray::writeFuint64(uint64_t value) {
+    XX(value);
+    write(&value, sizeof(value));
+}
+
+void ByteArray::writeInt32(int32_t value) {
+    writeUint32(EncodeZigzag32(value));
+}
+
+void ByteArray::writeUint32(uint32_t value) {
+    uint8_t tmp[5];
+    uint8_t i = 0;
+    while(value >= 0x80) {
+        tmp[i++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    tmp[i++] = value;
+    write(tmp, i);
+}
+
+void ByteArray::writeInt64(int64_t value) {
+    writeUint64(EncodeZigzag64(value));
+}
+
+void ByteArray::writeUint64(uint64_t value) {
+    uint8_t tmp[10];
+    uint8_t i = 0;
+    while(value >= 0x80) {
+        tmp[i++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    tmp[i++] = value;
+    write(tmp, i);
+}
+
+void ByteArray::writeFloat(float value) {
+    uint32_t v;
+    memcpy(&v, &value, sizeof(value));
+    writeFuint32(v);
+}
+
+void ByteArray::writeDouble(double value) {
+    uint64_t v;
+    memcpy(&v, &value, sizeof(value));
+    writeFuint64(v);
+}
+
+void ByteArray::writeStringF16(const std::string& value) {
+    writeFuint16(value.size());
+    write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringF32(const std::string& value) {
+    writeFuint32(value.size());
+    write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringF64(const std::string& value) {
+    writeFuint64(value.size());
+    write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringVint(const std::string& value) {
+    writeUint64(value.size());
+    write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringWithoutLength(const std::string& value) {
+    write(value.c_str(), value.size());
+}
+
+int8_t ByteArray::readFint8() {
+    int8_t v;
+    read(&v, sizeof(v));
+    return v;
+}
+
+uint8_t ByteArray::readFuint8() {
+    uint8_t v;
+    read(&v, sizeof(v));
+    return v;
+}
+
+#define XX_READ(type) \
+    type v; \
+    read(&v, sizeof(v)); \
+    XX(v); \
+    return v;
+
+int16_t ByteArray::readFint16() {
+    XX_READ(int16_t);
+}
+
+uint16_t ByteArray::readFuint16() {
+    XX_READ(uint16_t);
+}
+
+int32_t ByteArray::readFint32() {
+    XX_READ(int32_t);
+}
+
+uint32_t ByteArray::readFuint32() {
+    XX_READ(uint32_t);
+}
+
+int64_t ByteArray::readFint64() {
+    XX_READ(int64_t);
+}
+
+uint64_t ByteArray::readFuint64() {
+    XX_READ(uint64_t);
+}
+
+#undef XX_READ
+#undef XX
+
+uint64_t ByteArray::readVarint() {
+    size_t npos = m_position % m_baseSize;
+    if(m_cur) {
+        // common case, the whole varint sits in the current block
+        size_t avail = std::min(m_cur->size - npos, m_size - m_position);
+        const uint8_t* p = (const uint8_t*)m_cur->ptr + npos;
+        uint64_t result = 0;
+        for(size_t i = 0; i < avail && i < 10; ++i) {
+            result |= ((uint64_t)(p[i] & 0x7F)) << (7 * i);
+            if(p[i] < 0x80) {
+                m_position += i + 1;
+                if(npos + i + 1 == m_cur->size) {
+                    m_cur = m_cur->next;
+                }
+                return result;
+            }
+        }
+    }
+
+    uint64_t result = 0;
+    for(int i = 0; i < 64; i += 7) {
+        uint8_t b = readFuint8();
+        result |= ((uint64_t)(b & 0x7F)) << i;
+        if(b < 0x80) {
+            break;
+        }
+    }
+    return result;
+}
+
+int32_t ByteArray::readInt32() {
+    return DecodeZigzag32(readUint32());
+}
+
+uint32_t ByteArray::readUint32() {
+    return (uint32_t)readVarint();
+}
+
+int64_t ByteArray::readInt64() {
+    return DecodeZigzag64(readUint64());
+}
+
+uint64_t ByteArray::readUint64() {
+    return readVarint();
+}
+
+float ByteArray::readFloat() {
+    uint32_t v = readFuint32();
+    float value;
+    memcpy(&value, &v, sizeof(v));
+    return value;
+}
+
+double ByteArray::readDouble() {
+    uint64_t v = readFuint64();
+    double value;
+    memcpy(&value, &v, sizeof(v));
+    return value;
+}
+
+#define XX_READ_STRING(len) \
+    std::string buff; \
+    buff.resize(len); \
+    read(&buff[0], buff.size()); \
+    return buff;
+
+std::string ByteArray::readStringF16() {
+    XX_READ_STRING(readFuint16());
+}
+
+std::string ByteArray::readStringF32() {
+    XX_READ_STRING(readFuint32());
+}
+
+std::string ByteArray::readStringF64() {
+    XX_READ_STRING(readFuint64());
+}
+
+std::string ByteArray::readStringVint() {
+    XX_READ_STRING(readUint64());
+}
+
+#undef XX_READ_STRING
+
+void ByteArray::clear() {
+    m_position = m_size = 0;
+    m_capacity = m_baseSize;
+    Node* tmp = m_root->next;
+    while(tmp) {
+        m_cur = tmp;
+        tmp = tmp->next;
+        delete m_cur;
+    }
+    m_root->next = nullptr;
+    m_cur = m_tail = m_root;
+}
+
+void ByteArray::write(const void* buf, size_t size) {
+    if(size == 0) {
+        return;
+    }
+    addCapacity(size);
+
+    size_t npos = m_position % m_baseSize;
+    size_t ncap = m_cur->size - npos;
+    size_t bpos = 0;
+
+    while(size > 0) {
+        if(ncap >= size) {
+            memcpy(m_cur->ptr + npos, (const char*)buf + bpos, size);
+            if(m_cur->size == (npos + size)) {
+                m_cur = m_cur->next;
+            }
+            m_position += size;
+            bpos += size;
+            size = 0;
+        } else {
+            memcpy(m_cur->ptr + npos, (const char*)buf + bpos, ncap);
+            m_position += ncap;
+            bpos += ncap;
+            size -= ncap;
+            m_cur = m_cur->next;
+            ncap = m_cur->size;
+            npos = 0;
+        }
+    }
+
+    if(m_position > m_size) {
+        m_size = m_position;
+    }
+}
+
+void ByteArray::read(void* buf, size_t size) {
+    if(size > getReadSize()) {
+        throw std::out_of_range("not enough len");
+    }
+
+    size_t npos = m_position % m_baseSize;
+    size_t ncap = m_cur->size - npos;
+    size_t bpos = 0;
+    while(size > 0) {
+        if(ncap >= size) {
+            memcpy((char*)buf + bpos, m_cur->ptr + npos, size);
+            if(m_cur->size == (npos + size)) {
+                m_cur = m_cur->next;
+            }
+            m_position += size;
+            bpos += size;
+            size = 0;
+        } else {
+            memcpy((char*)buf + bpos, m_cur->ptr + npos, ncap);
+            m_position += ncap;
+            bpos += ncap;
+            size -= ncap;
+            m_cur = m_cur->next;
+            ncap = m_cur->size;
+            npos = 0;
+        }
+    }
+}
+
+void ByteArray::read(void* buf, size_t size, size_t position) const {
+    if(position > m_size || size > (m_size - position)) {
+        throw std::out_of_range("not enough len");
+    }
+
+    Node* cur = m_root;
+    size_t npos = position;
+    while(npos >= cur->size) {
+        npos -= cur->size;
+        cur = cur->next;
+    }
+    size_t ncap = cur->size - npos;
+    size_t bpos = 0;
+    while(size > 0) {
+        if(ncap >= size) {
+            memcpy((char*)buf + bpos, cur->ptr + npos, size);
+            size = 0;
+        } else {
+            memcpy((char*)buf + bpos, cur->ptr + npos, ncap);
+            bpos += ncap;
+            size -= ncap;
+            cur = cur->next;
+            ncap = cur->size;
+            npos = 0;
+        }
+    }
+}
+
+void ByteArray::setPosition(size_t v) {
+    if(v > m_capacity) {
+        throw std::out_of_range("set_position out of range");
+    }
+    m_position = v;
+    if(m_position > m_size) {
+        m_size = m_position;
+    }
+    m_cur = m_root;
+    while(m_cur && v >= m_cur->size) {
+        v -= m_cur->size;
+        m_cur = m_cur->next;
+    }
+}
+
+bool ByteArray::writeToFile(const std::string& name) const {
+    int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        SYLAR_LOG_ERROR(g_logger) << "writeToFile name=" << name
+            << " error, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+
+    std::vector<iovec> iovs;
+    getReadBuffers(iovs, getReadSize());
+    size_t idx = 0;
+    while(idx < iovs.size()) {
+        int cnt = std::min(iovs.size() - idx, (size_t)IOV_MAX);
+        ssize_t n = writev(fd, &iovs[idx], cnt);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            SYLAR_LOG_ERROR(g_logger) << "writeToFile name=" << name
+                << " writev error, errno=" << errno << " errstr=" << strerror(errno);
+            close(fd);
+            return false;
+        }
+        // skip what went out, a short write leaves part of one iovec
+        while(n > 0 && idx < iovs.size()) {
+            if((size_t)n >= iovs[idx].iov_len) {
+                n -= iovs[idx].iov_len;
+                ++idx;
+            } else {
+                iovs[idx].iov_base = (char*)iovs[idx].iov_base + n;
+                iovs[idx].iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+    close(fd);
+    return true;
+}
+
+bool ByteArray::readFromFile(const std::string& name) {
+    int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        SYLAR_LOG_ERROR(g_logger) << "readFromFile name=" << name
+            << " error, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+
+    // read straight into the blocks, a base size worth at a time
+    while(true) {
+        std::vector<iovec> iovs;
+        getWriteBuffers(iovs, m_baseSize);
+        ssize_t n = readv(fd, &iovs[0], iovs.size());
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            SYLAR_LOG_ERROR(g_logger) << "readFromFile name=" << name
+                << " readv error, errno=" << errno << " errstr=" << strerror(errno);
+            close(fd);
+            return false;
+        }
+        if(n == 0) {
+            break;
+        }
+        setPosition(m_position + n);
+    }
+    close(fd);
+    return true;
+}
+
+void ByteArray::addCapacity(size_t size) {
+    if(size == 0) {
+        return;
+    }
+    size_t old_cap = getCapacity();
+    if(old_cap >= size) {
+        return;
+    }
+
+    size = size - old_cap;
+    size_t count = (size + m_baseSize - 1) / m_baseSize;
+    Node* first = nullptr;
+    for(size_t i = 0; i < count; ++i) {
+        m_tail->next = new Node(m_baseSize);
+        m_tail = m_tail->next;
+        if(first == nullptr) {
+            first = m_tail;
+        }
+        m_capacity += m_baseSize;
+    }
+
+    if(old_cap == 0) {
+        m_cur = first;
+    }
+}
+
+std::string ByteArray::toString() const {
+    std::string str;
+    str.resize(getReadSize());
+    if(str.empty()) {
+        return str;
+    }
+    read(&str[0], str.size(), m_position);
+    return str;
+}
+
+std::string ByteArray::toHexString() const {
+    std::string str = toString();
+    std::stringstream ss;
+
+    for(size_t i = 0; i < str.size(); ++i) {
+        if(i > 0 && i % 32 == 0) {
+            ss << std::endl;
+        }
+        ss << std::setw(2) << std::setfill('0') << std::hex
+           << (int)(uint8_t)str[i] << " ";
+    }
+
+    return ss.str();
+}
+
+uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len) const {
+    return getReadBuffers(buffers, len, m_position);
+}
+
+uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers
+                                ,uint64_t len, uint64_t position) const {
+    if(position >= m_size) {
+        return 0;
+    }
+    len = std::min(len, (uint64_t)(m_size - position));
+    if(len == 0) {
+        return 0;
+    }
+
+    uint64_t size = len;
+    Node* cur = m_root;
+    size_t npos = position;
+    while(npos >= cur->size) {
+        npos -= cur->size;
+        cur = cur->next;
+    }
+    size_t ncap = cur->size - npos;
+    iovec iov;
+    while(len > 0) {
+        if(ncap >= len) {
+            iov.iov_base = cur->ptr + npos;
+            iov.iov_len = len;
+            len = 0;
+        } else {
+            iov.iov_base = cur->ptr + npos;
+            iov.iov_len = ncap;
+            len -= ncap;
+            cur = cur->next;
+            ncap = cur->size;
+            npos = 0;
+        }
+        buffers.push_back(iov);
+    }
+    return size;
+}
+
+uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers, uint64_t len) {
+    if(len == 0) {
+        return 0;
+    }
+    addCapacity(len);
+    uint64_t size = len;
+
+    size_t npos = m_position % m_baseSize;
+    size_t ncap = m_cur->size - npos;
+    iovec iov;
+    Node* cur = m_cur;
+    while(len > 0) {
+        if(ncap >= len) {
+            iov.iov_base = cur->ptr + npos;
+            iov.iov_len = len;
+            len = 0;
+        } else {
+            iov.iov_base = cur->ptr + npos;
+            iov.iov_len = ncap;
+            len -= ncap;
+            cur = cur->next;
+            ncap = cur->size;
+            npos = 0;
+        }
+        buffers.push_back(iov);
+    }
+    return size;
+}
+
+}
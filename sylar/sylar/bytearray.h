@@ -0,0 +1,230 @@
+#ifndef __SYLAR_BYTEARRAY_H__
+#define __SYLAR_BYTEARRAY_H__
+
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+namespace sylar {
+
+/**
+ * @brief Serialization buffer
+ * @details Data lives in a chain of fixed size blocks, growing never moves
+ *          what's already written. Blocks come from a per thread pool
+ *          (bytearray.pool.max_blocks) so short lived buffers don't go
+ *          through malloc. getReadBuffers()/getWriteBuffers() expose the
+ *          blocks directly as iovec arrays for readv/writev/recvmsg/sendmsg.
+ *
+ *          Fixed width values (writeFint32...) go out in network byte order
+ *          unless setIsLittleEndian(true). The varint forms (writeInt32...)
+ *          use 7 bits per byte, signed values are zigzag encoded first so
+ *          small negative numbers stay short.
+ *
+ *          There is one position for reading and writing: write at the end,
+ *          setPosition() back, then read.
+ */
+class ByteArray {
+public:
+    typedef std::shared_ptr<ByteArray> ptr;
+
+    /**
+     * @brief One block of the chain
+     */
+    struct Node {
+        Node(size_t s);
+        Node();
+        ~Node();
+
+        char* ptr;
+        Node* next;
+        size_t size;
+    };
+
+    /**
+     * @param[in] base_size Size of each block
+     */
+    ByteArray(size_t base_size = 4096);
+    ~ByteArray();
+
+    ByteArray(const ByteArray&) = delete;
+    ByteArray& operator=(const ByteArray&) = delete;
+
+    /**
+     * @name Fixed width
+     * @{
+     */
+    void writeFint8  (int8_t value);
+    void writeFuint8 (uint8_t value);
+    void writeFint16 (int16_t value);
+    void writeFuint16(uint16_t value);
+    void writeFint32 (int32_t value);
+    void writeFuint32(uint32_t value);
+    void writeFint64 (int64_t value);
+    void writeFuint64(uint64_t value);
+    /** @} */
+
+    /**
+     * @name Varint, signed ones zigzag encoded
+     * @{
+     */
+    void writeInt32  (int32_t value);
+    void writeUint32 (uint32_t value);
+    void writeInt64  (int64_t value);
+    void writeUint64 (uint64_t value);
+    /** @} */
+
+    void writeFloat  (float value);
+    void writeDouble (double value);
+
+    /**
+     * @brief String with a uint16_t/uint32_t/uint64_t/varint length in front
+     */
+    void writeStringF16(const std::string& value);
+    void writeStringF32(const std::string& value);
+    void writeStringF64(const std::string& value);
+    void writeStringVint(const std::string& value);
+
+    /**
+     * @brief Raw string, no length
+     */
+    void writeStringWithoutLength(const std::string& value);
+
+    /**
+     * @name Readers, throw std::out_of_range when not enough data is left
+     * @{
+     */
+    int8_t   readFint8();
+    uint8_t  readFuint8();
+    int16_t  readFint16();
+    uint16_t readFuint16();
+    int32_t  readFint32();
+    uint32_t readFuint32();
+    int64_t  readFint64();
+    uint64_t readFuint64();
+
+    int32_t  readInt32();
+    uint32_t readUint32();
+    int64_t  readInt64();
+    uint64_t readUint64();
+
+    float    readFloat();
+    double   readDouble();
+
+    std::string readStringF16();
+    std::string readStringF32();
+    std::string readStringF64();
+    std::string readStringVint();
+    /** @} */
+
+    /**
+     * @brief Drop all data, keep only the first block
+     */
+    void clear();
+
+    /**
+     * @brief Copy size bytes in at the current position
+     */
+    void write(const void* buf, size_t size);
+
+    /**
+     * @brief Copy size bytes out from the current position
+     * @exception std::out_of_range getReadSize() < size
+     */
+    void read(void* buf, size_t size);
+
+    /**
+     * @brief Copy size bytes out from position, the current position is
+     *        left alone
+     * @exception std::out_of_range not enough data after position
+     */
+    void read(void* buf, size_t size, size_t position) const;
+
+    size_t getPosition() const { return m_position;}
+
+    /**
+     * @brief Move the position, past the end grows the data size
+     * @exception std::out_of_range position > capacity
+     */
+    void setPosition(size_t v);
+
+    /**
+     * @brief Write the readable data to a file (truncated)
+     */
+    bool writeToFile(const std::string& name) const;
+
+    /**
+     * @brief Append the content of a file at the current position
+     */
+    bool readFromFile(const std::string& name);
+
+    size_t getBaseSize() const { return m_baseSize;}
+
+    /**
+     * @brief Bytes between the position and the end of the data
+     */
+    size_t getReadSize() const { return m_size - m_position;}
+
+    bool isLittleEndian() const;
+    void setIsLittleEndian(bool val);
+
+    /**
+     * @brief Readable data as a string (position unchanged)
+     */
+    std::string toString() const;
+
+    /**
+     * @brief Readable data as hex, 32 bytes per line
+     */
+    std::string toHexString() const;
+
+    /**
+     * @brief Readable data as iovecs, no copy
+     * @param[out] buffers iovecs are appended here
+     * @param[in] len At most this many bytes
+     * @return Bytes covered
+     */
+    uint64_t getReadBuffers(std::vector<iovec>& buffers, uint64_t len = ~0ull) const;
+
+    /**
+     * @brief Same, starting at position instead of the current position
+     */
+    uint64_t getReadBuffers(std::vector<iovec>& buffers, uint64_t len, uint64_t position) const;
+
+    /**
+     * @brief Room for len bytes after the position as iovecs, allocating
+     *        blocks as needed. Fill them (readv/recvmsg), then advance with
+     *        setPosition(getPosition() + n).
+     * @return len
+     */
+    uint64_t getWriteBuffers(std::vector<iovec>& buffers, uint64_t len);
+
+    /**
+     * @brief Data size
+     */
+    size_t getSize() const { return m_size;}
+private:
+    void addCapacity(size_t size);
+
+    /**
+     * @brief Decode a varint at the position
+     */
+    uint64_t readVarint();
+    size_t getCapacity() const { return m_capacity - m_position;}
+private:
+    size_t m_baseSize;
+    size_t m_position;
+    size_t m_capacity;
+    size_t m_size;
+    bool m_littleEndian;
+    Node* m_root;
+    Node* m_cur;
+    Node* m_tail;
+};
+
+}
+
+#endif
@@ -0,0 +1,280 @@
+#include "connection_pool.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sstream>
+
+namespace sylar {
+
+static sylar::ConfigVar<uint32_t>::ptr g_connection_pool_max_idle =
+    sylar::Config::Lookup("connection_pool.max_idle", (uint32_t)8
+            , "idle connections kept per host");
+
+static sylar::ConfigVar<uint32_t>::ptr g_connection_pool_max_total =
+    sylar::Config::Lookup("connection_pool.max_total", (uint32_t)64
+            , "open connections per host, idle or in use");
+
+static sylar::ConfigVar<uint32_t>::ptr g_connection_pool_max_requests =
+    sylar::Config::Lookup("connection_pool.max_requests", (uint32_t)0
+            , "uses of a connection before it is closed, 0 for no limit");
+
+static sylar::ConfigVar<uint64_t>::ptr g_connection_pool_idle_timeout =
+    sylar::Config::Lookup("connection_pool.idle_timeout", (uint64_t)(30 * 1000)
+            , "idle connections older than this (ms) are closed, 0 for never");
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+PooledConnection::PooledConnection(Socket::ptr sock, const std::string& key)
+    :m_sock(sock)
+    ,m_key(key)
+    ,m_requests(1)
+    ,m_bad(false)
+    ,m_createTime(sylar::GetCurrentMS())
+    ,m_lastUsed(m_createTime) {
+}
+
+ConnectionPool::ConnectionPool()
+    :m_maxIdle(g_connection_pool_max_idle->getValue())
+    ,m_maxTotal(g_connection_pool_max_total->getValue())
+    ,m_maxRequests(g_connection_pool_max_requests->getValue())
+    ,m_idleTimeout(g_connection_pool_idle_timeout->getValue()) {
+}
+
+ConnectionPool::~ConnectionPool() {
+    // handed out connections keep the pool alive, only idle ones are left
+    for(auto& i : m_hosts) {
+        for(auto c : i.second.idle) {
+            c->m_sock->close();
+            delete c;
+        }
+    }
+}
+
+PooledConnection::ptr ConnectionPool::wrap(PooledConnection* conn) {
+    return PooledConnection::ptr(conn, std::bind(&ConnectionPool::Release
+                        ,std::placeholders::_1, shared_from_this()));
+}
+
+bool ConnectionPool::isHealthy(PooledConnection* conn, uint64_t now) {
+    if(m_idleTimeout && now - conn->m_lastUsed >= m_idleTimeout) {
+        return false;
+    }
+    // an idle keep-alive connection has nothing to read; EOF means the
+    // peer closed it, data means it is out of sync
+    char c;
+    int rt = ::recv(conn->m_sock->getSocket(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+PooledConnection::ptr ConnectionPool::acquire(const std::string& host, uint64_t timeout_ms) {
+    uint64_t start = sylar::GetCurrentMS();
+    std::vector<PooledConnection*> stale;
+    PooledConnection* conn = nullptr;
+    bool can_connect = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        Host& h = m_hosts[host];
+        while(true) {
+            uint64_t now = sylar::GetCurrentMS();
+            while(!h.idle.empty()) {
+                PooledConnection* c = h.idle.back();
+                h.idle.pop_back();
+                if(isHealthy(c, now)) {
+                    conn = c;
+                    break;
+                }
+                --h.total;
+                stale.push_back(c);
+            }
+            if(conn) {
+                break;
+            }
+            if(h.total < m_maxTotal) {
+                ++h.total;
+                can_connect = true;
+                break;
+            }
+
+            IOManager* iom = IOManager::GetThis();
+            uint64_t used = now - start;
+            if(!iom || used >= timeout_ms) {
+                break;
+            }
+            Waiter::ptr w(new Waiter);
+            w->fiber = Fiber::GetThis();
+            w->scheduler = iom;
+            h.waiters.push_back(w);
+
+            Timer::ptr timer;
+            if(timeout_ms != (uint64_t)-1) {
+                ConnectionPool::ptr self = shared_from_this();
+                timer = iom->addTimer(timeout_ms - used, [self, w, host](){
+                    {
+                        MutexType::Lock lock(self->m_mutex);
+                        if(w->done) {
+                            return;
+                        }
+                        w->done = true;
+                        self->m_hosts[host].waiters.remove(w);
+                    }
+                    w->scheduler->schedule(w->fiber);
+                });
+            }
+            lock.unlock();
+            Fiber::YieldToHold();
+            if(timer) {
+                timer->cancel();
+            }
+            lock.lock();
+
+            if(w->conn) {
+                conn = w->conn;
+            } else if(w->slot) {
+                can_connect = true;
+            }
+            break;
+        }
+    }
+
+    for(auto c : stale) {
+        c->m_sock->close();
+        delete c;
+    }
+    if(conn) {
+        ++conn->m_requests;
+        return wrap(conn);
+    }
+    if(can_connect) {
+        return connect(host);
+    }
+    SYLAR_LOG_DEBUG(g_logger) << "ConnectionPool acquire " << host << " timed out after "
+        << sylar::GetCurrentMS() - start << "ms";
+    return nullptr;
+}
+
+PooledConnection::ptr ConnectionPool::connect(const std::string& host) {
+    // the caller holds one of the host's slots
+    IPAddress::ptr addr = Address::LookupAnyIPAddress(host);
+    Socket::ptr sock;
+    if(addr) {
+        sock = Socket::CreateTCP(addr);
+        if(!sock->connect(addr)) {
+            sock.reset();
+        }
+    }
+    if(!sock) {
+        SYLAR_LOG_ERROR(g_logger) << "ConnectionPool connect " << host << " fail errno="
+            << errno << " errstr=" << strerror(errno);
+        Waiter::ptr w;
+        {
+            MutexType::Lock lock(m_mutex);
+            Host& h = m_hosts[host];
+            if(h.waiters.empty()) {
+                --h.total;
+            } else {
+                w = h.waiters.front();
+                h.waiters.pop_front();
+                w->done = true;
+                w->slot = true;
+            }
+        }
+        if(w) {
+            w->scheduler->schedule(w->fiber);
+        }
+        return nullptr;
+    }
+    ++m_connects;
+    return wrap(new PooledConnection(sock, host));
+}
+
+void ConnectionPool::Release(PooledConnection* conn, ConnectionPool::ptr pool) {
+    pool->release(conn);
+}
+
+void ConnectionPool::release(PooledConnection* conn) {
+    bool reuse = !conn->m_bad && conn->m_sock->isConnected()
+        && (m_maxRequests == 0 || conn->m_requests < m_maxRequests);
+    bool close = false;
+    Waiter::ptr w;
+    {
+        MutexType::Lock lock(m_mutex);
+        Host& h = m_hosts[conn->m_key];
+        if(!h.waiters.empty()) {
+            // hand the connection, or its slot, straight to the oldest waiter
+            w = h.waiters.front();
+            h.waiters.pop_front();
+            w->done = true;
+            if(reuse) {
+                w->conn = conn;
+            } else {
+                w->slot = true;
+                close = true;
+            }
+        } else if(reuse && h.idle.size() < m_maxIdle) {
+            conn->m_lastUsed = sylar::GetCurrentMS();
+            h.idle.push_back(conn);
+        } else {
+            --h.total;
+            close = true;
+        }
+    }
+    if(close) {
+        conn->m_sock->close();
+        delete conn;
+    }
+    if(w) {
+        w->scheduler->schedule(w->fiber);
+    }
+}
+
+void ConnectionPool::clear() {
+    std::vector<PooledConnection*> conns;
+    {
+        MutexType::Lock lock(m_mutex);
+        for(auto& i : m_hosts) {
+            Host& h = i.second;
+            h.total -= h.idle.size();
+            conns.insert(conns.end(), h.idle.begin(), h.idle.end());
+            h.idle.clear();
+        }
+    }
+    for(auto c : conns) {
+        c->m_sock->close();
+        delete c;
+    }
+}
+
+uint32_t ConnectionPool::getTotal(const std::string& host) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_hosts.find(host);
+    return it == m_hosts.end() ? 0 : it->second.total;
+}
+
+uint32_t ConnectionPool::getIdle(const std::string& host) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_hosts.find(host);
+    return it == m_hosts.end() ? 0 : it->second.idle.size();
+}
+
+std::string ConnectionPool::toString() {
+    std::stringstream ss;
+    ss << "[ConnectionPool max_idle=" << m_maxIdle
+       << " max_total=" << m_maxTotal
+       << " max_requests=" << m_maxRequests
+       << " idle_timeout=" << m_idleTimeout
+       << " connects=" << m_connects;
+    MutexType::Lock lock(m_mutex);
+    for(auto& i : m_hosts) {
+        ss << " " << i.first << "(total=" << i.second.total
+           << " idle=" << i.second.idle.size()
+           << " waiters=" << i.second.waiters.size() << ")";
+    }
+    ss << "]";
+    return ss.str();
+}
+
+}
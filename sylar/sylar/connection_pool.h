@@ -0,0 +1,185 @@
+#ifndef __SYLAR_CONNECTION_POOL_H__
+#define __SYLAR_CONNECTION_POOL_H__
+
+#include <memory>
+#include <string>
+#include <list>
+#include <atomic>
+#include <unordered_map>
+#include "address.h"
+#include "iomanager.h"
+#include "socket.h"
+#include "thread.h"
+
+namespace sylar {
+
+class ConnectionPool;
+
+/**
+ * @brief Client connection borrowed from a ConnectionPool
+ * @details Goes back to the pool when the last reference is dropped. Call
+ *          markBad() after an IO error or a protocol violation so the
+ *          connection is closed instead of being handed out again.
+ */
+class PooledConnection {
+friend class ConnectionPool;
+public:
+    typedef std::shared_ptr<PooledConnection> ptr;
+
+    Socket::ptr getSocket() const { return m_sock;}
+
+    /**
+     * @brief host:port the connection belongs to
+     */
+    const std::string& getKey() const { return m_key;}
+
+    /**
+     * @brief Times the connection has been handed out, this one included
+     */
+    uint32_t getRequests() const { return m_requests;}
+
+    /**
+     * @brief Whether this is the first use of the connection; a failure on
+     *        a reused one may just be the peer having dropped it while idle
+     */
+    bool isReused() const { return m_requests > 1;}
+
+    uint64_t getCreateTime() const { return m_createTime;}
+
+    /**
+     * @brief Don't reuse the connection
+     */
+    void markBad() { m_bad = true;}
+    bool isBad() const { return m_bad;}
+private:
+    PooledConnection(Socket::ptr sock, const std::string& key);
+private:
+    Socket::ptr m_sock;
+    std::string m_key;
+    uint32_t m_requests;
+    bool m_bad;
+    uint64_t m_createTime;
+    /// When it went back to the pool
+    uint64_t m_lastUsed;
+};
+
+/**
+ * @brief Keep-alive client connections, by host:port
+ * @details acquire() hands out an idle connection of the host if there's a
+ *          healthy one, opens a new one while the host is below its
+ *          max_total, and otherwise blocks the calling fiber until a
+ *          connection comes back or the timeout runs out.
+ *
+ *          Connections that were marked bad, have served max_requests,
+ *          were closed by the peer or sat idle longer than idle_timeout are
+ *          closed rather than reused. At most max_idle of a host's
+ *          connections are kept open while unused.
+ *
+ *          Limits default to connection_pool.* and apply per host.
+ */
+class ConnectionPool : public std::enable_shared_from_this<ConnectionPool> {
+public:
+    typedef std::shared_ptr<ConnectionPool> ptr;
+    typedef Mutex MutexType;
+
+    ConnectionPool();
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    /**
+     * @brief Borrow a connection to host
+     * @param[in] host "host:port", resolved with Address::LookupAnyIPAddress
+     * @param[in] timeout_ms How long to wait for a free connection, the
+     *            connect timeout is tcp.connect.timeout. Waiting needs to
+     *            happen in an IOManager fiber, elsewhere a full host fails
+     *            right away.
+     * @return nullptr on timeout or if connecting failed
+     */
+    PooledConnection::ptr acquire(const std::string& host, uint64_t timeout_ms = -1);
+
+    /**
+     * @brief Close the idle connections of every host
+     */
+    void clear();
+
+    uint32_t getMaxIdle() const { return m_maxIdle;}
+    void setMaxIdle(uint32_t v) { m_maxIdle = v;}
+
+    uint32_t getMaxTotal() const { return m_maxTotal;}
+    void setMaxTotal(uint32_t v) { m_maxTotal = v;}
+
+    /**
+     * @brief Uses of a connection before it is closed, 0 for no limit
+     */
+    uint32_t getMaxRequests() const { return m_maxRequests;}
+    void setMaxRequests(uint32_t v) { m_maxRequests = v;}
+
+    /**
+     * @brief Idle connections older than this (ms) are closed, 0 for never
+     */
+    uint64_t getIdleTimeout() const { return m_idleTimeout;}
+    void setIdleTimeout(uint64_t v) { m_idleTimeout = v;}
+
+    /**
+     * @brief Open connections of host, idle or in use
+     */
+    uint32_t getTotal(const std::string& host);
+    uint32_t getIdle(const std::string& host);
+
+    /**
+     * @brief Connections opened since the pool was created
+     */
+    uint64_t getConnectCount() const { return m_connects;}
+
+    std::string toString();
+private:
+    /**
+     * @brief A fiber waiting in acquire()
+     */
+    struct Waiter {
+        typedef std::shared_ptr<Waiter> ptr;
+        Fiber::ptr fiber;
+        Scheduler* scheduler = nullptr;
+        /// Handed over by release()
+        PooledConnection* conn = nullptr;
+        /// release() freed a slot, the waiter may connect
+        bool slot = false;
+        bool done = false;
+    };
+
+    struct Host {
+        /// Most recently used at the back
+        std::list<PooledConnection*> idle;
+        std::list<Waiter::ptr> waiters;
+        uint32_t total = 0;
+    };
+
+    /**
+     * @brief Deleter of handed out connections
+     */
+    static void Release(PooledConnection* conn, ConnectionPool::ptr pool);
+    void release(PooledConnection* conn);
+
+    /**
+     * @brief Whether an idle connection can be handed out, false if it
+     *        timed out or the peer closed it (or sent something unasked)
+     */
+    bool isHealthy(PooledConnection* conn, uint64_t now);
+
+    PooledConnection::ptr connect(const std::string& host);
+    PooledConnection::ptr wrap(PooledConnection* conn);
+private:
+    MutexType m_mutex;
+    std::unordered_map<std::string, Host> m_hosts;
+    uint32_t m_maxIdle;
+    uint32_t m_maxTotal;
+    uint32_t m_maxRequests;
+    uint64_t m_idleTimeout;
+    std::atomic<uint64_t> m_connects = {0};
+};
+
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include "datagram_socket.h"
+#include "iomanager.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_udp_batch_size =
+    sylar::Config::Lookup("udp.batch_size", (uint32_t)32
+            , "datagrams per recvmmsg/sendmmsg of a DatagramSocket");
+
+static sylar::ConfigVar<uint32_t>::ptr g_udp_max_datagram_size =
+    sylar::Config::Lookup("udp.max_datagram_size", (uint32_t)2048
+            , "receive slot size of a DatagramSocket without GRO");
+
+static sylar::ConfigVar<bool>::ptr g_udp_gro =
+    sylar::Config::Lookup("udp.gro", true
+            , "receive coalesced datagrams (UDP_GRO) when the kernel supports it");
+
+static sylar::ConfigVar<bool>::ptr g_udp_gso =
+    sylar::Config::Lookup("udp.gso", true
+            , "send equal sized datagrams with UDP_SEGMENT when the kernel supports it");
+
+/// A GRO receive can be up to a full IP packet
+static const size_t s_gro_slot_size = 65536;
+/// Kernel limit on segments per GSO send (UDP_MAX_SEGMENTS of older kernels)
+static const size_t s_gso_max_segments = 64;
+/// Payload of one GSO send has to fit in an IP packet
+static const size_t s_gso_max_bytes = 65000;
+/// Larger segments may not fit the device MTU, which fails the send
+static const size_t s_gso_max_segment_size = 1452;
+
+DatagramSocket::DatagramSocket(Socket::ptr sock, uint32_t batch)
+    :m_sock(sock)
+    ,m_batch(batch ? batch : g_udp_batch_size->getValue())
+    ,m_gro(false)
+    ,m_gso(false)
+    ,m_sendCount(0)
+    ,m_recvCalls(0)
+    ,m_recvDatagrams(0)
+    ,m_sendCalls(0)
+    ,m_sendDatagrams(0)
+    ,m_truncated(0) {
+    if(m_batch == 0) {
+        m_batch = 1;
+    }
+    if(m_sock->getFamily() == AF_INET || m_sock->getFamily() == AF_INET6) {
+        int one = 1;
+        if(g_udp_gro->getValue()) {
+            m_gro = m_sock->setOption(IPPROTO_UDP, UDP_GRO, one);
+        }
+        int seg = 0;
+        if(g_udp_gso->getValue()) {
+            // readable where the kernel knows UDP_SEGMENT
+            m_gso = m_sock->getOption(IPPROTO_UDP, UDP_SEGMENT, seg);
+        }
+    }
+    m_slotSize = m_gro ? s_gro_slot_size : g_udp_max_datagram_size->getValue();
+    m_slots = (char*)malloc(m_slotSize * m_batch);
+
+    m_recvHdrs.resize(m_batch);
+    m_recvIovs.resize(m_batch);
+    m_recvAddrs.resize(m_batch);
+    m_recvControl.resize(CMSG_SPACE(sizeof(int)) * m_batch);
+    for(uint32_t i = 0; i < m_batch; ++i) {
+        m_recvIovs[i].iov_base = m_slots + i * m_slotSize;
+        m_recvIovs[i].iov_len = m_slotSize;
+    }
+
+    m_sendHdrs.resize(m_batch);
+    m_sendSegs.resize(m_batch);
+    m_sendControl.resize(CMSG_SPACE(sizeof(uint16_t)) * m_batch);
+}
+
+DatagramSocket::~DatagramSocket() {
+    free(m_slots);
+}
+
+int DatagramSocket::recv(std::vector<Datagram>& out) {
+    out.clear();
+    const size_t control = CMSG_SPACE(sizeof(int));
+    for(uint32_t i = 0; i < m_batch; ++i) {
+        // the kernel writes the lengths back, reset them every call
+        msghdr& msg = m_recvHdrs[i].msg_hdr;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &m_recvAddrs[i];
+        msg.msg_namelen = sizeof(sockaddr_storage);
+        msg.msg_iov = &m_recvIovs[i];
+        msg.msg_iovlen = 1;
+        if(m_gro) {
+            msg.msg_control = &m_recvControl[i * control];
+            msg.msg_controllen = control;
+        }
+        m_recvHdrs[i].msg_len = 0;
+    }
+
+    int fd = m_sock->getSocket();
+    IOManager* iom = m_sock->ioManager();
+    int n = iom ? iom->recvmmsg(fd, &m_recvHdrs[0], m_batch)
+                : ::recvmmsg(fd, &m_recvHdrs[0], m_batch, 0, nullptr);
+    if(n < 0) {
+        return -1;
+    }
+    ++m_recvCalls;
+
+    for(int i = 0; i < n; ++i) {
+        const msghdr& msg = m_recvHdrs[i].msg_hdr;
+        if(msg.msg_flags & MSG_TRUNC) {
+            ++m_truncated;
+            continue;
+        }
+        const char* data = (const char*)m_recvIovs[i].iov_base;
+        size_t len = m_recvHdrs[i].msg_len;
+        size_t seg = len;
+        if(m_gro) {
+            for(cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR((msghdr*)&msg, c)) {
+                if(c->cmsg_level == IPPROTO_UDP && c->cmsg_type == UDP_GRO) {
+                    int gso_size;
+                    memcpy(&gso_size, CMSG_DATA(c), sizeof(gso_size));
+                    if(gso_size > 0) {
+                        seg = gso_size;
+                    }
+                }
+            }
+        }
+        // a coalesced buffer is seg sized datagrams, the last one may be shorter
+        size_t off = 0;
+        do {
+            size_t l = std::min(seg, len - off);
+            out.push_back(Datagram(data + off, l, (const sockaddr*)msg.msg_name, msg.msg_namelen));
+            off += l;
+        } while(off < len);
+    }
+    m_recvDatagrams += out.size();
+    return out.size();
+}
+
+static bool same_addr(const DatagramSocket::Datagram& a, const DatagramSocket::Datagram& b) {
+    return a.addrlen == b.addrlen
+        && (a.addr == b.addr || memcmp(a.addr, b.addr, a.addrlen) == 0);
+}
+
+void DatagramSocket::prepareSend(const Datagram* msgs, size_t count) {
+    const size_t control = CMSG_SPACE(sizeof(uint16_t));
+    if(m_sendIovs.size() < count) {
+        m_sendIovs.resize(count);
+    }
+    size_t used = 0;
+    m_sendCount = 0;
+    while(used < count && m_sendCount < m_batch) {
+        const Datagram& first = msgs[used];
+        size_t segs = 1;
+        size_t bytes = first.len;
+        if(m_gso && first.len > 0 && first.len <= s_gso_max_segment_size) {
+            // equal sized datagrams to the same peer, the last may be shorter
+            while(used + segs < count && segs < s_gso_max_segments) {
+                const Datagram& next = msgs[used + segs];
+                if(next.len == 0 || next.len > first.len
+                        || bytes + next.len > s_gso_max_bytes
+                        || !same_addr(first, next)) {
+                    break;
+                }
+                bytes += next.len;
+                ++segs;
+                if(next.len < first.len) {
+                    break;
+                }
+            }
+        }
+
+        for(size_t i = 0; i < segs; ++i) {
+            m_sendIovs[used + i].iov_base = (void*)msgs[used + i].data;
+            m_sendIovs[used + i].iov_len = msgs[used + i].len;
+        }
+        mmsghdr& hdr = m_sendHdrs[m_sendCount];
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_hdr.msg_name = (void*)first.addr;
+        hdr.msg_hdr.msg_namelen = first.addr ? first.addrlen : 0;
+        hdr.msg_hdr.msg_iov = &m_sendIovs[used];
+        hdr.msg_hdr.msg_iovlen = segs;
+        if(segs > 1) {
+            char* buf = &m_sendControl[m_sendCount * control];
+            memset(buf, 0, control);
+            hdr.msg_hdr.msg_control = buf;
+            hdr.msg_hdr.msg_controllen = control;
+            cmsghdr* c = CMSG_FIRSTHDR(&hdr.msg_hdr);
+            c->cmsg_level = IPPROTO_UDP;
+            c->cmsg_type = UDP_SEGMENT;
+            c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t seg_size = first.len;
+            memcpy(CMSG_DATA(c), &seg_size, sizeof(seg_size));
+        }
+        m_sendSegs[m_sendCount] = segs;
+        ++m_sendCount;
+        used += segs;
+    }
+}
+
+int DatagramSocket::send(const Datagram* msgs, size_t count) {
+    int fd = m_sock->getSocket();
+    IOManager* iom = m_sock->ioManager();
+    size_t sent = 0;
+    while(sent < count) {
+        prepareSend(msgs + sent, count - sent);
+        size_t hdr = 0;
+        while(hdr < m_sendCount) {
+            int n = iom ? iom->sendmmsg(fd, &m_sendHdrs[hdr], m_sendCount - hdr)
+                        : ::sendmmsg(fd, &m_sendHdrs[hdr], m_sendCount - hdr, MSG_NOSIGNAL);
+            if(n < 0) {
+                if(errno == EIO && m_gso && m_sendSegs[hdr] > 1) {
+                    // the device can't checksum offload, segment here instead
+                    SYLAR_LOG_INFO(g_logger) << "UDP GSO failed, disabled for " << *m_sock;
+                    m_gso = false;
+                    break;
+                }
+                return sent ? (int)sent : -1;
+            }
+            ++m_sendCalls;
+            for(int i = 0; i < n; ++i) {
+                sent += m_sendSegs[hdr + i];
+                m_sendDatagrams += m_sendSegs[hdr + i];
+            }
+            hdr += n;
+        }
+    }
+    return sent;
+}
+
+std::string DatagramSocket::toString() const {
+    std::stringstream ss;
+    ss << "[DatagramSocket " << *m_sock
+       << " batch=" << m_batch
+       << " gro=" << m_gro
+       << " gso=" << m_gso
+       << " recv_calls=" << m_recvCalls
+       << " recv_datagrams=" << m_recvDatagrams
+       << " send_calls=" << m_sendCalls
+       << " send_datagrams=" << m_sendDatagrams
+       << " truncated=" << m_truncated
+       << "]";
+    return ss.str();
+}
+
+}
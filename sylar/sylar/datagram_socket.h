@@ -0,0 +1,136 @@
+#ifndef __SYLAR_DATAGRAM_SOCKET_H__
+#define __SYLAR_DATAGRAM_SOCKET_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include "address.h"
+#include "socket.h"
+
+namespace sylar {
+
+/**
+ * @brief Batched IO on a UDP socket
+ * @details recv() takes up to udp.batch_size datagrams with one recvmmsg
+ *          into a set of receive slots allocated once, and send() hands a
+ *          whole batch to one sendmmsg. Where the kernel supports it
+ *          (udp.gro, udp.gso) received datagrams come coalesced with UDP_GRO
+ *          and are split back here, and runs of equal sized datagrams to the
+ *          same destination go out as one UDP_SEGMENT (GSO) send.
+ *          Waiting goes through the current IOManager like Socket. One
+ *          fiber may be in recv() and one in send() at a time.
+ */
+class DatagramSocket {
+public:
+    typedef std::shared_ptr<DatagramSocket> ptr;
+
+    /**
+     * @brief One datagram, received or to send
+     * @details Received ones point into the receive slots and stay valid
+     *          until the next recv(). addr is the peer; for send() it is the
+     *          destination, nullptr on a connected socket.
+     */
+    struct Datagram {
+        const char* data = nullptr;
+        size_t len = 0;
+        const sockaddr* addr = nullptr;
+        socklen_t addrlen = 0;
+
+        Datagram() {}
+        Datagram(const void* d, size_t l, const sockaddr* a = nullptr, socklen_t al = 0)
+            :data((const char*)d), len(l), addr(a), addrlen(al) {}
+        Datagram(const void* d, size_t l, Address::ptr to)
+            :data((const char*)d), len(l), addr(to->getAddr()), addrlen(to->getAddrLen()) {}
+
+        Address::ptr getAddress() const { return Address::Create(addr, addrlen);}
+    };
+
+    /**
+     * @param[in] sock UDP socket, bound or connected
+     * @param[in] batch Datagrams per syscall, 0 for udp.batch_size
+     */
+    DatagramSocket(Socket::ptr sock, uint32_t batch = 0);
+    ~DatagramSocket();
+
+    DatagramSocket(const DatagramSocket&) = delete;
+    DatagramSocket& operator=(const DatagramSocket&) = delete;
+
+    /**
+     * @brief Receive what is queued, waiting while nothing is
+     * @details out is replaced with the datagrams; with GRO there can be
+     *          more than the batch size. Datagrams longer than
+     *          udp.max_datagram_size are dropped (see getTruncated()).
+     * @return Number of datagrams in out, -1 and errno on error (ETIMEDOUT
+     *         after the socket's receive timeout)
+     */
+    int recv(std::vector<Datagram>& out);
+
+    /**
+     * @brief Send count datagrams, waiting whenever the socket is full
+     * @return Datagrams sent, less than count if one failed; -1 and errno
+     *         if the first one did
+     */
+    int send(const Datagram* msgs, size_t count);
+    int send(const std::vector<Datagram>& msgs) { return send(msgs.data(), msgs.size());}
+
+    Socket::ptr getSocket() const { return m_sock;}
+    uint32_t getBatch() const { return m_batch;}
+
+    /**
+     * @brief Whether UDP_GRO / UDP_SEGMENT are in use
+     */
+    bool hasGRO() const { return m_gro;}
+    bool hasGSO() const { return m_gso;}
+
+    /**
+     * @name Counters, syscalls and the datagrams they moved
+     * @{
+     */
+    uint64_t getRecvCalls() const { return m_recvCalls;}
+    uint64_t getRecvDatagrams() const { return m_recvDatagrams;}
+    uint64_t getSendCalls() const { return m_sendCalls;}
+    uint64_t getSendDatagrams() const { return m_sendDatagrams;}
+    uint64_t getTruncated() const { return m_truncated;}
+    /** @} */
+
+    std::string toString() const;
+private:
+    /**
+     * @brief Fill up to m_batch send headers from the front of msgs,
+     *        m_sendCount gets the number used
+     */
+    void prepareSend(const Datagram* msgs, size_t count);
+private:
+    Socket::ptr m_sock;
+    uint32_t m_batch;
+    /// bytes per receive slot
+    size_t m_slotSize;
+    bool m_gro;
+    bool m_gso;
+
+    /// receive side, m_batch of each
+    char* m_slots;
+    std::vector<mmsghdr> m_recvHdrs;
+    std::vector<iovec> m_recvIovs;
+    std::vector<sockaddr_storage> m_recvAddrs;
+    std::vector<char> m_recvControl;
+
+    /// send side, m_batch headers, one iovec per datagram
+    std::vector<mmsghdr> m_sendHdrs;
+    std::vector<iovec> m_sendIovs;
+    std::vector<char> m_sendControl;
+    /// datagrams behind each send header
+    std::vector<uint32_t> m_sendSegs;
+    size_t m_sendCount;
+
+    uint64_t m_recvCalls;
+    uint64_t m_recvDatagrams;
+    uint64_t m_sendCalls;
+    uint64_t m_sendDatagrams;
+    uint64_t m_truncated;
+};
+
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "fd_manager.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace sylar {
+
+FdCtx::FdCtx(int fd)
+    :m_fd(fd) {
+    init();
+}
+
+FdCtx::~FdCtx() {
+}
+
+bool FdCtx::init() {
+    if(m_isInit) {
+        return true;
+    }
+    m_recvTimeout = -1;
+    m_sendTimeout = -1;
+
+    struct stat fd_stat;
+    if(-1 == fstat(m_fd, &fd_stat)) {
+        m_isInit = false;
+        m_isSocket = false;
+    } else {
+        m_isInit = true;
+        m_isSocket = S_ISSOCK(fd_stat.st_mode);
+    }
+
+    if(m_isSocket) {
+        int flags = fcntl(m_fd, F_GETFL, 0);
+        // whatever the user set before we saw the fd is the user's choice
+        m_userNonblock = flags & O_NONBLOCK;
+        if(!(flags & O_NONBLOCK)) {
+            fcntl(m_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        m_sysNonblock = true;
+    } else {
+        m_userNonblock = false;
+        m_sysNonblock = false;
+    }
+
+    m_isClosed = false;
+    return m_isInit;
+}
+
+void FdCtx::close() {
+    m_isClosed = true;
+    m_isInit = false;
+    m_isSocket = false;
+    m_sysNonblock = false;
+    m_userNonblock = false;
+    m_recvTimeout = -1;
+    m_sendTimeout = -1;
+}
+
+void FdCtx::setTimeout(int type, uint64_t v) {
+    if(type == SO_RCVTIMEO) {
+        m_recvTimeout = v;
+    } else {
+        m_sendTimeout = v;
+    }
+}
+
+uint64_t FdCtx::getTimeout(int type) {
+    if(type == SO_RCVTIMEO) {
+        return m_recvTimeout;
+    } else {
+        return m_sendTimeout;
+    }
+}
+
+FdCtx* FdManager::get(int fd, bool auto_create) {
+    FdCtx* ctx = m_table.get(fd);
+    if(ctx && !ctx->isClose()) {
+        return ctx;
+    }
+    if(!auto_create) {
+        return nullptr;
+    }
+
+    MutexType::Lock lock(m_mutex);
+    ctx = m_table.getOrCreate(fd, [fd](){ return new FdCtx(fd);});
+    if(ctx && ctx->isClose()) {
+        // the fd number has been handed out again, probe the new file
+        ctx->init();
+    }
+    return ctx;
+}
+
+void FdManager::del(int fd) {
+    FdCtx* ctx = m_table.get(fd);
+    if(!ctx) {
+        return;
+    }
+    MutexType::Lock lock(m_mutex);
+    ctx->close();
+}
+
+}
@@ -0,0 +1,145 @@
+#ifndef __SYLAR_FD_MANAGER_H__
+#define __SYLAR_FD_MANAGER_H__
+
+#include <memory>
+#include <atomic>
+#include <stdint.h>
+#include "thread.h"
+#include "singleton.h"
+#include "fd_table.h"
+
+namespace sylar {
+
+/**
+ * @brief File descriptor context
+ * @details Caches what the IO layer needs to know about an fd (is it a
+ *          socket, who asked for O_NONBLOCK, recv/send timeouts) so that
+ *          callers don't have to fstat/fcntl on every IO.
+ */
+class FdCtx {
+public:
+    /**
+     * @brief Construct and probe the fd
+     * @param[in] fd File descriptor
+     */
+    FdCtx(int fd);
+
+    ~FdCtx();
+
+    /**
+     * @brief Whether the fd has been probed successfully
+     */
+    bool isInit() const { return m_isInit;}
+
+    /**
+     * @brief Whether the fd is a socket
+     */
+    bool isSocket() const { return m_isSocket;}
+
+    /**
+     * @brief Whether the fd has been closed
+     */
+    bool isClose() const { return m_isClosed;}
+
+    /**
+     * @brief Record that the user explicitly asked for O_NONBLOCK
+     */
+    void setUserNonblock(bool v) { m_userNonblock = v;}
+
+    /**
+     * @brief Whether the user explicitly asked for O_NONBLOCK
+     */
+    bool getUserNonblock() const { return m_userNonblock;}
+
+    /**
+     * @brief Record that the framework put the fd into O_NONBLOCK
+     */
+    void setSysNonblock(bool v) { m_sysNonblock = v;}
+
+    /**
+     * @brief Whether the framework put the fd into O_NONBLOCK
+     */
+    bool getSysNonblock() const { return m_sysNonblock;}
+
+    /**
+     * @brief Set a timeout
+     * @param[in] type SO_RCVTIMEO or SO_SNDTIMEO
+     * @param[in] v Timeout in milliseconds, ~0ull means no timeout
+     */
+    void setTimeout(int type, uint64_t v);
+
+    /**
+     * @brief Get a timeout
+     * @param[in] type SO_RCVTIMEO or SO_SNDTIMEO
+     * @return Timeout in milliseconds, ~0ull means no timeout
+     */
+    uint64_t getTimeout(int type);
+
+private:
+    friend class FdManager;
+
+    /**
+     * @brief Probe the fd with fstat/fcntl
+     */
+    bool init();
+
+    /**
+     * @brief Mark the fd as closed so the slot can be reused
+     */
+    void close();
+private:
+    /// Whether the fd has been probed
+    std::atomic<bool> m_isInit = {false};
+    /// Whether the fd is a socket
+    std::atomic<bool> m_isSocket = {false};
+    /// Whether O_NONBLOCK was set by the framework
+    std::atomic<bool> m_sysNonblock = {false};
+    /// Whether O_NONBLOCK was asked for by the user
+    std::atomic<bool> m_userNonblock = {false};
+    /// Whether the fd has been closed
+    std::atomic<bool> m_isClosed = {false};
+    /// File descriptor
+    int m_fd;
+    /// Receive timeout in milliseconds
+    std::atomic<uint64_t> m_recvTimeout = {(uint64_t)-1};
+    /// Send timeout in milliseconds
+    std::atomic<uint64_t> m_sendTimeout = {(uint64_t)-1};
+};
+
+/**
+ * @brief File descriptor manager
+ * @details Contexts live in an FdTable, so lookups don't take any lock.
+ *          They are owned by the manager and are recycled instead of freed
+ *          when an fd is closed.
+ */
+class FdManager {
+public:
+    typedef Mutex MutexType;
+
+    /**
+     * @brief Get the context of an fd
+     * @param[in] fd File descriptor
+     * @param[in] auto_create Create the context if it doesn't exist yet
+     * @return Context, or nullptr if missing and auto_create is false
+     */
+    FdCtx* get(int fd, bool auto_create = false);
+
+    /**
+     * @brief Forget an fd, called when it is closed
+     * @param[in] fd File descriptor
+     */
+    void del(int fd);
+
+private:
+    /// Serializes context re-initialization and close
+    MutexType m_mutex;
+    /// fd -> context
+    FdTable<FdCtx> m_table;
+};
+
+/// FdManager singleton
+typedef Singleton<FdManager> FdMgr;
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef __SYLAR_FD_TABLE_H__
+#define __SYLAR_FD_TABLE_H__
+
+#include <atomic>
+#include <stddef.h>
+#include "thread.h"
+
+namespace sylar {
+
+/**
+ * @brief Table of per-fd objects indexed by fd
+ * @details Two levels: a fixed array of chunk pointers, each chunk a flat
+ *          array of object pointers. Growing only ever publishes a new chunk,
+ *          so slots never move and get() takes no lock, even while another
+ *          thread is growing the table. Objects are created lazily, on the
+ *          first getOrCreate() of their fd, and are owned by the table.
+ * @tparam T Object type
+ * @tparam CHUNK_SIZE Slots per chunk
+ * @tparam MAX_CHUNKS Number of chunks, the largest fd is CHUNK_SIZE * MAX_CHUNKS - 1
+ */
+template<class T, size_t CHUNK_SIZE = 1024, size_t MAX_CHUNKS = 1024>
+class FdTable {
+public:
+    typedef Mutex MutexType;
+
+    FdTable() {
+        for(size_t i = 0; i < MAX_CHUNKS; ++i) {
+            m_chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~FdTable() {
+        for(size_t i = 0; i < MAX_CHUNKS; ++i) {
+            Chunk* chunk = m_chunks[i].load(std::memory_order_relaxed);
+            if(!chunk) {
+                continue;
+            }
+            for(size_t j = 0; j < CHUNK_SIZE; ++j) {
+                delete chunk->slots[j].load(std::memory_order_relaxed);
+            }
+            delete chunk;
+        }
+    }
+
+    /**
+     * @brief Lock free lookup
+     * @return The object of fd, nullptr if it hasn't been created
+     */
+    T* get(int fd) const {
+        if(fd < 0 || (size_t)fd >= CHUNK_SIZE * MAX_CHUNKS) {
+            return nullptr;
+        }
+        Chunk* chunk = m_chunks[fd / CHUNK_SIZE].load(std::memory_order_acquire);
+        if(!chunk) {
+            return nullptr;
+        }
+        return chunk->slots[fd % CHUNK_SIZE].load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Lookup, creating the object with create() if it doesn't exist
+     * @details Creation is serialized, create() runs at most once per fd.
+     * @return The object of fd, nullptr if fd is out of range
+     */
+    template<class F>
+    T* getOrCreate(int fd, F create) {
+        T* obj = get(fd);
+        if(obj || fd < 0 || (size_t)fd >= CHUNK_SIZE * MAX_CHUNKS) {
+            return obj;
+        }
+        MutexType::Lock lock(m_mutex);
+        std::atomic<Chunk*>& c = m_chunks[fd / CHUNK_SIZE];
+        Chunk* chunk = c.load(std::memory_order_relaxed);
+        if(!chunk) {
+            chunk = new Chunk;
+            c.store(chunk, std::memory_order_release);
+        }
+        std::atomic<T*>& slot = chunk->slots[fd % CHUNK_SIZE];
+        obj = slot.load(std::memory_order_relaxed);
+        if(!obj) {
+            obj = create();
+            slot.store(obj, std::memory_order_release);
+        }
+        return obj;
+    }
+private:
+    struct Chunk {
+        std::atomic<T*> slots[CHUNK_SIZE];
+        Chunk() {
+            for(size_t i = 0; i < CHUNK_SIZE; ++i) {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+private:
+    /// Serializes chunk publishing and object creation
+    MutexType m_mutex;
+    /// Chunk table
+    std::atomic<Chunk*> m_chunks[MAX_CHUNKS];
+};
+
+}
+
+#endif
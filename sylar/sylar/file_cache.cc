@@ -0,0 +1,151 @@
+#include "file_cache.h"
+#include "config.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace sylar {
+
+static sylar::ConfigVar<uint32_t>::ptr g_file_cache_max_files =
+    sylar::Config::Lookup("file_cache.max_files", (uint32_t)1024
+            , "open files kept by FileCache");
+
+static sylar::ConfigVar<uint64_t>::ptr g_file_cache_check_interval =
+    sylar::Config::Lookup("file_cache.check_interval", (uint64_t)1000
+            , "ms between stat() checks of a cached file, 0 for every open");
+
+/**
+ * @brief Whether st describes the same file content as the cached one
+ */
+static bool same_file(const struct stat& a, const struct stat& b) {
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino
+        && a.st_size == b.st_size
+        && a.st_mtim.tv_sec == b.st_mtim.tv_sec
+        && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+CachedFile::CachedFile(int fd, const std::string& path, const struct stat& st)
+    :m_fd(fd)
+    ,m_path(path)
+    ,m_stat(st) {
+}
+
+CachedFile::~CachedFile() {
+    ::close(m_fd);
+}
+
+FileCache::FileCache() {
+}
+
+CachedFile::ptr FileCache::open(const std::string& path) {
+    uint64_t now = sylar::GetCurrentMS();
+    uint64_t interval = g_file_cache_check_interval->getValue();
+    CachedFile::ptr cached;
+    {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_files.find(path);
+        if(it != m_files.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+            if(interval && now - it->second.checkTime < interval) {
+                ++m_hits;
+                return it->second.file;
+            }
+            cached = it->second.file;
+        }
+    }
+
+    struct stat st;
+    if(::stat(path.c_str(), &st)) {
+        if(cached) {
+            invalidate(path);
+        }
+        return nullptr;
+    }
+    if(cached && same_file(st, cached->m_stat)) {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_files.find(path);
+        if(it != m_files.end() && it->second.file == cached) {
+            it->second.checkTime = now;
+        }
+        ++m_hits;
+        return cached;
+    }
+    if(!S_ISREG(st.st_mode)) {
+        if(cached) {
+            invalidate(path);
+        }
+        errno = S_ISDIR(st.st_mode) ? EISDIR : EACCES;
+        return nullptr;
+    }
+
+    ++m_misses;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return nullptr;
+    }
+    // what was opened, the path may have been replaced since stat()
+    if(fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        errno = EACCES;
+        return nullptr;
+    }
+    CachedFile::ptr file(new CachedFile(fd, path, st));
+    insert(path, file, now);
+    return file;
+}
+
+void FileCache::insert(const std::string& path, CachedFile::ptr file, uint64_t now) {
+    // dropped files are closed outside the lock, by their last owner
+    std::vector<CachedFile::ptr> dropped;
+    uint32_t max_files = g_file_cache_max_files->getValue();
+    MutexType::Lock lock(m_mutex);
+    auto it = m_files.find(path);
+    if(it != m_files.end()) {
+        dropped.push_back(it->second.file);
+        it->second.file = file;
+        it->second.checkTime = now;
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    } else {
+        m_lru.push_front(path);
+        Entry& e = m_files[path];
+        e.file = file;
+        e.checkTime = now;
+        e.lru = m_lru.begin();
+    }
+    while(m_files.size() > max_files && !m_lru.empty()) {
+        auto old = m_files.find(m_lru.back());
+        dropped.push_back(old->second.file);
+        m_files.erase(old);
+        m_lru.pop_back();
+    }
+    lock.unlock();
+}
+
+void FileCache::invalidate(const std::string& path) {
+    CachedFile::ptr file;
+    MutexType::Lock lock(m_mutex);
+    auto it = m_files.find(path);
+    if(it != m_files.end()) {
+        file = it->second.file;
+        m_lru.erase(it->second.lru);
+        m_files.erase(it);
+    }
+    lock.unlock();
+}
+
+void FileCache::clear() {
+    std::unordered_map<std::string, Entry> files;
+    MutexType::Lock lock(m_mutex);
+    files.swap(m_files);
+    m_lru.clear();
+    lock.unlock();
+}
+
+size_t FileCache::size() {
+    MutexType::Lock lock(m_mutex);
+    return m_files.size();
+}
+
+}
@@ -0,0 +1,100 @@
+#ifndef __SYLAR_FILE_CACHE_H__
+#define __SYLAR_FILE_CACHE_H__
+
+#include <memory>
+#include <string>
+#include <list>
+#include <atomic>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "singleton.h"
+#include "thread.h"
+
+namespace sylar {
+
+/**
+ * @brief Read only fd of a file, from FileCache
+ * @details Closed once the cache dropped it and the last user is done, so
+ *          a file being sent stays readable when it is replaced on disk.
+ */
+class CachedFile {
+friend class FileCache;
+public:
+    typedef std::shared_ptr<CachedFile> ptr;
+
+    ~CachedFile();
+
+    CachedFile(const CachedFile&) = delete;
+    CachedFile& operator=(const CachedFile&) = delete;
+
+    int getFd() const { return m_fd;}
+    const std::string& getPath() const { return m_path;}
+    uint64_t getSize() const { return m_stat.st_size;}
+    time_t getMtime() const { return m_stat.st_mtime;}
+    const struct stat& getStat() const { return m_stat;}
+private:
+    CachedFile(int fd, const std::string& path, const struct stat& st);
+private:
+    int m_fd;
+    std::string m_path;
+    /// From fstat() of m_fd when it was opened
+    struct stat m_stat;
+};
+
+/**
+ * @brief Open fds of regular files, by path
+ * @details Serving a hot file costs no open()/close() pair. An entry is
+ *          checked against stat() of its path at most every
+ *          file_cache.check_interval ms (0 for every open()) and reopened
+ *          if the inode, size or mtime changed. At most file_cache.max_files
+ *          entries are kept, the least recently used is dropped first.
+ */
+class FileCache {
+public:
+    typedef Mutex MutexType;
+
+    FileCache();
+
+    /**
+     * @brief The file at path, opened read only
+     * @return nullptr and errno set if it can't be opened, EISDIR for a
+     *         directory and EACCES for anything else that isn't a regular
+     *         file
+     */
+    CachedFile::ptr open(const std::string& path);
+
+    /**
+     * @brief Drop the entry of path, the next open() opens it again
+     */
+    void invalidate(const std::string& path);
+    void clear();
+
+    size_t size();
+    uint64_t getHits() const { return m_hits;}
+    uint64_t getMisses() const { return m_misses;}
+private:
+    struct Entry {
+        CachedFile::ptr file;
+        /// Last time the path was stat()ed
+        uint64_t checkTime;
+        std::list<std::string>::iterator lru;
+    };
+
+    /**
+     * @brief Add or replace the entry of path, evict over max_files
+     */
+    void insert(const std::string& path, CachedFile::ptr file, uint64_t now);
+private:
+    MutexType m_mutex;
+    std::unordered_map<std::string, Entry> m_files;
+    /// Most recently used at the front
+    std::list<std::string> m_lru;
+    std::atomic<uint64_t> m_hits = {0};
+    std::atomic<uint64_t> m_misses = {0};
+};
+
+typedef Singleton<FileCache> FileCacheMgr;
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include "file_io.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sstream>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_file_io_threads =
+    sylar::Config::Lookup("file_io.threads", (uint32_t)4
+            , "threads of the blocking file IO pool");
+
+static void update_max(std::atomic<uint64_t>& max, uint64_t v) {
+    uint64_t cur = max.load(std::memory_order_relaxed);
+    while(v > cur && !max.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+    }
+}
+
+std::string FileIOPool::Stats::toString() const {
+    std::stringstream ss;
+    ss << "submitted=" << submitted
+       << " completed=" << completed
+       << " queue_depth=" << queueDepth
+       << " max_queue_depth=" << maxQueueDepth
+       << " avg_wait_us=" << avgWaitUs()
+       << " max_wait_us=" << maxWaitUs
+       << " avg_run_us=" << avgRunUs()
+       << " max_run_us=" << maxRunUs;
+    return ss.str();
+}
+
+FileIOPool::FileIOPool(size_t threads, const std::string& name)
+    :m_name(name)
+    ,m_threadCount(threads ? threads : g_file_io_threads->getValue()) {
+    if(m_threadCount == 0) {
+        m_threadCount = 1;
+    }
+}
+
+FileIOPool::~FileIOPool() {
+    std::vector<Thread::ptr> thrs;
+    {
+        MutexType::Lock lock(m_mutex);
+        m_stopping = true;
+        thrs.swap(m_threads);
+    }
+    for(size_t i = 0; i < thrs.size(); ++i) {
+        m_sem.notify();
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+}
+
+void FileIOPool::start() {
+    // m_mutex held
+    m_threads.resize(m_threadCount);
+    for(size_t i = 0; i < m_threadCount; ++i) {
+        m_threads[i].reset(new Thread(std::bind(&FileIOPool::worker, this)
+                            , m_name + "_" + std::to_string(i)));
+    }
+}
+
+int64_t FileIOPool::run(std::function<int64_t()> op) {
+    Scheduler* scheduler = Scheduler::GetThis();
+    if(!scheduler) {
+        return op();
+    }
+
+    Task task;
+    task.op.swap(op);
+    task.scheduler = scheduler;
+    task.fiber = Fiber::GetThis();
+    task.submitUs = sylar::GetCurrentUS();
+    {
+        MutexType::Lock lock(m_mutex);
+        SYLAR_ASSERT(!m_stopping);
+        if(m_threads.empty()) {
+            start();
+        }
+        m_tasks.push_back(&task);
+        update_max(m_maxQueueDepth, m_tasks.size());
+    }
+    ++m_submitted;
+    // keeps the scheduler from stopping while the fiber is away
+    scheduler->beginExternalWait();
+    m_sem.notify();
+
+    // rescheduling the fiber before it is off its thread is fine, the
+    // scheduler doesn't resume it while it is still running
+    Fiber::YieldToHold();
+    scheduler->endExternalWait();
+    errno = task.error;
+    return task.result;
+}
+
+void FileIOPool::worker() {
+    while(true) {
+        m_sem.wait();
+        Task* task = nullptr;
+        {
+            MutexType::Lock lock(m_mutex);
+            if(m_tasks.empty()) {
+                if(m_stopping) {
+                    return;
+                }
+                continue;
+            }
+            task = m_tasks.front();
+            m_tasks.pop_front();
+        }
+
+        uint64_t start = sylar::GetCurrentUS();
+        uint64_t wait = start - task->submitUs;
+        errno = 0;
+        task->result = task->op();
+        task->error = errno;
+        uint64_t used = sylar::GetCurrentUS() - start;
+
+        m_totalWaitUs += wait;
+        update_max(m_maxWaitUs, wait);
+        m_totalRunUs += used;
+        update_max(m_maxRunUs, used);
+        ++m_completed;
+        if(used > 1000 * 1000) {
+            SYLAR_LOG_WARN(g_logger) << m_name << " file operation took " << used / 1000 << "ms";
+        }
+
+        // task is gone once the fiber runs again
+        Scheduler* scheduler = task->scheduler;
+        Fiber::ptr fiber;
+        fiber.swap(task->fiber);
+        scheduler->schedule(fiber);
+    }
+}
+
+FileIOPool::Stats FileIOPool::getStats() const {
+    Stats stats;
+    stats.submitted = m_submitted;
+    stats.completed = m_completed;
+    {
+        MutexType::Lock lock(m_mutex);
+        stats.queueDepth = m_tasks.size();
+    }
+    stats.maxQueueDepth = m_maxQueueDepth;
+    stats.totalWaitUs = m_totalWaitUs;
+    stats.maxWaitUs = m_maxWaitUs;
+    stats.totalRunUs = m_totalRunUs;
+    stats.maxRunUs = m_maxRunUs;
+    return stats;
+}
+
+ssize_t FileIOPool::read(int fd, void* buf, size_t count) {
+    return run([=](){ return (int64_t)::read(fd, buf, count);});
+}
+
+ssize_t FileIOPool::write(int fd, const void* buf, size_t count) {
+    return run([=](){ return (int64_t)::write(fd, buf, count);});
+}
+
+ssize_t FileIOPool::pread(int fd, void* buf, size_t count, off_t offset) {
+    return run([=](){ return (int64_t)::pread(fd, buf, count, offset);});
+}
+
+ssize_t FileIOPool::pwrite(int fd, const void* buf, size_t count, off_t offset) {
+    return run([=](){ return (int64_t)::pwrite(fd, buf, count, offset);});
+}
+
+int FileIOPool::fsync(int fd) {
+    return run([=](){ return (int64_t)::fsync(fd);});
+}
+
+int FileIOPool::fdatasync(int fd) {
+    return run([=](){ return (int64_t)::fdatasync(fd);});
+}
+
+int FileIOPool::open(const std::string& path, int flags, mode_t mode) {
+    return run([&path, flags, mode](){ return (int64_t)::open(path.c_str(), flags | O_CLOEXEC, mode);});
+}
+
+int FileIOPool::close(int fd) {
+    return run([=](){ return (int64_t)::close(fd);});
+}
+
+int FileIOPool::stat(const std::string& path, struct stat* st) {
+    return run([&path, st](){ return (int64_t)::stat(path.c_str(), st);});
+}
+
+}
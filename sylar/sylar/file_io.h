@@ -0,0 +1,135 @@
+#ifndef __SYLAR_FILE_IO_H__
+#define __SYLAR_FILE_IO_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <list>
+#include <atomic>
+#include <functional>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "fiber.h"
+#include "scheduler.h"
+#include "singleton.h"
+#include "thread.h"
+
+namespace sylar {
+
+/**
+ * @brief Threads that run blocking file operations for fibers
+ * @details Regular files are always "ready" to epoll, so read/write/fsync
+ *          on them block whatever thread calls them, and with it every
+ *          fiber queued on that worker. Here the calling fiber queues the
+ *          operation and yields; a pool thread runs it and schedules the
+ *          fiber back on the Scheduler it came from. Called outside a
+ *          Scheduler the operation just runs in place.
+ *          The threads (file_io.threads of them for FileIOMgr) are started
+ *          by the first operation.
+ */
+class FileIOPool {
+public:
+    typedef Mutex MutexType;
+
+    /**
+     * @brief Queue and latency statistics
+     */
+    struct Stats {
+        /// operations queued and finished so far
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        /// waiting for a thread right now, and the most there have been
+        uint64_t queueDepth = 0;
+        uint64_t maxQueueDepth = 0;
+        /// time from submit until a thread picked the operation up, in us
+        uint64_t totalWaitUs = 0;
+        uint64_t maxWaitUs = 0;
+        /// time the operation itself took, in us
+        uint64_t totalRunUs = 0;
+        uint64_t maxRunUs = 0;
+
+        double avgWaitUs() const { return completed ? (double)totalWaitUs / completed : 0;}
+        double avgRunUs() const { return completed ? (double)totalRunUs / completed : 0;}
+        std::string toString() const;
+    };
+
+    /**
+     * @param[in] threads Pool size, 0 for file_io.threads
+     */
+    FileIOPool(size_t threads = 0, const std::string& name = "file_io");
+
+    /**
+     * @brief Runs what is still queued, then joins the threads
+     */
+    ~FileIOPool();
+
+    FileIOPool(const FileIOPool&) = delete;
+    FileIOPool& operator=(const FileIOPool&) = delete;
+
+    /**
+     * @brief Run op on a pool thread, suspending the calling fiber meanwhile
+     * @param[in] op Returns like a syscall, errno is carried back with it
+     * @return What op returned, errno as op left it
+     */
+    int64_t run(std::function<int64_t()> op);
+
+    /**
+     * @name The syscalls through run()
+     * @{
+     */
+    ssize_t read(int fd, void* buf, size_t count);
+    ssize_t write(int fd, const void* buf, size_t count);
+    ssize_t pread(int fd, void* buf, size_t count, off_t offset);
+    ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset);
+    int fsync(int fd);
+    int fdatasync(int fd);
+    int open(const std::string& path, int flags, mode_t mode = 0644);
+    int close(int fd);
+    int stat(const std::string& path, struct stat* st);
+    /** @} */
+
+    Stats getStats() const;
+    size_t getThreadCount() const { return m_threadCount;}
+    const std::string& getName() const { return m_name;}
+private:
+    /**
+     * @brief An operation, living on the stack of the fiber that waits for it
+     */
+    struct Task {
+        std::function<int64_t()> op;
+        Scheduler* scheduler = nullptr;
+        Fiber::ptr fiber;
+        uint64_t submitUs = 0;
+        int64_t result = 0;
+        int error = 0;
+    };
+
+    void start();
+    void worker();
+private:
+    std::string m_name;
+    size_t m_threadCount;
+    std::vector<Thread::ptr> m_threads;
+    bool m_stopping = false;
+
+    mutable MutexType m_mutex;
+    std::list<Task*> m_tasks;
+    Semaphore m_sem;
+
+    std::atomic<uint64_t> m_submitted = {0};
+    std::atomic<uint64_t> m_completed = {0};
+    std::atomic<uint64_t> m_maxQueueDepth = {0};
+    std::atomic<uint64_t> m_totalWaitUs = {0};
+    std::atomic<uint64_t> m_maxWaitUs = {0};
+    std::atomic<uint64_t> m_totalRunUs = {0};
+    std::atomic<uint64_t> m_maxRunUs = {0};
+};
+
+/**
+ * @brief The process wide pool
+ */
+typedef Singleton<FileIOPool> FileIOMgr;
+
+}
+
+#endif
@@ -0,0 +1,246 @@
+#include "http.h"
+#include <sstream>
+#include <inttypes.h>
+
+namespace sylar {
+namespace http {
+
+HttpMethod StringToHttpMethod(const char* m, size_t len) {
+#define XX(num, name, string) \
+    if(len == sizeof(#string) - 1 && memcmp(#string, m, len) == 0) { \
+        return HttpMethod::name; \
+    }
+    HTTP_METHOD_MAP(XX);
+#undef XX
+    return HttpMethod::INVALID_METHOD;
+}
+
+static const char* s_method_string[] = {
+#define XX(num, name, string) #string,
+    HTTP_METHOD_MAP(XX)
+#undef XX
+};
+
+const char* HttpMethodToString(const HttpMethod& m) {
+    uint32_t idx = (uint32_t)m;
+    if(idx >= (sizeof(s_method_string) / sizeof(s_method_string[0]))) {
+        return "<unknown>";
+    }
+    return s_method_string[idx];
+}
+
+const char* HttpStatusToString(const HttpStatus& s) {
+    switch(s) {
+#define XX(code, name, msg) \
+        case HttpStatus::name: \
+            return #msg;
+        HTTP_STATUS_MAP(XX);
+#undef XX
+        default:
+            return "<unknown>";
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, const StringView& v) {
+    return os.write(v.ptr, v.len);
+}
+
+bool HeaderHasToken(const StringView& value, const StringView& token) {
+    const char* p = value.ptr;
+    const char* end = value.ptr + value.len;
+    while(p < end) {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            ++p;
+        }
+        const char* start = p;
+        while(p < end && *p != ',') {
+            ++p;
+        }
+        const char* last = p;
+        while(last > start && (last[-1] == ' ' || last[-1] == '\t')) {
+            --last;
+        }
+        if(StringView(start, last - start).iequals(token)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+HttpRequest::HttpRequest()
+    :m_method(HttpMethod::GET)
+    ,m_version(0x11)
+    ,m_close(false)
+    ,m_chunked(false) {
+}
+
+StringView HttpRequest::getHeader(const StringView& name, const StringView& def) const {
+    for(auto& i : m_headers) {
+        if(i.first.iequals(name)) {
+            return i.second;
+        }
+    }
+    return def;
+}
+
+bool HttpRequest::hasHeader(const StringView& name) const {
+    for(auto& i : m_headers) {
+        if(i.first.iequals(name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HttpRequest::reset() {
+    m_method = HttpMethod::GET;
+    m_version = 0x11;
+    m_close = false;
+    m_chunked = false;
+    m_uri = m_path = m_query = m_fragment = m_body = StringView();
+    m_headers.clear();
+}
+
+std::ostream& HttpRequest::dump(std::ostream& os) const {
+    os << HttpMethodToString(m_method) << " "
+       << m_uri
+       << " HTTP/"
+       << ((uint32_t)(m_version >> 4))
+       << "."
+       << ((uint32_t)(m_version & 0x0F))
+       << "\r\n";
+    for(auto& i : m_headers) {
+        os << i.first << ": " << i.second << "\r\n";
+    }
+    os << "\r\n" << m_body;
+    return os;
+}
+
+std::string HttpRequest::toString() const {
+    std::stringstream ss;
+    dump(ss);
+    return ss.str();
+}
+
+HttpResponse::HttpResponse(uint8_t version, bool close)
+    :m_status(HttpStatus::OK)
+    ,m_version(version)
+    ,m_close(close)
+    ,m_chunked(false)
+    ,m_fileOffset(0)
+    ,m_fileLength(0) {
+}
+
+void HttpResponse::setFile(std::shared_ptr<CachedFile> file, uint64_t offset, uint64_t length) {
+    m_file = file;
+    m_fileOffset = offset;
+    m_fileLength = length;
+}
+
+void HttpResponse::setHeader(const std::string& name, const std::string& value) {
+    for(auto& i : m_headers) {
+        if(!strcasecmp(i.first.c_str(), name.c_str())) {
+            i.second = value;
+            return;
+        }
+    }
+    m_headers.push_back(std::make_pair(name, value));
+}
+
+void HttpResponse::addHeader(const std::string& name, const std::string& value) {
+    m_headers.push_back(std::make_pair(name, value));
+}
+
+std::string HttpResponse::getHeader(const std::string& name, const std::string& def) const {
+    for(auto& i : m_headers) {
+        if(!strcasecmp(i.first.c_str(), name.c_str())) {
+            return i.second;
+        }
+    }
+    return def;
+}
+
+void HttpResponse::delHeader(const std::string& name) {
+    for(auto it = m_headers.begin(); it != m_headers.end();) {
+        if(!strcasecmp(it->first.c_str(), name.c_str())) {
+            it = m_headers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void HttpResponse::encode(std::string& out, bool head) const {
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "HTTP/%u.%u %u ", (uint32_t)(m_version >> 4)
+                    , (uint32_t)(m_version & 0x0F), (uint32_t)m_status);
+    out.append(buf, n);
+    if(m_reason.empty()) {
+        out.append(HttpStatusToString(m_status));
+    } else {
+        out.append(m_reason);
+    }
+    out.append("\r\n");
+
+    for(auto& i : m_headers) {
+        if(!strcasecmp(i.first.c_str(), "connection")
+                || !strcasecmp(i.first.c_str(), "content-length")
+                || !strcasecmp(i.first.c_str(), "transfer-encoding")) {
+            continue;
+        }
+        out.append(i.first);
+        out.append(": ");
+        out.append(i.second);
+        out.append("\r\n");
+    }
+    out.append(m_close ? "Connection: close\r\n" : "Connection: keep-alive\r\n");
+
+    uint32_t code = (uint32_t)m_status;
+    if((code >= 100 && code < 200) || code == 204 || code == 304) {
+        // never carry a body
+        out.append("\r\n");
+    } else if(m_file) {
+        n = snprintf(buf, sizeof(buf), "Content-Length: %" PRIu64 "\r\n\r\n", m_fileLength);
+        out.append(buf, n);
+    } else if(m_chunked) {
+        out.append("Transfer-Encoding: chunked\r\n\r\n");
+        if(!head) {
+            if(!m_body.empty()) {
+                n = snprintf(buf, sizeof(buf), "%zx\r\n", m_body.size());
+                out.append(buf, n);
+                out.append(m_body);
+                out.append("\r\n");
+            }
+            out.append("0\r\n\r\n");
+        }
+    } else {
+        n = snprintf(buf, sizeof(buf), "Content-Length: %zu\r\n\r\n", m_body.size());
+        out.append(buf, n);
+        if(!head) {
+            out.append(m_body);
+        }
+    }
+}
+
+std::ostream& HttpResponse::dump(std::ostream& os) const {
+    std::string str;
+    encode(str);
+    return os << str;
+}
+
+std::string HttpResponse::toString() const {
+    std::string str;
+    encode(str);
+    return str;
+}
+
+std::ostream& operator<<(std::ostream& os, const HttpRequest& req) {
+    return req.dump(os);
+}
+
+std::ostream& operator<<(std::ostream& os, const HttpResponse& rsp) {
+    return rsp.dump(os);
+}
+
+}
+}
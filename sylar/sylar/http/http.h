@@ -0,0 +1,284 @@
+#ifndef __SYLAR_HTTP_HTTP_H__
+#define __SYLAR_HTTP_HTTP_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <string.h>
+#include <strings.h>
+
+namespace sylar {
+
+class CachedFile;
+
+namespace http {
+
+/* Request Methods */
+#define HTTP_METHOD_MAP(XX)         \
+  XX(0,  DELETE,      DELETE)       \
+  XX(1,  GET,         GET)          \
+  XX(2,  HEAD,        HEAD)         \
+  XX(3,  POST,        POST)         \
+  XX(4,  PUT,         PUT)          \
+  XX(5,  CONNECT,     CONNECT)      \
+  XX(6,  OPTIONS,     OPTIONS)      \
+  XX(7,  TRACE,       TRACE)        \
+  XX(8,  PATCH,       PATCH)        \
+
+/* Status Codes */
+#define HTTP_STATUS_MAP(XX)                                                 \
+  XX(100, CONTINUE,                        Continue)                        \
+  XX(101, SWITCHING_PROTOCOLS,             Switching Protocols)             \
+  XX(200, OK,                              OK)                              \
+  XX(201, CREATED,                         Created)                         \
+  XX(202, ACCEPTED,                        Accepted)                        \
+  XX(204, NO_CONTENT,                      No Content)                      \
+  XX(206, PARTIAL_CONTENT,                 Partial Content)                 \
+  XX(301, MOVED_PERMANENTLY,               Moved Permanently)               \
+  XX(302, FOUND,                           Found)                           \
+  XX(304, NOT_MODIFIED,                    Not Modified)                    \
+  XX(400, BAD_REQUEST,                     Bad Request)                     \
+  XX(401, UNAUTHORIZED,                    Unauthorized)                    \
+  XX(403, FORBIDDEN,                       Forbidden)                       \
+  XX(404, NOT_FOUND,                       Not Found)                       \
+  XX(405, METHOD_NOT_ALLOWED,              Method Not Allowed)              \
+  XX(408, REQUEST_TIMEOUT,                 Request Timeout)                 \
+  XX(411, LENGTH_REQUIRED,                 Length Required)                 \
+  XX(413, PAYLOAD_TOO_LARGE,               Payload Too Large)               \
+  XX(414, URI_TOO_LONG,                    URI Too Long)                    \
+  XX(416, RANGE_NOT_SATISFIABLE,           Range Not Satisfiable)           \
+  XX(431, REQUEST_HEADER_FIELDS_TOO_LARGE, Request Header Fields Too Large) \
+  XX(500, INTERNAL_SERVER_ERROR,           Internal Server Error)           \
+  XX(501, NOT_IMPLEMENTED,                 Not Implemented)                 \
+  XX(502, BAD_GATEWAY,                     Bad Gateway)                     \
+  XX(503, SERVICE_UNAVAILABLE,             Service Unavailable)             \
+  XX(504, GATEWAY_TIMEOUT,                 Gateway Timeout)                 \
+  XX(505, HTTP_VERSION_NOT_SUPPORTED,      HTTP Version Not Supported)      \
+
+enum class HttpMethod {
+#define XX(num, name, string) name = num,
+    HTTP_METHOD_MAP(XX)
+#undef XX
+    INVALID_METHOD
+};
+
+enum class HttpStatus {
+#define XX(code, name, desc) name = code,
+    HTTP_STATUS_MAP(XX)
+#undef XX
+};
+
+HttpMethod StringToHttpMethod(const char* m, size_t len);
+const char* HttpMethodToString(const HttpMethod& m);
+const char* HttpStatusToString(const HttpStatus& s);
+
+/**
+ * @brief Non owning view of a piece of a buffer
+ * @details What the parser hands out instead of copies. Only valid as long
+ *          as the buffer it points into.
+ */
+struct StringView {
+    StringView()
+        :ptr(nullptr)
+        ,len(0) {
+    }
+
+    StringView(const char* p, size_t l)
+        :ptr(p)
+        ,len(l) {
+    }
+
+    StringView(const char* p)
+        :ptr(p)
+        ,len(strlen(p)) {
+    }
+
+    StringView(const std::string& s)
+        :ptr(s.c_str())
+        ,len(s.size()) {
+    }
+
+    bool empty() const { return len == 0;}
+    const char* data() const { return ptr;}
+    size_t size() const { return len;}
+    std::string str() const { return std::string(ptr, len);}
+
+    bool operator==(const StringView& rhs) const {
+        return len == rhs.len && (len == 0 || !memcmp(ptr, rhs.ptr, len));
+    }
+    bool operator!=(const StringView& rhs) const { return !(*this == rhs);}
+
+    /**
+     * @brief ASCII case insensitive compare, for header names and tokens
+     */
+    bool iequals(const StringView& rhs) const {
+        return len == rhs.len && (len == 0 || !strncasecmp(ptr, rhs.ptr, len));
+    }
+
+    const char* ptr;
+    size_t len;
+};
+
+std::ostream& operator<<(std::ostream& os, const StringView& v);
+
+/**
+ * @brief Whether the comma separated header value list contains token
+ *        (case insensitive), "keep-alive, Upgrade" contains "upgrade"
+ */
+bool HeaderHasToken(const StringView& value, const StringView& token);
+
+/**
+ * @brief HTTP request
+ * @details Everything but the body of a chunked request is a view into the
+ *          buffer the request was parsed from, see HttpRequestParser.
+ */
+class HttpRequest {
+public:
+    typedef std::shared_ptr<HttpRequest> ptr;
+    typedef std::pair<StringView, StringView> Header;
+
+    HttpRequest();
+
+    HttpMethod getMethod() const { return m_method;}
+    /// 0x11 for HTTP/1.1, 0x10 for HTTP/1.0
+    uint8_t getVersion() const { return m_version;}
+    const StringView& getUri() const { return m_uri;}
+    const StringView& getPath() const { return m_path;}
+    const StringView& getQuery() const { return m_query;}
+    const StringView& getFragment() const { return m_fragment;}
+    const StringView& getBody() const { return m_body;}
+    const std::vector<Header>& getHeaders() const { return m_headers;}
+
+    /**
+     * @brief First header called name (case insensitive)
+     */
+    StringView getHeader(const StringView& name, const StringView& def = StringView()) const;
+    bool hasHeader(const StringView& name) const;
+
+    /**
+     * @brief Whether the connection has to be closed after the response:
+     *        HTTP/1.1 unless "Connection: close", HTTP/1.0 unless
+     *        "Connection: keep-alive"
+     */
+    bool isClose() const { return m_close;}
+    bool isChunked() const { return m_chunked;}
+
+    void setMethod(HttpMethod v) { m_method = v;}
+    void setVersion(uint8_t v) { m_version = v;}
+    void setUri(const StringView& v) { m_uri = v;}
+    void setPath(const StringView& v) { m_path = v;}
+    void setQuery(const StringView& v) { m_query = v;}
+    void setFragment(const StringView& v) { m_fragment = v;}
+    void setBody(const StringView& v) { m_body = v;}
+    void setClose(bool v) { m_close = v;}
+    void setChunked(bool v) { m_chunked = v;}
+    void addHeader(const StringView& name, const StringView& value) {
+        m_headers.push_back(std::make_pair(name, value));
+    }
+
+    /**
+     * @brief Forget everything, keeps the header vector's capacity
+     */
+    void reset();
+
+    std::ostream& dump(std::ostream& os) const;
+    std::string toString() const;
+private:
+    HttpMethod m_method;
+    uint8_t m_version;
+    bool m_close;
+    bool m_chunked;
+    StringView m_uri;
+    StringView m_path;
+    StringView m_query;
+    StringView m_fragment;
+    StringView m_body;
+    std::vector<Header> m_headers;
+};
+
+/**
+ * @brief HTTP response
+ * @details Owns its data, servlets fill it in and the server encodes it.
+ */
+class HttpResponse {
+public:
+    typedef std::shared_ptr<HttpResponse> ptr;
+    typedef std::pair<std::string, std::string> Header;
+
+    HttpResponse(uint8_t version = 0x11, bool close = false);
+
+    HttpStatus getStatus() const { return m_status;}
+    uint8_t getVersion() const { return m_version;}
+    const std::string& getBody() const { return m_body;}
+    const std::string& getReason() const { return m_reason;}
+    const std::vector<Header>& getHeaders() const { return m_headers;}
+
+    void setStatus(HttpStatus v) { m_status = v;}
+    void setVersion(uint8_t v) { m_version = v;}
+    void setBody(const std::string& v) { m_body = v;}
+    void appendBody(const char* data, size_t len) { m_body.append(data, len);}
+    void setReason(const std::string& v) { m_reason = v;}
+
+    /**
+     * @brief Replace the header called name, add it if there's none
+     */
+    void setHeader(const std::string& name, const std::string& value);
+    /**
+     * @brief Add a header, even if one with that name exists
+     */
+    void addHeader(const std::string& name, const std::string& value);
+    std::string getHeader(const std::string& name, const std::string& def = "") const;
+    void delHeader(const std::string& name);
+
+    bool isClose() const { return m_close;}
+    void setClose(bool v) { m_close = v;}
+
+    /**
+     * @brief Send the body with Transfer-Encoding: chunked instead of
+     *        Content-Length
+     */
+    bool isChunked() const { return m_chunked;}
+    void setChunked(bool v) { m_chunked = v;}
+
+    /**
+     * @brief Send length bytes of file from offset as the body instead of
+     *        getBody(), the session hands them to Socket::sendFile()
+     */
+    void setFile(std::shared_ptr<CachedFile> file, uint64_t offset, uint64_t length);
+    std::shared_ptr<CachedFile> getFile() const { return m_file;}
+    uint64_t getFileOffset() const { return m_fileOffset;}
+    uint64_t getFileLength() const { return m_fileLength;}
+
+    /**
+     * @brief Append the wire form to out
+     * @details Connection and Content-Length/Transfer-Encoding are written
+     *          from isClose()/isChunked(), headers of those names are
+     *          skipped. With a file the head is all there is to append and
+     *          Content-Length is the file range's.
+     * @param[in] head Answer to a HEAD request, leave the body out
+     */
+    void encode(std::string& out, bool head = false) const;
+
+    std::ostream& dump(std::ostream& os) const;
+    std::string toString() const;
+private:
+    HttpStatus m_status;
+    uint8_t m_version;
+    bool m_close;
+    bool m_chunked;
+    std::string m_body;
+    std::string m_reason;
+    std::vector<Header> m_headers;
+    std::shared_ptr<CachedFile> m_file;
+    uint64_t m_fileOffset;
+    uint64_t m_fileLength;
+};
+
+std::ostream& operator<<(std::ostream& os, const HttpRequest& req);
+std::ostream& operator<<(std::ostream& os, const HttpResponse& rsp);
+
+}
+}
+
+#endif
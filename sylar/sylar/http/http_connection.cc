@@ -0,0 +1,227 @@
+#include "http_connection.h"
+#include "sylar/log.h"
+#include "sylar/util.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <sstream>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+std::string HttpResult::toString() const {
+    std::stringstream ss;
+    ss << "[HttpResult result=" << (int)result
+       << " error=" << error
+       << " response=" << (response ? response->toString() : "nullptr")
+       << "]";
+    return ss.str();
+}
+
+HttpConnection::HttpConnection(Socket::ptr sock)
+    :m_sock(sock)
+    ,m_cap(HttpResponseParser::GetHttpResponseBufferSize())
+    ,m_end(0) {
+    if(m_cap < 512) {
+        m_cap = 512;
+    }
+    m_buf = (char*)malloc(m_cap);
+}
+
+HttpConnection::~HttpConnection() {
+    free(m_buf);
+}
+
+void HttpConnection::EncodeRequest(std::string& out, HttpMethod method
+                                   ,const std::string& host, const std::string& uri
+                                   ,const std::map<std::string, std::string>& headers
+                                   ,const std::string& body) {
+    out.append(HttpMethodToString(method));
+    out.append(" ");
+    out.append(uri.empty() ? "/" : uri);
+    out.append(" HTTP/1.1\r\n");
+    bool has_host = false;
+    bool has_connection = false;
+    for(auto& i : headers) {
+        if(!strcasecmp(i.first.c_str(), "content-length")
+                || !strcasecmp(i.first.c_str(), "transfer-encoding")) {
+            continue;
+        }
+        if(!strcasecmp(i.first.c_str(), "host")) {
+            has_host = true;
+        } else if(!strcasecmp(i.first.c_str(), "connection")) {
+            has_connection = true;
+        }
+        out.append(i.first);
+        out.append(": ");
+        out.append(i.second);
+        out.append("\r\n");
+    }
+    if(!has_host) {
+        out.append("Host: ");
+        out.append(host);
+        out.append("\r\n");
+    }
+    if(!has_connection) {
+        out.append("Connection: keep-alive\r\n");
+    }
+    if(!body.empty() || method == HttpMethod::POST || method == HttpMethod::PUT) {
+        out.append("Content-Length: ");
+        out.append(std::to_string(body.size()));
+        out.append("\r\n");
+    }
+    out.append("\r\n");
+    out.append(body);
+}
+
+int HttpConnection::sendRequest(const std::string& data) {
+    m_parser.reset();
+    m_end = 0;
+    size_t offset = 0;
+    while(offset < data.size()) {
+        int rt = m_sock->send(data.c_str() + offset, data.size() - offset);
+        if(rt <= 0) {
+            return rt;
+        }
+        offset += rt;
+    }
+    return offset;
+}
+
+HttpResponse::ptr HttpConnection::recvResponse(bool head) {
+    m_parser.setHeadResponse(head);
+    while(true) {
+        if(m_end > 0 && m_parser.execute(m_buf, m_end)) {
+            return m_parser.getResponse();
+        }
+        if(m_parser.hasError()) {
+            SYLAR_LOG_DEBUG(g_logger) << "bad http response error=" << m_parser.getError()
+                << " " << *m_sock;
+            return nullptr;
+        }
+        if(m_end == m_cap) {
+            m_cap *= 2;
+            m_buf = (char*)realloc(m_buf, m_cap);
+        }
+        int rt = m_sock->recv(m_buf + m_end, m_cap - m_end);
+        if(rt == 0) {
+            // a response without length ends with the connection
+            return m_parser.finishOnEof(m_buf) ? m_parser.getResponse() : nullptr;
+        }
+        if(rt < 0) {
+            return nullptr;
+        }
+        m_end += rt;
+    }
+}
+
+static bool is_idempotent(HttpMethod method) {
+    return method != HttpMethod::POST && method != HttpMethod::PATCH
+        && method != HttpMethod::CONNECT;
+}
+
+HttpConnectionPool::HttpConnectionPool(ConnectionPool::ptr pool)
+    :m_pool(pool) {
+    if(!m_pool) {
+        m_pool.reset(new ConnectionPool);
+    }
+}
+
+HttpResult::ptr HttpConnectionPool::doGet(const std::string& host, const std::string& uri
+                                          ,uint64_t timeout_ms
+                                          ,const std::map<std::string, std::string>& headers
+                                          ,const std::string& body) {
+    return doRequest(HttpMethod::GET, host, uri, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnectionPool::doPost(const std::string& host, const std::string& uri
+                                           ,uint64_t timeout_ms
+                                           ,const std::map<std::string, std::string>& headers
+                                           ,const std::string& body) {
+    return doRequest(HttpMethod::POST, host, uri, timeout_ms, headers, body);
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method
+                                              ,const std::string& host, const std::string& uri
+                                              ,uint64_t timeout_ms
+                                              ,const std::map<std::string, std::string>& headers
+                                              ,const std::string& body) {
+    std::string data;
+    HttpConnection::EncodeRequest(data, method, host, uri, headers, body);
+
+    uint64_t start = sylar::GetCurrentMS();
+    for(int attempt = 0; ; ++attempt) {
+        uint64_t left = -1;
+        if(timeout_ms != (uint64_t)-1) {
+            uint64_t used = sylar::GetCurrentMS() - start;
+            if(used >= timeout_ms) {
+                return std::make_shared<HttpResult>(HttpResult::Error::TIMEOUT
+                        , nullptr, "timeout before the request was sent to " + host);
+            }
+            left = timeout_ms - used;
+        }
+
+        PooledConnection::ptr conn = m_pool->acquire(host, left);
+        if(!conn) {
+            return std::make_shared<HttpResult>(HttpResult::Error::POOL_GET_CONNECTION
+                    , nullptr, "no connection to " + host);
+        }
+        Socket::ptr sock = conn->getSocket();
+        sock->setRecvTimeout(left);
+        sock->setSendTimeout(left);
+
+        HttpConnection client(sock);
+        errno = 0;
+        int rt = client.sendRequest(data);
+        HttpResponse::ptr rsp;
+        if(rt > 0) {
+            rsp = client.recvResponse(method == HttpMethod::HEAD);
+        }
+        if(rsp) {
+            if(rsp->isClose() || client.hasLeftover()) {
+                conn->markBad();
+            }
+            return std::make_shared<HttpResult>(HttpResult::Error::OK, rsp, "ok");
+        }
+
+        int error = errno;
+        conn->markBad();
+        if(attempt == 0 && conn->isReused() && client.getReceived() == 0
+                && !client.hasParseError() && error != ETIMEDOUT
+                && is_idempotent(method)) {
+            SYLAR_LOG_DEBUG(g_logger) << "reused connection to " << host
+                << " failed, retry on a new one errno=" << error;
+            continue;
+        }
+
+        if(rt == 0) {
+            return std::make_shared<HttpResult>(HttpResult::Error::SEND_CLOSE_BY_PEER
+                    , nullptr, "send request closed by peer " + host);
+        }
+        if(rt < 0) {
+            return std::make_shared<HttpResult>(
+                    error == ETIMEDOUT ? HttpResult::Error::TIMEOUT : HttpResult::Error::SEND_SOCKET_ERROR
+                    , nullptr, std::string("send request socket error errno=")
+                    + std::to_string(error) + " errstr=" + strerror(error));
+        }
+        if(client.hasParseError()) {
+            return std::make_shared<HttpResult>(HttpResult::Error::PARSE_ERROR
+                    , nullptr, "bad response from " + host);
+        }
+        if(error == ETIMEDOUT) {
+            return std::make_shared<HttpResult>(HttpResult::Error::TIMEOUT
+                    , nullptr, "recv response timeout from " + host);
+        }
+        if(error) {
+            return std::make_shared<HttpResult>(HttpResult::Error::RECV_SOCKET_ERROR
+                    , nullptr, std::string("recv response socket error errno=")
+                    + std::to_string(error) + " errstr=" + strerror(error));
+        }
+        return std::make_shared<HttpResult>(HttpResult::Error::RECV_CLOSE_BY_PEER
+                , nullptr, "recv response closed by peer " + host);
+    }
+}
+
+}
+}
@@ -0,0 +1,154 @@
+#ifndef __SYLAR_HTTP_CONNECTION_H__
+#define __SYLAR_HTTP_CONNECTION_H__
+
+#include <map>
+#include "http.h"
+#include "http_parser.h"
+#include "sylar/connection_pool.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief Outcome of a client request
+ */
+struct HttpResult {
+    typedef std::shared_ptr<HttpResult> ptr;
+
+    enum class Error {
+        /// Got a response
+        OK = 0,
+        /// No connection within the timeout, or connecting failed
+        POOL_GET_CONNECTION,
+        /// The peer closed the connection before the request was sent
+        SEND_CLOSE_BY_PEER,
+        /// Sending the request failed
+        SEND_SOCKET_ERROR,
+        /// The peer closed the connection before the response was complete
+        RECV_CLOSE_BY_PEER,
+        /// Receiving the response failed
+        RECV_SOCKET_ERROR,
+        /// The request didn't complete within its timeout
+        TIMEOUT,
+        /// The response is malformed or too large
+        PARSE_ERROR
+    };
+
+    HttpResult(Error _result, HttpResponse::ptr _response, const std::string& _error)
+        :result(_result)
+        ,response(_response)
+        ,error(_error) {}
+
+    Error result;
+    HttpResponse::ptr response;
+    std::string error;
+
+    std::string toString() const;
+};
+
+/**
+ * @brief Client side of one HTTP connection
+ */
+class HttpConnection {
+public:
+    typedef std::shared_ptr<HttpConnection> ptr;
+
+    HttpConnection(Socket::ptr sock);
+    ~HttpConnection();
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    /**
+     * @brief Send an encoded request, see EncodeRequest()
+     * @return > 0 once all of it is sent, otherwise what send returned
+     */
+    int sendRequest(const std::string& data);
+
+    /**
+     * @brief Receive the response to the last request
+     * @param[in] head The request was a HEAD, the response has no body
+     * @return nullptr on socket error, EOF or parse error (hasParseError())
+     */
+    HttpResponse::ptr recvResponse(bool head = false);
+
+    bool hasParseError() const { return m_parser.hasError();}
+
+    /**
+     * @brief Bytes received since the last sendRequest()
+     */
+    size_t getReceived() const { return m_end;}
+
+    /**
+     * @brief The peer sent more than the response, the connection is out
+     *        of sync
+     */
+    bool hasLeftover() const {
+        return m_parser.isFinished() && m_end > m_parser.getMessageLength();
+    }
+
+    Socket::ptr getSocket() const { return m_sock;}
+
+    /**
+     * @brief Append the wire form of a request to out. Host is set from
+     *        host unless headers has one, Content-Length from body.
+     */
+    static void EncodeRequest(std::string& out, HttpMethod method
+                              ,const std::string& host, const std::string& uri
+                              ,const std::map<std::string, std::string>& headers
+                              ,const std::string& body);
+private:
+    Socket::ptr m_sock;
+    HttpResponseParser m_parser;
+    char* m_buf;
+    size_t m_cap;
+    size_t m_end;
+};
+
+/**
+ * @brief HTTP client over a ConnectionPool
+ * @details Requests to a host reuse its keep-alive connections. A request
+ *          that fails on a reused connection before any response byte
+ *          arrived is retried once on a new one if its method is
+ *          idempotent, the server may have closed the idle connection just
+ *          as it was handed out.
+ */
+class HttpConnectionPool {
+public:
+    typedef std::shared_ptr<HttpConnectionPool> ptr;
+
+    /**
+     * @param[in] pool Connections to use, a new pool if nullptr
+     */
+    HttpConnectionPool(ConnectionPool::ptr pool = nullptr);
+
+    /**
+     * @param[in] host "host:port"
+     * @param[in] timeout_ms Covers waiting for a connection, sending and
+     *            receiving
+     */
+    HttpResult::ptr doGet(const std::string& host, const std::string& uri
+                          ,uint64_t timeout_ms
+                          ,const std::map<std::string, std::string>& headers = {}
+                          ,const std::string& body = "");
+
+    HttpResult::ptr doPost(const std::string& host, const std::string& uri
+                           ,uint64_t timeout_ms
+                           ,const std::map<std::string, std::string>& headers = {}
+                           ,const std::string& body = "");
+
+    HttpResult::ptr doRequest(HttpMethod method
+                              ,const std::string& host, const std::string& uri
+                              ,uint64_t timeout_ms
+                              ,const std::map<std::string, std::string>& headers = {}
+                              ,const std::string& body = "");
+
+    ConnectionPool::ptr getPool() const { return m_pool;}
+private:
+    ConnectionPool::ptr m_pool;
+};
+
+}
+}
+
+#endif
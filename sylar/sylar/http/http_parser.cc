@@ -0,0 +1,558 @@
+#include "http_parser.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_request_buffer_size =
+    sylar::Config::Lookup("http.request.buffer_size"
+                ,(uint64_t)(4 * 1024), "http request head max size");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_request_max_body_size =
+    sylar::Config::Lookup("http.request.max_body_size"
+                ,(uint64_t)(64 * 1024 * 1024), "http request body max size");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_response_buffer_size =
+    sylar::Config::Lookup("http.response.buffer_size"
+                ,(uint64_t)(4 * 1024), "http response head max size");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_response_max_body_size =
+    sylar::Config::Lookup("http.response.max_body_size"
+                ,(uint64_t)(64 * 1024 * 1024), "http response body max size");
+
+static uint64_t s_http_request_buffer_size = 0;
+static uint64_t s_http_request_max_body_size = 0;
+static uint64_t s_http_response_buffer_size = 0;
+static uint64_t s_http_response_max_body_size = 0;
+
+namespace {
+struct _RequestSizeIniter {
+    _RequestSizeIniter() {
+        s_http_request_buffer_size = g_http_request_buffer_size->getValue();
+        s_http_request_max_body_size = g_http_request_max_body_size->getValue();
+        s_http_response_buffer_size = g_http_response_buffer_size->getValue();
+        s_http_response_max_body_size = g_http_response_max_body_size->getValue();
+
+        g_http_request_buffer_size->addListener(
+                [](const uint64_t& ov, const uint64_t& nv){
+                s_http_request_buffer_size = nv;
+        });
+        g_http_request_max_body_size->addListener(
+                [](const uint64_t& ov, const uint64_t& nv){
+                s_http_request_max_body_size = nv;
+        });
+        g_http_response_buffer_size->addListener(
+                [](const uint64_t& ov, const uint64_t& nv){
+                s_http_response_buffer_size = nv;
+        });
+        g_http_response_max_body_size->addListener(
+                [](const uint64_t& ov, const uint64_t& nv){
+                s_http_response_max_body_size = nv;
+        });
+    }
+};
+static _RequestSizeIniter _init;
+}
+
+/// Longest chunk size line accepted, extensions included
+static const size_t s_max_chunk_line = 1024;
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+/**
+ * @brief "HTTP/1.1" -> 0x11, 0 if it isn't HTTP/1.x
+ */
+static uint8_t parse_version(const char* p, size_t len) {
+    if(len != 8 || memcmp(p, "HTTP/1.", 7) != 0
+            || (p[7] != '0' && p[7] != '1')) {
+        return 0;
+    }
+    return 0x10 | (p[7] - '0');
+}
+
+HttpParser::HttpParser(Type type)
+    :m_type(type) {
+    if(type == REQUEST) {
+        m_headLimit = s_http_request_buffer_size;
+        m_bodyLimit = s_http_request_max_body_size;
+    } else {
+        m_headLimit = s_http_response_buffer_size;
+        m_bodyLimit = s_http_response_max_body_size;
+    }
+    reset();
+}
+
+void HttpParser::reset() {
+    m_state = START_LINE;
+    m_error = OK;
+    m_pos = 0;
+    m_messageLength = 0;
+    m_method = HttpMethod::INVALID_METHOD;
+    m_status = 0;
+    m_version = 0;
+    m_close = false;
+    m_chunked = false;
+    m_headResponse = false;
+    m_hasLength = false;
+    m_hasTransferEncoding = false;
+    m_connClose = false;
+    m_connKeepAlive = false;
+    m_contentLength = 0;
+    m_chunkLeft = 0;
+    m_uri = m_path = m_query = m_fragment = m_reason = m_body = Span();
+    m_headers.clear();
+}
+
+bool HttpParser::setError(Error e) {
+    m_error = e;
+    SYLAR_LOG_DEBUG(g_logger) << "http parse error=" << e
+        << " type=" << (m_type == REQUEST ? "request" : "response")
+        << " pos=" << m_pos;
+    return false;
+}
+
+bool HttpParser::parseRequestLine(char* data, size_t begin, size_t end) {
+    const char* line = data + begin;
+    size_t len = end - begin;
+    const char* sp1 = (const char*)memchr(line, ' ', len);
+    if(!sp1) {
+        return setError(INVALID_METHOD);
+    }
+    m_method = StringToHttpMethod(line, sp1 - line);
+    if(m_method == HttpMethod::INVALID_METHOD) {
+        return setError(INVALID_METHOD);
+    }
+    const char* sp2 = (const char*)memrchr(line, ' ', len);
+    if(sp2 == sp1) {
+        return setError(INVALID_VERSION);
+    }
+    m_version = parse_version(sp2 + 1, line + len - sp2 - 1);
+    if(!m_version) {
+        return setError(INVALID_VERSION);
+    }
+
+    const char* uri = sp1 + 1;
+    const char* uri_end = sp2;
+    if(uri == uri_end) {
+        return setError(INVALID_URI);
+    }
+    for(const char* p = uri; p < uri_end; ++p) {
+        if((unsigned char)*p <= ' ' || *p == 0x7f) {
+            return setError(INVALID_URI);
+        }
+    }
+    m_uri = Span(uri - data, uri_end - uri);
+
+    // absolute-form, http://host:port/path?query
+    const char* path = uri;
+    if(*path != '/' && *path != '*') {
+        const char* scheme = (const char*)memmem(uri, uri_end - uri, "://", 3);
+        if(!scheme) {
+            return setError(INVALID_URI);
+        }
+        path = (const char*)memchr(scheme + 3, '/', uri_end - scheme - 3);
+        if(!path) {
+            path = uri_end;
+        }
+    }
+
+    const char* fragment = (const char*)memchr(path, '#', uri_end - path);
+    const char* path_end = fragment ? fragment : uri_end;
+    if(fragment) {
+        m_fragment = Span(fragment + 1 - data, uri_end - fragment - 1);
+    }
+    const char* query = (const char*)memchr(path, '?', path_end - path);
+    if(query) {
+        m_query = Span(query + 1 - data, path_end - query - 1);
+        path_end = query;
+    }
+    m_path = Span(path - data, path_end - path);
+    return true;
+}
+
+bool HttpParser::parseStatusLine(char* data, size_t begin, size_t end) {
+    const char* line = data + begin;
+    size_t len = end - begin;
+    const char* sp = (const char*)memchr(line, ' ', len);
+    if(!sp) {
+        return setError(INVALID_VERSION);
+    }
+    m_version = parse_version(line, sp - line);
+    if(!m_version) {
+        return setError(INVALID_VERSION);
+    }
+    const char* code = sp + 1;
+    const char* line_end = line + len;
+    if(line_end - code < 3) {
+        return setError(INVALID_STATUS);
+    }
+    m_status = 0;
+    for(int i = 0; i < 3; ++i) {
+        if(code[i] < '0' || code[i] > '9') {
+            return setError(INVALID_STATUS);
+        }
+        m_status = m_status * 10 + code[i] - '0';
+    }
+    const char* reason = code + 3;
+    if(reason < line_end) {
+        if(*reason != ' ') {
+            return setError(INVALID_STATUS);
+        }
+        ++reason;
+    }
+    m_reason = Span(reason - data, line_end - reason);
+    return true;
+}
+
+bool HttpParser::parseHeader(char* data, size_t begin, size_t end) {
+    const char* line = data + begin;
+    const char* line_end = data + end;
+    // obsolete line folding is rejected, RFC 7230 3.2.4
+    if(is_space(*line)) {
+        return setError(INVALID_HEADER);
+    }
+    const char* colon = (const char*)memchr(line, ':', end - begin);
+    if(!colon || colon == line) {
+        return setError(INVALID_HEADER);
+    }
+    for(const char* p = line; p < colon; ++p) {
+        if((unsigned char)*p <= ' ' || *p == 0x7f) {
+            return setError(INVALID_HEADER);
+        }
+    }
+    const char* value = colon + 1;
+    while(value < line_end && is_space(*value)) {
+        ++value;
+    }
+    const char* value_end = line_end;
+    while(value_end > value && is_space(value_end[-1])) {
+        --value_end;
+    }
+
+    StringView name(line, colon - line);
+    StringView v(value, value_end - value);
+    if(name.iequals("content-length")) {
+        if(v.empty()) {
+            return setError(INVALID_CONTENT_LENGTH);
+        }
+        uint64_t n = 0;
+        for(size_t i = 0; i < v.len; ++i) {
+            if(v.ptr[i] < '0' || v.ptr[i] > '9') {
+                return setError(INVALID_CONTENT_LENGTH);
+            }
+            n = n * 10 + v.ptr[i] - '0';
+            if(n > m_bodyLimit) {
+                return setError(BODY_TOO_LARGE);
+            }
+        }
+        if(m_hasLength && n != m_contentLength) {
+            return setError(INVALID_CONTENT_LENGTH);
+        }
+        m_hasLength = true;
+        m_contentLength = n;
+    } else if(name.iequals("transfer-encoding")) {
+        m_hasTransferEncoding = true;
+        if(HeaderHasToken(v, "chunked")) {
+            m_chunked = true;
+        }
+    } else if(name.iequals("connection")) {
+        if(HeaderHasToken(v, "close")) {
+            m_connClose = true;
+        }
+        if(HeaderHasToken(v, "keep-alive")) {
+            m_connKeepAlive = true;
+        }
+    }
+    m_headers.push_back(std::make_pair(Span(line - data, name.len)
+                        ,Span(value - data, v.len)));
+    return true;
+}
+
+bool HttpParser::headersDone(char* data) {
+    if(m_version == 0x11) {
+        m_close = m_connClose;
+    } else {
+        m_close = !m_connKeepAlive;
+    }
+    m_body = Span(m_pos, 0);
+
+    if(m_type == RESPONSE && (m_headResponse
+                || (m_status >= 100 && m_status < 200)
+                || m_status == 204 || m_status == 304)) {
+        m_state = DONE;
+        return true;
+    }
+    if(m_chunked) {
+        // Transfer-Encoding wins over Content-Length, but a message carrying
+        // both is suspicious (request smuggling), don't reuse the connection
+        if(m_hasLength) {
+            m_close = true;
+        }
+        m_state = CHUNK_SIZE;
+        return true;
+    }
+    if(m_hasTransferEncoding && m_type == REQUEST) {
+        // only chunked is understood, the body length is unknown
+        return setError(INVALID_HEADER);
+    }
+    if(m_hasLength && !m_hasTransferEncoding) {
+        m_state = m_contentLength ? BODY_LENGTH : DONE;
+        return true;
+    }
+    if(m_type == REQUEST) {
+        m_state = DONE;
+    } else {
+        m_close = true;
+        m_state = BODY_EOF;
+    }
+    return true;
+}
+
+bool HttpParser::execute(char* data, size_t len) {
+    while(m_state != DONE && m_error == OK) {
+        switch(m_state) {
+            case START_LINE:
+            case HEADERS:
+            case CHUNK_SIZE:
+            case CHUNK_END:
+            case TRAILERS: {
+                char* nl = (char*)memchr(data + m_pos, '\n', len - m_pos);
+                if(!nl) {
+                    if(m_state == CHUNK_SIZE || m_state == CHUNK_END) {
+                        if(len - m_pos > s_max_chunk_line) {
+                            return setError(INVALID_CHUNK);
+                        }
+                    } else if(m_state == TRAILERS) {
+                        if(len - m_pos > m_headLimit) {
+                            return setError(HEAD_TOO_LARGE);
+                        }
+                    } else if(len > m_headLimit) {
+                        return setError(HEAD_TOO_LARGE);
+                    }
+                    return false;
+                }
+                size_t begin = m_pos;
+                size_t end = nl - data;
+                m_pos = end + 1;
+                if(end > begin && data[end - 1] == '\r') {
+                    --end;
+                }
+                if((m_state == START_LINE || m_state == HEADERS)
+                        && m_pos > m_headLimit) {
+                    return setError(HEAD_TOO_LARGE);
+                }
+
+                if(m_state == START_LINE) {
+                    // empty lines before the start line are ignored,
+                    // RFC 7230 3.5
+                    if(begin == end) {
+                        break;
+                    }
+                    if(!(m_type == REQUEST ? parseRequestLine(data, begin, end)
+                                : parseStatusLine(data, begin, end))) {
+                        return false;
+                    }
+                    m_state = HEADERS;
+                } else if(m_state == HEADERS) {
+                    if(begin == end) {
+                        if(!headersDone(data)) {
+                            return false;
+                        }
+                    } else if(!parseHeader(data, begin, end)) {
+                        return false;
+                    }
+                } else if(m_state == CHUNK_SIZE) {
+                    uint64_t size = 0;
+                    size_t i = begin;
+                    for(; i < end; ++i) {
+                        char c = data[i];
+                        int v;
+                        if(c >= '0' && c <= '9') {
+                            v = c - '0';
+                        } else if(c >= 'a' && c <= 'f') {
+                            v = c - 'a' + 10;
+                        } else if(c >= 'A' && c <= 'F') {
+                            v = c - 'A' + 10;
+                        } else {
+                            break;
+                        }
+                        size = size * 16 + v;
+                        if(size > m_bodyLimit) {
+                            return setError(BODY_TOO_LARGE);
+                        }
+                    }
+                    // chunk extensions after ';' are ignored
+                    if(i == begin || (i < end && data[i] != ';' && !is_space(data[i]))) {
+                        return setError(INVALID_CHUNK);
+                    }
+                    if(size == 0) {
+                        m_state = TRAILERS;
+                    } else if(m_body.len + size > m_bodyLimit) {
+                        return setError(BODY_TOO_LARGE);
+                    } else {
+                        m_chunkLeft = size;
+                        m_state = CHUNK_DATA;
+                    }
+                } else if(m_state == CHUNK_END) {
+                    if(begin != end) {
+                        return setError(INVALID_CHUNK);
+                    }
+                    m_state = CHUNK_SIZE;
+                } else {
+                    // trailer fields are not kept
+                    if(begin == end) {
+                        m_state = DONE;
+                    }
+                }
+                break;
+            }
+            case CHUNK_DATA: {
+                size_t n = len - m_pos;
+                if(n == 0) {
+                    return false;
+                }
+                if(n > m_chunkLeft) {
+                    n = m_chunkLeft;
+                }
+                // the decoded body stays contiguous behind the head
+                size_t to = m_body.off + m_body.len;
+                if(to != m_pos) {
+                    memmove(data + to, data + m_pos, n);
+                }
+                m_body.len += n;
+                m_pos += n;
+                m_chunkLeft -= n;
+                if(m_chunkLeft == 0) {
+                    m_state = CHUNK_END;
+                }
+                break;
+            }
+            case BODY_LENGTH: {
+                if(len - m_pos < m_contentLength) {
+                    return false;
+                }
+                m_body.len = m_contentLength;
+                m_pos += m_contentLength;
+                m_state = DONE;
+                break;
+            }
+            case BODY_EOF: {
+                if(len - m_body.off > m_bodyLimit) {
+                    return setError(BODY_TOO_LARGE);
+                }
+                m_body.len = len - m_body.off;
+                m_pos = len;
+                return false;
+            }
+            default:
+                break;
+        }
+    }
+    if(m_error != OK) {
+        return false;
+    }
+    m_messageLength = m_pos;
+    return true;
+}
+
+bool HttpParser::finishOnEof() {
+    if(m_state == BODY_EOF && m_error == OK) {
+        m_state = DONE;
+        m_messageLength = m_pos;
+        return true;
+    }
+    return m_state == DONE;
+}
+
+HttpRequestParser::HttpRequestParser()
+    :m_parser(HttpParser::REQUEST) {
+}
+
+bool HttpRequestParser::execute(char* data, size_t len) {
+    if(!m_parser.execute(data, len)) {
+        return false;
+    }
+    m_request.reset();
+    m_request.setMethod(m_parser.getMethod());
+    m_request.setVersion(m_parser.getVersion());
+    m_request.setClose(m_parser.isClose());
+    m_request.setChunked(m_parser.isChunked());
+    m_request.setUri(m_parser.getUri().view(data));
+    m_request.setPath(m_parser.getPath().view(data));
+    m_request.setQuery(m_parser.getQuery().view(data));
+    m_request.setFragment(m_parser.getFragment().view(data));
+    m_request.setBody(m_parser.getBody().view(data));
+    for(auto& i : m_parser.getHeaders()) {
+        m_request.addHeader(i.first.view(data), i.second.view(data));
+    }
+    return true;
+}
+
+void HttpRequestParser::reset() {
+    m_parser.reset();
+    m_request.reset();
+}
+
+uint64_t HttpRequestParser::GetHttpRequestBufferSize() {
+    return s_http_request_buffer_size;
+}
+
+uint64_t HttpRequestParser::GetHttpRequestMaxBodySize() {
+    return s_http_request_max_body_size;
+}
+
+HttpResponseParser::HttpResponseParser()
+    :m_parser(HttpParser::RESPONSE) {
+}
+
+bool HttpResponseParser::execute(char* data, size_t len) {
+    if(!m_parser.execute(data, len)) {
+        return false;
+    }
+    fill(data);
+    return true;
+}
+
+bool HttpResponseParser::finishOnEof(char* data) {
+    if(m_parser.isFinished()) {
+        return true;
+    }
+    if(!m_parser.finishOnEof()) {
+        return false;
+    }
+    fill(data);
+    return true;
+}
+
+void HttpResponseParser::reset() {
+    m_parser.reset();
+    m_response.reset();
+}
+
+void HttpResponseParser::fill(char* data) {
+    m_response.reset(new HttpResponse(m_parser.getVersion(), m_parser.isClose()));
+    m_response->setStatus((HttpStatus)m_parser.getStatus());
+    m_response->setReason(m_parser.getReason().view(data).str());
+    m_response->setChunked(m_parser.isChunked());
+    for(auto& i : m_parser.getHeaders()) {
+        m_response->addHeader(i.first.view(data).str(), i.second.view(data).str());
+    }
+    StringView body = m_parser.getBody().view(data);
+    m_response->appendBody(body.ptr, body.len);
+}
+
+uint64_t HttpResponseParser::GetHttpResponseBufferSize() {
+    return s_http_response_buffer_size;
+}
+
+uint64_t HttpResponseParser::GetHttpResponseMaxBodySize() {
+    return s_http_response_max_body_size;
+}
+
+}
+}
@@ -0,0 +1,258 @@
+#ifndef __SYLAR_HTTP_PARSER_H__
+#define __SYLAR_HTTP_PARSER_H__
+
+#include "http.h"
+#include <stdint.h>
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief Incremental HTTP/1.x message parser
+ * @details The caller keeps the bytes of the message being parsed in one
+ *          contiguous buffer and calls execute() with its start and length
+ *          each time more arrives. The parser resumes where it stopped, so
+ *          a message split over any number of reads costs one pass over
+ *          its bytes. The buffer may be moved (compacted, grown) between
+ *          calls; the parser only keeps offsets into it.
+ *
+ *          Chunked bodies are decoded in place: chunk data is moved down
+ *          over the chunk framing, so the body ends up contiguous right
+ *          after the head and nothing is copied out of the buffer.
+ *
+ *          Head size and body size are limited by
+ *          http.{request,response}.buffer_size and
+ *          http.{request,response}.max_body_size.
+ */
+class HttpParser {
+public:
+    enum Type {
+        REQUEST,
+        RESPONSE
+    };
+
+    enum Error {
+        OK = 0,
+        INVALID_METHOD,
+        INVALID_URI,
+        INVALID_VERSION,
+        INVALID_STATUS,
+        INVALID_HEADER,
+        HEAD_TOO_LARGE,
+        INVALID_CONTENT_LENGTH,
+        BODY_TOO_LARGE,
+        INVALID_CHUNK
+    };
+
+    /**
+     * @brief Piece of the message, as an offset from its start
+     */
+    struct Span {
+        Span()
+            :off(0)
+            ,len(0) {
+        }
+        Span(uint32_t o, uint32_t l)
+            :off(o)
+            ,len(l) {
+        }
+        StringView view(const char* base) const { return StringView(base + off, len);}
+
+        uint32_t off;
+        uint32_t len;
+    };
+
+    HttpParser(Type type);
+
+    /**
+     * @brief Parse what has arrived of the message
+     * @param[in] data Start of the message, may differ from the last call
+     *            if the buffer moved
+     * @param[in] len Bytes of the message available at data, at least what
+     *            was passed last time
+     * @return true once the whole message is there, see getMessageLength()
+     *         for where the next one (pipelined) starts. false if more data
+     *         is needed or on error (hasError())
+     */
+    bool execute(char* data, size_t len);
+
+    /**
+     * @brief The peer closed the connection
+     * @return true if that completes the message (response body delimited
+     *         by the close)
+     */
+    bool finishOnEof();
+
+    /**
+     * @brief Start on the next message
+     */
+    void reset();
+
+    bool isFinished() const { return m_state == DONE;}
+    bool hasError() const { return m_error != OK;}
+    Error getError() const { return m_error;}
+
+    /**
+     * @brief Bytes the message takes up in the buffer once finished. With a
+     *        chunked body this is the length of the raw message, not of
+     *        the decoded one.
+     */
+    size_t getMessageLength() const { return m_messageLength;}
+
+    /**
+     * @brief The response answers a HEAD request and has no body
+     */
+    void setHeadResponse(bool v) { m_headResponse = v;}
+
+    // set once the start line is parsed
+    HttpMethod getMethod() const { return m_method;}
+    int getStatus() const { return m_status;}
+    uint8_t getVersion() const { return m_version;}
+    const Span& getUri() const { return m_uri;}
+    const Span& getPath() const { return m_path;}
+    const Span& getQuery() const { return m_query;}
+    const Span& getFragment() const { return m_fragment;}
+    const Span& getReason() const { return m_reason;}
+
+    // set once the headers are parsed
+    const std::vector<std::pair<Span, Span> >& getHeaders() const { return m_headers;}
+    bool isClose() const { return m_close;}
+    bool isChunked() const { return m_chunked;}
+
+    // set once finished
+    const Span& getBody() const { return m_body;}
+private:
+    enum State {
+        START_LINE,
+        HEADERS,
+        BODY_LENGTH,
+        BODY_EOF,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_END,
+        TRAILERS,
+        DONE
+    };
+
+    bool parseRequestLine(char* data, size_t begin, size_t end);
+    bool parseStatusLine(char* data, size_t begin, size_t end);
+    bool parseHeader(char* data, size_t begin, size_t end);
+    /**
+     * @brief Decide how the body is delimited after the last header
+     */
+    bool headersDone(char* data);
+    bool setError(Error e);
+private:
+    Type m_type;
+    State m_state;
+    Error m_error;
+    /// Where scanning resumes
+    size_t m_pos;
+    size_t m_messageLength;
+    uint64_t m_headLimit;
+    uint64_t m_bodyLimit;
+
+    HttpMethod m_method;
+    int m_status;
+    uint8_t m_version;
+    bool m_close;
+    bool m_chunked;
+    bool m_headResponse;
+    bool m_hasLength;
+    bool m_hasTransferEncoding;
+    /// Connection: close seen
+    bool m_connClose;
+    /// Connection: keep-alive seen
+    bool m_connKeepAlive;
+    uint64_t m_contentLength;
+    /// Chunk bytes still to come
+    uint64_t m_chunkLeft;
+
+    Span m_uri;
+    Span m_path;
+    Span m_query;
+    Span m_fragment;
+    Span m_reason;
+    Span m_body;
+    std::vector<std::pair<Span, Span> > m_headers;
+};
+
+/**
+ * @brief Parses requests into an HttpRequest
+ * @details getRequest() views point into the buffer given to execute(),
+ *          they stay valid as long as those bytes are left alone.
+ */
+class HttpRequestParser {
+public:
+    typedef std::shared_ptr<HttpRequestParser> ptr;
+
+    HttpRequestParser();
+
+    /**
+     * @see HttpParser::execute
+     */
+    bool execute(char* data, size_t len);
+    void reset();
+
+    bool isFinished() const { return m_parser.isFinished();}
+    bool hasError() const { return m_parser.hasError();}
+    HttpParser::Error getError() const { return m_parser.getError();}
+    size_t getMessageLength() const { return m_parser.getMessageLength();}
+
+    HttpRequest& getRequest() { return m_request;}
+    const HttpParser& getParser() const { return m_parser;}
+
+    static uint64_t GetHttpRequestBufferSize();
+    static uint64_t GetHttpRequestMaxBodySize();
+private:
+    HttpParser m_parser;
+    HttpRequest m_request;
+};
+
+/**
+ * @brief Parses responses into an HttpResponse (copied out of the buffer)
+ */
+class HttpResponseParser {
+public:
+    typedef std::shared_ptr<HttpResponseParser> ptr;
+
+    HttpResponseParser();
+
+    /**
+     * @see HttpParser::execute
+     */
+    bool execute(char* data, size_t len);
+
+    /**
+     * @see HttpParser::finishOnEof
+     */
+    bool finishOnEof(char* data);
+
+    void reset();
+
+    /**
+     * @see HttpParser::setHeadResponse
+     */
+    void setHeadResponse(bool v) { m_parser.setHeadResponse(v);}
+
+    bool isFinished() const { return m_parser.isFinished();}
+    bool hasError() const { return m_parser.hasError();}
+    HttpParser::Error getError() const { return m_parser.getError();}
+    size_t getMessageLength() const { return m_parser.getMessageLength();}
+
+    HttpResponse::ptr getResponse() const { return m_response;}
+    const HttpParser& getParser() const { return m_parser;}
+
+    static uint64_t GetHttpResponseBufferSize();
+    static uint64_t GetHttpResponseMaxBodySize();
+private:
+    void fill(char* data);
+private:
+    HttpParser m_parser;
+    HttpResponse::ptr m_response;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,50 @@
+#include "http_server.h"
+#include "sylar/log.h"
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+HttpServer::HttpServer(bool keepalive
+               ,sylar::IOManager* worker
+               ,sylar::IOManager* accept_worker)
+    :TcpServer(worker, accept_worker)
+    ,m_isKeepalive(keepalive) {
+    m_dispatch.reset(new ServletDispatch);
+}
+
+void HttpServer::setName(const std::string& v) {
+    TcpServer::setName(v);
+    m_dispatch->setDefault(std::make_shared<NotFoundServlet>(v));
+}
+
+void HttpServer::handleClient(Socket::ptr client) {
+    SYLAR_LOG_DEBUG(g_logger) << "handleClient " << *client;
+    HttpSession session(client);
+    while(true) {
+        HttpRequest* req = session.recvRequest();
+        if(!req) {
+            SYLAR_LOG_DEBUG(g_logger) << "recv http request fail, errno="
+                << errno << " errstr=" << strerror(errno)
+                << " client:" << *client << " keep_alive=" << m_isKeepalive;
+            break;
+        }
+
+        bool close = req->isClose() || !m_isKeepalive || isStop();
+        HttpResponse rsp(req->getVersion(), close);
+        rsp.setHeader("Server", getName());
+        m_dispatch->handle(*req, rsp, session);
+        if(!session.sendResponse(rsp, req->getMethod() == HttpMethod::HEAD)) {
+            break;
+        }
+        if(rsp.isClose()) {
+            break;
+        }
+    }
+    session.flush();
+    client->close();
+}
+
+}
+}
@@ -0,0 +1,46 @@
+#ifndef __SYLAR_HTTP_SERVER_H__
+#define __SYLAR_HTTP_SERVER_H__
+
+#include "sylar/tcp_server.h"
+#include "http_session.h"
+#include "servlet.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief HTTP/1.1 server
+ * @details Every connection runs a loop of recvRequest(), dispatch,
+ *          sendResponse() on the io worker. Connections are kept alive
+ *          unless the client or setKeepalive(false) says otherwise, and
+ *          pipelined requests are answered in order with their responses
+ *          batched into one write.
+ */
+class HttpServer : public TcpServer {
+public:
+    typedef std::shared_ptr<HttpServer> ptr;
+
+    /**
+     * @param[in] keepalive Keep connections open between requests
+     * @param[in] worker Runs the connections
+     * @param[in] accept_worker Runs the accept loops
+     */
+    HttpServer(bool keepalive = false
+               ,sylar::IOManager* worker = sylar::IOManager::GetThis()
+               ,sylar::IOManager* accept_worker = sylar::IOManager::GetThis());
+
+    ServletDispatch::ptr getServletDispatch() const { return m_dispatch;}
+    void setServletDispatch(ServletDispatch::ptr v) { m_dispatch = v;}
+
+    virtual void setName(const std::string& v) override;
+protected:
+    virtual void handleClient(Socket::ptr client) override;
+private:
+    bool m_isKeepalive;
+    ServletDispatch::ptr m_dispatch;
+};
+
+}
+}
+
+#endif
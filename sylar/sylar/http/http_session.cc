@@ -0,0 +1,127 @@
+#include "http_session.h"
+#include "sylar/file_cache.h"
+#include "sylar/log.h"
+#include <stdlib.h>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+/// Queued responses are written once they get this big, pipelined or not
+static const size_t s_max_pending_output = 64 * 1024;
+
+HttpSession::HttpSession(Socket::ptr sock)
+    :m_sock(sock)
+    ,m_cap(HttpRequestParser::GetHttpRequestBufferSize())
+    ,m_begin(0)
+    ,m_end(0)
+    ,m_hasRequest(false) {
+    if(m_cap < 512) {
+        m_cap = 512;
+    }
+    m_buf = (char*)malloc(m_cap);
+}
+
+HttpSession::~HttpSession() {
+    free(m_buf);
+}
+
+void HttpSession::reserve() {
+    if(m_end < m_cap) {
+        return;
+    }
+    // the parser keeps offsets relative to the message start, moving the
+    // message to the front is fine
+    if(m_begin > 0) {
+        memmove(m_buf, m_buf + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+        return;
+    }
+    m_cap *= 2;
+    m_buf = (char*)realloc(m_buf, m_cap);
+}
+
+HttpRequest* HttpSession::recvRequest() {
+    if(m_hasRequest) {
+        m_begin += m_parser.getMessageLength();
+        m_parser.reset();
+        m_hasRequest = false;
+    }
+    if(m_begin == m_end) {
+        m_begin = m_end = 0;
+    }
+
+    while(true) {
+        if(m_end > m_begin) {
+            if(m_parser.execute(m_buf + m_begin, m_end - m_begin)) {
+                m_hasRequest = true;
+                return &m_parser.getRequest();
+            }
+            if(m_parser.hasError()) {
+                HttpResponse rsp(0x11, true);
+                switch(m_parser.getError()) {
+                    case HttpParser::HEAD_TOO_LARGE:
+                        rsp.setStatus(HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE);
+                        break;
+                    case HttpParser::BODY_TOO_LARGE:
+                        rsp.setStatus(HttpStatus::PAYLOAD_TOO_LARGE);
+                        break;
+                    default:
+                        rsp.setStatus(HttpStatus::BAD_REQUEST);
+                        break;
+                }
+                SYLAR_LOG_DEBUG(g_logger) << "bad http request error="
+                    << m_parser.getError() << " " << *m_sock->getRemoteAddress();
+                sendResponse(rsp);
+                flush();
+                return nullptr;
+            }
+        }
+
+        // nothing more to answer without reading, send what is queued
+        if(!m_out.empty() && !flush()) {
+            return nullptr;
+        }
+
+        reserve();
+        int rt = m_sock->recv(m_buf + m_end, m_cap - m_end);
+        if(rt <= 0) {
+            return nullptr;
+        }
+        m_end += rt;
+    }
+}
+
+bool HttpSession::sendResponse(const HttpResponse& rsp, bool head) {
+    rsp.encode(m_out, head);
+    if(rsp.getFile() && !head) {
+        if(!flush()) {
+            return false;
+        }
+        return m_sock->sendFile(rsp.getFile()->getFd(), rsp.getFileOffset()
+                , rsp.getFileLength()) == (int64_t)rsp.getFileLength();
+    }
+    if(m_out.size() >= s_max_pending_output) {
+        return flush();
+    }
+    return true;
+}
+
+bool HttpSession::flush() {
+    size_t offset = 0;
+    while(offset < m_out.size()) {
+        int rt = m_sock->send(m_out.c_str() + offset, m_out.size() - offset);
+        if(rt <= 0) {
+            m_out.clear();
+            return false;
+        }
+        offset += rt;
+    }
+    m_out.clear();
+    return true;
+}
+
+}
+}
@@ -0,0 +1,78 @@
+#ifndef __SYLAR_HTTP_SESSION_H__
+#define __SYLAR_HTTP_SESSION_H__
+
+#include "http.h"
+#include "http_parser.h"
+#include "sylar/socket.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief Server side of one HTTP connection
+ * @details Requests are parsed straight out of the session's receive buffer,
+ *          the HttpRequest returned by recvRequest() points into it and
+ *          stays valid until the next recvRequest().
+ *
+ *          Responses are queued by sendResponse() and written when the
+ *          session runs out of buffered requests, so a pipelined batch of
+ *          requests is answered with a single send.
+ */
+class HttpSession {
+public:
+    typedef std::shared_ptr<HttpSession> ptr;
+
+    HttpSession(Socket::ptr sock);
+    ~HttpSession();
+
+    HttpSession(const HttpSession&) = delete;
+    HttpSession& operator=(const HttpSession&) = delete;
+
+    /**
+     * @brief Next request of the connection
+     * @details Blocks the fiber until one has fully arrived. A malformed
+     *          request is answered with 400 (431/413 for ones that are too
+     *          large) and the connection is to be closed.
+     * @return nullptr on EOF, socket error or malformed request
+     */
+    HttpRequest* recvRequest();
+
+    /**
+     * @brief Queue rsp, it goes out with the next flush()
+     * @details A file body (HttpResponse::setFile()) is sent right away
+     *          with Socket::sendFile(), after what is queued.
+     * @param[in] head Answer to a HEAD request, leave the body out
+     * @return false if the socket failed
+     */
+    bool sendResponse(const HttpResponse& rsp, bool head = false);
+
+    /**
+     * @brief Write all queued responses
+     * @return false if the socket failed
+     */
+    bool flush();
+
+    Socket::ptr getSocket() const { return m_sock;}
+private:
+    /**
+     * @brief Make room for more data behind m_end
+     */
+    void reserve();
+private:
+    Socket::ptr m_sock;
+    HttpRequestParser m_parser;
+    char* m_buf;
+    size_t m_cap;
+    /// Start of the message being parsed
+    size_t m_begin;
+    /// End of the received data
+    size_t m_end;
+    /// recvRequest() returned the request at m_begin
+    bool m_hasRequest;
+    std::string m_out;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef __SYLAR_HTTP_SERVLET_H__
+#define __SYLAR_HTTP_SERVLET_H__
+
+#include <memory>
+#include <functional>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "http.h"
+#include "http_session.h"
+#include "sylar/thread.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief Request handler
+ */
+class Servlet {
+public:
+    typedef std::shared_ptr<Servlet> ptr;
+
+    Servlet(const std::string& name)
+        :m_name(name) {}
+    virtual ~Servlet() {}
+
+    /**
+     * @brief Fill rsp in for req
+     * @return 0 on success
+     */
+    virtual int32_t handle(HttpRequest& req, HttpResponse& rsp
+                           ,HttpSession& session) = 0;
+
+    const std::string& getName() const { return m_name;}
+protected:
+    std::string m_name;
+};
+
+/**
+ * @brief Servlet running a callback
+ */
+class FunctionServlet : public Servlet {
+public:
+    typedef std::shared_ptr<FunctionServlet> ptr;
+    typedef std::function<int32_t (HttpRequest& req, HttpResponse& rsp
+                                   ,HttpSession& session)> callback;
+
+    FunctionServlet(callback cb);
+    int32_t handle(HttpRequest& req, HttpResponse& rsp
+                   ,HttpSession& session) override;
+private:
+    callback m_cb;
+};
+
+/**
+ * @brief Answers 404
+ */
+class NotFoundServlet : public Servlet {
+public:
+    typedef std::shared_ptr<NotFoundServlet> ptr;
+
+    NotFoundServlet(const std::string& name);
+    int32_t handle(HttpRequest& req, HttpResponse& rsp
+                   ,HttpSession& session) override;
+private:
+    std::string m_content;
+};
+
+/**
+ * @brief Routes requests by path
+ * @details Exact paths are looked up in a hash table first, then glob
+ *          patterns (fnmatch, e.g. ending in a *) are tried in the order they were
+ *          added, then the default servlet (404) answers.
+ */
+class ServletDispatch : public Servlet {
+public:
+    typedef std::shared_ptr<ServletDispatch> ptr;
+    typedef RWMutex RWMutexType;
+
+    ServletDispatch();
+    int32_t handle(HttpRequest& req, HttpResponse& rsp
+                   ,HttpSession& session) override;
+
+    void addServlet(const std::string& uri, Servlet::ptr slt);
+    void addServlet(const std::string& uri, FunctionServlet::callback cb);
+    void addGlobServlet(const std::string& uri, Servlet::ptr slt);
+    void addGlobServlet(const std::string& uri, FunctionServlet::callback cb);
+
+    void delServlet(const std::string& uri);
+    void delGlobServlet(const std::string& uri);
+
+    Servlet::ptr getDefault() const { return m_default;}
+    void setDefault(Servlet::ptr v) { m_default = v;}
+
+    Servlet::ptr getServlet(const std::string& uri);
+    Servlet::ptr getGlobServlet(const std::string& uri);
+
+    /**
+     * @brief Servlet that handles path: exact, glob, then default
+     */
+    Servlet::ptr getMatchedServlet(const StringView& path);
+private:
+    RWMutexType m_mutex;
+    /// uri(/sylar/xxx) -> servlet
+    std::unordered_map<std::string, Servlet::ptr> m_datas;
+    /// uri(/sylar/*) -> servlet
+    std::vector<std::pair<std::string, Servlet::ptr> > m_globs;
+    Servlet::ptr m_default;
+};
+
+}
+}
+
+#endif
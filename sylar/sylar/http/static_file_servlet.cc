@@ -0,0 +1,237 @@
+#include "static_file_servlet.h"
+#include "sylar/file_cache.h"
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+
+namespace sylar {
+namespace http {
+
+StaticFileServlet::StaticFileServlet(const std::string& root, const std::string& prefix)
+    :Servlet("StaticFileServlet")
+    ,m_root(root)
+    ,m_prefix(prefix) {
+    while(!m_root.empty() && m_root.back() == '/') {
+        m_root.pop_back();
+    }
+}
+
+const char* StaticFileServlet::GetContentType(const std::string& path) {
+    static const std::unordered_map<std::string, const char*> s_types = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css"},
+        {"js", "application/javascript"},
+        {"json", "application/json"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"xml", "application/xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"svg", "image/svg+xml"},
+        {"ico", "image/x-icon"},
+        {"pdf", "application/pdf"},
+        {"mp4", "video/mp4"},
+        {"wasm", "application/wasm"}
+    };
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if(dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        auto it = s_types.find(path.substr(dot + 1));
+        if(it != s_types.end()) {
+            return it->second;
+        }
+    }
+    return "application/octet-stream";
+}
+
+static int hex_value(char c) {
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Percent decode path into out
+ * @return false on a bad escape or a decoded NUL
+ */
+static bool decode_path(const StringView& path, std::string& out) {
+    out.reserve(path.len + 1);
+    for(size_t i = 0; i < path.len; ++i) {
+        char c = path.ptr[i];
+        if(c == '%') {
+            if(i + 2 >= path.len) {
+                return false;
+            }
+            int h = hex_value(path.ptr[i + 1]);
+            int l = hex_value(path.ptr[i + 2]);
+            if(h < 0 || l < 0) {
+                return false;
+            }
+            c = (char)(h * 16 + l);
+            i += 2;
+        }
+        if(c == '\0') {
+            return false;
+        }
+        out.push_back(c);
+    }
+    return true;
+}
+
+/**
+ * @brief Whether a ".." segment could leave the root
+ */
+static bool has_dot_dot(const std::string& path) {
+    size_t pos = 0;
+    while((pos = path.find("..", pos)) != std::string::npos) {
+        bool start = pos == 0 || path[pos - 1] == '/';
+        bool end = pos + 2 == path.size() || path[pos + 2] == '/';
+        if(start && end) {
+            return true;
+        }
+        pos += 2;
+    }
+    return false;
+}
+
+static std::string http_date(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, n);
+}
+
+/**
+ * @brief Parse a single "bytes=" range against a size byte file
+ * @return 1 for a range in [begin, end], 0 to ignore the header (not a
+ *         single byte range), -1 if it can't be satisfied
+ */
+static int parse_range(const StringView& value, uint64_t size, uint64_t& begin, uint64_t& end) {
+    std::string v = value.str();
+    if(v.compare(0, 6, "bytes=") != 0 || v.find(',') != std::string::npos) {
+        return 0;
+    }
+    const char* p = v.c_str() + 6;
+    const char* dash = strchr(p, '-');
+    if(!dash) {
+        return 0;
+    }
+    char* e;
+    if(dash == p) {
+        // suffix range, the last n bytes
+        uint64_t n = strtoull(dash + 1, &e, 10);
+        if(*e || e == dash + 1) {
+            return 0;
+        }
+        if(n == 0 || size == 0) {
+            return -1;
+        }
+        begin = n >= size ? 0 : size - n;
+        end = size - 1;
+        return 1;
+    }
+    begin = strtoull(p, &e, 10);
+    if(e != dash) {
+        return 0;
+    }
+    if(dash[1] == '\0') {
+        end = size - 1;
+    } else {
+        end = strtoull(dash + 1, &e, 10);
+        if(*e || end < begin) {
+            return 0;
+        }
+        if(end >= size) {
+            end = size - 1;
+        }
+    }
+    return begin < size ? 1 : -1;
+}
+
+int32_t StaticFileServlet::handle(HttpRequest& req, HttpResponse& rsp
+                                  ,HttpSession& session) {
+    if(req.getMethod() != HttpMethod::GET && req.getMethod() != HttpMethod::HEAD) {
+        rsp.setStatus(HttpStatus::METHOD_NOT_ALLOWED);
+        rsp.setHeader("Allow", "GET, HEAD");
+        return 0;
+    }
+
+    StringView p = req.getPath();
+    if(!m_prefix.empty() && p.len >= m_prefix.size()
+            && !memcmp(p.ptr, m_prefix.c_str(), m_prefix.size())) {
+        p = StringView(p.ptr + m_prefix.size(), p.len - m_prefix.size());
+    }
+    std::string path;
+    if(p.empty() || p.ptr[0] != '/') {
+        path.push_back('/');
+    }
+    if(!decode_path(p, path)) {
+        rsp.setStatus(HttpStatus::BAD_REQUEST);
+        return 0;
+    }
+    if(has_dot_dot(path)) {
+        rsp.setStatus(HttpStatus::FORBIDDEN);
+        return 0;
+    }
+    if(path.back() == '/') {
+        path.append("index.html");
+    }
+
+    CachedFile::ptr file = FileCacheMgr::GetInstance()->open(m_root + path);
+    if(!file) {
+        if(errno == EACCES || errno == EPERM) {
+            rsp.setStatus(HttpStatus::FORBIDDEN);
+        } else if(errno == ENOENT || errno == ENOTDIR || errno == EISDIR) {
+            rsp.setStatus(HttpStatus::NOT_FOUND);
+        } else {
+            rsp.setStatus(HttpStatus::INTERNAL_SERVER_ERROR);
+        }
+        return 0;
+    }
+
+    std::string last_modified = http_date(file->getMtime());
+    rsp.setHeader("Last-Modified", last_modified);
+    rsp.setHeader("Accept-Ranges", "bytes");
+    if(req.getHeader("If-Modified-Since") == StringView(last_modified)) {
+        rsp.setStatus(HttpStatus::NOT_MODIFIED);
+        return 0;
+    }
+    rsp.setHeader("Content-Type", GetContentType(path));
+
+    uint64_t size = file->getSize();
+    StringView range = req.getHeader("Range");
+    if(!range.empty()) {
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        int rt = parse_range(range, size, begin, end);
+        if(rt < 0) {
+            rsp.setStatus(HttpStatus::RANGE_NOT_SATISFIABLE);
+            rsp.setHeader("Content-Range", "bytes */" + std::to_string(size));
+            return 0;
+        }
+        if(rt > 0) {
+            char buf[96];
+            snprintf(buf, sizeof(buf), "bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64
+                    , begin, end, size);
+            rsp.setStatus(HttpStatus::PARTIAL_CONTENT);
+            rsp.setHeader("Content-Range", buf);
+            rsp.setFile(file, begin, end - begin + 1);
+            return 0;
+        }
+    }
+    rsp.setFile(file, 0, size);
+    return 0;
+}
+
+}
+}
@@ -0,0 +1,43 @@
+#ifndef __SYLAR_HTTP_STATIC_FILE_SERVLET_H__
+#define __SYLAR_HTTP_STATIC_FILE_SERVLET_H__
+
+#include "servlet.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief Serves files under a directory
+ * @details Files are opened through FileCacheMgr and their content goes to
+ *          the socket with sendfile(2), it is never read into user space.
+ *          GET and HEAD only; answers If-Modified-Since with 304 and a
+ *          single "Range: bytes=" range with 206.
+ */
+class StaticFileServlet : public Servlet {
+public:
+    typedef std::shared_ptr<StaticFileServlet> ptr;
+
+    /**
+     * @param[in] root Directory the files are in
+     * @param[in] prefix Leading part of the request path to drop before
+     *            looking the rest up under root, "/static" for a servlet
+     *            added with addGlobServlet("/static/...")
+     */
+    StaticFileServlet(const std::string& root, const std::string& prefix = "");
+
+    int32_t handle(HttpRequest& req, HttpResponse& rsp
+                   ,HttpSession& session) override;
+
+    /**
+     * @brief Content-Type for the extension of path
+     */
+    static const char* GetContentType(const std::string& path);
+private:
+    std::string m_root;
+    std::string m_prefix;
+};
+
+}
+}
+
+#endif
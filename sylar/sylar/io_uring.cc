@@ -0,0 +1,399 @@
+#include "io_uring.h"
+#include "log.h"
+#include "macro.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static int sys_io_uring_setup(uint32_t entries, io_uring_params* p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int sys_io_uring_register(int fd, uint32_t opcode, const void* arg, uint32_t nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+IOUring::BufferGroup::BufferGroup(IOUring* ring, uint16_t bgid, uint32_t count, uint32_t size)
+    :m_ring(ring)
+    ,m_bgid(bgid)
+    ,m_count(count)
+    ,m_size(size) {
+    m_buffers = (char*)malloc((size_t)count * size);
+    if(!m_buffers) {
+        return;
+    }
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe.fd = count;
+    sqe.addr = (uint64_t)m_buffers;
+    sqe.len = size;
+    sqe.off = 0;
+    sqe.buf_group = bgid;
+    // usable only once the kernel has taken them
+    int32_t rt = m_ring->submitAndWait(sqe);
+    if(rt < 0) {
+        SYLAR_LOG_ERROR(g_logger) << "IORING_OP_PROVIDE_BUFFERS bgid=" << bgid
+            << " count=" << count << " errno=" << -rt << " " << strerror(-rt);
+        free(m_buffers);
+        m_buffers = nullptr;
+    }
+}
+
+IOUring::BufferGroup::~BufferGroup() {
+    if(m_buffers) {
+        // once this has completed the kernel can't pick one of the buffers
+        // for a recv still armed, so they may be freed
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_REMOVE_BUFFERS;
+        sqe.fd = m_count;
+        sqe.buf_group = m_bgid;
+        int32_t rt = m_ring->submitAndWait(sqe);
+        if(rt < 0 && rt != -ENOENT) {
+            SYLAR_LOG_ERROR(g_logger) << "IORING_OP_REMOVE_BUFFERS bgid=" << m_bgid
+                << " errno=" << -rt << " " << strerror(-rt);
+        }
+    }
+    free(m_buffers);
+}
+
+void IOUring::BufferGroup::recycle(uint16_t bid) {
+    if(m_hasParked.load(std::memory_order_relaxed)) {
+        provideParked();
+    }
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe.fd = 1;
+    sqe.addr = (uint64_t)getBuffer(bid);
+    sqe.len = m_size;
+    sqe.off = bid;
+    sqe.buf_group = m_bgid;
+    if(!m_ring->queue(&sqe)) {
+        // lost, the group would shrink until recvs fail with ENOBUFS
+        MutexType::Lock lock(m_parkedMutex);
+        m_parked.push_back(bid);
+        m_hasParked.store(true, std::memory_order_relaxed);
+    }
+}
+
+void IOUring::BufferGroup::provideParked() {
+    if(!m_hasParked.load(std::memory_order_relaxed)) {
+        return;
+    }
+    MutexType::Lock lock(m_parkedMutex);
+    while(!m_parked.empty()) {
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe.fd = 1;
+        sqe.addr = (uint64_t)getBuffer(m_parked.back());
+        sqe.len = m_size;
+        sqe.off = m_parked.back();
+        sqe.buf_group = m_bgid;
+        if(!m_ring->queue(&sqe)) {
+            return;
+        }
+        m_parked.pop_back();
+    }
+    m_hasParked.store(false, std::memory_order_relaxed);
+}
+
+IOUring::IOUring(uint32_t entries) {
+    memset(&m_params, 0, sizeof(m_params));
+    m_params.flags = IORING_SETUP_CLAMP;
+    m_fd = sys_io_uring_setup(entries, &m_params);
+    if(m_fd < 0) {
+        SYLAR_LOG_ERROR(g_logger) << "io_uring_setup entries=" << entries
+            << " errno=" << errno << " " << strerror(errno);
+        m_fd = -1;
+        return;
+    }
+
+    m_sqRingSize = m_params.sq_off.array + m_params.sq_entries * sizeof(uint32_t);
+    m_cqRingSize = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+    if(m_params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE
+                    , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if(m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        close(m_fd);
+        m_fd = -1;
+        return;
+    }
+    if(m_params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE
+                        , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if(m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            munmap(m_sqRing, m_sqRingSize);
+            m_sqRing = nullptr;
+            close(m_fd);
+            m_fd = -1;
+            return;
+        }
+    }
+
+    m_sqesSize = m_params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE
+                    , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        if(m_cqRing != m_sqRing) {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = m_cqRing = nullptr;
+        close(m_fd);
+        m_fd = -1;
+        return;
+    }
+    m_sqes = (io_uring_sqe*)sqes;
+
+    char* sq = (char*)m_sqRing;
+    m_sqHead = (uint32_t*)(sq + m_params.sq_off.head);
+    m_sqTail = (uint32_t*)(sq + m_params.sq_off.tail);
+    m_sqFlags = (uint32_t*)(sq + m_params.sq_off.flags);
+    m_sqMask = *(uint32_t*)(sq + m_params.sq_off.ring_mask);
+    m_sqEntries = *(uint32_t*)(sq + m_params.sq_off.ring_entries);
+    // sqe slot i is always index i, so the indirection array is fixed
+    uint32_t* array = (uint32_t*)(sq + m_params.sq_off.array);
+    for(uint32_t i = 0; i < m_sqEntries; ++i) {
+        array[i] = i;
+    }
+    m_sqLocalTail = *m_sqTail;
+
+    char* cq = (char*)m_cqRing;
+    m_cqHead = (uint32_t*)(cq + m_params.cq_off.head);
+    m_cqTail = (uint32_t*)(cq + m_params.cq_off.tail);
+    m_cqMask = *(uint32_t*)(cq + m_params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + m_params.cq_off.cqes);
+}
+
+IOUring::~IOUring() {
+    if(m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if(m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if(m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool IOUring::IsSupported() {
+    static const int s_supported = [](){
+        IOUring ring(4);
+        if(!ring.isValid()) {
+            return 0;
+        }
+        size_t len = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+        io_uring_probe* probe = (io_uring_probe*)calloc(1, len);
+        int rt = sys_io_uring_register(ring.getFd(), IORING_REGISTER_PROBE
+                                        , probe, IORING_OP_LAST);
+        if(rt) {
+            free(probe);
+            return 0;
+        }
+        static const int s_ops[] = {
+            IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READV, IORING_OP_WRITEV,
+            IORING_OP_RECV, IORING_OP_SEND, IORING_OP_ACCEPT, IORING_OP_CONNECT,
+            IORING_OP_RECVMSG, IORING_OP_SENDMSG,
+            IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL,
+            IORING_OP_PROVIDE_BUFFERS, IORING_OP_REMOVE_BUFFERS,
+            IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED
+        };
+        int ok = 1;
+        for(int op : s_ops) {
+            if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                SYLAR_LOG_INFO(g_logger) << "io_uring opcode " << op << " not supported";
+                ok = 0;
+            }
+        }
+        free(probe);
+        return ok;
+    }();
+    return s_supported;
+}
+
+bool IOUring::queue(const io_uring_sqe* sqes, uint32_t n) {
+    if(n > m_sqEntries) {
+        return false;
+    }
+    MutexType::Lock lock(m_sqMutex);
+    uint32_t head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if(m_sqLocalTail + n - head > m_sqEntries) {
+        // full: push what is queued to the kernel and look again
+        submitNoLock();
+        head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if(m_sqLocalTail + n - head > m_sqEntries) {
+            return false;
+        }
+    }
+    for(uint32_t i = 0; i < n; ++i) {
+        m_sqes[m_sqLocalTail & m_sqMask] = sqes[i];
+        ++m_sqLocalTail;
+    }
+    m_pending += n;
+    if(m_pending >= SUBMIT_BATCH) {
+        submitNoLock();
+    }
+    return true;
+}
+
+int IOUring::submit() {
+    if(!m_pending) {
+        return 0;
+    }
+    MutexType::Lock lock(m_sqMutex);
+    return submitNoLock();
+}
+
+int IOUring::submitNoLock() {
+    uint32_t n = m_pending;
+    if(!n) {
+        return 0;
+    }
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+    int rt = 0;
+    do {
+        rt = sys_io_uring_enter(m_fd, n, 0, 0);
+    } while(rt < 0 && errno == EINTR);
+    if(rt < 0) {
+        rt = -errno;
+        SYLAR_LOG_ERROR(g_logger) << "io_uring_enter submit=" << n
+            << " errno=" << -rt << " " << strerror(-rt);
+        return rt;
+    }
+    m_pending -= rt;
+    return rt;
+}
+
+namespace {
+
+/**
+ * @brief The CQE submitAndWait() waits for
+ */
+struct SyncCompletion : public IOUring::Completion {
+    std::atomic<bool> done = {false};
+    int32_t res = 0;
+
+    void onComplete(int32_t r, uint32_t flags) override {
+        res = r;
+        done.store(true, std::memory_order_release);
+    }
+};
+
+}
+
+int32_t IOUring::submitAndWait(io_uring_sqe& sqe) {
+    SyncCompletion c;
+    sqe.user_data = (uint64_t)&c;
+    bool queued = false;
+    while(true) {
+        if(!queued) {
+            queued = queue(&sqe);
+        }
+        submit();
+        reap();
+        if(c.done.load(std::memory_order_acquire)) {
+            return c.res;
+        }
+        // another thread may reap our CQE, so don't block on the ring
+        // for good
+        pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        poll(&pfd, 1, 1);
+    }
+}
+
+size_t IOUring::reap() {
+    size_t count = 0;
+    MutexType::Lock lock(m_cqMutex);
+    while(true) {
+        uint32_t head = *m_cqHead;
+        uint32_t tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        if(head == tail) {
+            if(__atomic_load_n(m_sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) {
+                // the kernel kept CQEs aside, ask it to flush them
+                sys_io_uring_enter(m_fd, 0, 0, IORING_ENTER_GETEVENTS);
+                if(__atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) != head) {
+                    continue;
+                }
+            }
+            break;
+        }
+        for(; head != tail; ++head) {
+            io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+            Completion* c = (Completion*)cqe.user_data;
+            int32_t res = cqe.res;
+            uint32_t flags = cqe.flags;
+            // free the slot before dispatching, the handler may resume a
+            // fiber that submits again
+            __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+            if(c) {
+                c->onComplete(res, flags);
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+
+int IOUring::registerBuffers(const struct iovec* iovs, uint32_t n) {
+    int rt = sys_io_uring_register(m_fd, IORING_REGISTER_BUFFERS, iovs, n);
+    return rt ? -errno : 0;
+}
+
+int IOUring::unregisterBuffers() {
+    int rt = sys_io_uring_register(m_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    return rt ? -errno : 0;
+}
+
+int IOUring::registerFileTable(uint32_t n) {
+    std::vector<int> fds(n, -1);
+    int rt = sys_io_uring_register(m_fd, IORING_REGISTER_FILES, &fds[0], n);
+    return rt ? -errno : 0;
+}
+
+int IOUring::updateFile(uint32_t index, int fd) {
+    io_uring_files_update up;
+    memset(&up, 0, sizeof(up));
+    up.offset = index;
+    up.fds = (uint64_t)&fd;
+    int rt = sys_io_uring_register(m_fd, IORING_REGISTER_FILES_UPDATE, &up, 1);
+    return rt < 0 ? -errno : 0;
+}
+
+IOUring::BufferGroup::ptr IOUring::createBufferGroup(uint16_t bgid, uint32_t count, uint32_t size) {
+    if(!count || count > 65536 || !size) {
+        return nullptr;
+    }
+    BufferGroup::ptr group(new BufferGroup(this, bgid, count, size));
+    return group->isValid() ? group : nullptr;
+}
+
+}
@@ -0,0 +1,210 @@
+#ifndef __SYLAR_IO_URING_H__
+#define __SYLAR_IO_URING_H__
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "thread.h"
+
+namespace sylar {
+
+/**
+ * @brief Thin wrapper around a raw io_uring instance
+ * @details Only deals with the rings themselves: queueing SQEs, flushing them
+ *          in batches, reaping CQEs, and the registered resources (fixed
+ *          buffers, fixed files, provided buffer groups). Suspending and
+ *          resuming fibers is left to IOManager, which polls getFd() with
+ *          epoll. Both queues may be used from any thread.
+ */
+class IOUring {
+public:
+    typedef std::shared_ptr<IOUring> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief Target of a CQE, passed to the kernel as user_data
+     */
+    class Completion {
+    public:
+        virtual ~Completion() {}
+        /**
+         * @param[in] res CQE result, -errno on failure
+         * @param[in] flags CQE flags (IORING_CQE_F_MORE, IORING_CQE_F_BUFFER...)
+         */
+        virtual void onComplete(int32_t res, uint32_t flags) = 0;
+    };
+
+    /**
+     * @brief Provided buffer group (IORING_OP_PROVIDE_BUFFERS)
+     * @details Buffers are picked by the kernel for IOSQE_BUFFER_SELECT
+     *          requests such as multishot recv and handed back with recycle().
+     *          Returning a buffer is just another SQE, so it rides along with
+     *          the next batch instead of costing a syscall of its own.
+     */
+    class BufferGroup {
+    public:
+        typedef std::shared_ptr<BufferGroup> ptr;
+
+        ~BufferGroup();
+
+        uint16_t getId() const { return m_bgid;}
+        uint32_t getBufferSize() const { return m_size;}
+        uint32_t getCount() const { return m_count;}
+
+        /**
+         * @brief Address of buffer bid
+         */
+        char* getBuffer(uint16_t bid) const { return m_buffers + (size_t)bid * m_size;}
+
+        /**
+         * @brief Give buffer bid back to the kernel
+         * @details If the SQ is full the buffer is parked and goes back
+         *          with the next recycle() or provideParked().
+         */
+        void recycle(uint16_t bid);
+
+        /**
+         * @brief Give back the buffers parked by recycle(), if any
+         */
+        void provideParked();
+    private:
+        friend class IOUring;
+        BufferGroup(IOUring* ring, uint16_t bgid, uint32_t count, uint32_t size);
+        bool isValid() const { return m_buffers != nullptr;}
+    private:
+        IOUring* m_ring;
+        uint16_t m_bgid;
+        uint32_t m_count;
+        uint32_t m_size;
+        char* m_buffers = nullptr;
+        MutexType m_parkedMutex;
+        /// bids the SQ had no room for
+        std::vector<uint16_t> m_parked;
+        std::atomic<bool> m_hasParked = {false};
+    };
+
+    /**
+     * @brief Set up a ring
+     * @param[in] entries SQ size, rounded up to a power of two by the kernel
+     */
+    IOUring(uint32_t entries);
+    ~IOUring();
+
+    /**
+     * @brief Whether the ring was set up successfully
+     */
+    bool isValid() const { return m_fd >= 0;}
+
+    /**
+     * @brief Ring fd, readable while there are CQEs to reap
+     */
+    int getFd() const { return m_fd;}
+
+    /**
+     * @brief Whether the running kernel has every opcode IOManager relies on
+     * @details Probed once per process.
+     */
+    static bool IsSupported();
+
+    /**
+     * @brief Copy n prepared SQEs into the submission queue
+     * @details The SQEs land next to each other so IOSQE_IO_LINK chains stay
+     *          intact. They are only handed to the kernel by submit(), or
+     *          right away when the queue is full or the batch is big enough.
+     * @return false if the ring couldn't take them
+     */
+    bool queue(const io_uring_sqe* sqes, uint32_t n = 1);
+
+    /**
+     * @brief Hand every queued SQE to the kernel in one io_uring_enter
+     * @return number of SQEs submitted, -errno on failure
+     */
+    int submit();
+
+    /**
+     * @brief Number of SQEs queued but not submitted yet
+     */
+    uint32_t pending() const { return m_pending;}
+
+    /**
+     * @brief Submit sqe and reap until its own CQE is in
+     * @details For setup and teardown, whether or not other threads reap
+     *          the ring too. Other CQEs reaped meanwhile are dispatched as
+     *          usual. sqe.user_data is overwritten.
+     * @return CQE result, -errno on failure
+     */
+    int32_t submitAndWait(io_uring_sqe& sqe);
+
+    /**
+     * @brief Drain the completion queue
+     * @details Every CQE is dispatched to the Completion stored in its
+     *          user_data, a user_data of 0 is dropped.
+     * @return number of CQEs reaped
+     */
+    size_t reap();
+
+    /**
+     * @brief Register fixed buffers (IORING_OP_READ_FIXED/WRITE_FIXED)
+     * @return 0 on success, -errno on failure
+     */
+    int registerBuffers(const struct iovec* iovs, uint32_t n);
+    int unregisterBuffers();
+
+    /**
+     * @brief Register a sparse fixed file table of size n
+     * @return 0 on success, -errno on failure
+     */
+    int registerFileTable(uint32_t n);
+
+    /**
+     * @brief Put fd at slot index of the fixed file table, -1 clears it
+     * @return 0 on success, -errno on failure
+     */
+    int updateFile(uint32_t index, int fd);
+
+    /**
+     * @brief Create a provided buffer group
+     * @param[in] bgid Group id
+     * @param[in] count Number of buffers
+     * @param[in] size Size of each buffer
+     * @return the group, nullptr if the kernel refused it
+     */
+    BufferGroup::ptr createBufferGroup(uint16_t bgid, uint32_t count, uint32_t size);
+private:
+    /// flush when this many SQEs are waiting
+    static const uint32_t SUBMIT_BATCH = 32;
+
+    int submitNoLock();
+private:
+    int m_fd = -1;
+    io_uring_params m_params;
+
+    MutexType m_sqMutex;
+    void* m_sqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+    uint32_t* m_sqHead = nullptr;
+    uint32_t* m_sqTail = nullptr;
+    uint32_t* m_sqFlags = nullptr;
+    uint32_t m_sqMask = 0;
+    uint32_t m_sqEntries = 0;
+    /// local tail, published to the kernel on submit
+    uint32_t m_sqLocalTail = 0;
+    std::atomic<uint32_t> m_pending = {0};
+
+    MutexType m_cqMutex;
+    void* m_cqRing = nullptr;
+    size_t m_cqRingSize = 0;
+    uint32_t* m_cqHead = nullptr;
+    uint32_t* m_cqTail = nullptr;
+    uint32_t m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+};
+
+}
+
+#endif
@@ -1,17 +1,97 @@
 #include "iomanager.h"
 #include "macro.h"
 #include "log.h"
+#include "config.h"
+#include "fd_manager.h"
 
 #include <errno.h>
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
+#include <sys/sendfile.h>
 #include <string.h>
+#include <poll.h>
+#include <sstream>
+#include <new>
+#include <stdlib.h>
+#include <set>
 
 namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+static sylar::ConfigVar<bool>::ptr g_iomanager_per_thread_epoll =
+    sylar::Config::Lookup("iomanager.per_thread_epoll", false
+            , "give every worker thread its own epoll instance and shard fds over them");
+
+static sylar::ConfigVar<uint32_t>::ptr g_epoll_batch_min =
+    sylar::Config::Lookup("iomanager.epoll.batch_min", (uint32_t)64
+            , "epoll_wait batch size an idle thread starts with and shrinks back to");
+
+static sylar::ConfigVar<uint32_t>::ptr g_epoll_batch_max =
+    sylar::Config::Lookup("iomanager.epoll.batch_max", (uint32_t)4096
+            , "largest epoll_wait batch size an idle thread grows to");
+
+static sylar::ConfigVar<std::string>::ptr g_epoll_mode =
+    sylar::Config::Lookup("iomanager.epoll.mode", std::string("classic")
+            , "fd registration: classic (re-register per wait), persistent, oneshot");
+
+static sylar::ConfigVar<bool>::ptr g_io_uring_enable =
+    sylar::Config::Lookup("iomanager.io_uring.enable", true
+            , "use io_uring for IOManager IO when the kernel supports it");
+
+static sylar::ConfigVar<uint32_t>::ptr g_io_uring_entries =
+    sylar::Config::Lookup("iomanager.io_uring.entries", (uint32_t)256
+            , "io_uring submission queue size");
+
+static sylar::ConfigVar<uint32_t>::ptr g_io_uring_fixed_files =
+    sylar::Config::Lookup("iomanager.io_uring.fixed_files", (uint32_t)4096
+            , "io_uring fixed file table size, fds below it can be registered");
+
+static sylar::ConfigVar<uint32_t>::ptr g_io_uring_buffer_count =
+    sylar::Config::Lookup("iomanager.io_uring.buffer_count", (uint32_t)1024
+            , "number of provided buffers for multishot recv");
+
+static sylar::ConfigVar<uint32_t>::ptr g_io_uring_buffer_size =
+    sylar::Config::Lookup("iomanager.io_uring.buffer_size", (uint32_t)4096
+            , "size of each provided buffer for multishot recv");
+
+namespace {
+
+/**
+ * @brief Shared between a timed wait and the timer that may cancel it
+ */
+struct IOTimeout {
+    Mutex mutex;
+    /// errno to fail the wait with once the timer fired
+    int cancelled = 0;
+    /// the wait is over, the timer must leave it alone
+    bool done = false;
+};
+
+/**
+ * @brief Resumes the fiber that submitted an SQE
+ */
+struct UringWaiter : public IOUring::Completion {
+    Scheduler* scheduler = nullptr;
+    Fiber::ptr fiber;
+    int32_t res = 0;
+    /// CQEs still to come, one per SQE; reap() dispatches them in order
+    uint32_t remaining = 1;
+
+    void onComplete(int32_t r, uint32_t flags) override {
+        res = r;
+        if(--remaining) {
+            return;
+        }
+        // the fiber may run and drop this object as soon as it is queued
+        scheduler->schedule(&fiber);
+    }
+};
+
+}
+
 IOManager::FdContext::EventContext& IOManager::FdContext::getContext(IOManager::Event event) {
   switch(event) {
     case IOManager::READ:
@@ -30,79 +110,189 @@ void IOManager::FdContext::resetContext(EventContext& ctx) {
   ctx.cb = nullptr;
 }
 
-void IOManager::FdContext::triggerEvent(Event event) {
+void IOManager::FdContext::triggerEvent(Event event, int thread) {
     SYLAR_ASSERT(events & event);
     events = (Event)(events & ~event);
     EventContext& ctx = getContext(event);
     if(ctx.cb) {
-      ctx.scheduler->schedule(&ctx.cb);
+      ctx.scheduler->schedule(&ctx.cb, thread);
     } else {
-      ctx.scheduler->schedule(&ctx.fiber);
+      ctx.scheduler->schedule(&ctx.fiber, thread);
     }
     ctx.scheduler = nullptr;
     return;
 }
 
-IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
-  :Scheduler(threads, use_caller, name) {
-    m_epfd = epoll_create(5000);
-    SYLAR_ASSERT(m_epfd > 0);
+IOManager::EpollShard::EpollShard() {
+    epfd = epoll_create(5000);
+    SYLAR_ASSERT(epfd > 0);
 
-    int rt = pipe(m_tickleFds);
-    SYLAR_ASSERT(!rt);
+    tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    SYLAR_ASSERT(tickleFd > 0);
 
     epoll_event event;
     memset(&event, 0, sizeof(epoll_event));
     event.events = EPOLLIN | EPOLLET;
-    event.data.fd = m_tickleFds[0];
+    event.data.fd = tickleFd;
 
-    rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
-    SYLAR_ASSERT(!rt);
-    
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
+    int rt = epoll_ctl(epfd, EPOLL_CTL_ADD, tickleFd, &event);
     SYLAR_ASSERT(!rt);
+}
+
+IOManager::EpollShard::~EpollShard() {
+    close(epfd);
+    close(tickleFd);
+}
+
+void IOManager::EpollShard::tickle() {
+  // coalesce: one outstanding wakeup is enough, whoever consumes it
+  // rescans the queue and tickles again if there is more work
+  if(tickled.exchange(true)) {
+    return;
+  }
+  uint64_t one = 1;
+  int rt = ::write(tickleFd, &one, sizeof(one));
+  SYLAR_ASSERT(rt == sizeof(one));
+}
+
+/// IOManagers not yet destroyed, for the static Cancel* calls
+static RWMutex& LiveMutex() {
+  static RWMutex s_mutex;
+  return s_mutex;
+}
+
+static std::set<IOManager*>& LiveIOManagers() {
+  static std::set<IOManager*> s_live;
+  return s_live;
+}
 
-    contextResize(32);
+IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
+  :Scheduler(threads, use_caller, name) {
+    m_perThread = g_iomanager_per_thread_epoll->getValue();
+    if(m_perThread) {
+      // fds are spread over the worker threads only: with use_caller the
+      // caller just runs the scheduler inside stop(), so it gets a shard of
+      // its own that only carries tickles
+      m_fdShardCount = m_threadCount ? m_threadCount : 1;
+      size_t count = m_fdShardCount;
+      if(m_rootThread != -1 && m_threadCount) {
+        ++count;
+      }
+      for(size_t i = 0; i < count; ++i) {
+        m_shards.push_back(new EpollShard);
+      }
+      if(m_rootThread != -1) {
+        m_shards.back()->thread = m_rootThread;
+      }
+    } else {
+      m_fdShardCount = 1;
+      m_shards.push_back(new EpollShard);
+    }
+
+    m_epollMode = EpollModeFromString(g_epoll_mode->getValue());
 
+    m_batchMin = std::max(g_epoll_batch_min->getValue(), (uint32_t)1);
+    m_batchMax = std::max(g_epoll_batch_max->getValue(), m_batchMin);
+    for(size_t i = 0; i < EPOLL_STATS_BUCKETS; ++i) {
+      m_statHistogram[i] = 0;
+    }
+    for(size_t i = 0; i < 3; ++i) {
+      m_statCtl[i] = 0;
+    }
+
+    if(g_io_uring_enable->getValue() && IOUring::IsSupported()) {
+      m_uring = new IOUring(g_io_uring_entries->getValue());
+      if(m_uring->isValid()) {
+        // completions are picked up by whoever waits on the first shard
+        epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = m_uring->getFd();
+        int rt = epoll_ctl(m_shards[0]->epfd, EPOLL_CTL_ADD, m_uring->getFd(), &event);
+        SYLAR_ASSERT(!rt);
+      } else {
+        delete m_uring;
+        m_uring = nullptr;
+      }
+    }
+
+    {
+      RWMutex::WriteLock lock(LiveMutex());
+      LiveIOManagers().insert(this);
+    }
     start();
 }
 
 IOManager::~IOManager(){
   stop();
-  close(m_epfd);
-  close(m_tickleFds[0]);
-  close(m_tickleFds[1]);
-
-  for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-    if(m_fdContexts[i]) {
-      delete m_fdContexts[i];
-    }
+  {
+    RWMutex::WriteLock lock(LiveMutex());
+    LiveIOManagers().erase(this);
+  }
+  m_bufferGroup.reset();
+  delete m_uring;
+  for(auto i : m_shards) {
+    delete i;
+  }
+  for(auto i : m_batchSizes) {
+    delete i;
   }
 };
 
-void IOManager::contextResize(size_t size) {
-  m_fdContexts.resize(size);
+IOManager::EpollShard* IOManager::claimShard() {
+  if(!m_perThread) {
+    return m_shards[0];
+  }
+  if(sylar::GetThreadId() == m_rootThread) {
+    return m_shards.back();
+  }
+  EpollShard* shard = m_shards[m_nextShard++ % m_fdShardCount];
+  shard->thread = sylar::GetThreadId();
+  return shard;
+}
+
+void IOManager::triggerEvent(FdContext* fd_ctx, Event event, int thread) {
+  // only pin when the waiter will be resumed by this IOManager, another
+  // scheduler doesn't run our threads
+  if(fd_ctx->getContext(event).scheduler != this) {
+    thread = -1;
+  }
+  fd_ctx->triggerEvent(event, thread);
+}
 
-  for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-    if(!m_fdContexts[i]) {
-      m_fdContexts[i] = new FdContext;
-      m_fdContexts[i]->fd = i;
-    }
+int IOManager::ownerOf(int fd) const {
+  if(!m_perThread) {
+    return -1;
   }
+  return shardOf(fd)->thread;
+}
+
+void* IOManager::FdContext::operator new(size_t size) {
+  void* ptr = nullptr;
+  if(posix_memalign(&ptr, alignof(FdContext), size)) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void IOManager::FdContext::operator delete(void* ptr) {
+  free(ptr);
+}
+
+IOManager::FdContext* IOManager::getFdContext(int fd) {
+  return m_fdContexts.getOrCreate(fd, [fd](){
+    FdContext* ctx = new FdContext;
+    ctx->fd = fd;
+    return ctx;
+  });
 }
 
 // 1 success, 0 retry, -1 error
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
-  FdContext* fd_ctx = nullptr;
-  RWMutexType::ReadLock lock(m_mutex);
-  if ((int)m_fdContexts.size() >= fd) {
-    fd_ctx = m_fdContexts[fd];
-    lock.unlock();
-  } else {
-    lock.unlock();
-    RWMutexType::WriteLock lock2(m_mutex);
-    contextResize(fd * 1.5);
-    fd_ctx = m_fdContexts[fd];
+  FdContext* fd_ctx = getFdContext(fd);
+  if(!fd_ctx) {
+    SYLAR_LOG_ERROR_RATELIMITED(g_logger, 10) << "addEvent fd=" << fd << " out of range";
+    return -1;
   }
 
   FdContext::MutexType::Lock lock2(fd_ctx->mutex);
@@ -113,17 +303,20 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     SYLAR_ASSERT(!(fd_ctx->events & event));
   }
 
-  int op = fd_ctx->events ?  EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-  epoll_event epevent;
-  epevent.events = EPOLLET | fd_ctx->events | event;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-  if(rt) {
-    SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << "," << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                    << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
-                    << (EPOLL_EVENTS)fd_ctx->events;
+  if(m_epollMode == PERSISTENT) {
+    if(!fd_ctx->inEpoll) {
+      if(!epollCtl(fd_ctx, EPOLL_CTL_ADD, READ | WRITE)) {
+        return -1;
+      }
+    } else if(fd_ctx->ready & event) {
+      // an edge came in while nobody was waiting and the caller may not
+      // have consumed it, have the kernel look at the fd again
+      fd_ctx->ready &= ~event;
+      if(!epollCtl(fd_ctx, EPOLL_CTL_MOD, READ | WRITE)) {
+        return -1;
+      }
+    }
+  } else if(!setInterest(fd_ctx, fd_ctx->events | event)) {
     return -1;
   }
 
@@ -145,12 +338,10 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
 }
 
 bool IOManager::delEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock(m_mutex);
-  if((int)m_fdContexts.size() <= fd) {
+  FdContext* fd_ctx = m_fdContexts.get(fd);
+  if(!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
   FdContext::MutexType::Lock lock2(fd_ctx->mutex);
   if(!(fd_ctx->events & event)) {
@@ -158,16 +349,7 @@ bool IOManager::delEvent(int fd, Event event) {
   }
 
   Event new_events = (Event)(fd_ctx->events & ~event);
-  int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-  epoll_event epevent;
-  epevent.events = EPOLLET | new_events;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-  if(rt) {
-    SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << "," << fd << "," << epevent.events << "):"
-                    << rt << " ()" << errno << ") (" << strerror(errno) << ")";
+  if(m_epollMode != PERSISTENT && !setInterest(fd_ctx, new_events)) {
     return false;
   }
 
@@ -179,12 +361,10 @@ bool IOManager::delEvent(int fd, Event event) {
 }
 
 bool IOManager::cancelEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock(m_mutex);
-  if((int)m_fdContexts.size() <= fd) {
+  FdContext* fd_ctx = m_fdContexts.get(fd);
+  if(!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
   FdContext::MutexType::Lock lock2(fd_ctx->mutex);
   if(!(fd_ctx->events & event)) {
@@ -192,56 +372,55 @@ bool IOManager::cancelEvent(int fd, Event event) {
   }
 
   Event new_events = (Event)(fd_ctx->events & ~event);
-  int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-  epoll_event epevent;
-  epevent.events = EPOLLET | new_events;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-  if(rt) {
-    SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << "," << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
+  if(m_epollMode != PERSISTENT && !setInterest(fd_ctx, new_events)) {
     return false;
   }
 
-  fd_ctx->triggerEvent(event);
+  triggerEvent(fd_ctx, event, ownerOf(fd));
   --m_pendingEventCount;
   return true;
 }
 
 bool IOManager::cancelAll(int fd) {
-  RWMutexType::ReadLock lock(m_mutex);
-  if((int)m_fdContexts.size() <= fd) {
+  FdContext* fd_ctx = m_fdContexts.get(fd);
+  if(m_uring && fd_ctx && fd_ctx->uringOps.load(std::memory_order_relaxed)) {
+    // io_uring ops in flight on fd don't go through the fd context, have
+    // the kernel complete all of them with -ECANCELED. The cancel names the
+    // fd, so it has to be submitted before the fd is closed and reused.
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    prepFd(sqe, fd);
+    if(sqe.flags & IOSQE_FIXED_FILE) {
+      sqe.flags &= ~IOSQE_FIXED_FILE;
+      sqe.cancel_flags |= IORING_ASYNC_CANCEL_FD_FIXED;
+    }
+    m_uring->queue(&sqe);
+    m_uring->submit();
+  }
+
+  if(!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
   FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-  if(!fd_ctx->events) {
+  // persistent and oneshot registrations outlive the waits, this is where
+  // they go away, so it must be called before the fd is closed
+  if(fd_ctx->inEpoll && !epollCtl(fd_ctx, EPOLL_CTL_DEL, NONE)) {
     return false;
   }
-
-  int op =  EPOLL_CTL_DEL;
-  epoll_event epevent;
-  epevent.events = 0;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-  if(rt) {
-    SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << "," << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
+  fd_ctx->ready = NONE;
+  if(!fd_ctx->events) {
     return false;
   }
 
   if(fd_ctx->events & READ) {
-      fd_ctx->triggerEvent(READ);
+      triggerEvent(fd_ctx, READ, ownerOf(fd));
       --m_pendingEventCount;
   }
   if(fd_ctx->events & WRITE) {
-    fd_ctx->triggerEvent(WRITE);
+    triggerEvent(fd_ctx, WRITE, ownerOf(fd));
     --m_pendingEventCount;
   }
 
@@ -253,35 +432,100 @@ IOManager* IOManager::GetThis() {
   return dynamic_cast<IOManager*>(Scheduler::GetThis());
 }
 
+bool IOManager::CancelEvent(IOManager* iom, int fd, Event event) {
+  if(!iom) {
+    return false;
+  }
+  RWMutex::ReadLock lock(LiveMutex());
+  return LiveIOManagers().count(iom) && iom->cancelEvent(fd, event);
+}
+
+bool IOManager::CancelAll(IOManager* iom, int fd) {
+  if(!iom) {
+    return false;
+  }
+  RWMutex::ReadLock lock(LiveMutex());
+  return LiveIOManagers().count(iom) && iom->cancelAll(fd);
+}
+
 void IOManager::tickle() {
-  if(!hasIdleThreads()) {
+  // no hasIdleThreads() shortcut: a thread that already scanned the queue
+  // but isn't counted idle yet would sleep through work pinned to it. The
+  // shard's tickled flag keeps this to one write per wakeup anyway.
+  if(m_shards.size() == 1) {
+    m_shards[0]->tickle();
     return;
   }
-  int rt = write(m_tickleFds[1], "T", 1);
-  SYLAR_ASSERT(rt == 1);
+  // wake one idle owner, round robin so pinned work reaches its thread
+  size_t start = m_tickleShard++;
+  for(size_t i = 0; i < m_shards.size(); ++i) {
+    EpollShard* shard = m_shards[(start + i) % m_shards.size()];
+    if(shard->idle) {
+      shard->tickle();
+      return;
+    }
+  }
+  // a thread is between run() and epoll_wait, we can't tell which one
+  for(auto i : m_shards) {
+    i->tickle();
+  }
 }
 
 bool IOManager::stopping() {
-  return Scheduler::stopping() 
-            && m_pendingEventCount == 0;
+  uint64_t timeout = 0;
+  return stopping(timeout);
+}
+
+bool IOManager::stopping(uint64_t& timeout) {
+  timeout = getNextTimer();
+  return timeout == ~0ull
+            && m_pendingEventCount == 0
+            && Scheduler::stopping();
+}
+
+void IOManager::onTimerInsertedAtFront() {
+  tickle();
 }
 
 void IOManager::idle() {
-   epoll_event* events = new epoll_event[64]();
-   std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr){
-      delete[] ptr; 
-   });
+   EpollShard* shard = claimShard();
+   // in per-thread mode woken fibers resume here, on the fd's owner
+   int thread = m_perThread ? sylar::GetThreadId() : -1;
+   // the batch doubles whenever epoll_wait fills it, so a busy thread
+   // drains its ready list in fewer calls, and halves again after a run
+   // of mostly empty wakeups so a quiet thread doesn't keep a big array
+   uint32_t batch = m_batchMin;
+   uint32_t quiet = 0;
+   std::vector<epoll_event> events(batch);
+   std::atomic<uint32_t>* batch_stat = new std::atomic<uint32_t>(batch);
+   {
+     Mutex::Lock lock(m_statMutex);
+     m_batchSizes.push_back(batch_stat);
+   }
 
    while(true) {
-     if(stopping()) {
+     uint64_t next_timeout = 0;
+     if(stopping(next_timeout)) {
       SYLAR_LOG_INFO(g_logger) << "name=" << getName() << " idle stopping exit";
+      *batch_stat = 0;
+      // wakeups are coalesced, pass the stop on to the next idle thread
+      tickle();
       return;
      }
 
+     if(m_uring) {
+       // batched submission: everything queued since the last idle goes
+       // to the kernel in one io_uring_enter
+       m_uring->submit();
+     }
+
      int rt = 0;
      do {
-        static const int MAX_TIMEOUT = 5000;
-        rt = epoll_wait(m_epfd, events, 64, MAX_TIMEOUT);
+        static const uint64_t MAX_TIMEOUT = 5000;
+        shard->idle = true;
+        rt = epoll_wait(shard->epfd, &events[0], batch
+                        , (int)std::min(next_timeout, MAX_TIMEOUT));
+        shard->idle = false;
 
         if(rt < 0 && errno == EINTR) {
         } else {
@@ -289,13 +533,57 @@ void IOManager::idle() {
         }
      } while(true); 
 
+     std::vector<std::function<void()> > cbs;
+     listExpiredCb(cbs);
+     if(!cbs.empty()) {
+       schedule(cbs.begin(), cbs.end());
+       cbs.clear();
+     }
+
+     if(rt >= 0) {
+       ++m_statWakeups;
+       m_statEvents += rt;
+       ++m_statHistogram[rt ? std::min(EPOLL_STATS_BUCKETS - 1
+                                  , (size_t)(32 - __builtin_clz(rt))) : 0];
+       if(rt == 0) {
+         ++m_statTimeouts;
+       }
+     }
+     static const uint32_t SHRINK_AFTER = 8;
+     if(rt == (int)batch) {
+       ++m_statFullBatches;
+       quiet = 0;
+     } else if(rt <= (int)batch / 4) {
+       ++quiet;
+     } else {
+       quiet = 0;
+     }
+     // events[] is still being read below, so resize only for the next call
+     uint32_t next_batch = batch;
+     if(rt == (int)batch && batch < m_batchMax) {
+       next_batch = std::min(batch * 2, m_batchMax);
+       ++m_statGrows;
+     } else if(quiet >= SHRINK_AFTER && batch > m_batchMin) {
+       next_batch = std::max(batch / 2, m_batchMin);
+       quiet = 0;
+       ++m_statShrinks;
+     }
+
      for(int i = 0; i < rt; ++i) {
           epoll_event& event = events[i];
-          if(event.data.fd == m_tickleFds[0]) {
-            uint8_t dummy;
-            while(read(m_tickleFds[0], &dummy, 1) == 1);
+          if(event.data.fd == shard->tickleFd) {
+            // drain before clearing the flag: a tickle racing with us is
+            // either read here or finds the flag still set, and in both
+            // cases this thread rescans the queue right after
+            uint64_t dummy;
+            while(::read(shard->tickleFd, &dummy, sizeof(dummy)) == sizeof(dummy));
+            shard->tickled = false;
             continue;      
           }
+          if(m_uring && event.data.fd == m_uring->getFd()) {
+            m_uring->reap();
+            continue;
+          }
 
           FdContext* fd_ctx = (FdContext*)event.data.ptr;
           FdContext::MutexType::Lock lock(fd_ctx->mutex);
@@ -310,32 +598,44 @@ void IOManager::idle() {
             real_events |= WRITE;
           }
 
-          if((fd_ctx->events & real_events) == NONE) {
-            continue;
+          if(m_epollMode == ONESHOT) {
+            // the kernel disarmed the fd when it reported it
+            fd_ctx->armed = NONE;
+          } else if(m_epollMode == PERSISTENT) {
+            // remember edges nobody waits for, see addEvent
+            fd_ctx->ready |= real_events & ~fd_ctx->events;
           }
+          real_events &= fd_ctx->events;
 
-          int left_events = (fd_ctx->events & ~real_events);
-          int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-          event.events = EPOLLET | left_events;
-
-          int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-          if(rt2) {
-              SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                            << op << "," << fd_ctx->fd << "," << event.events << "):"
-                            << rt2 << " ()" << errno << ") (" << strerror(errno) << ")";
+          if(m_epollMode != PERSISTENT) {
+            // what is left after firing real_events, MOD/DEL in classic
+            // mode, re-arm the other direction in oneshot mode
+            int left_events = (fd_ctx->events & ~real_events);
+            if(!setInterest(fd_ctx, left_events)) {
               continue;
+            }
+          }
+          if(real_events == NONE) {
+            continue;
           }
 
           if(real_events & READ) {
-            fd_ctx->triggerEvent(READ);
+            triggerEvent(fd_ctx, READ, thread);
             --m_pendingEventCount;
           }
           if(real_events & WRITE) {
-            fd_ctx->triggerEvent(WRITE);
+            triggerEvent(fd_ctx, WRITE, thread);
             --m_pendingEventCount;
           }
        }
 
+       if(next_batch != batch) {
+         batch = next_batch;
+         events.resize(batch);
+         events.shrink_to_fit();
+         *batch_stat = batch;
+       }
+
        Fiber::ptr cur = Fiber::GetThis();
        auto raw_ptr = cur.get();
 
@@ -343,4 +643,805 @@ void IOManager::idle() {
    }
 }
 
+IOManager::EpollMode IOManager::EpollModeFromString(const std::string& str) {
+  if(str == "classic") {
+    return CLASSIC;
+  } else if(str == "persistent") {
+    return PERSISTENT;
+  } else if(str == "oneshot") {
+    return ONESHOT;
+  }
+  SYLAR_LOG_ERROR(g_logger) << "unknown iomanager.epoll.mode " << str << ", using classic";
+  return CLASSIC;
+}
+
+bool IOManager::epollCtl(FdContext* fd_ctx, int op, int events) {
+  epoll_event epevent;
+  memset(&epevent, 0, sizeof(epevent));
+  epevent.events = events;
+  if(m_epollMode == ONESHOT) {
+    epevent.events |= EPOLLONESHOT;
+  } else {
+    epevent.events |= EPOLLET;
+  }
+  epevent.data.ptr = fd_ctx;
+
+  int epfd = shardOf(fd_ctx->fd)->epfd;
+  int rt = epoll_ctl(epfd, op, fd_ctx->fd, &epevent);
+  if(rt && op == EPOLL_CTL_MOD && errno == ENOENT) {
+    // the fd was closed without cancelAll() and its number reused
+    op = EPOLL_CTL_ADD;
+    rt = epoll_ctl(epfd, op, fd_ctx->fd, &epevent);
+  } else if(rt && op == EPOLL_CTL_ADD && errno == EEXIST) {
+    op = EPOLL_CTL_MOD;
+    rt = epoll_ctl(epfd, op, fd_ctx->fd, &epevent);
+  } else if(rt && op == EPOLL_CTL_DEL && (errno == ENOENT || errno == EBADF)) {
+    // already gone with the close
+    rt = 0;
+  }
+  ++m_statCtl[op == EPOLL_CTL_ADD ? 0 : op == EPOLL_CTL_MOD ? 1 : 2];
+  if(rt) {
+    SYLAR_LOG_ERROR_RATELIMITED(g_logger, 10) << "epoll_ctl(" << epfd << ", "
+                    << op << "," << fd_ctx->fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                    << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
+                    << (EPOLL_EVENTS)fd_ctx->events;
+    return false;
+  }
+  fd_ctx->inEpoll = op != EPOLL_CTL_DEL;
+  fd_ctx->armed = op == EPOLL_CTL_DEL ? NONE : events;
+  return true;
+}
+
+bool IOManager::setInterest(FdContext* fd_ctx, int events) {
+  if(events == NONE) {
+    if(m_epollMode == ONESHOT || !fd_ctx->inEpoll) {
+      // a oneshot registration with nothing armed costs nothing, leave it
+      return true;
+    }
+    return epollCtl(fd_ctx, EPOLL_CTL_DEL, NONE);
+  }
+  if(!fd_ctx->inEpoll) {
+    return epollCtl(fd_ctx, EPOLL_CTL_ADD, events);
+  }
+  if(fd_ctx->armed == events) {
+    return true;
+  }
+  return epollCtl(fd_ctx, EPOLL_CTL_MOD, events);
+}
+
+IOManager::EpollStats IOManager::getEpollStats() const {
+  EpollStats stats;
+  stats.wakeups = m_statWakeups;
+  stats.events = m_statEvents;
+  stats.timeouts = m_statTimeouts;
+  stats.fullBatches = m_statFullBatches;
+  stats.grows = m_statGrows;
+  stats.shrinks = m_statShrinks;
+  stats.ctlAdd = m_statCtl[0];
+  stats.ctlMod = m_statCtl[1];
+  stats.ctlDel = m_statCtl[2];
+  for(size_t i = 0; i < EPOLL_STATS_BUCKETS; ++i) {
+    stats.histogram[i] = m_statHistogram[i];
+  }
+  Mutex::Lock lock(m_statMutex);
+  for(auto i : m_batchSizes) {
+    stats.maxBatch = std::max(stats.maxBatch, i->load());
+  }
+  return stats;
+}
+
+std::string IOManager::EpollStats::toString() const {
+  std::stringstream ss;
+  ss << "wakeups=" << wakeups
+     << " events=" << events
+     << " avg=" << avgEvents()
+     << " timeouts=" << timeouts
+     << " full=" << fullBatches
+     << " grows=" << grows
+     << " shrinks=" << shrinks
+     << " max_batch=" << maxBatch
+     << " ctl_add=" << ctlAdd
+     << " ctl_mod=" << ctlMod
+     << " ctl_del=" << ctlDel
+     << " histogram=[";
+  for(size_t i = 0; i < EPOLL_STATS_BUCKETS; ++i) {
+    ss << (i ? " " : "") << histogram[i];
+  }
+  ss << "]";
+  return ss.str();
+}
+
+void IOManager::prepFd(io_uring_sqe& sqe, int fd) {
+  if(m_fixedFiles && (size_t)fd < m_fixedFileCount && m_fixedFiles[fd]) {
+    sqe.flags |= IOSQE_FIXED_FILE;
+  }
+  sqe.fd = fd;
+}
+
+void IOManager::uringFlush() {
+  // our own threads flush in idle(), anyone else has to do it now
+  if(Scheduler::GetThis() != this) {
+    m_uring->submit();
+  }
+}
+
+uint64_t IOManager::ioTimeout(int fd, Event event) {
+  FdCtx* ctx = FdMgr::GetInstance()->get(fd);
+  if(!ctx) {
+    return ~0ull;
+  }
+  return ctx->getTimeout(event == READ ? SO_RCVTIMEO : SO_SNDTIMEO);
+}
+
+int IOManager::waitEvent(int fd, Event event, uint64_t timeout) {
+  std::shared_ptr<IOTimeout> tinfo(new IOTimeout);
+  Timer::ptr timer;
+  if(timeout != ~0ull) {
+    std::weak_ptr<IOTimeout> winfo(tinfo);
+    timer = addConditionTimer(timeout, [winfo, fd, event, this](){
+      auto t = winfo.lock();
+      if(!t) {
+        return;
+      }
+      // under the mutex so the fiber sees the verdict once it is resumed,
+      // and only a timeout if the event really was still pending
+      Mutex::Lock lock(t->mutex);
+      if(t->done || t->cancelled) {
+        return;
+      }
+      if(cancelEvent(fd, event)) {
+        t->cancelled = ETIMEDOUT;
+      }
+    }, winfo);
+  }
+
+  if(addEvent(fd, event)) {
+    if(timer) {
+      timer->cancel();
+    }
+    return -1;
+  }
+  Fiber::YieldToHold();
+  if(timer) {
+    timer->cancel();
+  }
+  Mutex::Lock lock(tinfo->mutex);
+  tinfo->done = true;
+  if(tinfo->cancelled) {
+    errno = tinfo->cancelled;
+    return -1;
+  }
+  return 0;
+}
+
+int32_t IOManager::uringWait(int fd, io_uring_sqe* sqes, uint32_t n, uint64_t timeout) {
+  UringWaiter waiter;
+  waiter.scheduler = Scheduler::GetThis();
+  waiter.fiber = Fiber::GetThis();
+  waiter.remaining = n;
+  // every SQE completes to the waiter, so a cancel of it finds whichever
+  // link of the chain is in flight
+  for(uint32_t i = 0; i < n; ++i) {
+    sqes[i].user_data = (uint64_t)&waiter;
+  }
+
+  std::shared_ptr<IOTimeout> tinfo;
+  Timer::ptr timer;
+  if(timeout != ~0ull) {
+    tinfo.reset(new IOTimeout);
+    std::weak_ptr<IOTimeout> winfo(tinfo);
+    uint64_t target = (uint64_t)&waiter;
+    timer = addConditionTimer(timeout, [winfo, target, this](){
+      auto t = winfo.lock();
+      if(!t) {
+        return;
+      }
+      // under the mutex so the cancel can't outlive the wait and hit the
+      // next SQE that happens to reuse the same waiter address
+      Mutex::Lock lock(t->mutex);
+      if(t->done || t->cancelled) {
+        return;
+      }
+      t->cancelled = ETIMEDOUT;
+      io_uring_sqe cancel;
+      memset(&cancel, 0, sizeof(cancel));
+      cancel.opcode = IORING_OP_ASYNC_CANCEL;
+      cancel.fd = -1;
+      cancel.addr = target;
+      m_uring->queue(&cancel);
+      m_uring->submit();
+    }, winfo);
+  }
+
+  ++m_pendingEventCount;
+  uringOpBegin(fd);
+  if(!m_uring->queue(sqes, n)) {
+    uringOpEnd(fd);
+    --m_pendingEventCount;
+    if(timer) {
+      timer->cancel();
+    }
+    return -EBUSY;
+  }
+  uringFlush();
+  Fiber::YieldToHold();
+  uringOpEnd(fd);
+  --m_pendingEventCount;
+  if(tinfo) {
+    timer->cancel();
+    Mutex::Lock lock(tinfo->mutex);
+    tinfo->done = true;
+    if(tinfo->cancelled && waiter.res == -ECANCELED) {
+      return -tinfo->cancelled;
+    }
+  }
+  return waiter.res;
+}
+
+ssize_t IOManager::uringIO(int fd, Event event, io_uring_sqe& sqe) {
+  uint64_t timeout = ioTimeout(fd, event);
+  uint64_t deadline = timeout == ~0ull ? ~0ull : GetCurrentMS() + timeout;
+  // a socket usually has room to write, try that without the poll
+  bool linked = event == READ;
+  while(true) {
+    // O_NONBLOCK fds make io_uring return EAGAIN instead of waiting, so
+    // the op is linked behind a POLL_ADD: one round trip, and on a ready
+    // fd the poll completes at once
+    io_uring_sqe ops[2];
+    memset(&ops[0], 0, sizeof(ops[0]));
+    ops[0].opcode = IORING_OP_POLL_ADD;
+    prepFd(ops[0], fd);
+    ops[0].poll32_events = event == READ ? POLLIN : POLLOUT;
+    ops[0].flags |= IOSQE_IO_LINK;
+    ops[1] = sqe;
+    int32_t res = linked ? uringWait(fd, ops, 2, timeout)
+                         : uringWait(fd, &ops[1], 1, timeout);
+    linked = true;
+    if(res == -EAGAIN) {
+      // someone else took what the poll saw, the rest of the timeout is left
+      if(deadline != ~0ull) {
+        uint64_t now = GetCurrentMS();
+        if(now >= deadline) {
+          errno = ETIMEDOUT;
+          return -1;
+        }
+        timeout = deadline - now;
+      }
+      continue;
+    }
+    if(res < 0) {
+      errno = -res;
+      return -1;
+    }
+    return res;
+  }
+}
+
+void IOManager::uringOpBegin(int fd) {
+  if(FdContext* fd_ctx = getFdContext(fd)) {
+    fd_ctx->uringOps.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void IOManager::uringOpEnd(int fd) {
+  if(FdContext* fd_ctx = m_fdContexts.get(fd)) {
+    fd_ctx->uringOps.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+template<class F>
+ssize_t IOManager::doIO(int fd, Event event, F fun) {
+  uint64_t timeout = ~0ull;
+  bool timeout_known = false;
+  ssize_t n = fun();
+  while(true) {
+    while(n == -1 && errno == EINTR) {
+      n = fun();
+    }
+    if(n == -1 && errno == EAGAIN && Scheduler::GetThis()) {
+      if(!timeout_known) {
+        timeout = ioTimeout(fd, event);
+        timeout_known = true;
+      }
+      if(waitEvent(fd, event, timeout)) {
+        return -1;
+      }
+      n = fun();
+      continue;
+    }
+    return n;
+  }
+}
+
+#define URING_PREP(op, fd_, addr_, len_) \
+  io_uring_sqe sqe; \
+  memset(&sqe, 0, sizeof(sqe)); \
+  sqe.opcode = op; \
+  prepFd(sqe, fd_); \
+  sqe.addr = (uint64_t)(addr_); \
+  sqe.len = len_;
+
+ssize_t IOManager::read(int fd, void* buf, size_t count) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_READ, fd, buf, count);
+    sqe.off = -1;
+    return uringIO(fd, READ, sqe);
+  }
+  return doIO(fd, READ, [=](){ return ::read(fd, buf, count);});
+}
+
+ssize_t IOManager::write(int fd, const void* buf, size_t count) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_WRITE, fd, buf, count);
+    sqe.off = -1;
+    return uringIO(fd, WRITE, sqe);
+  }
+  return doIO(fd, WRITE, [=](){ return ::write(fd, buf, count);});
+}
+
+ssize_t IOManager::readv(int fd, const struct iovec* iov, int iovcnt) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_READV, fd, iov, iovcnt);
+    sqe.off = -1;
+    return uringIO(fd, READ, sqe);
+  }
+  return doIO(fd, READ, [=](){ return ::readv(fd, iov, iovcnt);});
+}
+
+ssize_t IOManager::writev(int fd, const struct iovec* iov, int iovcnt) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_WRITEV, fd, iov, iovcnt);
+    sqe.off = -1;
+    return uringIO(fd, WRITE, sqe);
+  }
+  return doIO(fd, WRITE, [=](){ return ::writev(fd, iov, iovcnt);});
+}
+
+ssize_t IOManager::recv(int fd, void* buf, size_t len, int flags) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_RECV, fd, buf, len);
+    sqe.msg_flags = flags;
+    return uringIO(fd, READ, sqe);
+  }
+  return doIO(fd, READ, [=](){ return ::recv(fd, buf, len, flags);});
+}
+
+ssize_t IOManager::send(int fd, const void* buf, size_t len, int flags) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_SEND, fd, buf, len);
+    sqe.msg_flags = flags | MSG_NOSIGNAL;
+    return uringIO(fd, WRITE, sqe);
+  }
+  return doIO(fd, WRITE, [=](){ return ::send(fd, buf, len, flags | MSG_NOSIGNAL);});
+}
+
+ssize_t IOManager::sendmsg(int fd, const msghdr* msg, int flags) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_SENDMSG, fd, msg, 1);
+    sqe.msg_flags = flags | MSG_NOSIGNAL;
+    return uringIO(fd, WRITE, sqe);
+  }
+  return doIO(fd, WRITE, [=](){ return ::sendmsg(fd, msg, flags | MSG_NOSIGNAL);});
+}
+
+ssize_t IOManager::recvmsg(int fd, msghdr* msg, int flags) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_RECVMSG, fd, msg, 1);
+    sqe.msg_flags = flags;
+    return uringIO(fd, READ, sqe);
+  }
+  return doIO(fd, READ, [=](){ return ::recvmsg(fd, msg, flags);});
+}
+
+ssize_t IOManager::sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+  // io_uring has no sendfile, both backends wait for readiness
+  return doIO(out_fd, WRITE, [=](){ return ::sendfile(out_fd, in_fd, offset, count);});
+}
+
+ssize_t IOManager::splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out
+                          , size_t len, unsigned int flags, Event wait) {
+  int fd = wait == READ ? fd_in : fd_out;
+  return doIO(fd, wait, [=](){
+    return ::splice(fd_in, off_in, fd_out, off_out, len, flags | SPLICE_F_NONBLOCK);
+  });
+}
+
+int IOManager::recvmmsg(int fd, mmsghdr* msgvec, unsigned int vlen, int flags) {
+  // io_uring has no recvmmsg/sendmmsg, both backends wait for readiness
+  return doIO(fd, READ, [=](){ return ::recvmmsg(fd, msgvec, vlen, flags, nullptr);});
+}
+
+int IOManager::sendmmsg(int fd, mmsghdr* msgvec, unsigned int vlen, int flags) {
+  return doIO(fd, WRITE, [=](){ return ::sendmmsg(fd, msgvec, vlen, flags | MSG_NOSIGNAL);});
+}
+
+int IOManager::accept(int fd, sockaddr* addr, socklen_t* addrlen) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_ACCEPT, fd, addr, 0);
+    sqe.addr2 = (uint64_t)addrlen;
+    sqe.accept_flags = SOCK_CLOEXEC;
+    return uringIO(fd, READ, sqe);
+  }
+  return doIO(fd, READ, [=](){ return ::accept4(fd, addr, addrlen, SOCK_CLOEXEC);});
+}
+
+int IOManager::connect(int fd, const sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_CONNECT, fd, addr, 0);
+    sqe.off = addrlen;
+    int32_t res = uringWait(fd, &sqe, 1, timeout_ms);
+    if(res != -EINPROGRESS && res != -EAGAIN) {
+      if(res < 0) {
+        errno = -res;
+        return -1;
+      }
+      return 0;
+    }
+    // nonblocking fd, wait for the handshake like the epoll path does
+    io_uring_sqe poll;
+    memset(&poll, 0, sizeof(poll));
+    poll.opcode = IORING_OP_POLL_ADD;
+    prepFd(poll, fd);
+    poll.poll32_events = POLLOUT;
+    res = uringWait(fd, &poll, 1, timeout_ms);
+    if(res < 0) {
+      errno = -res;
+      return -1;
+    }
+  } else {
+    int rt = ::connect(fd, addr, addrlen);
+    if(rt == 0 || errno != EINPROGRESS || !Scheduler::GetThis()) {
+      return rt;
+    }
+    if(waitEvent(fd, WRITE, timeout_ms)) {
+      return -1;
+    }
+  }
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if(-1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len)) {
+    return -1;
+  }
+  if(error) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+int IOManager::registerBuffers(const std::vector<iovec>& bufs) {
+  if(!m_uring) {
+    return -ENOTSUP;
+  }
+  Mutex::Lock lock(m_uringMutex);
+  m_uring->unregisterBuffers();
+  if(bufs.empty()) {
+    return 0;
+  }
+  return m_uring->registerBuffers(&bufs[0], bufs.size());
+}
+
+ssize_t IOManager::readFixed(int fd, void* buf, size_t count, int buf_index) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_READ_FIXED, fd, buf, count);
+    sqe.off = -1;
+    sqe.buf_index = buf_index;
+    return uringIO(fd, READ, sqe);
+  }
+  return read(fd, buf, count);
+}
+
+ssize_t IOManager::writeFixed(int fd, const void* buf, size_t count, int buf_index) {
+  if(m_uring && Scheduler::GetThis()) {
+    URING_PREP(IORING_OP_WRITE_FIXED, fd, buf, count);
+    sqe.off = -1;
+    sqe.buf_index = buf_index;
+    return uringIO(fd, WRITE, sqe);
+  }
+  return write(fd, buf, count);
+}
+
+#undef URING_PREP
+
+bool IOManager::registerFile(int fd) {
+  if(!m_uring || fd < 0) {
+    return false;
+  }
+  Mutex::Lock lock(m_uringMutex);
+  if(!m_fixedFiles) {
+    size_t count = g_io_uring_fixed_files->getValue();
+    if(!count || m_uring->registerFileTable(count)) {
+      return false;
+    }
+    m_fixedFiles.reset(new std::atomic<bool>[count]);
+    for(size_t i = 0; i < count; ++i) {
+      m_fixedFiles[i] = false;
+    }
+    m_fixedFileCount = count;
+  }
+  if((size_t)fd >= m_fixedFileCount) {
+    return false;
+  }
+  if(m_uring->updateFile(fd, fd)) {
+    return false;
+  }
+  m_fixedFiles[fd] = true;
+  return true;
+}
+
+void IOManager::unregisterFile(int fd) {
+  Mutex::Lock lock(m_uringMutex);
+  if(!m_fixedFiles || fd < 0 || (size_t)fd >= m_fixedFileCount || !m_fixedFiles[fd]) {
+    return;
+  }
+  m_fixedFiles[fd] = false;
+  m_uring->updateFile(fd, -1);
+}
+
+IOManager::MultishotAccept::ptr IOManager::acceptMultishot(int fd) {
+  return MultishotAccept::ptr(new MultishotAccept(this, fd));
+}
+
+IOManager::MultishotRecv::ptr IOManager::recvMultishot(int fd) {
+  if(m_uring) {
+    Mutex::Lock lock(m_uringMutex);
+    if(!m_bufferGroup) {
+      m_bufferGroup = m_uring->createBufferGroup(0
+                        , g_io_uring_buffer_count->getValue()
+                        , g_io_uring_buffer_size->getValue());
+    }
+  }
+  return MultishotRecv::ptr(new MultishotRecv(this, fd));
+}
+
+IOManager::MultishotAccept::MultishotAccept(IOManager* iom, int fd)
+  :m_iom(iom)
+  ,m_fd(fd) {
+}
+
+IOManager::MultishotAccept::~MultishotAccept() {
+  for(int i : m_results) {
+    if(i >= 0) {
+      ::close(i);
+    }
+  }
+}
+
+bool IOManager::MultishotAccept::arm() {
+  io_uring_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_ACCEPT;
+  m_iom->prepFd(sqe, m_fd);
+  sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe.accept_flags = SOCK_CLOEXEC;
+  sqe.user_data = (uint64_t)this;
+
+  ++m_iom->m_pendingEventCount;
+  m_iom->uringOpBegin(m_fd);
+  if(!m_iom->m_uring->queue(&sqe)) {
+    m_iom->uringOpEnd(m_fd);
+    --m_iom->m_pendingEventCount;
+    return false;
+  }
+  m_self = shared_from_this();
+  m_armed = true;
+  m_iom->uringFlush();
+  return true;
+}
+
+void IOManager::MultishotAccept::onComplete(int32_t res, uint32_t flags) {
+  ptr self;
+  Mutex::Lock lock(m_mutex);
+  bool more = flags & IORING_CQE_F_MORE;
+  if(!more) {
+    m_armed = false;
+    m_iom->uringOpEnd(m_fd);
+    --m_iom->m_pendingEventCount;
+    self.swap(m_self);
+  }
+  if(res == -EINVAL && !more && m_results.empty() && !m_cancelled) {
+    // kernel without multishot accept, fall back to one accept per call
+    m_multishot = false;
+  } else if(!(res == -ECANCELED && m_cancelled)) {
+    m_results.push_back(res);
+  }
+  if(m_waiter) {
+    m_scheduler->schedule(&m_waiter);
+  }
+  lock.unlock();
+}
+
+int IOManager::MultishotAccept::accept() {
+  Mutex::Lock lock(m_mutex);
+  while(true) {
+    if(!m_results.empty()) {
+      int rt = m_results.front();
+      m_results.pop_front();
+      if(rt < 0) {
+        errno = -rt;
+        return -1;
+      }
+      return rt;
+    }
+    if(m_cancelled) {
+      errno = ECANCELED;
+      return -1;
+    }
+    if(!m_iom->m_uring || !m_multishot || !Scheduler::GetThis()) {
+      lock.unlock();
+      return m_iom->accept(m_fd);
+    }
+    if(!m_armed && !arm()) {
+      lock.unlock();
+      return m_iom->accept(m_fd);
+    }
+    SYLAR_ASSERT2(!m_waiter, "one fiber at a time in MultishotAccept::accept");
+    m_scheduler = Scheduler::GetThis();
+    m_waiter = Fiber::GetThis();
+    lock.unlock();
+    Fiber::YieldToHold();
+    lock.lock();
+  }
+}
+
+void IOManager::MultishotAccept::cancel() {
+  Mutex::Lock lock(m_mutex);
+  if(m_cancelled) {
+    return;
+  }
+  m_cancelled = true;
+  if(m_armed) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.fd = -1;
+    sqe.addr = (uint64_t)this;
+    m_iom->m_uring->queue(&sqe);
+    m_iom->m_uring->submit();
+  }
+  if(m_waiter) {
+    m_scheduler->schedule(&m_waiter);
+  }
+}
+
+IOManager::MultishotRecv::MultishotRecv(IOManager* iom, int fd)
+  :m_iom(iom)
+  ,m_fd(fd) {
+}
+
+IOManager::MultishotRecv::~MultishotRecv() {
+  for(auto& i : m_results) {
+    if(i.res > 0) {
+      m_iom->m_bufferGroup->recycle(i.bid);
+    }
+  }
+}
+
+bool IOManager::MultishotRecv::arm() {
+  // after ENOBUFS the buffers may be all there is
+  m_iom->m_bufferGroup->provideParked();
+  io_uring_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_RECV;
+  m_iom->prepFd(sqe, m_fd);
+  sqe.ioprio = IORING_RECV_MULTISHOT;
+  sqe.flags |= IOSQE_BUFFER_SELECT;
+  sqe.buf_group = m_iom->m_bufferGroup->getId();
+  sqe.user_data = (uint64_t)this;
+
+  ++m_iom->m_pendingEventCount;
+  m_iom->uringOpBegin(m_fd);
+  if(!m_iom->m_uring->queue(&sqe)) {
+    m_iom->uringOpEnd(m_fd);
+    --m_iom->m_pendingEventCount;
+    return false;
+  }
+  m_self = shared_from_this();
+  m_armed = true;
+  m_iom->uringFlush();
+  return true;
+}
+
+void IOManager::MultishotRecv::onComplete(int32_t res, uint32_t flags) {
+  ptr self;
+  Mutex::Lock lock(m_mutex);
+  bool more = flags & IORING_CQE_F_MORE;
+  if(!more) {
+    m_armed = false;
+    m_iom->uringOpEnd(m_fd);
+    --m_iom->m_pendingEventCount;
+    self.swap(m_self);
+  }
+  if(flags & IORING_CQE_F_BUFFER) {
+    uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    if(res > 0) {
+      m_results.push_back(Chunk{res, bid, 0});
+    } else {
+      m_iom->m_bufferGroup->recycle(bid);
+    }
+  } else if(res == -ENOBUFS) {
+    // every provided buffer is in use, the next recv() re-arms once the
+    // consumed ones have been handed back
+  } else if(res == -EINVAL && !more && m_results.empty() && !m_cancelled) {
+    m_multishot = false;
+  } else if(res == -EAGAIN) {
+    // O_NONBLOCK socket on a kernel that doesn't poll for multishot recv
+    m_multishot = false;
+  } else if(!(res == -ECANCELED && m_cancelled)) {
+    m_results.push_back(Chunk{res, 0, 0});
+  }
+  if(m_waiter) {
+    m_scheduler->schedule(&m_waiter);
+  }
+  lock.unlock();
+}
+
+ssize_t IOManager::MultishotRecv::recv(void* buf, size_t len) {
+  Mutex::Lock lock(m_mutex);
+  while(true) {
+    if(!m_results.empty()) {
+      Chunk& c = m_results.front();
+      if(c.res <= 0) {
+        int32_t res = c.res;
+        m_results.pop_front();
+        if(res == 0) {
+          m_eof = true;
+          return 0;
+        }
+        errno = -res;
+        return -1;
+      }
+      size_t n = std::min(len, (size_t)(c.res - c.offset));
+      memcpy(buf, m_iom->m_bufferGroup->getBuffer(c.bid) + c.offset, n);
+      c.offset += n;
+      if(c.offset == (uint32_t)c.res) {
+        m_iom->m_bufferGroup->recycle(c.bid);
+        m_results.pop_front();
+      }
+      return n;
+    }
+    if(m_eof) {
+      return 0;
+    }
+    if(m_cancelled) {
+      errno = ECANCELED;
+      return -1;
+    }
+    if(!m_iom->m_bufferGroup || !m_multishot || !Scheduler::GetThis()) {
+      lock.unlock();
+      return m_iom->recv(m_fd, buf, len);
+    }
+    if(!m_armed && !arm()) {
+      lock.unlock();
+      return m_iom->recv(m_fd, buf, len);
+    }
+    SYLAR_ASSERT2(!m_waiter, "one fiber at a time in MultishotRecv::recv");
+    m_scheduler = Scheduler::GetThis();
+    m_waiter = Fiber::GetThis();
+    lock.unlock();
+    Fiber::YieldToHold();
+    lock.lock();
+  }
+}
+
+void IOManager::MultishotRecv::cancel() {
+  Mutex::Lock lock(m_mutex);
+  if(m_cancelled) {
+    return;
+  }
+  m_cancelled = true;
+  if(m_armed) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.fd = -1;
+    sqe.addr = (uint64_t)this;
+    m_iom->m_uring->queue(&sqe);
+    m_iom->m_uring->submit();
+  }
+  if(m_waiter) {
+    m_scheduler->schedule(&m_waiter);
+  }
+}
+
 }
@@ -1,23 +1,53 @@
 #ifndef __SYLAR_IOMANAGER_H__
 #define __SYLAR_IOMANAGER_H__
 
+#include <list>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include "scheduler.h"
+#include "io_uring.h"
+#include "fd_table.h"
+#include "timer.h"
 
 namespace sylar {
 
-class IOManager : public Scheduler {
+class IOManager : public Scheduler, public TimerManager {
 public:
     typedef std::shared_ptr<IOManager> ptr;
     typedef RWMutex RWMutexType;
 
+    /// buckets in EpollStats::histogram
+    static const size_t EPOLL_STATS_BUCKETS = 16;
+
     enum Event {
         NONE  = 0x0,  // 
         READ  = 0x1,  // EPOLLIN
         WRITE = 0x4   // EPOLLOUT
     };
 
+    /**
+     * @brief How fds are registered with epoll, iomanager.epoll.mode
+     */
+    enum EpollMode {
+        /// EPOLLET with exactly the awaited events, MOD/DEL after every wakeup
+        CLASSIC,
+        /// EPOLLET for both directions, added on first use and kept until
+        /// cancelAll(), readiness is matched against waiters in userspace
+        PERSISTENT,
+        /// EPOLLONESHOT, re-armed by the next addEvent()
+        ONESHOT
+    };
+
+    static EpollMode EpollModeFromString(const std::string& str);
+
 private: 
-    struct FdContext {
+    /**
+     * @brief Per-fd event state
+     * @details Cache line aligned so that threads working on neighbouring
+     *          fds don't false-share. The alignment is kept on the heap by
+     *          the class allocation functions, C++11 new doesn't honour it.
+     */
+    struct alignas(64) FdContext {
         typedef Mutex MutexType;
         struct EventContext {
             Scheduler* scheduler = nullptr;   // event Scheduler to be executed
@@ -27,14 +57,49 @@ private:
 
         EventContext& getContext(Event event);
         void resetContext(EventContext& ctx);
-        void triggerEvent(Event event);
+        // thread: pin the resumed fiber/cb to this thread id, -1 for any
+        void triggerEvent(Event event, int thread = -1);
+
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
 
         EventContext read;      // read event
         EventContext write;     // write event
         int fd = 0;     
         Event events = NONE;
+        /// registered with epoll
+        bool inEpoll = false;
+        /// events the kernel currently watches for this fd
+        int armed = NONE;
+        /// persistent mode: edges that came in while nobody waited
+        int ready = NONE;
+        /// io_uring ops in flight on the fd, cancelAll() asks the kernel
+        /// to cancel only when there are any
+        std::atomic<uint32_t> uringOps = {0};
         MutexType mutex;
     };
+
+    /**
+     * @brief An epoll instance and the eventfd used to wake its waiter
+     * @details In the default mode a single shard is shared by every thread.
+     *          With iomanager.per_thread_epoll each worker owns one shard and
+     *          the fds hashed to it, so hot fds stay on one core.
+     */
+    struct EpollShard {
+        int epfd = 0;
+        /// eventfd used to wake the thread(s) waiting on epfd
+        int tickleFd = 0;
+        /// a wakeup is already pending on tickleFd, further tickles are no-ops
+        std::atomic<bool> tickled = {false};
+        /// owner is blocked in (or about to enter) epoll_wait
+        std::atomic<bool> idle = {false};
+        /// owning thread id, -1 when shared or not claimed yet
+        std::atomic<int> thread = {-1};
+
+        EpollShard();
+        ~EpollShard();
+        void tickle();
+    };
     
 public:
     IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "");
@@ -49,19 +114,395 @@ public:
 
     static IOManager* GetThis();
 
+    /**
+     * @brief cancelEvent()/cancelAll() on iom, from any thread
+     * @details Does nothing if iom is null or has been destroyed, and
+     *          keeps iom from being destroyed meanwhile.
+     */
+    static bool CancelEvent(IOManager* iom, int fd, Event event);
+    static bool CancelAll(IOManager* iom, int fd);
+
+    /**
+     * @brief epoll_wait statistics, summed over all idle threads
+     */
+    struct EpollStats {
+        /// epoll_wait calls that returned
+        uint64_t wakeups = 0;
+        /// events returned by those calls
+        uint64_t events = 0;
+        /// calls that timed out with nothing to do
+        uint64_t timeouts = 0;
+        /// calls that filled the whole batch, there may have been more ready
+        uint64_t fullBatches = 0;
+        /// times a thread grew / shrank its batch
+        uint64_t grows = 0;
+        uint64_t shrinks = 0;
+        /// epoll_ctl calls by op, wakeups above is the epoll_wait count
+        uint64_t ctlAdd = 0;
+        uint64_t ctlMod = 0;
+        uint64_t ctlDel = 0;
+        /// largest batch any thread is using right now
+        uint32_t maxBatch = 0;
+        /// histogram[i]: wakeups that returned [2^(i-1), 2^i) events, [0] is 0 events
+        uint64_t histogram[EPOLL_STATS_BUCKETS] = {0};
+
+        /**
+         * @brief Mean events per wakeup
+         */
+        double avgEvents() const { return wakeups ? (double)events / wakeups : 0;}
+        std::string toString() const;
+    };
+
+    /**
+     * @brief Snapshot of the epoll_wait statistics
+     */
+    EpollStats getEpollStats() const;
+
+    EpollMode getEpollMode() const { return m_epollMode;}
+
+    /**
+     * @brief Thread fibers woken on fd resume on, -1 for any
+     * @details Only iomanager.per_thread_epoll pins fds, to the thread
+     *          owning their shard once it has claimed it.
+     */
+    int getOwnerThread(int fd) const { return ownerOf(fd);}
+
+    class MultishotAccept;
+    class MultishotRecv;
+
+    /**
+     * @brief Whether IO goes through the io_uring backend
+     * @details Enabled by iomanager.io_uring.enable when the kernel supports
+     *          it, the readiness (epoll) path is used otherwise.
+     */
+    bool hasIOUring() const { return m_uring != nullptr;}
+
+    /**
+     * @name Fiber blocking IO
+     * @details Same arguments and return values as the syscalls (-1 and
+     *          errno on failure). Called from a fiber the calling fiber is
+     *          suspended until the operation completes: on a CQE with
+     *          io_uring, on readiness for O_NONBLOCK fds with epoll. Outside
+     *          of a scheduler they are the plain syscalls.
+     *          Each wait is bounded by the fd's SO_RCVTIMEO/SO_SNDTIMEO in
+     *          FdManager and fails with ETIMEDOUT; connect() takes its own.
+     * @{
+     */
+    ssize_t read(int fd, void* buf, size_t count);
+    ssize_t write(int fd, const void* buf, size_t count);
+    ssize_t readv(int fd, const struct iovec* iov, int iovcnt);
+    ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+    ssize_t recv(int fd, void* buf, size_t len, int flags = 0);
+    ssize_t send(int fd, const void* buf, size_t len, int flags = 0);
+    int accept(int fd, sockaddr* addr = nullptr, socklen_t* addrlen = nullptr);
+    int connect(int fd, const sockaddr* addr, socklen_t addrlen
+                , uint64_t timeout_ms = ~0ull);
+    ssize_t sendmsg(int fd, const msghdr* msg, int flags = 0);
+    ssize_t recvmsg(int fd, msghdr* msg, int flags = 0);
+    /** @} */
+
+    /**
+     * @brief sendfile(2) from in_fd to out_fd, waiting for out_fd to become
+     *        writable on EAGAIN
+     * @details Readiness based with both backends, io_uring has no sendfile.
+     */
+    ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count);
+
+    /**
+     * @brief splice(2) with SPLICE_F_NONBLOCK
+     * @details EAGAIN can come from either end, wait says which one to wait
+     *          for: READ on fd_in or WRITE on fd_out. Readiness based with
+     *          both backends.
+     */
+    ssize_t splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out
+                   , size_t len, unsigned int flags, Event wait);
+
+    /**
+     * @brief recvmmsg(2), waiting for fd to become readable while nothing
+     *        is queued
+     * @details Returns as soon as at least one datagram was received.
+     *          Readiness based with both backends, io_uring has no recvmmsg.
+     */
+    int recvmmsg(int fd, mmsghdr* msgvec, unsigned int vlen, int flags = 0);
+
+    /**
+     * @brief sendmmsg(2), waiting for fd to become writable on EAGAIN
+     * @return Datagrams sent, may be less than vlen
+     */
+    int sendmmsg(int fd, mmsghdr* msgvec, unsigned int vlen, int flags = 0);
+
+    /**
+     * @brief Register buffers for readFixed()/writeFixed()
+     * @details Replaces the previous registration.
+     * @return 0 on success, -errno on failure (-ENOTSUP without io_uring)
+     */
+    int registerBuffers(const std::vector<iovec>& bufs);
+
+    /**
+     * @brief read() into registered buffer buf_index
+     * @pre [buf, buf + count) lies inside that buffer
+     */
+    ssize_t readFixed(int fd, void* buf, size_t count, int buf_index);
+
+    /**
+     * @brief write() from registered buffer buf_index
+     */
+    ssize_t writeFixed(int fd, const void* buf, size_t count, int buf_index);
+
+    /**
+     * @brief Put fd in the io_uring fixed file table
+     * @details Later IO on fd skips the per request fget/fput. Must be
+     *          undone with unregisterFile() before fd is closed.
+     */
+    bool registerFile(int fd);
+    void unregisterFile(int fd);
+
+    /**
+     * @brief Accept stream on a listening socket, multishot with io_uring
+     */
+    std::shared_ptr<MultishotAccept> acceptMultishot(int fd);
+
+    /**
+     * @brief Receive stream on a connected socket, multishot with io_uring
+     * @details Data lands in the IOManager's provided buffer group.
+     */
+    std::shared_ptr<MultishotRecv> recvMultishot(int fd);
+
 protected:
     void tickle() override;
     bool stopping() override;
     void idle() override;
+    void onTimerInsertedAtFront() override;
+
+    /**
+     * @brief stopping(), also returning how long until the next timer
+     */
+    bool stopping(uint64_t& timeout);
+
+    /**
+     * @brief Context of fd, created on first use
+     * @return nullptr if fd is out of range
+     */
+    FdContext* getFdContext(int fd);
+
+    /**
+     * @brief Shard whose epoll instance watches fd
+     */
+    EpollShard* shardOf(int fd) const { return m_shards[fd % m_fdShardCount];}
 
-    void contextResize(size_t size);
+    /**
+     * @brief Shard the calling thread waits on in idle()
+     */
+    EpollShard* claimShard();
+
+    /**
+     * @brief epoll_ctl on fd_ctx's shard, keeping fd_ctx's registration state
+     * @pre fd_ctx->mutex is held
+     */
+    bool epollCtl(FdContext* fd_ctx, int op, int events);
+
+    /**
+     * @brief Make the kernel watch exactly events, skipping the syscall if it
+     *        already does (classic and oneshot modes)
+     * @pre fd_ctx->mutex is held
+     */
+    bool setInterest(FdContext* fd_ctx, int events);
+
+    /**
+     * @brief Fire an event, resuming the waiter on thread if it is ours
+     * @pre fd_ctx->mutex is held
+     */
+    void triggerEvent(FdContext* fd_ctx, Event event, int thread);
+
+    /**
+     * @brief Thread a fiber woken on fd should resume on, -1 for any
+     */
+    int ownerOf(int fd) const;
+
+    /**
+     * @brief Timeout of fd in FdManager for event, ~0ull for none
+     */
+    uint64_t ioTimeout(int fd, Event event);
+
+    /**
+     * @brief addEvent() and suspend the calling fiber, ETIMEDOUT after timeout ms
+     * @return 0 once the event fired, -1 and errno otherwise
+     */
+    int waitEvent(int fd, Event event, uint64_t timeout);
+
+    /**
+     * @brief Queue SQEs on fd and suspend the calling fiber until all completed
+     * @details Chained with IOSQE_IO_LINK the last one completes last, a
+     *          failed link completes the rest with -ECANCELED.
+     * @param[in] timeout Cancel the chain after this many ms, ~0ull for never
+     * @return CQE result of the last SQE, -errno on failure (-ETIMEDOUT)
+     */
+    int32_t uringWait(int fd, io_uring_sqe* sqes, uint32_t n = 1, uint64_t timeout = ~0ull);
+
+    /**
+     * @brief Run a single SQE on fd, behind a linked POLL_ADD when it may block
+     * @details Reads always wait for the poll, writes only after -EAGAIN.
+     *          The fd's timeout covers all the rounds together.
+     * @return -1 and errno on failure, the CQE result otherwise
+     */
+    ssize_t uringIO(int fd, Event event, io_uring_sqe& sqe);
+
+    /**
+     * @brief Count an io_uring op on fd in or out of flight, for cancelAll()
+     */
+    void uringOpBegin(int fd);
+    void uringOpEnd(int fd);
+
+    /**
+     * @brief Readiness based IO for the epoll backend
+     */
+    template<class F>
+    ssize_t doIO(int fd, Event event, F fun);
+
+    /**
+     * @brief Fill the fd field of sqe, using the fixed file table if possible
+     */
+    void prepFd(io_uring_sqe& sqe, int fd);
+
+    /**
+     * @brief Hand queued SQEs to the kernel unless one of our threads will
+     */
+    void uringFlush();
 private:
-    int m_epfd = 0;
-    int m_tickleFds[2];
+    /// per_thread_epoll mode
+    bool m_perThread = false;
+    /// epoll instances, the first m_fdShardCount ones own fds
+    std::vector<EpollShard*> m_shards;
+    /// number of shards fds are hashed over
+    size_t m_fdShardCount = 1;
+    /// next worker shard to hand out in claimShard()
+    std::atomic<size_t> m_nextShard = {0};
+    /// round robin cursor for tickle()
+    std::atomic<size_t> m_tickleShard = {0};
+
+    EpollMode m_epollMode = CLASSIC;
+
+    /// epoll_wait batch bounds, read from config at construction
+    uint32_t m_batchMin = 64;
+    uint32_t m_batchMax = 64;
+    std::atomic<uint64_t> m_statWakeups = {0};
+    std::atomic<uint64_t> m_statEvents = {0};
+    std::atomic<uint64_t> m_statTimeouts = {0};
+    std::atomic<uint64_t> m_statFullBatches = {0};
+    std::atomic<uint64_t> m_statGrows = {0};
+    std::atomic<uint64_t> m_statShrinks = {0};
+    /// epoll_ctl ADD, MOD, DEL
+    std::atomic<uint64_t> m_statCtl[3];
+    std::atomic<uint64_t> m_statHistogram[EPOLL_STATS_BUCKETS];
+    /// current batch of every idle thread, indexed by claim order
+    std::vector<std::atomic<uint32_t>*> m_batchSizes;
+    mutable Mutex m_statMutex;
 
     std::atomic<size_t> m_pendingEventCount = {0};
-    RWMutexType m_mutex;
-    std::vector<FdContext*> m_fdContexts;
+    /// fd -> context, looked up without locking
+    FdTable<FdContext> m_fdContexts;
+
+    /// io_uring backend, nullptr when IO goes through epoll
+    IOUring* m_uring = nullptr;
+    /// provided buffers for multishot recv
+    IOUring::BufferGroup::ptr m_bufferGroup;
+    /// m_fixedFiles[fd] is set when fd sits at slot fd of the fixed file table
+    std::unique_ptr<std::atomic<bool>[]> m_fixedFiles;
+    size_t m_fixedFileCount = 0;
+    Mutex m_uringMutex;
+};
+
+/**
+ * @brief Stream of connections accepted from one listening socket
+ * @details With io_uring a single multishot accept stays armed and queues the
+ *          connections as they arrive. The kernel holds a pointer to this
+ *          object until its final CQE, so it stays alive while armed: call
+ *          cancel() when done. Only one fiber may wait in accept() at a time.
+ */
+class IOManager::MultishotAccept : public IOUring::Completion
+                                 , public std::enable_shared_from_this<MultishotAccept> {
+public:
+    typedef std::shared_ptr<MultishotAccept> ptr;
+    ~MultishotAccept();
+
+    /**
+     * @brief Next connection, suspending the fiber until there is one
+     * @return fd, or -1 and errno
+     */
+    int accept();
+
+    /**
+     * @brief Disarm, a fiber waiting in accept() gets ECANCELED
+     */
+    void cancel();
+private:
+    friend class IOManager;
+    MultishotAccept(IOManager* iom, int fd);
+    void onComplete(int32_t res, uint32_t flags) override;
+    bool arm();
+private:
+    IOManager* m_iom;
+    int m_fd;
+    Mutex m_mutex;
+    /// accepted fds or -errno, oldest first
+    std::list<int> m_results;
+    Scheduler* m_scheduler = nullptr;
+    Fiber::ptr m_waiter;
+    bool m_armed = false;
+    bool m_cancelled = false;
+    /// false once the kernel turned the multishot request down
+    bool m_multishot = true;
+    /// self reference held while the kernel may still post CQEs
+    ptr m_self;
+};
+
+/**
+ * @brief Stream of data received on one connected socket
+ * @details With io_uring a single multishot recv stays armed; the kernel fills
+ *          buffers of the IOManager's provided buffer group and recv() copies
+ *          out of them, recycling each buffer once consumed. Same lifetime
+ *          rules as MultishotAccept.
+ */
+class IOManager::MultishotRecv : public IOUring::Completion
+                               , public std::enable_shared_from_this<MultishotRecv> {
+public:
+    typedef std::shared_ptr<MultishotRecv> ptr;
+    ~MultishotRecv();
+
+    /**
+     * @brief Copy received data into buf, suspending the fiber until there is some
+     * @return bytes copied, 0 on EOF, -1 and errno on failure
+     */
+    ssize_t recv(void* buf, size_t len);
+
+    /**
+     * @brief Disarm, a fiber waiting in recv() gets ECANCELED
+     */
+    void cancel();
+private:
+    friend class IOManager;
+    MultishotRecv(IOManager* iom, int fd);
+    void onComplete(int32_t res, uint32_t flags) override;
+    bool arm();
+
+    struct Chunk {
+        /// bytes in the buffer, 0 for EOF, -errno for an error
+        int32_t res;
+        uint16_t bid;
+        uint32_t offset;
+    };
+private:
+    IOManager* m_iom;
+    int m_fd;
+    Mutex m_mutex;
+    std::list<Chunk> m_results;
+    Scheduler* m_scheduler = nullptr;
+    Fiber::ptr m_waiter;
+    bool m_armed = false;
+    bool m_cancelled = false;
+    bool m_eof = false;
+    bool m_multishot = true;
+    ptr m_self;
 };
 
 }
@@ -4,6 +4,17 @@
 #include "iostream"
 #include "config.h"
 #include <cctype> 
+#include <algorithm>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <type_traits>
+#include <cmath>
+#include <new>
 
 namespace sylar {
 
@@ -37,12 +48,235 @@ LogLevel::level LogLevel::FromString(std::string str) {
 #undef XX
 }
 
+LogStream::Buffer::Buffer(size_t capacity)
+    :m_data(capacity ? capacity : 1) {
+    setp(&m_data[0], &m_data[0] + m_data.size());
+}
+
+void LogStream::Buffer::grow(size_t len) {
+    size_t used = size();
+    size_t cap = std::max(m_data.size() * 2, used + len);
+    m_data.resize(cap);
+    setp(&m_data[0], &m_data[0] + cap);
+    pbump((int)used);
+}
+
+LogStream::Buffer::int_type LogStream::Buffer::overflow(int_type c) {
+    if(traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    char ch = traits_type::to_char_type(c);
+    append(&ch, 1);
+    return c;
+}
+
+std::streamsize LogStream::Buffer::xsputn(const char* s, std::streamsize n) {
+    append(s, n);
+    return n;
+}
+
+LogStream::LogStream(size_t capacity)
+    :std::ostream(nullptr)
+    ,m_buf(capacity) {
+    rdbuf(&m_buf);
+}
+
+void LogStream::reset() {
+    m_buf.reset();
+    std::ostream::clear();
+    flags(std::ios_base::skipws | std::ios_base::dec);
+    precision(6);
+    width(0);
+    fill(' ');
+}
+
+void LogStream::format(const char* fmt, va_list al) {
+    va_list copy;
+    va_copy(copy, al);
+    size_t avail = m_buf.avail();
+    int len = vsnprintf(m_buf.reserve(0), avail, fmt, copy);
+    va_end(copy);
+    if(len < 0) {
+        return;
+    }
+    if((size_t)len >= avail) {
+        vsnprintf(m_buf.reserve(len + 1), len + 1, fmt, al);
+    }
+    m_buf.commit(len);
+}
+
+LogStream& LogStream::operator<<(const char* v) {
+    if(!v || width()) {
+        static_cast<std::ostream&>(*this) << v;
+    } else {
+        m_buf.append(v, strlen(v));
+    }
+    return *this;
+}
+
+LogStream& LogStream::operator<<(const std::string& v) {
+    if(width()) {
+        static_cast<std::ostream&>(*this) << v;
+    } else {
+        m_buf.append(v.data(), v.size());
+    }
+    return *this;
+}
+
+LogStream& LogStream::operator<<(char v) {
+    if(width()) {
+        static_cast<std::ostream&>(*this) << v;
+    } else {
+        m_buf.append(&v, 1);
+    }
+    return *this;
+}
+
+template<class T>
+LogStream& LogStream::appendInteger(T v) {
+    if(!plain()) {
+        std::ostream::operator<<(v);
+        return *this;
+    }
+    char tmp[24];
+    char* end = tmp + sizeof(tmp);
+    char* p = end;
+    bool neg = v < 0;
+    // negate as unsigned so the minimum value works too
+    typename std::make_unsigned<T>::type u = v;
+    if(neg) {
+        u = 0 - u;
+    }
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while(u);
+    if(neg) {
+        *--p = '-';
+    }
+    m_buf.append(p, end - p);
+    return *this;
+}
+
+LogStream& LogStream::operator<<(short v) { return appendInteger((int)v); }
+LogStream& LogStream::operator<<(unsigned short v) { return appendInteger((unsigned int)v); }
+LogStream& LogStream::operator<<(int v) { return appendInteger(v); }
+LogStream& LogStream::operator<<(unsigned int v) { return appendInteger(v); }
+LogStream& LogStream::operator<<(long v) { return appendInteger(v); }
+LogStream& LogStream::operator<<(unsigned long v) { return appendInteger(v); }
+LogStream& LogStream::operator<<(long long v) { return appendInteger(v); }
+LogStream& LogStream::operator<<(unsigned long long v) { return appendInteger(v); }
+
+namespace {
+
+/**
+ * @brief Per thread: spare LogEvents, and the buffer records are
+ *        formatted into before they go to an appender
+ */
+struct LogThreadCache {
+    /// only events nobody else holds a reference to
+    std::vector<LogEvent::ptr> events;
+    LogStream format;
+    /// format is lent to a FormatBuffer
+    bool formatBusy = false;
+
+    LogThreadCache()
+        :format(1024) {
+    }
+    ~LogThreadCache();
+};
+
+/// logging can still happen in later thread_local/static destructors
+static thread_local bool t_log_cache_dead = false;
+static thread_local LogThreadCache t_log_cache;
+
+LogThreadCache::~LogThreadCache() {
+    t_log_cache_dead = true;
+}
+
+/**
+ * @brief The thread's format buffer, emptied
+ *
+ * One nested in another on the same thread (an appender that logs from
+ * log()) gets a stream of its own instead.
+ */
+class FormatBuffer {
+public:
+    FormatBuffer()
+        :m_own(t_log_cache_dead || t_log_cache.formatBusy) {
+        if(m_own) {
+            m_stream = new LogStream;
+        } else {
+            m_stream = &t_log_cache.format;
+            t_log_cache.formatBusy = true;
+        }
+        m_stream->reset();
+    }
+    ~FormatBuffer() {
+        if(m_own) {
+            delete m_stream;
+        } else {
+            t_log_cache.formatBusy = false;
+        }
+    }
+    LogStream& operator*() { return *m_stream; }
+    LogStream* operator->() { return m_stream; }
+private:
+    LogStream* m_stream;
+    bool m_own;
+};
+
+}
+
+static const size_t s_event_pool_max = 16;
+
+void LogEvent::reset(std::shared_ptr<Logger> logger, LogLevel::level level, const char* file, int32_t line
+                    ,uint32_t elapse, uint32_t thread_id, uint32_t fiber_id, uint64_t time
+                    ,const std::string& thread_name, uint32_t usec) {
+    m_file = file;
+    m_line = line;
+    m_elapse = elapse;
+    m_threadId = thread_id;
+    m_fiberId = fiber_id;
+    m_time = time;
+    m_usec = usec;
+    m_Logger.swap(logger);
+    m_level = level;
+    m_threadName.assign(thread_name);
+    m_ss.reset();
+    m_fields.clear();
+}
+
 LogEventWrap::LogEventWrap(LogEvent::ptr m) 
     :m_event(m){
 
 }
+
+LogEventWrap::LogEventWrap(std::shared_ptr<Logger> logger, LogLevel::level level, const char* file, int32_t line
+                          ,uint32_t elapse, uint32_t thread_id, uint32_t fiber_id) {
+    // vDSO, no syscall
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if(!t_log_cache_dead && !t_log_cache.events.empty()) {
+        m_event.swap(t_log_cache.events.back());
+        t_log_cache.events.pop_back();
+    } else {
+        m_event.reset(new LogEvent(logger, level, file, line, elapse, thread_id, fiber_id, ts.tv_sec, Thread::GetName()));
+    }
+    m_event->reset(logger, level, file, line, elapse, thread_id, fiber_id, ts.tv_sec
+                    ,Thread::GetName(), ts.tv_nsec / 1000);
+    m_pooled = true;
+}
+
 LogEventWrap::~LogEventWrap() {
     m_event->getLogger()->log(m_event->getLevel(), m_event);
+    // an appender that kept the event owns it now, it leaves the pool
+    if(m_pooled && m_event.use_count() == 1
+            && !t_log_cache_dead && t_log_cache.events.size() < s_event_pool_max) {
+        // don't hold on to the logger until the event is reused
+        m_event->reset(nullptr, LogLevel::level::UNKNOWN, nullptr, 0, 0, 0, 0, 0, "");
+        t_log_cache.events.push_back(std::move(m_event));
+    }
 }
 
 void LogEvent::format(const char* fmt, ...) {
@@ -53,15 +287,10 @@ void LogEvent::format(const char* fmt, ...) {
 }
 
 void LogEvent::format(const char* fmt, va_list al) {
-    char* buf = nullptr;
-    int len = vasprintf(&buf, fmt, al);
-    if(len != -1) {
-        m_ss << std::string(buf, len);
-        free(buf);
-    }
+    m_ss.format(fmt, al);
 }
 
-std::stringstream& LogEventWrap::getSS() {
+LogEventStream& LogEventWrap::getSS() {
     return m_event->getSS();
 }
 
@@ -71,18 +300,213 @@ LogEvent::ptr LogEventWrap::getEvent() const {
 
 LogFormatter::FormatItem::FormatItem(const std::string& fmt){}
 
+namespace {
+
+/**
+ * @brief Length of the valid UTF-8 sequence at p, 0 if there is none
+ */
+size_t Utf8Length(const unsigned char* p, const unsigned char* end) {
+    unsigned char c = p[0];
+    size_t n;
+    unsigned char lo = 0x80, hi = 0xbf;   // range of the second byte
+    if(c >= 0xc2 && c <= 0xdf) {
+        n = 2;
+    } else if(c >= 0xe0 && c <= 0xef) {
+        n = 3;
+        if(c == 0xe0) {
+            lo = 0xa0;                      // overlong
+        } else if(c == 0xed) {
+            hi = 0x9f;                      // surrogates
+        }
+    } else if(c >= 0xf0 && c <= 0xf4) {
+        n = 4;
+        if(c == 0xf0) {
+            lo = 0x90;
+        } else if(c == 0xf4) {
+            hi = 0x8f;                      // past U+10FFFF
+        }
+    } else {
+        return 0;
+    }
+    if((size_t)(end - p) < n || p[1] < lo || p[1] > hi) {
+        return 0;
+    }
+    for(size_t i = 2; i < n; ++i) {
+        if((p[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief The inside of a JSON string: quotes, backslashes and control
+ *        characters escaped, bytes that aren't UTF-8 as U+FFFD
+ */
+void AppendEscaped(LogStream& os, const char* str, size_t len) {
+    static const char s_hex[] = "0123456789abcdef";
+    const unsigned char* p = (const unsigned char*)str;
+    const unsigned char* end = p + len;
+    const unsigned char* run = p;
+    while(p < end) {
+        unsigned char c = *p;
+        if(c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            ++p;
+            continue;
+        }
+        if(c >= 0x80) {
+            if(size_t n = Utf8Length(p, end)) {
+                p += n;
+                continue;
+            }
+        }
+        os.append((const char*)run, p - run);
+        switch(c) {
+            case '"': os.append("\\\"", 2); break;
+            case '\\': os.append("\\\\", 2); break;
+            case '\n': os.append("\\n", 2); break;
+            case '\r': os.append("\\r", 2); break;
+            case '\t': os.append("\\t", 2); break;
+            case '\b': os.append("\\b", 2); break;
+            case '\f': os.append("\\f", 2); break;
+            default:
+                if(c >= 0x80) {
+                    os.append("\\ufffd", 6);
+                } else {
+                    char buf[6] = {'\\', 'u', '0', '0', s_hex[c >> 4], s_hex[c & 0xf]};
+                    os.append(buf, 6);
+                }
+                break;
+        }
+        run = ++p;
+    }
+    os.append((const char*)run, p - run);
+}
+
+void AppendJsonString(LogStream& os, const char* str, size_t len) {
+    os.append("\"", 1);
+    AppendEscaped(os, str, len);
+    os.append("\"", 1);
+}
+
+/**
+ * @brief A logfmt value, in quotes when it has spaces, '=', quotes,
+ *        control characters or anything outside ASCII
+ */
+void AppendLogfmtValue(LogStream& os, const char* str, size_t len) {
+    bool quote = len == 0;
+    for(size_t i = 0; i < len && !quote; ++i) {
+        unsigned char c = str[i];
+        quote = c <= ' ' || c >= 0x7f || c == '=' || c == '"' || c == '\\';
+    }
+    if(quote) {
+        AppendJsonString(os, str, len);
+    } else {
+        os.append(str, len);
+    }
+}
+
+/**
+ * @brief A logfmt key, characters it can't have become '_'
+ */
+void AppendLogfmtKey(LogStream& os, const char* str, size_t len) {
+    if(len == 0) {
+        os.append("_", 1);
+        return;
+    }
+    for(size_t i = 0; i < len; ++i) {
+        unsigned char c = str[i];
+        char k = c <= ' ' || c >= 0x7f || c == '=' || c == '"' || c == '\\' ? '_' : c;
+        os.append(&k, 1);
+    }
+}
+
+/**
+ * @brief Shortest of %.15g and %.17g that reads back the same
+ */
+void AppendDouble(LogStream& os, double d, bool json) {
+    if(std::isnan(d)) {
+        json ? os.append("null", 4) : os.append("NaN", 3);
+        return;
+    }
+    if(std::isinf(d)) {
+        if(json) {
+            os.append("null", 4);
+        } else {
+            d > 0 ? os.append("+Inf", 4) : os.append("-Inf", 4);
+        }
+        return;
+    }
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%.15g", d);
+    if(strtod(buf, nullptr) != d) {
+        n = snprintf(buf, sizeof(buf), "%.17g", d);
+    }
+    os.append(buf, n);
+}
+
+/**
+ * @brief The value of a field, as JSON or as logfmt
+ */
+void AppendFieldValue(LogStream& os, const LogFields& fields, const LogFields::Field& f, bool json) {
+    switch(f.type) {
+        case LogFields::INT:
+            os << (long long)f.i;
+            break;
+        case LogFields::UINT:
+            os << (unsigned long long)f.u;
+            break;
+        case LogFields::DOUBLE:
+            AppendDouble(os, f.d, json);
+            break;
+        case LogFields::BOOL:
+            f.b ? os.append("true", 4) : os.append("false", 5);
+            break;
+        case LogFields::STRING:
+            if(json) {
+                AppendJsonString(os, fields.data() + f.s.off, f.s.len);
+            } else {
+                AppendLogfmtValue(os, fields.data() + f.s.off, f.s.len);
+            }
+            break;
+        case LogFields::POINTER: {
+            char buf[24];
+            int n = snprintf(buf, sizeof(buf), json ? "\"0x%llx\"" : "0x%llx", (unsigned long long)f.u);
+            os.append(buf, n);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief " key=value" for each field
+ */
+void AppendLogfmtFields(LogStream& os, const LogFields& fields) {
+    for(size_t i = 0; i < fields.size(); ++i) {
+        const LogFields::Field& f = fields[i];
+        os.append(" ", 1);
+        AppendLogfmtKey(os, fields.data() + f.key.off, f.key.len);
+        os.append("=", 1);
+        AppendFieldValue(os, fields, f, false);
+    }
+}
+
+}
+
 class MessageFormatItem: public LogFormatter::FormatItem {
 	public:
         MessageFormatItem(const std::string str = "") {}
-		void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
-            os << event->getContent();
+		void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
+            os.append(event->getSS().data(), event->getSS().size());
+            // the fields don't get lost in a text pattern
+            AppendLogfmtFields(os, event->getFields());
         }
 };
 
 class LevelFormatItem: public LogFormatter::FormatItem {
 	public:    
         LevelFormatItem(const std::string str = "") {}
-		void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+		void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
             os << LogLevel::ToString(level);
         }
 };
@@ -90,7 +514,7 @@ class LevelFormatItem: public LogFormatter::FormatItem {
 class ElapseFormatItem: public LogFormatter::FormatItem {
     public:
         ElapseFormatItem(const std::string str = "") {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
             os << event->getElapse();
         }
 };
@@ -98,7 +522,7 @@ class ElapseFormatItem: public LogFormatter::FormatItem {
 class NameFormatItem: public LogFormatter::FormatItem {
     public:
         NameFormatItem(const std::string str = "") {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
             os << event->getLogger()->getName();
         }
 };
@@ -107,7 +531,7 @@ class NameFormatItem: public LogFormatter::FormatItem {
 class ThreadIdFormatItem: public LogFormatter::FormatItem {
     public:
         ThreadIdFormatItem(const std::string str = "") {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
                 os << event->getThreadId();
         }
 };
@@ -116,7 +540,7 @@ class ThreadIdFormatItem: public LogFormatter::FormatItem {
 class FiberFormatItem: public LogFormatter::FormatItem {
     public:
         FiberFormatItem(const std::string str = "") {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
             os << event->getFiberId();
         }
 };
@@ -124,36 +548,212 @@ class FiberFormatItem: public LogFormatter::FormatItem {
 class ThreadNameFormatItem: public LogFormatter::FormatItem {
     public:
         ThreadNameFormatItem(const std::string str = "") {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
             os << event->getThreadName();
         }
 };
 
+namespace {
+
+/**
+ * @brief A thread's rendering of one DateTimeFormatItem for one second
+ */
+struct DateTimeCache {
+    uint64_t id;
+    uint64_t sec;
+    char text[256];
+    /// end of each strftime part in text, the fractions go in between
+    uint16_t ends[5];
+};
+
+}
+
+/// direct mapped by item id, plain data so nothing to tear down
+static thread_local DateTimeCache t_datetime_cache[4];
+static std::atomic<uint64_t> s_datetime_ids = {0};
+
 class DateTimeFormatItem: public LogFormatter::FormatItem {
     public:
         DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S")
-            :m_format{format} {
+            :m_format{format}
+            ,m_id(++s_datetime_ids) {
                 if(m_format.empty()) {
                     m_format = "%Y-%m-%d %H:%M:%S";
                 } 
+                parse();
+            }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
+                // localtime_r and strftime only once a second per thread;
+                // localtime_r takes glibc's timezone lock
+                DateTimeCache& c = t_datetime_cache[m_id % 4];
+                if(c.id != m_id || c.sec != event->getTime()) {
+                    render(c, event->getTime());
+                }
+                size_t begin = 0;
+                for(size_t i = 0; i < m_parts.size(); ++i) {
+                    os.append(c.text + begin, c.ends[i] - begin);
+                    begin = c.ends[i];
+                    if(i < m_digits.size()) {
+                        appendFraction(os, event->getUsec(), m_digits[i]);
+                    }
+                }
+        }
+    private:
+        /**
+         * @brief Split m_format at %N / %<digits>N, which strftime lacks
+         */
+        void parse() {
+            std::string part;
+            for(size_t i = 0; i < m_format.size(); ++i) {
+                char c = m_format[i];
+                if(c == '%' && i + 1 < m_format.size() && m_digits.size() < 4) {
+                    char n = m_format[i + 1];
+                    if(n == 'N') {
+                        m_parts.push_back(part);
+                        part.clear();
+                        m_digits.push_back(9);
+                        ++i;
+                        continue;
+                    }
+                    if(n >= '1' && n <= '9' && i + 2 < m_format.size() && m_format[i + 2] == 'N') {
+                        m_parts.push_back(part);
+                        part.clear();
+                        m_digits.push_back(n - '0');
+                        i += 2;
+                        continue;
+                    }
+                    // keep %% whole, so %%N stays literal
+                    part += c;
+                    part += n;
+                    ++i;
+                    continue;
+                }
+                part += c;
+            }
+            m_parts.push_back(part);
+        }
+
+        void render(DateTimeCache& c, uint64_t sec) {
+            struct tm tm;
+            time_t t = sec;
+            localtime_r(&t, &tm);
+            size_t len = 0;
+            for(size_t i = 0; i < m_parts.size(); ++i) {
+                if(!m_parts[i].empty()) {
+                    len += strftime(c.text + len, sizeof(c.text) - len, m_parts[i].c_str(), &tm);
+                }
+                c.ends[i] = len;
             }
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
-                struct tm tm;
-                time_t time = event->getTime();
-                localtime_r(&time, &tm);
-                char buf[64];
-                strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-                os << buf;
+            c.id = m_id;
+            c.sec = sec;
+        }
+
+        static void appendFraction(LogStream& os, uint32_t usec, int digits) {
+            char buf[9];
+            uint32_t ns = usec * 1000;
+            for(int i = 8; i >= 0; --i) {
+                buf[i] = '0' + ns % 10;
+                ns /= 10;
+            }
+            os.append(buf, digits);
         }
     private:
         std::string m_format;
+        uint64_t m_id;
+        /// strftime formats, one more than there are fractions
+        std::vector<std::string> m_parts;
+        /// digits of each fraction
+        std::vector<int> m_digits;
+};
+
+
+/**
+ * @brief %J: the whole record as one JSON object
+ *
+ * {"time":..,"level":..,"logger":..,"thread":..,"thread_name":..,
+ * "fiber":..,"file":..,"line":..,"msg":..} followed by the event's
+ * fields. The time is formatted as by %d, %J{...} changes it.
+ */
+class JsonFormatItem: public LogFormatter::FormatItem {
+    public:
+        JsonFormatItem(const std::string& format = "")
+            :m_time(format.empty() ? "%Y-%m-%dT%H:%M:%S.%6N%z" : format) {
+        }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
+            os.append("{\"time\":\"", 9);
+            m_time.format(os, logger, level, event);
+            os.append("\",\"level\":\"", 11);
+            os << LogLevel::ToString(level);
+            os.append("\",\"logger\":", 11);
+            const std::string& name = event->getLogger()->getName();
+            AppendJsonString(os, name.data(), name.size());
+            os.append(",\"thread\":", 10);
+            os << event->getThreadId();
+            os.append(",\"thread_name\":", 15);
+            AppendJsonString(os, event->getThreadName().data(), event->getThreadName().size());
+            os.append(",\"fiber\":", 9);
+            os << event->getFiberId();
+            os.append(",\"file\":", 8);
+            AppendJsonString(os, event->getFile(), strlen(event->getFile()));
+            os.append(",\"line\":", 8);
+            os << event->getLine();
+            os.append(",\"msg\":", 7);
+            AppendJsonString(os, event->getSS().data(), event->getSS().size());
+            const LogFields& fields = event->getFields();
+            for(size_t i = 0; i < fields.size(); ++i) {
+                const LogFields::Field& f = fields[i];
+                os.append(",", 1);
+                AppendJsonString(os, fields.data() + f.key.off, f.key.len);
+                os.append(":", 1);
+                AppendFieldValue(os, fields, f, true);
+            }
+            os.append("}", 1);
+        }
+    private:
+        DateTimeFormatItem m_time;
+};
+
+/**
+ * @brief %K: the whole record as logfmt key=value pairs
+ *
+ * Same keys as %J, values quoted when they need to be.
+ */
+class LogfmtFormatItem: public LogFormatter::FormatItem {
+    public:
+        LogfmtFormatItem(const std::string& format = "")
+            :m_time(format.empty() ? "%Y-%m-%dT%H:%M:%S.%6N%z" : format) {
+        }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
+            os.append("time=", 5);
+            m_time.format(os, logger, level, event);
+            os.append(" level=", 7);
+            os << LogLevel::ToString(level);
+            os.append(" logger=", 8);
+            const std::string& name = event->getLogger()->getName();
+            AppendLogfmtValue(os, name.data(), name.size());
+            os.append(" thread=", 8);
+            os << event->getThreadId();
+            os.append(" thread_name=", 13);
+            AppendLogfmtValue(os, event->getThreadName().data(), event->getThreadName().size());
+            os.append(" fiber=", 7);
+            os << event->getFiberId();
+            os.append(" file=", 6);
+            AppendLogfmtValue(os, event->getFile(), strlen(event->getFile()));
+            os.append(" line=", 6);
+            os << event->getLine();
+            os.append(" msg=", 5);
+            AppendLogfmtValue(os, event->getSS().data(), event->getSS().size());
+            AppendLogfmtFields(os, event->getFields());
+        }
+    private:
+        DateTimeFormatItem m_time;
 };
 
 
 class LineFormatItem: public LogFormatter::FormatItem {
     public:
         LineFormatItem(const std::string str = "") {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
             os << event->getLine();
         }
 };
@@ -161,7 +761,7 @@ class LineFormatItem: public LogFormatter::FormatItem {
 class FileFormatItem: public LogFormatter::FormatItem {
     public:
         FileFormatItem(const std::string str = "") {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
                 os << event->getFile();
         }
 };
@@ -170,7 +770,7 @@ class StringFormatItem: public LogFormatter::FormatItem {
     public:
         StringFormatItem(const std::string &str)
             :FormatItem(str), m_string(str) {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
             os << m_string;
         }
     private:
@@ -181,7 +781,7 @@ class StringFormatItem: public LogFormatter::FormatItem {
 class NewLineFormatItem: public LogFormatter::FormatItem {
     public:
         NewLineFormatItem(const std::string str = "") {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
                 os << "\n";
         }
 };
@@ -189,65 +789,254 @@ class NewLineFormatItem: public LogFormatter::FormatItem {
 class TabFormatItem: public LogFormatter::FormatItem {
     public:
         TabFormatItem(const std::string str = "") {}
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) override {
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) override {
                 os << "\t";
         }
 };
 
+static sylar::ConfigVar<uint32_t>::ptr g_log_summary_interval =
+    sylar::Config::Lookup("log.ratelimit.summary_interval", (uint32_t)10000
+            , "ms between \"suppressed N messages\" records of a rate limited logger or log line");
+/// g_log_summary_interval in ns, read on every suppressed record
+static std::atomic<uint64_t> s_summary_interval{10000ull * 1000 * 1000};
+
+bool LogRateLimiter::suppress(uint64_t now) {
+    if(m_suppressed.fetch_add(1, std::memory_order_relaxed) == 0) {
+        // a new run of suppressed records, the first summary is an interval away
+        m_lastReport.store(now, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+uint64_t LogRateLimiter::takeSuppressed(uint64_t now) {
+    uint64_t last = m_lastReport.load(std::memory_order_relaxed);
+    if(now - last < s_summary_interval.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    // one thread reports, the others see a fresh time stamp
+    if(!m_lastReport.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        return 0;
+    }
+    return m_suppressed.exchange(0, std::memory_order_relaxed);
+}
+
+uint64_t LogRateLimiter::drain(uint64_t now) {
+    m_lastReport.store(now, std::memory_order_relaxed);
+    return m_suppressed.exchange(0, std::memory_order_relaxed);
+}
+
+static_assert(std::is_trivially_destructible<LogSite>::value
+              ,"a LogSite static must not need a guard");
+
+/// Sites that started a run of suppressed records since the last
+/// ReportPending(), pushed lock free, taken all at once
+static std::atomic<LogSite*> s_pendingSites{nullptr};
+
+void LogSite::suppress(Logger* logger, LogLevel::level level, const char* file, int32_t line) {
+    bool expected = false;
+    // once per run, so the count is reported even if the line isn't reached again
+    if(m_limiter.suppress(LogRateLimiter::Now())
+            && m_pending.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+        if(m_hasPendingLogger) {
+            pendingLogger() = logger->shared_from_this();
+        } else {
+            new (m_pendingLogger) std::weak_ptr<Logger>(logger->shared_from_this());
+            m_hasPendingLogger = true;
+        }
+        m_pendingLevel = level;
+        m_pendingFile = file;
+        m_pendingLine = line;
+        LogSite* head = s_pendingSites.load(std::memory_order_relaxed);
+        do {
+            m_nextPending = head;
+        } while(!s_pendingSites.compare_exchange_weak(head, this
+                    ,std::memory_order_release, std::memory_order_relaxed));
+    }
+    report(logger, level, file, line);
+}
+
+void LogSite::ReportPending() {
+    LogSite* site = s_pendingSites.exchange(nullptr, std::memory_order_acquire);
+    uint64_t now = LogRateLimiter::Now();
+    while(site) {
+        LogSite* next = site->m_nextPending;
+        Logger::ptr logger = site->pendingLogger().lock();
+        LogLevel::level level = site->m_pendingLevel;
+        const char* file = site->m_pendingFile;
+        int32_t line = site->m_pendingLine;
+        // off the list before the count is taken: a run starting from here
+        // on pushes the site again instead of going unreported
+        site->m_pending.store(false, std::memory_order_release);
+        // 0 if a report on the line itself took them meanwhile
+        uint64_t n = site->m_limiter.drain(now);
+        if(n && logger) {
+            LogEventWrap(logger, level, file, line, 0, GetThreadId(), GetFiberId()).getSS()
+                << "suppressed " << n << " messages";
+        }
+        site = next;
+    }
+}
+
+void LogSite::report(Logger* logger, LogLevel::level level, const char* file, int32_t line) {
+    if(uint64_t n = m_limiter.takeSuppressed(LogRateLimiter::Now())) {
+        LogEventWrap(logger->shared_from_this(), level, file, line, 0, GetThreadId(), GetFiberId()).getSS()
+            << "suppressed " << n << " messages";
+    }
+}
+
 Logger::Logger(const std::string& name) 
     : m_name(name) 
-    , m_level(LogLevel::level::DEBUG){
+    , m_level(LogLevel::level::DEBUG)
+    , m_appenders(std::make_shared<AppenderList>()) {
     m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));   // default formatter for appenders if their formatter is null
 
 }
 //%d{%Y-%m-%d %H:%M:%S}%T%t%T%F%T%[p]%T%[%c]%T%f:%l%T%m%n
 
+void Logger::inheritFormatter(LogAppender::ptr appender) {
+    LogAppender::MutexType::Lock ll(appender->m_mutex);
+    if(!appender->m_formatter) {
+        appender->m_formatter = m_formatter;
+        // don't change hasFormatter status
+        // hasFormatter is still false
+    }
+}
+
 void Logger::addAppender(LogAppender::ptr appender) {
     MutexType::Lock lock(m_mutex);
-    if(!appender->getFormatter()){
-            MutexType::Lock ll(appender->m_mutex);
-            appender->m_formatter = m_formatter; 
-            // don't change hasFormatter status
-            // hasFormatter is still false
-    }
-    Logger::m_appenders.push_back(appender); 
+    inheritFormatter(appender);
+    std::shared_ptr<AppenderList> list(new AppenderList(*m_appenders));
+    list->push_back(appender);
+    std::atomic_store(&m_appenders, std::shared_ptr<const AppenderList>(list));
 };
 
 void Logger::delAppender(LogAppender::ptr appender) {
-    for(auto it = Logger::m_appenders.begin(); it != Logger::m_appenders.end(); ++it) {  
-        if(*it == appender) {
-                m_appenders.erase(it);
-                break;
-        }   
+    MutexType::Lock lock(m_mutex);
+    std::shared_ptr<AppenderList> list(new AppenderList(*m_appenders));
+    auto it = std::find(list->begin(), list->end(), appender);
+    if(it != list->end()) {
+        list->erase(it);
+        std::atomic_store(&m_appenders, std::shared_ptr<const AppenderList>(list));
+    }
+}
+
+void Logger::clearAppenders() {
+    setAppenders(AppenderList());
+}
+
+void Logger::setAppenders(const AppenderList& appenders) {
+    MutexType::Lock lock(m_mutex);
+    for(auto& i : appenders) {
+        inheritFormatter(i);
     }
+    std::atomic_store(&m_appenders, std::shared_ptr<const AppenderList>(new AppenderList(appenders)));
+}
+
+std::shared_ptr<const Logger::AppenderList> Logger::getAppenders() const {
+    return std::atomic_load(&m_appenders);
 }
 
 void Logger::log(LogLevel::level level, LogEvent::ptr event) {
-    if(level >= m_level) {
-        auto self = shared_from_this();
-        MutexType::Lock lock(m_mutex);
-        if(!m_appenders.empty()) {
-            for(auto& i : m_appenders) {
-                i->log(self, level, event);
+    if(level < getLevel()) {
+        return;
+    }
+    uint64_t interval = m_rateInterval.load(std::memory_order_relaxed);
+    if(interval) {
+        uint64_t now = LogRateLimiter::Now();
+        bool allowed = m_rateLimiter.allow(now, interval
+                        ,m_rateTolerance.load(std::memory_order_relaxed));
+        if(!allowed) {
+            m_rateLimiter.suppress(now);
+        }
+        if(m_rateLimiter.hasSuppressed()) {
+            if(uint64_t n = m_rateLimiter.takeSuppressed(now)) {
+                writeSuppressed(n, event->getFile(), event->getLine());
             }
-        } else if(m_root){
-            m_root->log(level, event);
         }
+        if(!allowed) {
+            return;
+        }
+    }
+    write(level, event);
+}
+
+void Logger::write(LogLevel::level level, LogEvent::ptr event) {
+    // a snapshot: appenders do their IO without any logger lock held,
+    // and a list swapped out meanwhile stays alive until we are done
+    auto appenders = getAppenders();
+    if(!appenders->empty()) {
+        auto self = shared_from_this();
+        for(auto& i : *appenders) {
+            i->log(self, level, event);
+        }
+    } else if(m_root){
+        m_root->log(level, event);
+    }
+}
+
+void Logger::writeSuppressed(uint64_t n, const char* file, int32_t line) {
+    // straight to the appenders, the summary isn't limited itself
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    LogEvent::ptr summary(new LogEvent(nullptr, LogLevel::level::WARN, nullptr, 0, 0, 0, 0, 0, ""));
+    summary->reset(shared_from_this(), LogLevel::level::WARN, file, line, 0
+                ,GetThreadId(), GetFiberId(), ts.tv_sec, Thread::GetName(), ts.tv_nsec / 1000);
+    summary->getSS() << "logger " << m_name << " rate limit: suppressed "
+                     << n << " messages";
+    write(LogLevel::level::WARN, summary);
+}
+
+void Logger::setRateLimit(uint32_t per_sec, uint32_t burst) {
+    MutexType::Lock lock(m_mutex);
+    m_rateLimit = per_sec;
+    m_rateBurst = burst;
+    uint64_t interval = per_sec ? 1000000000ull / per_sec : 0;
+    if(!burst) {
+        burst = per_sec;
+    }
+    m_rateTolerance.store(burst > 1 ? (burst - 1) * interval : 0, std::memory_order_relaxed);
+    m_rateInterval.store(interval, std::memory_order_relaxed);
+}
+
+void Logger::flush() {
+    // the last run of a storm, no record after it to carry the summary
+    if(m_rateLimiter.hasSuppressed()) {
+        if(uint64_t n = m_rateLimiter.drain(LogRateLimiter::Now())) {
+            writeSuppressed(n, nullptr, 0);
+        }
+    }
+    auto appenders = getAppenders();
+    for(auto& i : *appenders) {
+        i->flush();
     }
 }
 
 void Logger::setFormatter(LogFormatter::ptr val) {
     MutexType::Lock lock(m_mutex);
     m_formatter = val;
+    if(m_binaryId) {
+        // records from now on are decoded with the new pattern
+        m_binaryId = BinaryLog::RegisterLogger(m_name, m_formatter->getPattern());
+    }
 
     // appenders' formatter will also be affected if inherited from logger
-    for(auto& i : m_appenders) {
-        MutexType::Lock ll(i->m_mutex);
+    for(auto& i : *m_appenders) {
+        LogAppender::MutexType::Lock ll(i->m_mutex);
         if(!i->m_hasFormatter) {
             i->m_formatter = m_formatter;
         }
     }
 }
+void Logger::setBinary(bool v) {
+    MutexType::Lock lock(m_mutex);
+    if(!v) {
+        m_binaryId = 0;
+    } else if(!m_binaryId) {
+        m_binaryId = BinaryLog::RegisterLogger(m_name, m_formatter->getPattern());
+    }
+}
+
 void Logger::setFormatter(const std::string& val) {
     sylar::LogFormatter::ptr new_val(new sylar::LogFormatter(val));
     if(new_val->isError()) {
@@ -291,7 +1080,7 @@ LogFormatter::ptr LogAppender::getFormatter() {
 
 
 LogFormatter::ptr Logger::getFormatter() {
-    MutexType lock(m_mutex);
+    MutexType::Lock lock(m_mutex);
     return m_formatter;
 }
 
@@ -311,25 +1100,62 @@ void Logger::fatal(LogEvent::ptr event) {
     log(LogLevel::level::FATAL, event);
 }
 
-std::string FileLogAppender::toYamlString() {
-    YAML::Node node;
-    node["type"] = "StdoutLogAppender";
-    node["file"] = m_filename;
-    node["level"] = LogLevel::ToString(m_level);
-    if(m_hasFormatter && m_formatter) { // filter out logger's formatter
-        node["formatter"] = m_formatter->getPattern();
-    }
-    std::stringstream ss;
-    ss << node;
-    return ss.str();
-}
-
 void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) {
     if (level >= m_level) {
+        // a copy: setFormatter may swap m_formatter meanwhile
+        LogFormatter::ptr fmt = getFormatter();
+        FormatBuffer buf;
+        fmt->format(*buf, logger, level, event);
         MutexType::Lock lock(m_mutex);
-        std::string str = m_formatter->format(logger, level, event);
-        std::cout << str << std::endl;
+        std::cout.write(buf->data(), buf->size());
+        std::cout.flush();
+    }
+}
+
+/**
+ * @brief writev() all of iov, picking up after short writes
+ */
+static bool writev_all(int fd, const iovec* iov, int iovcnt) {
+    while(iovcnt > 0) {
+        ssize_t n = ::writev(fd, iov, std::min(iovcnt, IOV_MAX));
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while(iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if(n > 0) {
+            // the rest of a partly written buffer, iov itself stays const
+            const char* p = (const char*)iov->iov_base + n;
+            size_t left = iov->iov_len - n;
+            while(left > 0) {
+                ssize_t w = ::write(fd, p, left);
+                if(w < 0) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                p += w;
+                left -= w;
+            }
+            ++iov;
+            --iovcnt;
+        }
     }
+    return true;
+}
+
+void StdoutLogAppender::write(const iovec* iov, int iovcnt) {
+    MutexType::Lock lock(m_mutex);
+    // whatever log() left in cout goes first
+    std::cout.flush();
+    writev_all(STDOUT_FILENO, iov, iovcnt);
 }
 
 std::string StdoutLogAppender::toYamlString() {
@@ -346,21 +1172,34 @@ std::string StdoutLogAppender::toYamlString() {
     return ss.str();
 }
 
-void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) {
-    if (level >= m_level) {
-        uint64_t now = time(0);
-        if(now != m_lastTime) {
-            reopen();
-            m_lastTime = now;
-        }
-
-        MutexType::Lock lock(m_mutex);
-        if(!(m_filestream << m_formatter->format(logger, level, event))) {
-            std::cout << "error" << std::endl;
-        }
+static sylar::ConfigVar<uint32_t>::ptr g_log_file_buffer_size =
+    sylar::Config::Lookup("log.file.buffer_size", (uint32_t)8192
+            , "bytes FileLogAppender collects before writing");
+static sylar::ConfigVar<uint32_t>::ptr g_log_file_check_interval =
+    sylar::Config::Lookup("log.file.check_interval", (uint32_t)5
+            , "seconds between checks whether a log file was moved away");
+
+FileLogAppender::Rotate FileLogAppender::RotateFromString(const std::string& str) {
+    std::string v = str;
+    std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+    if(v == "size") {
+        return Rotate::SIZE;
+    } else if(v == "hourly") {
+        return Rotate::HOURLY;
+    } else if(v == "daily") {
+        return Rotate::DAILY;
     }
+    return Rotate::NONE;
 }
 
+const char* FileLogAppender::RotateToString(Rotate v) {
+    switch(v) {
+        case Rotate::SIZE: return "size";
+        case Rotate::HOURLY: return "hourly";
+        case Rotate::DAILY: return "daily";
+        default: return "none";
+    }
+}
 
 FileLogAppender::FileLogAppender(const std::string& filename) 
     : m_filename(filename) {
@@ -369,14 +1208,465 @@ FileLogAppender::FileLogAppender(const std::string& filename)
     }
 }
 
+FileLogAppender::~FileLogAppender() {
+    flushBuffer();
+    if(m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) {
+    if (level >= m_level) {
+        // a copy: setFormatter may swap m_formatter meanwhile
+        LogFormatter::ptr fmt = getFormatter();
+        FormatBuffer buf;
+        fmt->format(*buf, logger, level, event);
+        MutexType::Lock lock(m_mutex);
+        time_t now = time(0);
+        prepareWrite(buf->size(), now);
+        m_buffer.append(buf->data(), buf->size());
+        m_size += buf->size();
+        // an idle logger's last records wait for the next one at most a
+        // second late, AsyncLogAppender bounds it by flush_interval
+        if(m_buffer.size() >= g_log_file_buffer_size->getValue()
+                || level >= LogLevel::level::ERROR
+                || now != m_lastWrite) {
+            flushBuffer();
+        }
+    }
+}
+
+void FileLogAppender::write(const iovec* iov, int iovcnt) {
+    size_t len = 0;
+    for(int i = 0; i < iovcnt; ++i) {
+        len += iov[i].iov_len;
+    }
+    MutexType::Lock lock(m_mutex);
+    prepareWrite(len, time(0));
+    flushBuffer();
+    // batches are big already, straight to the file
+    if(!writev_all(m_fd, iov, iovcnt)) {
+        std::cout << "FileLogAppender write " << m_filename << " error: "
+                  << strerror(errno) << std::endl;
+    }
+    m_size += len;
+}
+
+void FileLogAppender::flush() {
+    MutexType::Lock lock(m_mutex);
+    flushBuffer();
+}
+
+void FileLogAppender::flushBuffer() {
+    m_lastWrite = time(0);
+    if(m_buffer.empty()) {
+        return;
+    }
+    iovec iov;
+    iov.iov_base = &m_buffer[0];
+    iov.iov_len = m_buffer.size();
+    if(!writev_all(m_fd, &iov, 1)) {
+        std::cout << "FileLogAppender write " << m_filename << " error: "
+                  << strerror(errno) << std::endl;
+    }
+    m_buffer.clear();
+}
+
 // This pattern is useful for log rotation or when you need to reopen a log file after it might have been moved/deleted
 bool FileLogAppender::reopen() {
     MutexType::Lock lock(m_mutex);
-    if (m_filestream) {
-        m_filestream.close();
+    flushBuffer();
+    return openFile();
+}
+
+bool FileLogAppender::openFile() {
+    int fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        std::cout << "FileLogAppender open " << m_filename << " error: "
+                  << strerror(errno) << std::endl;
+        return false;
+    }
+    if(m_fd >= 0) {
+        ::close(m_fd);
+    }
+    m_fd = fd;
+    m_lastCheck = time(0);
+
+    struct stat st;
+    m_size = 0;
+    time_t since = m_lastCheck;
+    if(fstat(m_fd, &st) == 0) {
+        m_size = st.st_size;
+        // a file carried over from an earlier period is rotated as
+        // that period's
+        if(st.st_size > 0) {
+            since = st.st_mtime;
+        }
+    }
+    m_periodStart = periodStart(since);
+    m_nextRotate = nextRotateTime(since);
+    return true;
+}
+
+void FileLogAppender::setRotate(Rotate mode, uint64_t max_size, uint32_t max_files
+                                ,const std::string& pattern) {
+    MutexType::Lock lock(m_mutex);
+    m_rotate = mode;
+    m_maxSize = max_size;
+    m_maxFiles = max_files;
+    m_pattern = pattern;
+    if(m_pattern.empty()) {
+        if(mode == Rotate::DAILY) {
+            m_pattern = ".%Y%m%d";
+        } else if(mode == Rotate::HOURLY) {
+            m_pattern = ".%Y%m%d%H";
+        } else {
+            m_pattern = ".%Y%m%d-%H%M%S";
+        }
+    }
+    struct stat st;
+    time_t since = time(0);
+    if(fstat(m_fd, &st) == 0 && st.st_size > 0) {
+        since = st.st_mtime;
+    }
+    m_periodStart = periodStart(since);
+    m_nextRotate = nextRotateTime(since);
+}
+
+time_t FileLogAppender::periodStart(time_t t) const {
+    struct tm tm;
+    localtime_r(&t, &tm);
+    tm.tm_sec = 0;
+    tm.tm_min = 0;
+    if(m_rotate == Rotate::DAILY) {
+        tm.tm_hour = 0;
+    } else if(m_rotate != Rotate::HOURLY) {
+        return t;
+    }
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+time_t FileLogAppender::nextRotateTime(time_t t) const {
+    struct tm tm;
+    localtime_r(&t, &tm);
+    tm.tm_sec = 0;
+    tm.tm_min = 0;
+    if(m_rotate == Rotate::DAILY) {
+        tm.tm_hour = 0;
+        tm.tm_mday += 1;
+    } else if(m_rotate == Rotate::HOURLY) {
+        tm.tm_hour += 1;
+    } else {
+        return 0;
+    }
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+void FileLogAppender::prepareWrite(size_t len, time_t now) {
+    if(now - m_lastCheck >= (time_t)g_log_file_check_interval->getValue()) {
+        m_lastCheck = now;
+        checkFile();
+    }
+    if(m_rotate == Rotate::SIZE) {
+        if(m_maxSize && m_size > 0 && m_size + len > m_maxSize) {
+            doRotate(now);
+        }
+    } else if(m_rotate != Rotate::NONE && now >= m_nextRotate) {
+        doRotate(now);
     }
-    m_filestream.open(m_filename);
-    return !!m_filestream;
+}
+
+void FileLogAppender::checkFile() {
+    struct stat path_st, fd_st;
+    if(::stat(m_filename.c_str(), &path_st) == 0
+            && fstat(m_fd, &fd_st) == 0
+            && path_st.st_ino == fd_st.st_ino
+            && path_st.st_dev == fd_st.st_dev) {
+        return;
+    }
+    // moved or deleted under us, what is buffered goes after the rest
+    flushBuffer();
+    openFile();
+}
+
+bool FileLogAppender::rotate() {
+    MutexType::Lock lock(m_mutex);
+    return doRotate(time(0));
+}
+
+bool FileLogAppender::doRotate(time_t now) {
+    flushBuffer();
+    time_t t = (m_rotate == Rotate::HOURLY || m_rotate == Rotate::DAILY) ? m_periodStart : now;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char buf[256];
+    size_t n = strftime(buf, sizeof(buf)
+                , m_pattern.empty() ? ".%Y%m%d-%H%M%S" : m_pattern.c_str(), &tm);
+    std::string base = m_filename + std::string(buf, n);
+    std::string target = base;
+    for(int i = 1; access(target.c_str(), F_OK) == 0; ++i) {
+        target = base + "." + std::to_string(i);
+    }
+    if(::rename(m_filename.c_str(), target.c_str()) != 0) {
+        std::cout << "FileLogAppender rotate " << m_filename << " to " << target
+                  << " error: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if(!openFile()) {
+        return false;
+    }
+    removeOldFiles();
+    return true;
+}
+
+void FileLogAppender::removeOldFiles() {
+    if(m_maxFiles == 0) {
+        return;
+    }
+    std::string dir = ".";
+    std::string name = m_filename;
+    size_t pos = m_filename.rfind('/');
+    if(pos != std::string::npos) {
+        dir = pos ? m_filename.substr(0, pos) : "/";
+        name = m_filename.substr(pos + 1);
+    }
+    // rotated names are name + the pattern's leading literal + a date, so
+    // e.g. name.err of another appender is left alone
+    std::string prefix = name + m_pattern.substr(0, m_pattern.find('%'));
+
+    DIR* d = opendir(dir.c_str());
+    if(!d) {
+        return;
+    }
+    std::vector<std::pair<uint64_t, std::string> > files;
+    while(dirent* e = readdir(d)) {
+        std::string n = e->d_name;
+        if(n.size() <= prefix.size() || n.compare(0, prefix.size(), prefix) != 0
+                || !isdigit((unsigned char)n[prefix.size()])) {
+            continue;
+        }
+        std::string path = dir + "/" + n;
+        struct stat st;
+        if(::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            files.push_back(std::make_pair(st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec, path));
+        }
+    }
+    closedir(d);
+    if(files.size() <= m_maxFiles) {
+        return;
+    }
+    // oldest first
+    std::sort(files.begin(), files.end());
+    for(size_t i = 0; i < files.size() - m_maxFiles; ++i) {
+        ::unlink(files[i].second.c_str());
+    }
+}
+
+std::string FileLogAppender::toYamlString() {
+    YAML::Node node;
+    node["type"] = "FileLogAppender";
+    node["file"] = m_filename;
+    node["level"] = LogLevel::ToString(m_level);
+    if(m_hasFormatter && m_formatter) { // filter out logger's formatter
+        node["formatter"] = m_formatter->getPattern();
+    }
+    if(m_rotate != Rotate::NONE) {
+        node["rotate"] = RotateToString(m_rotate);
+        if(m_rotate == Rotate::SIZE) {
+            node["max_size"] = m_maxSize;
+        }
+        node["max_files"] = m_maxFiles;
+        node["rotate_pattern"] = m_pattern;
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+static sylar::ConfigVar<uint32_t>::ptr g_log_async_buffer_size =
+    sylar::Config::Lookup("log.async.buffer_size", (uint32_t)(1024 * 1024)
+            , "bytes per AsyncLogAppender buffer");
+static sylar::ConfigVar<uint32_t>::ptr g_log_async_max_buffers =
+    sylar::Config::Lookup("log.async.max_buffers", (uint32_t)16
+            , "full AsyncLogAppender buffers that may wait for the writer");
+static sylar::ConfigVar<uint32_t>::ptr g_log_async_flush_interval =
+    sylar::Config::Lookup("log.async.flush_interval", (uint32_t)100
+            , "longest an async log record waits to be written, in ms");
+
+AsyncLogAppender::Overflow AsyncLogAppender::OverflowFromString(const std::string& str) {
+    if(str == "drop" || str == "DROP") {
+        return Overflow::DROP;
+    }
+    return Overflow::BLOCK;
+}
+
+const char* AsyncLogAppender::OverflowToString(Overflow v) {
+    return v == Overflow::DROP ? "drop" : "block";
+}
+
+AsyncLogAppender::AsyncLogAppender(LogAppender::ptr target, Overflow overflow
+                                   ,uint32_t buffer_size, uint32_t max_buffers
+                                   ,uint32_t flush_interval)
+    :m_target(target)
+    ,m_overflow(overflow)
+    ,m_bufferSize(buffer_size ? buffer_size : g_log_async_buffer_size->getValue())
+    ,m_maxBuffers(max_buffers ? max_buffers : g_log_async_max_buffers->getValue())
+    ,m_flushInterval(flush_interval ? flush_interval : g_log_async_flush_interval->getValue()) {
+    if(m_maxBuffers == 0) {
+        m_maxBuffers = 1;
+    }
+    if(m_flushInterval == 0) {
+        m_flushInterval = 1;
+    }
+    m_current.reserve(m_bufferSize);
+    m_thread.reset(new Thread(std::bind(&AsyncLogAppender::run, this), "async_log"));
+}
+
+AsyncLogAppender::~AsyncLogAppender() {
+    {
+        std::lock_guard<std::mutex> lock(m_bufMutex);
+        m_stopping = true;
+    }
+    m_writerCond.notify_one();
+    m_thread->join();
+}
+
+void AsyncLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) {
+    if(level < m_level || level < m_target->getLevel()) {
+        return;
+    }
+    LogFormatter::ptr fmt = m_target->getFormatter();
+    if(!fmt) {
+        fmt = getFormatter();
+    }
+    FormatBuffer buf;
+    fmt->format(*buf, logger, level, event);
+    append(buf->data(), buf->size());
+    if(level >= LogLevel::level::FATAL) {
+        flush();
+    }
+}
+
+void AsyncLogAppender::write(const iovec* iov, int iovcnt) {
+    for(int i = 0; i < iovcnt; ++i) {
+        append((const char*)iov[i].iov_base, iov[i].iov_len);
+    }
+}
+
+std::string AsyncLogAppender::takeBuffer() {
+    std::string buf;
+    if(!m_free.empty()) {
+        buf.swap(m_free.back());
+        m_free.pop_back();
+    } else {
+        buf.reserve(m_bufferSize);
+    }
+    return buf;
+}
+
+void AsyncLogAppender::append(const char* data, size_t len) {
+    std::unique_lock<std::mutex> lock(m_bufMutex);
+    // a record bigger than a buffer gets an empty one to itself
+    while(!m_current.empty() && m_current.size() + len > m_bufferSize) {
+        if(m_full.size() >= m_maxBuffers) {
+            if(m_overflow == Overflow::DROP) {
+                ++m_dropped;
+                return;
+            }
+            ++m_blocked;
+            m_writerCond.notify_one();
+            m_doneCond.wait(lock);
+            continue;
+        }
+        m_full.push_back(std::move(m_current));
+        m_current = takeBuffer();
+        m_writerCond.notify_one();
+    }
+    m_current.append(data, len);
+    ++m_records;
+}
+
+void AsyncLogAppender::flush() {
+    std::unique_lock<std::mutex> lock(m_bufMutex);
+    uint64_t seq = ++m_flushSeq;
+    m_writerCond.notify_one();
+    m_doneCond.wait(lock, [this, seq](){ return m_writtenSeq >= seq;});
+}
+
+void AsyncLogAppender::run() {
+    std::vector<std::string> batch;
+    std::vector<iovec> iov;
+    uint64_t reported_drops = 0;
+    while(true) {
+        uint64_t seq;
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(m_bufMutex);
+            if(m_full.empty() && !m_stopping && m_flushSeq == m_writtenSeq) {
+                m_writerCond.wait_for(lock, std::chrono::milliseconds(m_flushInterval));
+            }
+            batch.swap(m_full);
+            if(!m_current.empty()) {
+                batch.push_back(std::move(m_current));
+                m_current = takeBuffer();
+            }
+            seq = m_flushSeq;
+            stopping = m_stopping;
+        }
+        // producers waiting for room can go on
+        m_doneCond.notify_all();
+
+        uint64_t dropped = m_dropped;
+        if(dropped != reported_drops) {
+            batch.push_back("AsyncLogAppender dropped " + std::to_string(dropped - reported_drops)
+                    + " log records, writer fell behind\n");
+            reported_drops = dropped;
+        }
+        if(!batch.empty()) {
+            iov.resize(batch.size());
+            for(size_t i = 0; i < batch.size(); ++i) {
+                iov[i].iov_base = &batch[i][0];
+                iov[i].iov_len = batch[i].size();
+            }
+            for(size_t i = 0; i < iov.size(); i += IOV_MAX) {
+                m_target->write(&iov[i], std::min((size_t)IOV_MAX, iov.size() - i));
+                ++m_batches;
+            }
+            m_target->flush();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_bufMutex);
+            for(auto& i : batch) {
+                if(m_free.size() < m_maxBuffers && i.capacity() >= m_bufferSize) {
+                    i.clear();
+                    m_free.push_back(std::move(i));
+                }
+            }
+            m_writtenSeq = seq;
+            if(stopping && m_full.empty() && m_current.empty()) {
+                break;
+            }
+        }
+        batch.clear();
+        m_doneCond.notify_all();
+    }
+    m_doneCond.notify_all();
+}
+
+std::string AsyncLogAppender::toYamlString() {
+    YAML::Node node = YAML::Load(m_target->toYamlString());
+    node["async"] = true;
+    node["overflow"] = OverflowToString(m_overflow);
+    node["level"] = LogLevel::ToString(m_level);
+    if(m_hasFormatter && m_formatter) {
+        node["formatter"] = m_formatter->getPattern();
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
 }
 
 LogFormatter::LogFormatter(const std::string& pattern)
@@ -385,11 +1675,15 @@ LogFormatter::LogFormatter(const std::string& pattern)
 }
 
 std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::level level, LogEvent::ptr event) {
-    std::stringstream ss;
+    LogStream ss;
+    format(ss, logger, level, event);
+    return ss.str();
+}
+
+void LogFormatter::format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::level level, const LogEvent::ptr& event) {
     for(auto& i : m_items) {
-        i->format(ss, logger, level, event);
+        i->format(os, logger, level, event);
     }
-    return ss.str();
 }
 
 
@@ -401,6 +1695,14 @@ std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::level
 //     → m_items (executable FormatItems)  
 //     → formatted output
 void LogFormatter::init() {
+    // whole-record formats by name, as in "formatter: json"
+    if(m_pattern == "json" || m_pattern == "logfmt") {
+        m_items.emplace_back(m_pattern == "json" ? FormatItem::ptr(new JsonFormatItem)
+                                                 : FormatItem::ptr(new LogfmtFormatItem));
+        m_items.emplace_back(FormatItem::ptr(new NewLineFormatItem));
+        return;
+    }
+
     // str, format, type
     std::vector<std::tuple<std::string, std::string, int>> tokens;
     std::string literal_buf; // Buffer for literal characters between format specifiers
@@ -546,7 +1848,9 @@ void LogFormatter::init() {
         FORMAT_ITEM(l, LineFormatItem),       // %l: Line number
         FORMAT_ITEM(T, TabFormatItem),        // %T  Tab character  
         FORMAT_ITEM(F, FiberFormatItem),       // %F  Fiber ID
-        FORMAT_ITEM(N, ThreadNameFormatItem)       // %F  Fiber ID
+        FORMAT_ITEM(N, ThreadNameFormatItem),      // %N  Thread name
+        FORMAT_ITEM(J, JsonFormatItem),       // %J  Whole record as JSON
+        FORMAT_ITEM(K, LogfmtFormatItem)      // %K  Whole record as logfmt
 
 
         // Clean up the macro to avoid pollution
@@ -562,6 +1866,8 @@ void LogFormatter::init() {
     //   %d → Timestamp (formatted date/time)
     //   %f → File name (source file where the log was emitted)
     //   %l → Line number (in the source file)
+    //   %J → The record as a JSON object, fields included
+    //   %K → The record as logfmt key=value pairs, fields included
 
     for(auto& i : tokens) {
         if(std::get<2>(i) == 0) {
@@ -589,17 +1895,27 @@ LoggerManager::LoggerManager() {
 }
 
 std::string Logger::ToYamlString() {
-    MutexType lock(m_mutex);
+    MutexType::Lock lock(m_mutex);
     YAML::Node node;
     node["name"] = m_name;
-    if(m_level != LogLevel::level::UNKNOWN) {
-        node["level"] = LogLevel::ToString(m_level);
+    LogLevel::level level = getLevel();
+    if(level != LogLevel::level::UNKNOWN) {
+        node["level"] = LogLevel::ToString(level);
     }
     if(m_formatter) {
         node["formatter"] = m_formatter->getPattern();
     }
+    if(m_binaryId) {
+        node["binary"] = true;
+    }
+    if(m_rateLimit) {
+        node["rate_limit"] = m_rateLimit;
+        if(m_rateBurst) {
+            node["rate_burst"] = m_rateBurst;
+        }
+    }
 
-    for(auto& i : m_appenders) {
+    for(auto& i : *getAppenders()) {
         node["appenders"].push_back(YAML::Load(i->toYamlString())); 
     }
 
@@ -609,7 +1925,7 @@ std::string Logger::ToYamlString() {
 }
 
 Logger::ptr LoggerManager::getLogger(const std::string& name) {
-    Mutextype lock(m_mutex);
+    Mutextype::Lock lock(m_mutex);
     auto it = m_loggers.find(name);
     if(it != m_loggers.end()) return it->second;
 
@@ -624,12 +1940,24 @@ struct LogAppenderDefine {
     LogLevel::level level = LogLevel::level::UNKNOWN;
     std::string formatter;
     std::string file;
+    bool async = false;
+    AsyncLogAppender::Overflow overflow = AsyncLogAppender::Overflow::BLOCK;
+    FileLogAppender::Rotate rotate = FileLogAppender::Rotate::NONE;
+    uint64_t max_size = 0;
+    uint32_t max_files = 0;
+    std::string rotate_pattern;
 
      bool operator==(const LogAppenderDefine& oth) const {
         return type == oth.type
             && level == oth.level
             && formatter == oth.formatter
-            && file == oth.file;
+            && file == oth.file
+            && async == oth.async
+            && overflow == oth.overflow
+            && rotate == oth.rotate
+            && max_size == oth.max_size
+            && max_files == oth.max_files
+            && rotate_pattern == oth.rotate_pattern;
     }
 };
 
@@ -637,12 +1965,18 @@ struct LogDefine {
     std::string name;
     LogLevel::level level = LogLevel::level::UNKNOWN;
     std::string formatter;
+    bool binary = false;
+    uint32_t rate_limit = 0;
+    uint32_t rate_burst = 0;
     std::vector<LogAppenderDefine> appenders;
 
    bool operator==(const LogDefine& oth) const {
         return name == oth.name
             && level == oth.level
             && formatter == oth.formatter
+            && binary == oth.binary
+            && rate_limit == oth.rate_limit
+            && rate_burst == oth.rate_burst
             && appenders == oth.appenders;
    }
 
@@ -684,6 +2018,18 @@ public:
                 ld.formatter = n["formatter"].as<std::string>();
             }
 
+            if(n["binary"].IsDefined()) {
+                ld.binary = n["binary"].as<bool>();
+            }
+
+            if(n["rate_limit"].IsDefined()) {
+                ld.rate_limit = n["rate_limit"].as<uint32_t>();
+            }
+
+            if(n["rate_burst"].IsDefined()) {
+                ld.rate_burst = n["rate_burst"].as<uint32_t>();
+            }
+
             // Process appenders if they exist
             if(n["appenders"].IsDefined()) {
                 for(size_t x = 0; x < n["appenders"].size(); ++x) {
@@ -705,6 +2051,18 @@ public:
                             continue;
                         }
                         lad.file = a["file"].as<std::string>();
+                        if(a["rotate"].IsDefined()) {
+                            lad.rotate = FileLogAppender::RotateFromString(a["rotate"].as<std::string>());
+                        }
+                        if(a["max_size"].IsDefined()) {
+                            lad.max_size = a["max_size"].as<uint64_t>();
+                        }
+                        if(a["max_files"].IsDefined()) {
+                            lad.max_files = a["max_files"].as<uint32_t>();
+                        }
+                        if(a["rotate_pattern"].IsDefined()) {
+                            lad.rotate_pattern = a["rotate_pattern"].as<std::string>();
+                        }
                     } else if(type == "StdoutLogAppender") {
                         lad.type = 2;  
                     }
@@ -716,6 +2074,14 @@ public:
                     if(a["formatter"].IsDefined()) {
                         lad.formatter = a["formatter"].as<std::string>();
                     }
+
+                    if(a["async"].IsDefined()) {
+                        lad.async = a["async"].as<bool>();
+                    }
+
+                    if(a["overflow"].IsDefined()) {
+                        lad.overflow = AsyncLogAppender::OverflowFromString(a["overflow"].as<std::string>());
+                    }
             
                     ld.appenders.emplace_back(lad);
                 }
@@ -746,12 +2112,29 @@ public:
             if(!i.formatter.empty()) {
                 n["formatter"] = i.formatter;
             }
+            if(i.binary) {
+                n["binary"] = true;
+            }
+            if(i.rate_limit) {
+                n["rate_limit"] = i.rate_limit;
+                if(i.rate_burst) {
+                    n["rate_burst"] = i.rate_burst;
+                }
+            }
             
             for(auto& a : i.appenders) {
                 YAML::Node na;
                 if(a.type == 1) {
                     na["type"] = "FileLogAppender";
                     na["file"] = a.file;
+                    if(a.rotate != FileLogAppender::Rotate::NONE) {
+                        na["rotate"] = FileLogAppender::RotateToString(a.rotate);
+                        na["max_size"] = a.max_size;
+                        na["max_files"] = a.max_files;
+                        if(!a.rotate_pattern.empty()) {
+                            na["rotate_pattern"] = a.rotate_pattern;
+                        }
+                    }
                 } else if(a.type == 2) {
                     na["type"] = "StdoutLogAppender";
                 }
@@ -761,6 +2144,10 @@ public:
                 if(!a.formatter.empty()) {
                     na["formatter"] = a.formatter;
                 }
+                if(a.async) {
+                    na["async"] = true;
+                    na["overflow"] = AsyncLogAppender::OverflowToString(a.overflow);
+                }
 
                 n["appenders"].push_back(na);            
             }
@@ -780,6 +2167,10 @@ sylar::ConfigVar<std::set<LogDefine>>::ptr g_log_defines =
 
 struct LogIniter {
     LogIniter() {
+        s_summary_interval = g_log_summary_interval->getValue() * 1000000ull;
+        g_log_summary_interval->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            s_summary_interval = new_value * 1000000ull;
+        });
         g_log_defines->addListener([](const std::set<LogDefine>& old_value, const std::set<LogDefine>& new_value){
             // 新增
             SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "On logger ref has been changed";
@@ -795,25 +2186,40 @@ struct LogIniter {
                         logger = SYLAR_LOG_NAME(i.name);
                     }
                 }
+                if(!logger) {
+                    continue;
+                }
                 logger->setLevel(i.level);
                 if(!(i.formatter.empty())) {
                     logger->setFormatter(i.formatter);
                 }
-                logger->clearAppenders();
+                logger->setBinary(i.binary);
+                logger->setRateLimit(i.rate_limit, i.rate_burst);
+                // built aside and swapped in, logging never sees a half
+                // configured logger
+                Logger::AppenderList appenders;
                 for(auto& a : i.appenders) {
                     sylar::LogAppender::ptr ap;
                     if(a.type == 1) {   
-                        ap.reset(new FileLogAppender(a.file));
+                        FileLogAppender::ptr fap(new FileLogAppender(a.file));
+                        if(a.rotate != FileLogAppender::Rotate::NONE) {
+                            fap->setRotate(a.rotate, a.max_size, a.max_files, a.rotate_pattern);
+                        }
+                        ap = fap;
                     } else if(a.type == 2) {
                         ap.reset(new StdoutLogAppender);   
                     }
+                    if(a.async) {
+                        ap.reset(new AsyncLogAppender(ap, a.overflow));
+                    }
                     ap->setLevel(a.level);           
                     if(!a.formatter.empty()) {
                         ap->setFormatter(a.formatter);
                     }
                     
-                    logger->addAppender(ap);
+                    appenders.push_back(ap);
                 }
+                logger->setAppenders(appenders);
             }
 
             for(auto& i : old_value) {
@@ -823,6 +2229,8 @@ struct LogIniter {
                     auto logger = SYLAR_LOG_NAME(i.name);
                     logger->setLevel((LogLevel::level)100);
                     logger->clearAppenders();
+                    logger->setBinary(false);
+                    logger->setRateLimit(0);
                 }
             } 
         });
@@ -831,6 +2239,22 @@ struct LogIniter {
 
 static LogIniter __log_init;
 
+void LoggerManager::flush() {
+    // before the appenders are flushed, they may buffer the summaries
+    LogSite::ReportPending();
+    // flushing waits for IO, not with the spinlock held
+    std::vector<Logger::ptr> loggers;
+    {
+        Mutextype::Lock lock(m_mutex);
+        for(auto& i : m_loggers) {
+            loggers.push_back(i.second);
+        }
+    }
+    for(auto& i : loggers) {
+        i->flush();
+    }
+}
+
 std::string LoggerManager::toYamlString() {
     Mutextype::Lock lock(m_mutex);
     YAML::Node node;
@@ -11,9 +11,40 @@
 #include <iostream>
 #include <stdarg.h>
 #include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
 #include "util.h"
 #include "singleton.h"
 #include "thread.h"
+#include "macro.h"
+
+/**
+ * @def SYLAR_LOG_MIN_LEVEL
+ * @brief Lowest level compiled in, as a LogLevel::level number
+ *
+ * Statements below it are constant false, the compiler drops them with
+ * their arguments. Set it with cmake -DSYLAR_LOG_MIN_LEVEL=INFO, 0 keeps
+ * everything.
+ */
+#ifndef SYLAR_LOG_MIN_LEVEL
+#define SYLAR_LOG_MIN_LEVEL 0
+#endif
+
+/// Whether statements at level are compiled in at all
+#define SYLAR_LOG_COMPILED(level) ((int)(level) >= SYLAR_LOG_MIN_LEVEL)
+
+/**
+ * @def SYLAR_LOG_EVENT(logger, level)
+ * @brief The stream of a new record, logger is a sylar::Logger*
+ */
+#define SYLAR_LOG_EVENT(logger, level) \
+    sylar::LogEventWrap(logger->shared_from_this(), level, \
+        __FILE__, __LINE__, 0, sylar::GetThreadId(), \
+        sylar::GetFiberId()).getSS()
 
 /**
  * @def SYLAR_LOG_LEVEL(logger, level)
@@ -21,13 +52,13 @@
  * 
  * Usage: SYLAR_LOG_LEVEL(logger_ptr, level) << "message";
  * 
- * Only evaluates if logger's level threshold permits
+ * Only evaluates if logger's level threshold permits. logger is a
+ * Logger::ptr or a Logger*, evaluated once.
  */
 #define SYLAR_LOG_LEVEL(logger, level) \
-    if(logger->getLevel() <= level) \
-        sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, \
-          __FILE__, __LINE__, 0, sylar::GetThreadId(), \
-            sylar::GetFiberId(), time(0), sylar::Thread::GetName()))).getSS()
+    if(!SYLAR_LOG_COMPILED(level)) {} \
+    else if(sylar::Logger* sylar_logger = sylar::LogEnabled(logger, level)) \
+        SYLAR_LOG_EVENT(sylar_logger, level)
 
 // Convenience macros for standard levels
 #define SYLAR_LOG_DEBUG(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::level::DEBUG)
@@ -36,27 +67,110 @@
 #define SYLAR_LOG_ERROR(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::level::ERROR)
 #define SYLAR_LOG_FATAL(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::level::FATAL)
 
-#define SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...) \
-	if(logger->getLevel() <= level)	\
-		sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, \
-			__FILE__, __LINE__, 0, sylar::GetThreadId(), \
-		sylar::GetFiberId(), time(0), sylar::Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
-
 /**
  * @def SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...)
  * @brief Formatted logging macro for specified level
  * 
  * Usage: SYLAR_LOG_FMT_LEVEL(logger, level, "format %s", arg)
+ *
+ * On a binary logger (Logger::setBinary) the record goes to the BinaryLog
+ * unformatted, see binary_log.h.
  */
+#define SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...) \
+    if(!SYLAR_LOG_COMPILED(level)) {} \
+    else if(sylar::Logger* sylar_logger = sylar::LogEnabled(logger, level)) \
+        sylar::LogFormat(sylar_logger, level, []{}, __FILE__, __LINE__, fmt, __VA_ARGS__)
+
 #define SYLAR_LOG_FMT_DEBUG(logger, fmt, ...)  SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::level::DEBUG, fmt, __VA_ARGS__)
 #define SYLAR_LOG_FMT_INFO(logger, fmt, ...)   SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::level::INFO, fmt, __VA_ARGS__)
 #define SYLAR_LOG_FMT_WARN(logger, fmt, ...)   SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::level::WARN, fmt, __VA_ARGS__)
 #define SYLAR_LOG_FMT_ERROR(logger, fmt, ...)  SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::level::ERROR, fmt, __VA_ARGS__)
 #define SYLAR_LOG_FMT_FATAL(logger, fmt, ...)  SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::level::FATAL, fmt, __VA_ARGS__)
 
+/**
+ * @def SYLAR_LOG_SITE()
+ * @brief The LogSite of the call site it appears at
+ *
+ * A lambda per expansion, so each site gets its own static. LogSite is
+ * constant initialized, there is no guard to check.
+ */
+#define SYLAR_LOG_SITE() \
+    ([]() -> sylar::LogSite& { static sylar::LogSite s_site; return s_site; }())
+
+/**
+ * @def SYLAR_LOG_LEVEL_EVERY_N(logger, level, n)
+ * @brief Log the 1st, (n+1)th, (2n+1)th... time this line is reached
+ *
+ * Usage: SYLAR_LOG_ERROR_EVERY_N(logger, 100) << "accept failed";
+ */
+#define SYLAR_LOG_LEVEL_EVERY_N(logger, level, n) \
+    if(!SYLAR_LOG_COMPILED(level)) {} \
+    else if(sylar::Logger* sylar_logger = SYLAR_LOG_SITE().everyN( \
+                sylar::LogEnabled(logger, level), n)) \
+        SYLAR_LOG_EVENT(sylar_logger, level)
+
+/**
+ * @def SYLAR_LOG_LEVEL_FIRST_N(logger, level, n)
+ * @brief Log the first n times this line is reached
+ *
+ * The rest are counted. A "suppressed N messages" record reports them
+ * when the line is reached again log.ratelimit.summary_interval ms or
+ * more after the last report, and on LoggerManager::flush().
+ */
+#define SYLAR_LOG_LEVEL_FIRST_N(logger, level, n) \
+    if(!SYLAR_LOG_COMPILED(level)) {} \
+    else if(sylar::Logger* sylar_logger = SYLAR_LOG_SITE().firstN( \
+                sylar::LogEnabled(logger, level), n, level, __FILE__, __LINE__)) \
+        SYLAR_LOG_EVENT(sylar_logger, level)
+
+/**
+ * @def SYLAR_LOG_LEVEL_RATELIMITED(logger, level, per_sec, burst)
+ * @brief Log this line at most per_sec times a second, burst at once
+ *
+ * Suppressed records are reported like SYLAR_LOG_LEVEL_FIRST_N's.
+ */
+#define SYLAR_LOG_LEVEL_RATELIMITED(logger, level, per_sec, burst) \
+    if(!SYLAR_LOG_COMPILED(level)) {} \
+    else if(sylar::Logger* sylar_logger = SYLAR_LOG_SITE().rateLimited( \
+                sylar::LogEnabled(logger, level), per_sec, burst, level, __FILE__, __LINE__)) \
+        SYLAR_LOG_EVENT(sylar_logger, level)
+
+#define SYLAR_LOG_DEBUG_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::level::DEBUG, n)
+#define SYLAR_LOG_INFO_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::level::INFO, n)
+#define SYLAR_LOG_WARN_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::level::WARN, n)
+#define SYLAR_LOG_ERROR_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::level::ERROR, n)
+#define SYLAR_LOG_FATAL_EVERY_N(logger, n) SYLAR_LOG_LEVEL_EVERY_N(logger, sylar::LogLevel::level::FATAL, n)
+
+#define SYLAR_LOG_DEBUG_FIRST_N(logger, n) SYLAR_LOG_LEVEL_FIRST_N(logger, sylar::LogLevel::level::DEBUG, n)
+#define SYLAR_LOG_INFO_FIRST_N(logger, n) SYLAR_LOG_LEVEL_FIRST_N(logger, sylar::LogLevel::level::INFO, n)
+#define SYLAR_LOG_WARN_FIRST_N(logger, n) SYLAR_LOG_LEVEL_FIRST_N(logger, sylar::LogLevel::level::WARN, n)
+#define SYLAR_LOG_ERROR_FIRST_N(logger, n) SYLAR_LOG_LEVEL_FIRST_N(logger, sylar::LogLevel::level::ERROR, n)
+#define SYLAR_LOG_FATAL_FIRST_N(logger, n) SYLAR_LOG_LEVEL_FIRST_N(logger, sylar::LogLevel::level::FATAL, n)
+
+// a second's worth of burst
+#define SYLAR_LOG_DEBUG_RATELIMITED(logger, per_sec) SYLAR_LOG_LEVEL_RATELIMITED(logger, sylar::LogLevel::level::DEBUG, per_sec, per_sec)
+#define SYLAR_LOG_INFO_RATELIMITED(logger, per_sec) SYLAR_LOG_LEVEL_RATELIMITED(logger, sylar::LogLevel::level::INFO, per_sec, per_sec)
+#define SYLAR_LOG_WARN_RATELIMITED(logger, per_sec) SYLAR_LOG_LEVEL_RATELIMITED(logger, sylar::LogLevel::level::WARN, per_sec, per_sec)
+#define SYLAR_LOG_ERROR_RATELIMITED(logger, per_sec) SYLAR_LOG_LEVEL_RATELIMITED(logger, sylar::LogLevel::level::ERROR, per_sec, per_sec)
+#define SYLAR_LOG_FATAL_RATELIMITED(logger, per_sec) SYLAR_LOG_LEVEL_RATELIMITED(logger, sylar::LogLevel::level::FATAL, per_sec, per_sec)
+
 // Root logger access  
 #define SYLAR_LOG_ROOT() sylar::LoggerMgr::GetInstance()->getRoot()
-#define SYLAR_LOG_NAME(name) sylar::LoggerMgr::GetInstance()->getLogger(name);
+#define SYLAR_LOG_NAME(name) sylar::LoggerMgr::GetInstance()->getLogger(name)
+
+/**
+ * @def SYLAR_LOG_CACHED(name)
+ * @brief The logger called name as a Logger*, looked up the first time
+ *        the line runs
+ *
+ * For logging to a named logger from a hot path without a static of
+ * one's own: SYLAR_LOG_INFO(SYLAR_LOG_CACHED("system")) << ...; name must
+ * be the same every time. Loggers live as long as the LoggerManager.
+ */
+#define SYLAR_LOG_CACHED(name) \
+    ([&]() -> sylar::Logger* { \
+        static sylar::Logger* s_logger = SYLAR_LOG_NAME(name).get(); \
+        return s_logger; }())
 
 namespace sylar {
 
@@ -83,6 +197,221 @@ public:
     static LogLevel::level FromString(const std::string str);
 };
 
+/**
+ * @class LogStream
+ * @brief std::ostream over a reusable in-memory buffer
+ *
+ * Messages and formatted records are built in one of these. The buffer
+ * grows when a record needs more room and keeps its capacity across
+ * reset(), so a stream that is reused (the pooled LogEvents, each
+ * thread's format buffer) stops allocating once it has seen its longest
+ * record. Strings, characters and integers are copied in directly;
+ * anything else goes through the usual std::ostream operators, which
+ * write into the same buffer.
+ */
+class LogStream : public std::ostream {
+public:
+    explicit LogStream(size_t capacity = 256);
+
+    LogStream(const LogStream&) = delete;
+    LogStream& operator=(const LogStream&) = delete;
+
+    const char* data() const { return m_buf.data(); }
+    size_t size() const { return m_buf.size(); }
+    bool empty() const { return m_buf.size() == 0; }
+    std::string str() const { return std::string(data(), size()); }
+
+    /**
+     * @brief Empty the buffer and restore the default formatting flags
+     */
+    void reset();
+
+    void append(const char* data, size_t len) { m_buf.append(data, len); }
+
+    /**
+     * @brief printf into the buffer
+     */
+    void format(const char* fmt, va_list al);
+
+    using std::ostream::operator<<;
+    LogStream& operator<<(const char* v);
+    LogStream& operator<<(const std::string& v);
+    LogStream& operator<<(char v);
+    LogStream& operator<<(signed char v) { return *this << (char)v; }
+    LogStream& operator<<(unsigned char v) { return *this << (char)v; }
+    LogStream& operator<<(short v);
+    LogStream& operator<<(unsigned short v);
+    LogStream& operator<<(int v);
+    LogStream& operator<<(unsigned int v);
+    LogStream& operator<<(long v);
+    LogStream& operator<<(unsigned long v);
+    LogStream& operator<<(long long v);
+    LogStream& operator<<(unsigned long long v);
+private:
+    /**
+     * @brief Growable put area
+     */
+    class Buffer : public std::streambuf {
+    public:
+        explicit Buffer(size_t capacity);
+
+        const char* data() const { return pbase(); }
+        size_t size() const { return pptr() - pbase(); }
+        void reset() { setp(pbase(), epptr()); }
+
+        void append(const char* data, size_t len) {
+            memcpy(reserve(len), data, len);
+            commit(len);
+        }
+
+        /**
+         * @brief Room for len more bytes, written with commit()
+         */
+        char* reserve(size_t len) {
+            if((size_t)(epptr() - pptr()) < len) {
+                grow(len);
+            }
+            return pptr();
+        }
+        void commit(size_t len) { pbump((int)len); }
+        size_t avail() const { return epptr() - pptr(); }
+    protected:
+        int_type overflow(int_type c) override;
+        std::streamsize xsputn(const char* s, std::streamsize n) override;
+    private:
+        void grow(size_t len);
+    private:
+        std::vector<char> m_data;
+    };
+
+    /**
+     * @brief Whether integers may take the direct path: decimal, no width
+     */
+    bool plain() const {
+        return width() == 0 && (flags() & (std::ios_base::basefield
+                    | std::ios_base::showpos)) == std::ios_base::dec;
+    }
+
+    template<class T>
+    LogStream& appendInteger(T v);
+private:
+    Buffer m_buf;
+};
+
+/**
+ * @class LogFields
+ * @brief Typed key-value pairs attached to a LogEvent
+ *
+ * Values are kept as they were given and only turned into text by the
+ * formatter that writes them out (%J json, %K logfmt, or after the
+ * message for %m). Keys and string values are copied into one buffer
+ * which, like the message's, keeps its capacity when the event is reused.
+ */
+class LogFields {
+public:
+    enum Type {
+        INT,
+        UINT,
+        DOUBLE,
+        BOOL,
+        STRING,
+        POINTER
+    };
+
+    /// offset and length of a string in data()
+    struct Range {
+        uint32_t off;
+        uint32_t len;
+    };
+
+    struct Field {
+        Range key;
+        Type type;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+            bool b;
+            Range s;
+        };
+    };
+
+    void add(const char* key, bool v) { push(key, BOOL).b = v; }
+    void add(const char* key, char v) { add(key, &v, 1); }
+    void add(const char* key, signed char v) { push(key, INT).i = v; }
+    void add(const char* key, unsigned char v) { push(key, UINT).u = v; }
+    void add(const char* key, short v) { push(key, INT).i = v; }
+    void add(const char* key, unsigned short v) { push(key, UINT).u = v; }
+    void add(const char* key, int v) { push(key, INT).i = v; }
+    void add(const char* key, unsigned int v) { push(key, UINT).u = v; }
+    void add(const char* key, long v) { push(key, INT).i = v; }
+    void add(const char* key, unsigned long v) { push(key, UINT).u = v; }
+    void add(const char* key, long long v) { push(key, INT).i = v; }
+    void add(const char* key, unsigned long long v) { push(key, UINT).u = v; }
+    void add(const char* key, float v) { push(key, DOUBLE).d = v; }
+    void add(const char* key, double v) { push(key, DOUBLE).d = v; }
+    void add(const char* key, const void* v) { push(key, POINTER).u = (uintptr_t)v; }
+    void add(const char* key, const char* v) {
+        if(!v) {
+            v = "(null)";
+        }
+        add(key, v, strlen(v));
+    }
+    void add(const char* key, const std::string& v) { add(key, v.data(), v.size()); }
+    void add(const char* key, const char* v, size_t len) {
+        Field& f = push(key, STRING);
+        f.s.off = m_data.size();
+        f.s.len = len;
+        m_data.append(v, len);
+    }
+
+    void clear() {
+        m_fields.clear();
+        m_data.clear();
+    }
+    bool empty() const { return m_fields.empty(); }
+    size_t size() const { return m_fields.size(); }
+    const Field& operator[](size_t i) const { return m_fields[i]; }
+    const char* data() const { return m_data.data(); }
+private:
+    Field& push(const char* key, Type type) {
+        if(!key) {
+            key = "";
+        }
+        Field f;
+        f.key.off = m_data.size();
+        f.key.len = strlen(key);
+        f.type = type;
+        m_data.append(key, f.key.len);
+        m_fields.push_back(f);
+        return m_fields.back();
+    }
+private:
+    std::vector<Field> m_fields;
+    std::string m_data;
+};
+
+/**
+ * @class LogEventStream
+ * @brief The message stream of a LogEvent, which also takes fields
+ *
+ * Usage: SYLAR_LOG_INFO(logger).kv("fd", fd).kv("peer", name) << "accepted";
+ */
+class LogEventStream : public LogStream {
+public:
+    explicit LogEventStream(LogFields& fields)
+        :m_fields(fields) {
+    }
+
+    template<class T>
+    LogEventStream& kv(const char* key, const T& v) {
+        m_fields.add(key, v);
+        return *this;
+    }
+private:
+    LogFields& m_fields;
+};
+
 /**
  * @class LogEvent
  * @brief Contains all data for a single log event
@@ -120,19 +449,30 @@ public:
 		  m_level(level),
           m_threadName(thread_name) {}
 
+    /**
+     * @brief Start over as a new event, keeping the buffers
+     * @param usec Microseconds within the second time is in
+     */
+    void reset(std::shared_ptr<Logger> logger, LogLevel::level level, const char* file, int32_t line, uint32_t elapse,
+            uint32_t thread_id, uint32_t fiber_id, uint64_t time, const std::string& thread_name,
+            uint32_t usec = 0);
+
     const char* getFile() const { return m_file ? m_file : ""; }
     int32_t getLine() const { return m_line; }
     uint32_t getElapse() const { return m_elapse; }
     uint32_t getThreadId() const { return m_threadId; }
     uint32_t getFiberId() const { return m_fiberId; }
     uint64_t getTime() const { return m_time; }
+    /// microseconds within getTime()'s second
+    uint32_t getUsec() const { return m_usec; }
     const std::string& getThreadName() const { return m_threadName; }
 
     std::string getContent() const { return m_ss.str(); }
-	std::shared_ptr<Logger> getLogger() const { return m_Logger; }
+	const std::shared_ptr<Logger>& getLogger() const { return m_Logger; }
 	LogLevel::level getLevel() const { return m_level; }
 
-    std::stringstream& getSS() { return m_ss; }
+    LogEventStream& getSS() { return m_ss; }
+    const LogFields& getFields() const { return m_fields; }
 	void format(const char* fmt, ...);
 	void format(const char* fmt, va_list al);
 
@@ -143,7 +483,9 @@ private:
     uint32_t m_threadId = 0;     // thread id
     uint32_t m_fiberId = 0;      // fiber id
     uint64_t m_time = 0;         // time stamp    
-    std::stringstream m_ss;   
+    uint32_t m_usec = 0;         // sub-second part of the time stamp
+    LogFields m_fields;          // key-value pairs, ahead of m_ss which refers to them
+    LogEventStream m_ss{m_fields};
 	std::shared_ptr<Logger> m_Logger;  
 	LogLevel::level m_level;
     std::string m_threadName;
@@ -158,13 +500,167 @@ private:
 class LogEventWrap {
 public:
     LogEventWrap(LogEvent::ptr e);
+
+    /**
+     * @brief Wrap an event from this thread's pool, as the macros do
+     *
+     * Once the pool is warm this allocates nothing. The event goes back
+     * to the pool when the wrap is destroyed, unless an appender kept the
+     * LogEvent::ptr it was handed: then it stays the appender's. The time
+     * stamp, to the microsecond, is taken here.
+     */
+    LogEventWrap(std::shared_ptr<Logger> logger, LogLevel::level level, const char* file, int32_t line,
+            uint32_t elapse, uint32_t thread_id, uint32_t fiber_id);
     ~LogEventWrap();
+
+    LogEventWrap(const LogEventWrap&) = delete;
+    LogEventWrap& operator=(const LogEventWrap&) = delete;
     
-    std::stringstream& getSS();
+    LogEventStream& getSS();
     LogEvent::ptr getEvent() const;
     
 private:
     LogEvent::ptr m_event;
+    /// m_event goes back to the pool when it is done
+    bool m_pooled = false;
+};
+
+/**
+ * @class LogRateLimiter
+ * @brief Lock-free token bucket plus a count of what it turned away
+ *
+ * The bucket is kept as one time stamp (GCRA): the time at which it
+ * would be full again. A record is let through if that is no more than
+ * tolerance ns ahead of now, and pushes it interval ns further.
+ * interval = 1s / rate, tolerance = (burst - 1) * interval.
+ */
+class LogRateLimiter {
+public:
+    bool allow(uint64_t now, uint64_t interval, uint64_t tolerance) {
+        uint64_t tat = m_tat.load(std::memory_order_relaxed);
+        while(true) {
+            uint64_t t = tat > now ? tat : now;
+            if(t - now > tolerance) {
+                return false;
+            }
+            if(m_tat.compare_exchange_weak(tat, t + interval, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    /**
+     * @brief Count a record turned away at now
+     * @return true if it is the first since the count was last taken
+     */
+    bool suppress(uint64_t now);
+    bool hasSuppressed() const { return m_suppressed.load(std::memory_order_relaxed) != 0; }
+
+    /**
+     * @brief Suppressed records to report now
+     * @return 0 if none, or if the last report is less than
+     *         log.ratelimit.summary_interval ago
+     */
+    uint64_t takeSuppressed(uint64_t now);
+
+    /**
+     * @brief Suppressed records to report now, however recent the last report
+     */
+    uint64_t drain(uint64_t now);
+
+    /**
+     * @brief Coarse monotonic ns, all the bucket needs
+     */
+    static uint64_t Now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+private:
+    std::atomic<uint64_t> m_tat{0};
+    std::atomic<uint64_t> m_suppressed{0};
+    std::atomic<uint64_t> m_lastReport{0};
+};
+
+/**
+ * @class LogSite
+ * @brief State of one rate limited or sampled log statement
+ *
+ * Lives in a static at the call site (SYLAR_LOG_SITE()), shared by
+ * every thread that gets there, atomics only.
+ */
+class LogSite {
+public:
+    /**
+     * @return logger on the 1st, (n+1)th... call with a logger
+     */
+    Logger* everyN(Logger* logger, uint64_t n) {
+        if(!logger) {
+            return nullptr;
+        }
+        uint64_t c = m_calls.fetch_add(1, std::memory_order_relaxed);
+        return n <= 1 || c % n == 0 ? logger : nullptr;
+    }
+
+    Logger* firstN(Logger* logger, uint64_t n, LogLevel::level level
+                   ,const char* file, int32_t line) {
+        if(!logger) {
+            return nullptr;
+        }
+        // stop counting once past n, the counter line goes quiet
+        if(m_calls.load(std::memory_order_relaxed) < n
+                && m_calls.fetch_add(1, std::memory_order_relaxed) < n) {
+            return logger;
+        }
+        suppress(logger, level, file, line);
+        return nullptr;
+    }
+
+    Logger* rateLimited(Logger* logger, uint32_t per_sec, uint32_t burst
+                        ,LogLevel::level level, const char* file, int32_t line) {
+        if(!logger) {
+            return nullptr;
+        }
+        uint64_t interval = per_sec ? 1000000000ull / per_sec : 0;
+        uint64_t tolerance = burst > 1 ? (burst - 1) * interval : 0;
+        if(m_limiter.allow(LogRateLimiter::Now(), interval, tolerance)) {
+            if(m_limiter.hasSuppressed()) {
+                report(logger, level, file, line);
+            }
+            return logger;
+        }
+        suppress(logger, level, file, line);
+        return nullptr;
+    }
+
+    /**
+     * @brief Log the summary of every site with suppressed records
+     *
+     * Without it the count of the last run of a storm would wait for the
+     * line to be reached again. Called by LoggerManager::flush().
+     */
+    static void ReportPending();
+private:
+    void suppress(Logger* logger, LogLevel::level level, const char* file, int32_t line);
+    /// log the "suppressed N messages" record if one is due
+    void report(Logger* logger, LogLevel::level level, const char* file, int32_t line);
+    /// m_pendingLogger, as the weak_ptr it holds
+    std::weak_ptr<Logger>& pendingLogger() {
+        return *reinterpret_cast<std::weak_ptr<Logger>*>(m_pendingLogger);
+    }
+private:
+    std::atomic<uint64_t> m_calls{0};
+    LogRateLimiter m_limiter;
+    /// on ReportPending()'s list; the fields below belong to whoever set it
+    std::atomic<bool> m_pending{false};
+    LogSite* m_nextPending = nullptr;
+    LogLevel::level m_pendingLevel = LogLevel::level::UNKNOWN;
+    const char* m_pendingFile = nullptr;
+    int32_t m_pendingLine = 0;
+    /// a std::weak_ptr<Logger> built in place on first use, so that the
+    /// site stays trivially destructible and its static needs no guard
+    alignas(std::weak_ptr<Logger>) char m_pendingLogger[sizeof(std::weak_ptr<Logger>)] = {};
+    bool m_hasPendingLogger = false;
 };
 
 
@@ -186,17 +682,24 @@ public:
      * @param pattern Format pattern string (e.g. "%d [%p] %m%n")
      *
      * Pattern syntax:
-     *   %m - Message content
+     *   %m - Message content, then the fields as " key=value"
      *   %p - Log level (DEBUG/INFO/etc)
      *   %r - Elapsed time since program start
      *   %c - Logger name
      *   %t - Thread ID
      *   %n - Newline
-     *   %d - Date/time (with optional format: %d{format})
+     *   %d - Date/time (with optional format: %d{format}). Besides the
+     *        strftime conversions the format takes %3N, %6N and %N for
+     *        milli-, micro- and nanoseconds (the latter to the microsecond)
      *   %f - Filename
      *   %l - Line number
      *   %F - Fiber ID
+     *   %J - The record as one JSON object, fields included; %J{format}
+     *        formats its time as %d{format} would
+     *   %K - The same as logfmt key=value pairs
      *   %% - Percent sign
+     *
+     * The patterns "json" and "logfmt" stand for "%J%n" and "%K%n".
      */
     explicit LogFormatter(const std::string& pattern);
 
@@ -211,6 +714,12 @@ public:
                       LogLevel::level level, 
                       LogEvent::ptr event);
 
+    /**
+     * @brief Format a log event onto the end of os, without allocating
+     */
+    void format(LogStream& os, const std::shared_ptr<Logger>& logger,
+                LogLevel::level level, const LogEvent::ptr& event);
+
     /**
      * @class FormatItem
      * @brief Abstract base class for pattern format items
@@ -237,10 +746,10 @@ public:
          * @param level Log severity level
          * @param event Log event data
          */
-        virtual void format(std::ostream& os,
-                           std::shared_ptr<Logger> logger,
+        virtual void format(LogStream& os,
+                           const std::shared_ptr<Logger>& logger,
                            LogLevel::level level,
-                           LogEvent::ptr event) = 0;
+                           const LogEvent::ptr& event) = 0;
     };
 
     /**
@@ -273,7 +782,8 @@ class LogAppender {
 public:
     /// Shared pointer type for safe memory management
     typedef std::shared_ptr<LogAppender> ptr;
-    typedef Spinlock MutexType;
+    /// appenders write out while holding it
+    typedef AdaptiveMutex MutexType;
 
     /// Virtual destructor for polymorphic deletion
     virtual ~LogAppender() = default;
@@ -326,6 +836,21 @@ public:
                     LogLevel::level level, 
                     LogEvent::ptr event) = 0;
 
+    /**
+     * @brief Write records that are formatted already
+     * @param iov Buffers holding whole records, written in order
+     * @param iovcnt Number of buffers
+     *
+     * The raw output path AsyncLogAppender batches into: one call can
+     * carry thousands of records.
+     */
+    virtual void write(const iovec* iov, int iovcnt) = 0;
+
+    /**
+     * @brief Push out anything buffered
+     */
+    virtual void flush() {}
+
     virtual std::string toYamlString() = 0;
 
 protected:
@@ -358,13 +883,38 @@ public:
     void error(LogEvent::ptr event);
     void fatal(LogEvent::ptr event);
 
+    /// Immutable appender list, replaced as a whole on every change
+    typedef std::vector<LogAppender::ptr> AppenderList;
+
     // Appender management
     void addAppender(LogAppender::ptr appender);
     void delAppender(LogAppender::ptr appender);
-    void clearAppenders() { m_appenders.clear(); }
+    void clearAppenders();
+    /**
+     * @brief Replace all appenders at once
+     *
+     * Records logged meanwhile go to either the old or the new list,
+     * never to neither.
+     */
+    void setAppenders(const AppenderList& appenders);
+    /// The current list; it doesn't change after it's returned
+    std::shared_ptr<const AppenderList> getAppenders() const;
+
+    /**
+     * @brief Let at most per_sec records a second through, burst at once
+     *
+     * 0 turns the limit off, burst 0 means per_sec. Records over the
+     * limit are counted. A "suppressed N messages" record reports them
+     * with the first record log.ratelimit.summary_interval ms or more
+     * after the last report, and on flush().
+     */
+    void setRateLimit(uint32_t per_sec, uint32_t burst = 0);
+    uint32_t getRateLimit() const { return m_rateLimit; }
+    uint32_t getRateBurst() const { return m_rateBurst; }
     // Level configuration
-    LogLevel::level getLevel() const { return m_level; }
-    void setLevel(LogLevel::level val) { m_level = val; }
+    /// Read by every SYLAR_LOG_* statement, a plain load
+    LogLevel::level getLevel() const { return m_level.load(std::memory_order_relaxed); }
+    void setLevel(LogLevel::level val) { m_level.store(val, std::memory_order_relaxed); }
 
     const std::string& getName() { return m_name; }
 
@@ -373,15 +923,44 @@ public:
 
     LogFormatter::ptr getFormatter();
 
+    /**
+     * @brief Report records the rate limit held back, flush all appenders
+     */
+    void flush();
+
+    /**
+     * @brief Send SYLAR_LOG_FMT_* records to the BinaryLog instead of the appenders
+     *
+     * The records are formatted by the decoder, with the formatter the
+     * logger has now. Stream records (SYLAR_LOG_INFO() << ...) still go
+     * to the appenders, and so does everything while no BinaryLog is open.
+     */
+    void setBinary(bool v);
+    /// BinaryLog id, 0 when not binary
+    uint32_t getBinaryId() const { return m_binaryId; }
+
     std::string ToYamlString();
+private:
+    /// Give an appender without a formatter of its own ours, m_mutex held
+    void inheritFormatter(LogAppender::ptr appender);
+    /// Hand event to the appenders, or the root logger without any
+    void write(LogLevel::level level, LogEvent::ptr event);
+    /// Write the "suppressed N messages" record of the rate limit
+    void writeSuppressed(uint64_t n, const char* file, int32_t line);
 private:
     friend class LoggerManager;
     std::string m_name;                 // Hierarchical name (e.g. "system.network")
-    LogLevel::level m_level = LogLevel::level::DEBUG;
-    MutexType m_mutex;
-    std::list<LogAppender::ptr> m_appenders;
+    std::atomic<LogLevel::level> m_level;
+    MutexType m_mutex;                  // Serializes changes, log() doesn't take it
+    std::shared_ptr<const AppenderList> m_appenders;    // Read with std::atomic_load
     LogFormatter::ptr m_formatter;      // Default format for appenders without their own
     Logger::ptr m_root;                 // Fallback logger when no appenders are configured
+    uint32_t m_binaryId = 0;            // BinaryLog id, 0 when logging as text
+    uint32_t m_rateLimit = 0;           // Records per second, 0 for no limit
+    uint32_t m_rateBurst = 0;
+    std::atomic<uint64_t> m_rateInterval{0};    // ns per record, 0 for no limit
+    std::atomic<uint64_t> m_rateTolerance{0};
+    LogRateLimiter m_rateLimiter;
 };
 
 /**
@@ -408,38 +987,233 @@ public:
     virtual void log(std::shared_ptr<Logger> logger, 
                    LogLevel::level level,
                    LogEvent::ptr event) override;
+    void write(const iovec* iov, int iovcnt) override;
     std::string toYamlString() override;
 };
 
 /**
  * Thread-safe file logging with rotation support.
- * Automatically flushes writes to disk.
+ *
+ * Records go through a userland buffer to an O_APPEND fd. The buffer is
+ * written out when it reaches log.file.buffer_size, for ERROR and above,
+ * when a second has passed since the last write, and on flush().
+ *
+ * Rotation, if set, happens by size or at hour/day boundaries. The
+ * current file is renamed to filename + strftime(pattern), and a new one
+ * is started. Only the newest max_files rotated files are kept.
+ * At most every log.file.check_interval seconds, the appender checks
+ * whether the path still names the open file. If logrotate moved the
+ * file away, the path is reopened.
  */
 class FileLogAppender : public LogAppender {
 public:
     using ptr = std::shared_ptr<FileLogAppender>;
+
+    enum class Rotate {
+        NONE,
+        SIZE,   ///< when the file would grow past max_size
+        HOURLY,
+        DAILY
+    };
+
+    static Rotate RotateFromString(const std::string& str);
+    static const char* RotateToString(Rotate v);
     
     /**
-     * Opens specified log file for writing.
-     * @throws std::ios_base::failure if file cannot be opened
+     * Opens specified log file for appending.
+     * @throws std::runtime_error if file cannot be opened
      */
     explicit FileLogAppender(const std::string& filename);
+
+    /**
+     * Writes out the buffer and closes the file.
+     */
+    ~FileLogAppender();
     
     virtual void log(std::shared_ptr<Logger> logger,
             LogLevel::level level,
             LogEvent::ptr event) override;
 
     /**
-     * Reopens log file, typically after rotation.
+     * Reopens log file, typically after external rotation.
      * @return false if file couldn't be reopened
      */
     bool reopen();
+    void write(const iovec* iov, int iovcnt) override;
+    void flush() override;
     std::string toYamlString() override;
 
+    /**
+     * Sets up rotation.
+     * @param mode When to rotate
+     * @param max_size File size limit for Rotate::SIZE, in bytes
+     * @param max_files Rotated files to keep, 0 keeps all
+     * @param pattern strftime suffix of rotated files. Empty picks one
+     *        that fits the mode, e.g. ".%Y%m%d" for DAILY
+     */
+    void setRotate(Rotate mode, uint64_t max_size = 0, uint32_t max_files = 0
+                   ,const std::string& pattern = "");
+
+    const std::string& getFilename() const { return m_filename; }
+    Rotate getRotate() const { return m_rotate; }
+    uint64_t getMaxSize() const { return m_maxSize; }
+    uint32_t getMaxFiles() const { return m_maxFiles; }
+    const std::string& getRotatePattern() const { return m_pattern; }
+
+    /**
+     * Rotate now, regardless of the mode.
+     */
+    bool rotate();
+
+private:
+    /**
+     * @pre m_mutex held
+     */
+    bool openFile();
+    void flushBuffer();
+    bool doRotate(time_t now);
+    void removeOldFiles();
+    /**
+     * Reopen if the path no longer names the open file.
+     */
+    void checkFile();
+    /**
+     * Start of the rotation period t is in, and of the one after it.
+     */
+    time_t periodStart(time_t t) const;
+    time_t nextRotateTime(time_t t) const;
+    /**
+     * Rotate or reopen as due, before len more bytes are written.
+     */
+    void prepareWrite(size_t len, time_t now);
+
 private:
     std::string m_filename;
-    std::ofstream m_filestream;
-    uint64_t m_lastTime = 0;
+    int m_fd = -1;
+    /// records not yet written to m_fd
+    std::string m_buffer;
+    /// bytes in the file, buffer included
+    uint64_t m_size = 0;
+    time_t m_lastWrite = 0;
+    time_t m_lastCheck = 0;
+
+    Rotate m_rotate = Rotate::NONE;
+    uint64_t m_maxSize = 0;
+    uint32_t m_maxFiles = 0;
+    std::string m_pattern;
+    /// the current period started at m_periodStart, ends at m_nextRotate
+    time_t m_periodStart = 0;
+    time_t m_nextRotate = 0;
+};
+
+/**
+ * @class AsyncLogAppender
+ * @brief Formats in the logging thread, writes from a background thread
+ *
+ * Callers format a record and append it to the current buffer, which is
+ * all the locking they do. Full buffers are queued for a single writer
+ * thread. The writer hands everything queued to the wrapped appender's
+ * write() as one batch, at least every flush_interval ms. When max_buffers
+ * are queued the overflow policy applies: BLOCK waits for the writer, DROP
+ * discards the record and counts it. A FATAL record is on disk before
+ * log() returns.
+ *
+ * The wrapped appender's formatter and level are used if it has them,
+ * this appender's otherwise.
+ */
+class AsyncLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<AsyncLogAppender> ptr;
+
+    enum class Overflow {
+        BLOCK,  ///< Wait for the writer to catch up
+        DROP    ///< Discard the record, see getDropped()
+    };
+
+    static Overflow OverflowFromString(const std::string& str);
+    static const char* OverflowToString(Overflow v);
+
+    /**
+     * @param target Appender that does the actual output
+     * @param overflow What to do when the writer falls behind
+     * @param buffer_size Bytes per buffer, 0 for log.async.buffer_size
+     * @param max_buffers Full buffers that may wait for the writer, 0 for
+     *        log.async.max_buffers
+     * @param flush_interval Longest time a record waits to be written in
+     *        ms, 0 for log.async.flush_interval
+     */
+    AsyncLogAppender(LogAppender::ptr target, Overflow overflow = Overflow::BLOCK
+                     ,uint32_t buffer_size = 0, uint32_t max_buffers = 0
+                     ,uint32_t flush_interval = 0);
+
+    /**
+     * @brief Writes out what is buffered, then stops the writer
+     */
+    ~AsyncLogAppender();
+
+    void log(std::shared_ptr<Logger> logger,
+            LogLevel::level level,
+            LogEvent::ptr event) override;
+
+    /**
+     * @brief Queue already formatted records
+     */
+    void write(const iovec* iov, int iovcnt) override;
+
+    /**
+     * @brief Wait until everything logged so far has been written
+     */
+    void flush() override;
+
+    std::string toYamlString() override;
+
+    LogAppender::ptr getTarget() const { return m_target; }
+    Overflow getOverflow() const { return m_overflow; }
+
+    /// Records taken, dropped, and times a caller had to wait for the writer
+    uint64_t getRecords() const { return m_records; }
+    uint64_t getDropped() const { return m_dropped; }
+    uint64_t getBlocked() const { return m_blocked; }
+    /// write() calls made on the target
+    uint64_t getBatches() const { return m_batches; }
+private:
+    /**
+     * @brief Append one record
+     */
+    void append(const char* data, size_t len);
+
+    /**
+     * @brief An empty buffer, reused if possible
+     * @pre m_bufMutex held
+     */
+    std::string takeBuffer();
+
+    void run();
+private:
+    LogAppender::ptr m_target;
+    Overflow m_overflow;
+    size_t m_bufferSize;
+    size_t m_maxBuffers;
+    uint32_t m_flushInterval;
+
+    std::mutex m_bufMutex;
+    /// wakes the writer
+    std::condition_variable m_writerCond;
+    /// signalled by the writer after taking or writing a batch
+    std::condition_variable m_doneCond;
+    std::string m_current;
+    std::vector<std::string> m_full;
+    std::vector<std::string> m_free;
+    /// flush() requests, and the last one the writer has completed
+    uint64_t m_flushSeq = 0;
+    uint64_t m_writtenSeq = 0;
+    bool m_stopping = false;
+
+    std::atomic<uint64_t> m_records = {0};
+    std::atomic<uint64_t> m_dropped = {0};
+    std::atomic<uint64_t> m_blocked = {0};
+    std::atomic<uint64_t> m_batches = {0};
+    Thread::ptr m_thread;
 };
 
 /**
@@ -478,7 +1252,16 @@ public:
      * @brief Get root logger instance
      * @return Root logger shared pointer
      */
-    Logger::ptr getRoot() const { return m_root; }
+    const Logger::ptr& getRoot() const { return m_root; }
+
+    /**
+     * @brief Flush the appenders of every logger
+     *
+     * Called before an assertion aborts, so that buffered records
+     * (AsyncLogAppender) make it out. Pending "suppressed N messages"
+     * summaries go out first.
+     */
+    void flush();
 
     std::string toYamlString();
 private:
@@ -495,7 +1278,29 @@ private:
 /// Global singleton accessor for LoggerManager
 typedef sylar::Singleton<LoggerManager> LoggerMgr;
 
+/**
+ * @brief logger if it logs records at level, else nullptr
+ *
+ * The check of every SYLAR_LOG_* statement: one relaxed load. Only
+ * DEBUG, usually off in production, is hinted to fail, so that building
+ * its record stays out of the hot path; INFO and up are left to the
+ * branch predictor. level is a constant at the call site, the choice
+ * folds away.
+ */
+inline Logger* LogEnabled(Logger* logger, LogLevel::level level) {
+    bool enabled = logger->getLevel() <= level;
+    if(level == LogLevel::level::DEBUG) {
+        return SYLAR_UNLIKELY(enabled) ? logger : nullptr;
+    }
+    return enabled ? logger : nullptr;
+}
+
+inline Logger* LogEnabled(const Logger::ptr& logger, LogLevel::level level) {
+    return LogEnabled(logger.get(), level);
+}
+
 };
 
-#endif
+#include "binary_log.h"
 
+#endif
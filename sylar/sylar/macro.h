@@ -5,20 +5,32 @@
 #include <assert.h>
 #include "util.h"
 
+#if defined __GNUC__ || defined __llvm__
+/// the condition is expected to hold
+#   define SYLAR_LIKELY(x)      __builtin_expect(!!(x), 1)
+/// the condition is expected not to hold
+#   define SYLAR_UNLIKELY(x)    __builtin_expect(!!(x), 0)
+#else
+#   define SYLAR_LIKELY(x)      (x)
+#   define SYLAR_UNLIKELY(x)    (x)
+#endif
+
 #define SYLAR_ASSERT(x) \
-    if(!(x)) {  \
+    if(SYLAR_UNLIKELY(!(x))) {  \
         SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << "ASSERTION: " #x   \
             << "\nbacktrace:\n" \
             << sylar::BacktraceToString(100, 2, "    ");    \
+        sylar::LoggerMgr::GetInstance()->flush();   \
         assert(x);  \
     }                
 
 #define SYLAR_ASSERT2(x, w) \
-    if(!(x)) {  \
+    if(SYLAR_UNLIKELY(!(x))) {  \
         SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << "ASSERTION: " #x   \
             << "\n" << w \
             << "\nbacktrace:\n" \
             << sylar::BacktraceToString(100, 2, "    ");    \
+        sylar::LoggerMgr::GetInstance()->flush();   \
         assert(x);  \
     }                                    
 
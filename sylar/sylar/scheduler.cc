@@ -235,7 +235,8 @@ void Scheduler::tickle() {
 bool Scheduler::stopping() {
     MutexType::Lock lock(m_mutex);
     return m_autoStop && m_stopping
-        && m_fibers.empty() && m_activeThreadCount == 0;
+        && m_fibers.empty() && m_activeThreadCount == 0
+        && m_externalWaits == 0;
 }
 
 void Scheduler::idle() {
@@ -38,6 +38,11 @@ public:
      */
     const std::string& getName() const { return m_name;}
 
+    /**
+     * @brief 返回调度器各线程的id, start()之后有效
+     */
+    const std::vector<int>& getThreadIds() const { return m_threadIds;}
+
     /**
      * @brief 返回当前协程调度器
      */
@@ -96,6 +101,13 @@ public:
         }
     }
 
+    /**
+     * @brief 登记一个在等待调度器之外的线程唤醒的协程
+     * @details 登记期间stop()不会结束, 协程被重新调度后调用endExternalWait()
+     */
+    void beginExternalWait() { ++m_externalWaits;}
+    void endExternalWait() { --m_externalWaits;}
+
     void switchTo(int thread = -1);
     std::ostream& dump(std::ostream& os);
 protected:
@@ -229,6 +241,8 @@ protected:
     std::atomic<size_t> m_activeThreadCount = {0};
     /// 空闲线程数量
     std::atomic<size_t> m_idleThreadCount = {0};
+    /// 等待外部线程唤醒的协程数量
+    std::atomic<size_t> m_externalWaits = {0};
     /// 是否正在停止
     bool m_stopping = true;
     /// 是否自动停止
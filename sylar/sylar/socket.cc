@@ -0,0 +1,639 @@
+#include "socket.h"
+#include "iomanager.h"
+#include "fd_manager.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+
+#include <errno.h>
+#include <sstream>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <netinet/tcp.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_tcp_connect_timeout =
+    sylar::Config::Lookup("tcp.connect.timeout", (uint64_t)5000
+            , "default Socket::connect timeout in ms");
+
+Socket::ptr Socket::CreateTCP(sylar::Address::ptr address) {
+    Socket::ptr sock(new Socket(address->getFamily(), TCP, 0));
+    sock->newSock();
+    return sock;
+}
+
+Socket::ptr Socket::CreateUDP(sylar::Address::ptr address) {
+    Socket::ptr sock(new Socket(address->getFamily(), UDP, 0));
+    sock->newSock();
+    sock->m_isConnected = true;
+    return sock;
+}
+
+Socket::ptr Socket::CreateTCPSocket() {
+    Socket::ptr sock(new Socket(IPv4, TCP, 0));
+    sock->newSock();
+    return sock;
+}
+
+Socket::ptr Socket::CreateUDPSocket() {
+    Socket::ptr sock(new Socket(IPv4, UDP, 0));
+    sock->newSock();
+    sock->m_isConnected = true;
+    return sock;
+}
+
+Socket::ptr Socket::CreateTCPSocket6() {
+    Socket::ptr sock(new Socket(IPv6, TCP, 0));
+    sock->newSock();
+    return sock;
+}
+
+Socket::ptr Socket::CreateUDPSocket6() {
+    Socket::ptr sock(new Socket(IPv6, UDP, 0));
+    sock->newSock();
+    sock->m_isConnected = true;
+    return sock;
+}
+
+Socket::ptr Socket::CreateUnixTCPSocket() {
+    Socket::ptr sock(new Socket(UNIX, TCP, 0));
+    sock->newSock();
+    return sock;
+}
+
+Socket::ptr Socket::CreateUnixUDPSocket() {
+    Socket::ptr sock(new Socket(UNIX, UDP, 0));
+    sock->newSock();
+    sock->m_isConnected = true;
+    return sock;
+}
+
+Socket::Socket(int family, int type, int protocol)
+    :m_sock(-1)
+    ,m_family(family)
+    ,m_type(type)
+    ,m_protocol(protocol)
+    ,m_isConnected(false)
+    ,m_iom(nullptr) {
+}
+
+Socket::~Socket() {
+    close();
+}
+
+int64_t Socket::getSendTimeout() {
+    FdCtx* ctx = FdMgr::GetInstance()->get(m_sock);
+    if(ctx) {
+        return ctx->getTimeout(SO_SNDTIMEO);
+    }
+    return -1;
+}
+
+void Socket::setSendTimeout(int64_t v) {
+    FdCtx* ctx = FdMgr::GetInstance()->get(m_sock);
+    if(ctx) {
+        ctx->setTimeout(SO_SNDTIMEO, v);
+    }
+}
+
+int64_t Socket::getRecvTimeout() {
+    FdCtx* ctx = FdMgr::GetInstance()->get(m_sock);
+    if(ctx) {
+        return ctx->getTimeout(SO_RCVTIMEO);
+    }
+    return -1;
+}
+
+void Socket::setRecvTimeout(int64_t v) {
+    FdCtx* ctx = FdMgr::GetInstance()->get(m_sock);
+    if(ctx) {
+        ctx->setTimeout(SO_RCVTIMEO, v);
+    }
+}
+
+bool Socket::getOption(int level, int option, void* result, socklen_t* len) {
+    int rt = getsockopt(m_sock, level, option, result, (socklen_t*)len);
+    if(rt) {
+        SYLAR_LOG_DEBUG(g_logger) << "getOption sock=" << m_sock
+            << " level=" << level << " option=" << option
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::setOption(int level, int option, const void* result, socklen_t len) {
+    if(setsockopt(m_sock, level, option, result, (socklen_t)len)) {
+        SYLAR_LOG_DEBUG(g_logger) << "setOption sock=" << m_sock
+            << " level=" << level << " option=" << option
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::setNoDelay(bool v) {
+    int val = v;
+    return setOption(IPPROTO_TCP, TCP_NODELAY, val);
+}
+
+bool Socket::setReuseAddr(bool v) {
+    int val = v;
+    return setOption(SOL_SOCKET, SO_REUSEADDR, val);
+}
+
+bool Socket::setReusePort(bool v) {
+    int val = v;
+    return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
+Socket::ptr Socket::accept() {
+    Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
+    IOManager* iom = ioManager();
+    int newsock = iom ? iom->accept(m_sock) : ::accept4(m_sock, nullptr, nullptr, SOCK_CLOEXEC);
+    if(newsock == -1) {
+        SYLAR_LOG_DEBUG(g_logger) << "accept(" << m_sock << ") errno="
+            << errno << " errstr=" << strerror(errno);
+        return nullptr;
+    }
+    if(sock->init(newsock)) {
+        return sock;
+    }
+    return nullptr;
+}
+
+bool Socket::init(int sock) {
+    FdCtx* ctx = FdMgr::GetInstance()->get(sock, true);
+    if(ctx && ctx->isSocket() && !ctx->isClose()) {
+        m_sock = sock;
+        m_isConnected = true;
+        initSock();
+        getLocalAddress();
+        getRemoteAddress();
+        return true;
+    }
+    ::close(sock);
+    return false;
+}
+
+bool Socket::bind(const Address::ptr addr) {
+    if(!isValid()) {
+        newSock();
+        if(!isValid()) {
+            return false;
+        }
+    }
+
+    if(addr->getFamily() != m_family) {
+        SYLAR_LOG_ERROR(g_logger) << "bind sock.family("
+            << m_family << ") addr.family(" << addr->getFamily()
+            << ") not equal, addr=" << addr->toString();
+        return false;
+    }
+
+    if(::bind(m_sock, addr->getAddr(), addr->getAddrLen())) {
+        SYLAR_LOG_ERROR(g_logger) << "bind error errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    getLocalAddress();
+    return true;
+}
+
+bool Socket::reconnect(uint64_t timeout_ms) {
+    if(!m_remoteAddress) {
+        SYLAR_LOG_ERROR(g_logger) << "reconnect m_remoteAddress is null";
+        return false;
+    }
+    m_localAddress.reset();
+    return connect(m_remoteAddress, timeout_ms);
+}
+
+bool Socket::connect(const Address::ptr addr, uint64_t timeout_ms) {
+    m_remoteAddress = addr;
+    if(!isValid()) {
+        newSock();
+        if(!isValid()) {
+            return false;
+        }
+    }
+
+    if(addr->getFamily() != m_family) {
+        SYLAR_LOG_ERROR(g_logger) << "connect sock.family("
+            << m_family << ") addr.family(" << addr->getFamily()
+            << ") not equal, addr=" << addr->toString();
+        return false;
+    }
+
+    if(timeout_ms == (uint64_t)-1) {
+        timeout_ms = g_tcp_connect_timeout->getValue();
+    }
+    IOManager* iom = ioManager();
+    int rt = iom ? iom->connect(m_sock, addr->getAddr(), addr->getAddrLen(), timeout_ms)
+                 : ::connect(m_sock, addr->getAddr(), addr->getAddrLen());
+    if(rt) {
+        SYLAR_LOG_ERROR(g_logger) << "sock=" << m_sock << " connect(" << addr->toString()
+            << ") timeout=" << timeout_ms << " error errno="
+            << errno << " errstr=" << strerror(errno);
+        close();
+        return false;
+    }
+    m_isConnected = true;
+    getRemoteAddress();
+    getLocalAddress();
+    return true;
+}
+
+bool Socket::listen(int backlog) {
+    if(!isValid()) {
+        SYLAR_LOG_ERROR(g_logger) << "listen error sock=-1";
+        return false;
+    }
+    if(::listen(m_sock, backlog)) {
+        SYLAR_LOG_ERROR(g_logger) << "listen error errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::close() {
+    if(!m_isConnected && m_sock == -1) {
+        return true;
+    }
+    m_isConnected = false;
+    if(m_sock != -1) {
+        // wake whoever still waits on the fd and drop its epoll
+        // registration before the number can be reused
+        // the IOManager it was used with, closing may happen on any thread
+        IOManager::CancelAll(registeredIOManager(), m_sock);
+        FdMgr::GetInstance()->del(m_sock);
+        ::close(m_sock);
+        m_sock = -1;
+    }
+    return true;
+}
+
+int Socket::send(const void* buffer, size_t length, int flags) {
+    if(isConnected()) {
+        IOManager* iom = ioManager();
+        return iom ? iom->send(m_sock, buffer, length, flags)
+                   : ::send(m_sock, buffer, length, flags | MSG_NOSIGNAL);
+    }
+    return -1;
+}
+
+int Socket::send(const iovec* buffers, size_t length, int flags) {
+    if(isConnected()) {
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (iovec*)buffers;
+        msg.msg_iovlen = length;
+        IOManager* iom = ioManager();
+        return iom ? iom->sendmsg(m_sock, &msg, flags)
+                   : ::sendmsg(m_sock, &msg, flags | MSG_NOSIGNAL);
+    }
+    return -1;
+}
+
+/// Most sendfile(2) moves in one call
+static const uint64_t s_max_sendfile = 0x7ffff000;
+
+/**
+ * @brief Pipes for splicing, reused across sendFile() calls
+ * @details Not thread local: a fiber can be resumed on another thread
+ *          while its data is still in the pipe.
+ */
+class SplicePipes {
+public:
+    ~SplicePipes() {
+        for(auto& i : m_pipes) {
+            ::close(i.first);
+            ::close(i.second);
+        }
+    }
+
+    bool get(int fds[2]) {
+        {
+            Mutex::Lock lock(m_mutex);
+            if(!m_pipes.empty()) {
+                fds[0] = m_pipes.back().first;
+                fds[1] = m_pipes.back().second;
+                m_pipes.pop_back();
+                return true;
+            }
+        }
+        return pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0;
+    }
+
+    /**
+     * @param[in] empty Nothing is left in the pipe, otherwise it is closed
+     */
+    void put(int fds[2], bool empty) {
+        if(empty) {
+            Mutex::Lock lock(m_mutex);
+            if(m_pipes.size() < 16) {
+                m_pipes.push_back(std::make_pair(fds[0], fds[1]));
+                return;
+            }
+        }
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+private:
+    Mutex m_mutex;
+    std::vector<std::pair<int, int> > m_pipes;
+};
+
+static SplicePipes s_splice_pipes;
+
+int64_t Socket::sendFile(int fd, uint64_t offset, uint64_t length) {
+    if(!isConnected()) {
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st)) {
+        return -1;
+    }
+    IOManager* iom = ioManager();
+    uint64_t sent = 0;
+
+    if(S_ISREG(st.st_mode)) {
+        off_t off = offset;
+        while(sent < length) {
+            size_t n = std::min(length - sent, s_max_sendfile);
+            ssize_t rt = iom ? iom->sendfile(m_sock, fd, &off, n)
+                             : ::sendfile(m_sock, fd, &off, n);
+            if(rt < 0) {
+                return -1;
+            }
+            if(rt == 0) {
+                // the file got shorter
+                break;
+            }
+            sent += rt;
+        }
+        return sent;
+    }
+
+    // fd -> pipe -> socket. With our own pipe in the middle an EAGAIN
+    // filling it can only mean fd has nothing, and one draining it can only
+    // mean the socket is full
+    int fds[2];
+    if(!s_splice_pipes.get(fds)) {
+        return -1;
+    }
+    size_t in_pipe = 0;
+    bool error = false;
+    while(sent < length) {
+        ssize_t rt;
+        if(!in_pipe) {
+            size_t n = std::min(length - sent, s_max_sendfile);
+            rt = iom ? iom->splice(fd, nullptr, fds[1], nullptr, n, SPLICE_F_MOVE, IOManager::READ)
+                     : ::splice(fd, nullptr, fds[1], nullptr, n, SPLICE_F_MOVE);
+            if(rt <= 0) {
+                error = rt < 0;
+                break;
+            }
+            in_pipe = rt;
+        }
+        rt = iom ? iom->splice(fds[0], nullptr, m_sock, nullptr, in_pipe
+                                , SPLICE_F_MOVE | SPLICE_F_MORE, IOManager::WRITE)
+                 : ::splice(fds[0], nullptr, m_sock, nullptr, in_pipe, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(rt <= 0) {
+            error = true;
+            break;
+        }
+        in_pipe -= rt;
+        sent += rt;
+    }
+    s_splice_pipes.put(fds, !error && !in_pipe);
+    return error ? -1 : (int64_t)sent;
+}
+
+int Socket::sendTo(const void* buffer, size_t length, const Address::ptr to, int flags) {
+    iovec iov;
+    iov.iov_base = (void*)buffer;
+    iov.iov_len = length;
+    return sendTo(&iov, 1, to, flags);
+}
+
+int Socket::sendTo(const iovec* buffers, size_t length, const Address::ptr to, int flags) {
+    if(isConnected()) {
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (iovec*)buffers;
+        msg.msg_iovlen = length;
+        msg.msg_name = (void*)to->getAddr();
+        msg.msg_namelen = to->getAddrLen();
+        IOManager* iom = ioManager();
+        return iom ? iom->sendmsg(m_sock, &msg, flags)
+                   : ::sendmsg(m_sock, &msg, flags | MSG_NOSIGNAL);
+    }
+    return -1;
+}
+
+int Socket::recv(void* buffer, size_t length, int flags) {
+    if(isConnected()) {
+        IOManager* iom = ioManager();
+        return iom ? iom->recv(m_sock, buffer, length, flags)
+                   : ::recv(m_sock, buffer, length, flags);
+    }
+    return -1;
+}
+
+int Socket::recv(iovec* buffers, size_t length, int flags) {
+    if(isConnected()) {
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (iovec*)buffers;
+        msg.msg_iovlen = length;
+        IOManager* iom = ioManager();
+        return iom ? iom->recvmsg(m_sock, &msg, flags)
+                   : ::recvmsg(m_sock, &msg, flags);
+    }
+    return -1;
+}
+
+int Socket::recvFrom(void* buffer, size_t length, Address::ptr from, int flags) {
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = length;
+    return recvFrom(&iov, 1, from, flags);
+}
+
+int Socket::recvFrom(iovec* buffers, size_t length, Address::ptr from, int flags) {
+    if(isConnected()) {
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (iovec*)buffers;
+        msg.msg_iovlen = length;
+        msg.msg_name = from->getAddr();
+        msg.msg_namelen = from->getAddrLen();
+        IOManager* iom = ioManager();
+        return iom ? iom->recvmsg(m_sock, &msg, flags)
+                   : ::recvmsg(m_sock, &msg, flags);
+    }
+    return -1;
+}
+
+Address::ptr Socket::getRemoteAddress() {
+    if(m_remoteAddress) {
+        return m_remoteAddress;
+    }
+
+    Address::ptr result;
+    switch(m_family) {
+        case AF_INET:
+            result.reset(new IPv4Address());
+            break;
+        case AF_INET6:
+            result.reset(new IPv6Address());
+            break;
+        case AF_UNIX:
+            result.reset(new UnixAddress());
+            break;
+        default:
+            result.reset(new UnknownAddress(m_family));
+            break;
+    }
+    socklen_t addrlen = result->getAddrLen();
+    if(getpeername(m_sock, result->getAddr(), &addrlen)) {
+        return Address::ptr(new UnknownAddress(m_family));
+    }
+    if(m_family == AF_UNIX) {
+        UnixAddress::ptr addr = std::dynamic_pointer_cast<UnixAddress>(result);
+        addr->setAddrLen(addrlen);
+    }
+    m_remoteAddress = result;
+    return m_remoteAddress;
+}
+
+Address::ptr Socket::getLocalAddress() {
+    if(m_localAddress) {
+        return m_localAddress;
+    }
+
+    Address::ptr result;
+    switch(m_family) {
+        case AF_INET:
+            result.reset(new IPv4Address());
+            break;
+        case AF_INET6:
+            result.reset(new IPv6Address());
+            break;
+        case AF_UNIX:
+            result.reset(new UnixAddress());
+            break;
+        default:
+            result.reset(new UnknownAddress(m_family));
+            break;
+    }
+    socklen_t addrlen = result->getAddrLen();
+    if(getsockname(m_sock, result->getAddr(), &addrlen)) {
+        SYLAR_LOG_ERROR(g_logger) << "getsockname error sock=" << m_sock
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        return Address::ptr(new UnknownAddress(m_family));
+    }
+    if(m_family == AF_UNIX) {
+        UnixAddress::ptr addr = std::dynamic_pointer_cast<UnixAddress>(result);
+        addr->setAddrLen(addrlen);
+    }
+    m_localAddress = result;
+    return m_localAddress;
+}
+
+bool Socket::isValid() const {
+    return m_sock != -1;
+}
+
+int Socket::getError() {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if(!getOption(SOL_SOCKET, SO_ERROR, &error, &len)) {
+        error = errno;
+    }
+    return error;
+}
+
+std::ostream& Socket::dump(std::ostream& os) const {
+    os << "[Socket sock=" << m_sock
+       << " is_connected=" << m_isConnected
+       << " family=" << m_family
+       << " type=" << m_type
+       << " protocol=" << m_protocol;
+    if(m_localAddress) {
+        os << " local_address=" << m_localAddress->toString();
+    }
+    if(m_remoteAddress) {
+        os << " remote_address=" << m_remoteAddress->toString();
+    }
+    os << "]";
+    return os;
+}
+
+std::string Socket::toString() const {
+    std::stringstream ss;
+    dump(ss);
+    return ss.str();
+}
+
+bool Socket::cancelRead() {
+    return IOManager::CancelEvent(registeredIOManager(), m_sock, sylar::IOManager::READ);
+}
+
+bool Socket::cancelWrite() {
+    return IOManager::CancelEvent(registeredIOManager(), m_sock, sylar::IOManager::WRITE);
+}
+
+bool Socket::cancelAccept() {
+    return IOManager::CancelEvent(registeredIOManager(), m_sock, sylar::IOManager::READ);
+}
+
+bool Socket::cancelAll() {
+    return IOManager::CancelAll(registeredIOManager(), m_sock);
+}
+
+IOManager* Socket::ioManager() {
+    IOManager* iom = IOManager::GetThis();
+    if(iom && m_iom.load(std::memory_order_relaxed) != iom) {
+        m_iom.store(iom, std::memory_order_relaxed);
+    }
+    return iom;
+}
+
+IOManager* Socket::registeredIOManager() const {
+    IOManager* iom = m_iom.load(std::memory_order_relaxed);
+    return iom ? iom : IOManager::GetThis();
+}
+
+void Socket::initSock() {
+    setReuseAddr(true);
+    if(m_type == SOCK_STREAM && m_family != AF_UNIX) {
+        setNoDelay(true);
+    }
+}
+
+void Socket::newSock() {
+    m_sock = socket(m_family, m_type | SOCK_CLOEXEC, m_protocol);
+    if(m_sock != -1) {
+        FdMgr::GetInstance()->get(m_sock, true);
+        initSock();
+    } else {
+        SYLAR_LOG_ERROR(g_logger) << "socket(" << m_family
+            << ", " << m_type << ", " << m_protocol << ") errno="
+            << errno << " errstr=" << strerror(errno);
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, const Socket& sock) {
+    return sock.dump(os);
+}
+
+}
@@ -0,0 +1,234 @@
+#ifndef __SYLAR_SOCKET_H__
+#define __SYLAR_SOCKET_H__
+
+#include <memory>
+#include <string>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <atomic>
+#include "address.h"
+
+namespace sylar {
+
+class IOManager;
+
+/**
+ * @brief Socket wrapper
+ * @details The fd is registered with FdManager, which puts it in O_NONBLOCK.
+ *          IO goes through the current IOManager, so called from one of its
+ *          fibers recv/send/accept/connect look blocking but only suspend the
+ *          calling fiber (io_uring or epoll underneath). Timeouts set with
+ *          setRecvTimeout()/setSendTimeout() bound every such wait and fail
+ *          it with ETIMEDOUT. Outside an IOManager the calls are plain non
+ *          blocking syscalls.
+ */
+class Socket : public std::enable_shared_from_this<Socket> {
+public:
+    typedef std::shared_ptr<Socket> ptr;
+    typedef std::weak_ptr<Socket> weak_ptr;
+
+    enum Type {
+        TCP = SOCK_STREAM,
+        UDP = SOCK_DGRAM
+    };
+
+    enum Family {
+        IPv4 = AF_INET,
+        IPv6 = AF_INET6,
+        UNIX = AF_UNIX
+    };
+
+    /**
+     * @brief TCP socket of address's family
+     * @details The fd is created right away so options can be set before
+     *          bind()/connect(); after close() they create a new one.
+     */
+    static Socket::ptr CreateTCP(sylar::Address::ptr address);
+
+    /**
+     * @brief UDP socket of address's family
+     */
+    static Socket::ptr CreateUDP(sylar::Address::ptr address);
+
+    static Socket::ptr CreateTCPSocket();
+    static Socket::ptr CreateUDPSocket();
+    static Socket::ptr CreateTCPSocket6();
+    static Socket::ptr CreateUDPSocket6();
+    static Socket::ptr CreateUnixTCPSocket();
+    static Socket::ptr CreateUnixUDPSocket();
+
+    /**
+     * @param[in] family AF_INET, AF_INET6, AF_UNIX
+     * @param[in] type SOCK_STREAM, SOCK_DGRAM
+     * @param[in] protocol Protocol, 0 for the default
+     */
+    Socket(int family, int type, int protocol = 0);
+    virtual ~Socket();
+
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    /**
+     * @brief Send timeout in ms, -1 for none
+     */
+    int64_t getSendTimeout();
+    void setSendTimeout(int64_t v);
+
+    /**
+     * @brief Receive timeout in ms, -1 for none (also bounds accept)
+     */
+    int64_t getRecvTimeout();
+    void setRecvTimeout(int64_t v);
+
+    bool getOption(int level, int option, void* result, socklen_t* len);
+
+    template<class T>
+    bool getOption(int level, int option, T& result) {
+        socklen_t length = sizeof(T);
+        return getOption(level, option, &result, &length);
+    }
+
+    bool setOption(int level, int option, const void* result, socklen_t len);
+
+    template<class T>
+    bool setOption(int level, int option, const T& value) {
+        return setOption(level, option, &value, sizeof(T));
+    }
+
+    /**
+     * @brief TCP_NODELAY, on by default for TCP sockets
+     */
+    bool setNoDelay(bool v);
+
+    /**
+     * @brief SO_REUSEADDR, on by default
+     */
+    bool setReuseAddr(bool v);
+
+    /**
+     * @brief SO_REUSEPORT, lets several sockets bind the same port and the
+     *        kernel balance connections over them
+     */
+    bool setReusePort(bool v);
+
+    /**
+     * @brief Accept a connection
+     * @return The connection, nullptr on failure
+     */
+    virtual Socket::ptr accept();
+
+    virtual bool bind(const Address::ptr addr);
+
+    /**
+     * @brief Connect to addr
+     * @param[in] timeout_ms Timeout, -1 for tcp.connect.timeout
+     */
+    virtual bool connect(const Address::ptr addr, uint64_t timeout_ms = -1);
+
+    /**
+     * @brief Connect again to the last remote address
+     */
+    virtual bool reconnect(uint64_t timeout_ms = -1);
+
+    virtual bool listen(int backlog = SOMAXCONN);
+
+    virtual bool close();
+
+    /**
+     * @return > 0 bytes sent, 0 the socket was closed, < 0 error
+     */
+    virtual int send(const void* buffer, size_t length, int flags = 0);
+    virtual int send(const iovec* buffers, size_t length, int flags = 0);
+    virtual int sendTo(const void* buffer, size_t length, const Address::ptr to, int flags = 0);
+    virtual int sendTo(const iovec* buffers, size_t length, const Address::ptr to, int flags = 0);
+
+    /**
+     * @brief Send length bytes of fd without copying them through user space
+     * @details sendfile(2) for a regular file, starting at offset (fd's
+     *          file position is left alone). Anything else (pipe, socket,
+     *          device, which should be O_NONBLOCK) is spliced through a pipe
+     *          from its current position, offset is ignored. The fiber
+     *          waits for the socket (or fd) whenever it would block.
+     * @return Bytes sent, less than length if fd ended first, < 0 on error
+     */
+    virtual int64_t sendFile(int fd, uint64_t offset, uint64_t length);
+
+    /**
+     * @return > 0 bytes received, 0 the peer closed, < 0 error
+     */
+    virtual int recv(void* buffer, size_t length, int flags = 0);
+    virtual int recv(iovec* buffers, size_t length, int flags = 0);
+    virtual int recvFrom(void* buffer, size_t length, Address::ptr from, int flags = 0);
+    virtual int recvFrom(iovec* buffers, size_t length, Address::ptr from, int flags = 0);
+
+    Address::ptr getRemoteAddress();
+    Address::ptr getLocalAddress();
+
+    int getFamily() const { return m_family;}
+    int getType() const { return m_type;}
+    int getProtocol() const { return m_protocol;}
+
+    bool isConnected() const { return m_isConnected;}
+    bool isValid() const;
+
+    /**
+     * @brief Pending SO_ERROR
+     */
+    int getError();
+
+    virtual std::ostream& dump(std::ostream& os) const;
+    virtual std::string toString() const;
+
+    int getSocket() const { return m_sock;}
+
+    /**
+     * @brief Wake a fiber waiting to read/write/accept, its call fails
+     */
+    bool cancelRead();
+    bool cancelWrite();
+    bool cancelAccept();
+    bool cancelAll();
+
+    /**
+     * @brief The IOManager this thread runs, which the socket's I/O goes
+     *        through; remembered so that close() and cancel*() from
+     *        elsewhere reach its waiters
+     */
+    IOManager* ioManager();
+protected:
+    /**
+     * @brief Default options for a new socket
+     */
+    void initSock();
+
+    void newSock();
+
+    /**
+     * @brief Where close() and cancel*() go: the remembered IOManager,
+     *        else this thread's
+     */
+    IOManager* registeredIOManager() const;
+
+    /**
+     * @brief Adopt an accepted fd
+     */
+    virtual bool init(int sock);
+protected:
+    int m_sock;
+    int m_family;
+    int m_type;
+    int m_protocol;
+    bool m_isConnected;
+    /// last IOManager the fd was used with, maybe destroyed since
+    std::atomic<IOManager*> m_iom;
+    Address::ptr m_localAddress;
+    Address::ptr m_remoteAddress;
+};
+
+std::ostream& operator<<(std::ostream& os, const Socket& sock);
+
+}
+
+#endif
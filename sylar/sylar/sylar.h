@@ -1,13 +1,24 @@
 #ifndef __SYLAR_SYLAR_H__
 #define __SYLAR_SYLAR_H__
 
+#include "address.h"
+#include "binary_log.h"
+#include "bytearray.h"
 #include "config.h"
+#include "connection_pool.h"
+#include "datagram_socket.h"
+#include "fd_manager.h"
 #include "fiber.h"
+#include "file_cache.h"
+#include "file_io.h"
 #include "log.h"
 #include "macro.h"
 #include "scheduler.h"
 #include "singleton.h"
+#include "socket.h"
+#include "tcp_server.h"
 #include "thread.h"
+#include "timer.h"
 #include "util.h"
 
 #endif
\ No newline at end of file
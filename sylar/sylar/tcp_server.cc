@@ -0,0 +1,226 @@
+#include "tcp_server.h"
+#include "config.h"
+#include "log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sstream>
+
+namespace sylar {
+
+static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
+    sylar::Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2)
+            , "tcp server client read timeout in ms");
+
+static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_write_timeout =
+    sylar::Config::Lookup("tcp_server.write_timeout", (uint64_t)(60 * 1000 * 2)
+            , "tcp server client write timeout in ms");
+
+static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_stop_timeout =
+    sylar::Config::Lookup("tcp_server.stop_timeout", (uint64_t)5000
+            , "grace period in ms for connections after TcpServer::stop");
+
+static sylar::ConfigVar<bool>::ptr g_tcp_server_reuse_port =
+    sylar::Config::Lookup("tcp_server.reuse_port", false
+            , "one SO_REUSEPORT listener per accept thread");
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+TcpServer::TcpServer(sylar::IOManager* worker, sylar::IOManager* accept_worker)
+    :m_worker(worker)
+    ,m_acceptWorker(accept_worker)
+    ,m_recvTimeout(g_tcp_server_read_timeout->getValue())
+    ,m_sendTimeout(g_tcp_server_write_timeout->getValue())
+    ,m_stopTimeout(g_tcp_server_stop_timeout->getValue())
+    ,m_name("sylar/1.0.0")
+    ,m_reusePort(g_tcp_server_reuse_port->getValue())
+    ,m_isStop(true) {
+}
+
+TcpServer::~TcpServer() {
+    std::vector<Socket::ptr> socks;
+    {
+        Mutex::Lock lock(m_mutex);
+        socks.swap(m_socks);
+    }
+    for(auto& i : socks) {
+        i->close();
+    }
+}
+
+std::vector<Socket::ptr> TcpServer::getSocks() const {
+    Mutex::Lock lock(m_mutex);
+    return m_socks;
+}
+
+bool TcpServer::bind(sylar::Address::ptr addr) {
+    std::vector<Address::ptr> addrs;
+    std::vector<Address::ptr> fails;
+    addrs.push_back(addr);
+    return bind(addrs, fails);
+}
+
+bool TcpServer::bind(const std::vector<Address::ptr>& addrs
+                        ,std::vector<Address::ptr>& fails) {
+    std::vector<Socket::ptr> socks;
+    size_t listeners = 1;
+    if(m_reusePort) {
+        listeners = std::max((size_t)1, m_acceptWorker->getThreadIds().size());
+    }
+    for(auto& a : addrs) {
+        Address::ptr addr = a;
+        for(size_t i = 0; i < listeners; ++i) {
+            Socket::ptr sock = Socket::CreateTCP(addr);
+            if(m_reusePort && !sock->setReusePort(true)) {
+                fails.push_back(a);
+                break;
+            }
+            if(!sock->bind(addr)) {
+                SYLAR_LOG_ERROR(g_logger) << "bind fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(a);
+                break;
+            }
+            if(!sock->listen()) {
+                SYLAR_LOG_ERROR(g_logger) << "listen fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(a);
+                break;
+            }
+            socks.push_back(sock);
+            // port 0: the other listeners must share the port the kernel
+            // picked for the first one
+            addr = sock->getLocalAddress();
+        }
+    }
+
+    if(!fails.empty()) {
+        return false;
+    }
+
+    for(auto& i : socks) {
+        SYLAR_LOG_INFO(g_logger) << "server bind success: " << *i;
+    }
+    Mutex::Lock lock(m_mutex);
+    m_socks.insert(m_socks.end(), socks.begin(), socks.end());
+    return true;
+}
+
+void TcpServer::startAccept(Socket::ptr sock) {
+    while(!m_isStop) {
+        Socket::ptr client = sock->accept();
+        if(client) {
+            ++m_accepted;
+            m_worker->schedule(std::bind(&TcpServer::onClient
+                        ,shared_from_this(), client));
+        } else if(!m_isStop) {
+            SYLAR_LOG_ERROR_RATELIMITED(g_logger, 10) << "accept errno=" << errno
+                << " errstr=" << strerror(errno);
+        }
+    }
+    sock->close();
+}
+
+bool TcpServer::start() {
+    if(!m_isStop) {
+        return true;
+    }
+    m_isStop = false;
+    const std::vector<int>& threads = m_acceptWorker->getThreadIds();
+    size_t idx = 0;
+    for(auto& sock : getSocks()) {
+        // reuse_port listeners come in groups of one per thread, pin each
+        // loop to its own thread
+        int thread = (m_reusePort && !threads.empty())
+                        ? threads[idx++ % threads.size()] : -1;
+        m_acceptWorker->schedule(std::bind(&TcpServer::startAccept,
+                    shared_from_this(), sock), thread);
+    }
+    return true;
+}
+
+void TcpServer::stop() {
+    if(m_isStop) {
+        return;
+    }
+    m_isStop = true;
+    auto self = shared_from_this();
+    std::vector<Socket::ptr> socks;
+    Mutex::Lock lock(m_mutex);
+    socks.swap(m_socks);
+    m_acceptWorker->schedule([socks]() {
+        // wake the accept loops, they close their listener on the way out;
+        // after shutdown() a retried accept fails instead of waiting again
+        for(auto& sock : socks) {
+            ::shutdown(sock->getSocket(), SHUT_RDWR);
+            sock->cancelAll();
+        }
+    });
+
+    if(!m_clients.empty()) {
+        m_stopTimer = m_worker->addTimer(m_stopTimeout, [self]() {
+            self->shutdownClients();
+        });
+    }
+}
+
+void TcpServer::onClient(Socket::ptr client) {
+    client->setRecvTimeout(m_recvTimeout);
+    client->setSendTimeout(m_sendTimeout);
+    {
+        Mutex::Lock lock(m_mutex);
+        m_clients.insert(client.get());
+        ++m_connections;
+    }
+    handleClient(client);
+    {
+        Mutex::Lock lock(m_mutex);
+        m_clients.erase(client.get());
+        --m_connections;
+        if(m_clients.empty() && m_stopTimer) {
+            // a pending timer would hold the worker up until it fires
+            m_stopTimer->cancel();
+            m_stopTimer.reset();
+        }
+    }
+}
+
+void TcpServer::shutdownClients() {
+    Mutex::Lock lock(m_mutex);
+    m_stopTimer.reset();
+    if(m_clients.empty()) {
+        return;
+    }
+    SYLAR_LOG_INFO(g_logger) << m_name << " stop, shutting down "
+        << m_clients.size() << " connections";
+    // shutdown() wakes whatever the handlers wait on, with either backend,
+    // and leaves closing the fd to the owner of the Socket
+    for(auto& i : m_clients) {
+        ::shutdown(i->getSocket(), SHUT_RDWR);
+    }
+}
+
+void TcpServer::handleClient(Socket::ptr client) {
+    SYLAR_LOG_INFO(g_logger) << "handleClient: " << *client;
+}
+
+std::string TcpServer::toString(const std::string& prefix) {
+    std::stringstream ss;
+    ss << prefix << "[name=" << m_name
+       << " worker=" << (m_worker ? m_worker->getName() : "")
+       << " accept=" << (m_acceptWorker ? m_acceptWorker->getName() : "")
+       << " recv_timeout=" << m_recvTimeout
+       << " send_timeout=" << m_sendTimeout
+       << " reuse_port=" << m_reusePort
+       << " connections=" << m_connections
+       << " accepted=" << m_accepted << "]" << std::endl;
+    std::string pfx = prefix.empty() ? "    " : prefix;
+    for(auto& i : getSocks()) {
+        ss << pfx << pfx << *i << std::endl;
+    }
+    return ss.str();
+}
+
+}
@@ -0,0 +1,161 @@
+#ifndef __SYLAR_TCP_SERVER_H__
+#define __SYLAR_TCP_SERVER_H__
+
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <unordered_set>
+#include "address.h"
+#include "iomanager.h"
+#include "socket.h"
+#include "thread.h"
+
+namespace sylar {
+
+/**
+ * @brief TCP server
+ * @details Accept loops run on the accept worker, every connection is handed
+ *          to handleClient() on the io worker. Subclasses override
+ *          handleClient() to speak their protocol.
+ *
+ *          With setReusePort(true) (or tcp_server.reuse_port) bind() opens
+ *          one SO_REUSEPORT listener per accept worker thread and start()
+ *          pins one accept loop to each thread, so the kernel spreads new
+ *          connections over them instead of waking every thread for a
+ *          single listener.
+ *
+ *          stop() closes the listeners right away; connections still being
+ *          handled get tcp_server.stop_timeout ms to finish (handlers can
+ *          check isStop()) before they are shut down.
+ */
+class TcpServer : public std::enable_shared_from_this<TcpServer> {
+public:
+    typedef std::shared_ptr<TcpServer> ptr;
+
+    /**
+     * @param[in] worker Runs handleClient()
+     * @param[in] accept_worker Runs the accept loops
+     */
+    TcpServer(sylar::IOManager* worker = sylar::IOManager::GetThis()
+              ,sylar::IOManager* accept_worker = sylar::IOManager::GetThis());
+
+    virtual ~TcpServer();
+
+    TcpServer(const TcpServer&) = delete;
+    TcpServer& operator=(const TcpServer&) = delete;
+
+    /**
+     * @brief Listen on addr
+     */
+    virtual bool bind(sylar::Address::ptr addr);
+
+    /**
+     * @brief Listen on every address of addrs
+     * @param[out] fails Addresses that couldn't be bound
+     * @return true if all of them were bound, otherwise nothing is
+     */
+    virtual bool bind(const std::vector<Address::ptr>& addrs
+                        ,std::vector<Address::ptr>& fails);
+
+    /**
+     * @brief Start the accept loops
+     */
+    virtual bool start();
+
+    /**
+     * @brief Stop accepting, shut remaining connections down after
+     *        getStopTimeout() ms. Doesn't block.
+     */
+    virtual void stop();
+
+    /**
+     * @brief Read timeout of client sockets in ms (tcp_server.read_timeout)
+     */
+    uint64_t getRecvTimeout() const { return m_recvTimeout;}
+    void setRecvTimeout(uint64_t v) { m_recvTimeout = v;}
+
+    /**
+     * @brief Write timeout of client sockets in ms (tcp_server.write_timeout)
+     */
+    uint64_t getSendTimeout() const { return m_sendTimeout;}
+    void setSendTimeout(uint64_t v) { m_sendTimeout = v;}
+
+    /**
+     * @brief Grace period of stop() in ms (tcp_server.stop_timeout)
+     */
+    uint64_t getStopTimeout() const { return m_stopTimeout;}
+    void setStopTimeout(uint64_t v) { m_stopTimeout = v;}
+
+    /**
+     * @brief One listener per accept thread, only takes effect before bind()
+     */
+    bool isReusePort() const { return m_reusePort;}
+    void setReusePort(bool v) { m_reusePort = v;}
+
+    std::string getName() const { return m_name;}
+    virtual void setName(const std::string& v) { m_name = v;}
+
+    bool isStop() const { return m_isStop;}
+
+    /**
+     * @brief Connections being handled right now
+     */
+    uint64_t getConnectionCount() const { return m_connections;}
+
+    /**
+     * @brief Connections accepted since start
+     */
+    uint64_t getAcceptCount() const { return m_accepted;}
+
+    /**
+     * @brief Listeners bound and not yet stopped
+     */
+    std::vector<Socket::ptr> getSocks() const;
+
+    virtual std::string toString(const std::string& prefix = "");
+protected:
+    /**
+     * @brief Serve one connection, the socket is closed when this returns
+     *        and the last reference goes away
+     */
+    virtual void handleClient(Socket::ptr client);
+
+    /**
+     * @brief Accept loop of one listener
+     */
+    virtual void startAccept(Socket::ptr sock);
+private:
+    /**
+     * @brief Count the connection and run handleClient()
+     */
+    void onClient(Socket::ptr client);
+
+    /**
+     * @brief Shut down connections that outlived the grace period
+     */
+    void shutdownClients();
+protected:
+    /// Listeners
+    std::vector<Socket::ptr> m_socks;
+    IOManager* m_worker;
+    IOManager* m_acceptWorker;
+    uint64_t m_recvTimeout;
+    uint64_t m_sendTimeout;
+    uint64_t m_stopTimeout;
+    std::string m_name;
+    bool m_reusePort;
+    std::atomic<bool> m_isStop;
+private:
+    /// Guards m_socks, m_clients and m_stopTimer
+    mutable Mutex m_mutex;
+    /// Connections inside handleClient()
+    std::unordered_set<Socket*> m_clients;
+    /// Grace period of stop(), cancelled once the last connection is done
+    Timer::ptr m_stopTimer;
+    std::atomic<uint64_t> m_connections = {0};
+    std::atomic<uint64_t> m_accepted = {0};
+};
+
+}
+
+#endif
@@ -2,6 +2,15 @@
 #include "log.h"
 #include "util.h"
 
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+
 namespace sylar {
 
 // Thread-local storage for current thread pointer
@@ -35,6 +44,136 @@ void Semaphore::notify() {
     }
 }
 
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Registry of the locks with stats, weak so a lock's stats go with it
+static std::mutex s_lock_stats_mutex;
+static std::vector<std::weak_ptr<LockStats> > s_lock_stats;
+
+LockStats::ptr LockStats::Create(const std::string& name) {
+    LockStats::ptr stats(new LockStats(name));
+    std::lock_guard<std::mutex> lock(s_lock_stats_mutex);
+    s_lock_stats.push_back(stats);
+    return stats;
+}
+
+std::vector<LockStats::ptr> LockStats::GetAll() {
+    std::vector<ptr> all;
+    {
+        std::lock_guard<std::mutex> lock(s_lock_stats_mutex);
+        for(auto it = s_lock_stats.begin(); it != s_lock_stats.end();) {
+            if(auto stats = it->lock()) {
+                all.push_back(stats);
+                ++it;
+            } else {
+                it = s_lock_stats.erase(it);
+            }
+        }
+    }
+    std::sort(all.begin(), all.end(), [](const ptr& a, const ptr& b){
+        return a->waitNs > b->waitNs;
+    });
+    return all;
+}
+
+std::string LockStats::toString() const {
+    std::stringstream ss;
+    ss << name
+       << " acquisitions=" << acquisitions
+       << " contended=" << contended
+       << " spins=" << spins
+       << " sleeps=" << sleeps
+       << " wait_us=" << waitNs / 1000;
+    return ss.str();
+}
+
+/**
+ * @brief Account one contended lock() that started at start
+ */
+static void record_contention(LockStats* stats, uint64_t start, uint64_t spins, uint64_t sleeps) {
+    stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    stats->contended.fetch_add(1, std::memory_order_relaxed);
+    stats->spins.fetch_add(spins, std::memory_order_relaxed);
+    stats->sleeps.fetch_add(sleeps, std::memory_order_relaxed);
+    stats->waitNs.fetch_add(monotonic_ns() - start, std::memory_order_relaxed);
+}
+
+// pauses in the longest run before a Spinlock waiter starts yielding
+static const uint32_t s_spin_max_backoff = 1024;
+
+void Spinlock::lockSlow() {
+    uint64_t start = m_stats ? monotonic_ns() : 0;
+    uint64_t spins = 0;
+    uint64_t sleeps = 0;
+    uint32_t backoff = 1;
+    do {
+        // spin on a load, the exchange only when it looks free
+        while(m_locked.load(std::memory_order_relaxed)) {
+            if(backoff <= s_spin_max_backoff) {
+                for(uint32_t i = 0; i < backoff; ++i) {
+                    CpuRelax();
+                }
+                spins += backoff;
+                backoff <<= 1;
+            } else {
+                sched_yield();
+                ++sleeps;
+            }
+        }
+    } while(m_locked.exchange(true, std::memory_order_acquire));
+    if(m_stats) {
+        record_contention(m_stats.get(), start, spins, sleeps);
+    }
+}
+
+// looks at an AdaptiveMutex before going to sleep on it
+static const uint32_t s_adaptive_spins = 100;
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex needs a plain int");
+
+void AdaptiveMutex::lockSlow() {
+    uint64_t start = m_stats ? monotonic_ns() : 0;
+    uint64_t spins = 0;
+    uint64_t sleeps = 0;
+    int c = FREE;
+    for(uint32_t i = 0; i < s_adaptive_spins; ++i) {
+        c = m_state.load(std::memory_order_relaxed);
+        if(c == FREE && m_state.compare_exchange_weak(c, LOCKED, std::memory_order_acquire)) {
+            break;
+        }
+        // others already sleep, joining them is fairer than spinning
+        if(c == SLEEPERS) {
+            break;
+        }
+        CpuRelax();
+        ++spins;
+        c = LOCKED;
+    }
+    if(c != FREE) {
+        // from here on the state says there may be sleepers, whoever
+        // unlocks wakes one
+        c = m_state.exchange(SLEEPERS, std::memory_order_acquire);
+        while(c != FREE) {
+            syscall(SYS_futex, reinterpret_cast<int*>(&m_state), FUTEX_WAIT_PRIVATE
+                    , SLEEPERS, nullptr, nullptr, 0);
+            ++sleeps;
+            c = m_state.exchange(SLEEPERS, std::memory_order_acquire);
+        }
+    }
+    if(m_stats) {
+        record_contention(m_stats.get(), start, spins, sleeps);
+    }
+}
+
+void AdaptiveMutex::wake() {
+    syscall(SYS_futex, reinterpret_cast<int*>(&m_state), FUTEX_WAKE_PRIVATE
+            , 1, nullptr, nullptr, 0);
+}
+
 // Get current thread object
 Thread* Thread::GetThis() {
     return t_thread;
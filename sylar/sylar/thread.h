@@ -8,6 +8,8 @@
 #include <semaphore.h>
 #include <stdint.h>
 #include <atomic>
+#include <string>
+#include <vector>
 
 // pthread_xxx   C
 // std::thread, pthread 
@@ -193,25 +195,173 @@ public:
     void unlock() {}
 };
 
+/**
+ * @brief Contention counters of one lock
+ *
+ * Off unless enableStats() was called on the lock, before it is shared.
+ * A lock that finds itself free counts one acquisition and nothing else.
+ */
+struct LockStats {
+    typedef std::shared_ptr<LockStats> ptr;
+
+    explicit LockStats(const std::string& name)
+        :name(name) {
+    }
+
+    std::string name;
+    /// lock() calls that got the lock
+    std::atomic<uint64_t> acquisitions{0};
+    /// of those, the ones that found it taken
+    std::atomic<uint64_t> contended{0};
+    /// pause instructions spent waiting
+    std::atomic<uint64_t> spins{0};
+    /// times the waiter gave up the cpu (sched_yield or futex wait)
+    std::atomic<uint64_t> sleeps{0};
+    /// nanoseconds spent in contended lock() calls
+    std::atomic<uint64_t> waitNs{0};
+
+    std::string toString() const;
+
+    /**
+     * @brief Stats of every lock that has them, most waited on first
+     */
+    static std::vector<ptr> GetAll();
+
+    /**
+     * @brief Create stats named name and list them in GetAll()
+     */
+    static ptr Create(const std::string& name);
+};
+
+/**
+ * @brief One pause, what a spinning thread does between looks at the lock
+ */
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/**
+ * @brief Test-and-test-and-set spinlock
+ *
+ * Waiters spin on a plain load, so the cache line only bounces when the
+ * lock is released, with exponentially growing runs of pause in
+ * between. Past about 2000 pauses a waiter yields the cpu each round
+ * instead, the holder may be descheduled. For short critical sections
+ * without IO; AdaptiveMutex is for the rest.
+ */
 class Spinlock {
 public:
     typedef ScopedLockImpl<Spinlock> Lock;
-    Spinlock() {
-        pthread_spin_init(&m_mutex, 0);
+    Spinlock() {}
+
+    Spinlock(const Spinlock&) = delete;
+    Spinlock& operator=(const Spinlock&) = delete;
+
+    void lock() {
+        if(!m_locked.exchange(true, std::memory_order_acquire)) {
+            if(m_stats) {
+                m_stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+        lockSlow();
+    }
+
+    bool tryLock() {
+        if(m_locked.load(std::memory_order_relaxed)
+                || m_locked.exchange(true, std::memory_order_acquire)) {
+            return false;
+        }
+        if(m_stats) {
+            m_stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
     }
-    ~Spinlock() {
-        pthread_spin_destroy(&m_mutex);
+
+    void unlock() {
+        m_locked.store(false, std::memory_order_release);
     }
 
+    /**
+     * @brief Count contention under name, call before the lock is in use
+     */
+    void enableStats(const std::string& name) { m_stats = LockStats::Create(name); }
+    LockStats::ptr getStats() const { return m_stats; }
+private:
+    void lockSlow();
+private:
+    std::atomic<bool> m_locked{false};
+    LockStats::ptr m_stats;
+};
+
+/**
+ * @brief Mutex that spins a little, then sleeps on a futex
+ *
+ * Uncontended lock() and unlock() are one atomic operation each, no
+ * syscall. A waiter spins for a short while (the holder is usually
+ * nearly done) and then sleeps in the kernel until unlock() wakes it,
+ * so critical sections may do IO.
+ */
+class AdaptiveMutex {
+public:
+    typedef ScopedLockImpl<AdaptiveMutex> Lock;
+    AdaptiveMutex() {}
+
+    AdaptiveMutex(const AdaptiveMutex&) = delete;
+    AdaptiveMutex& operator=(const AdaptiveMutex&) = delete;
+
     void lock() {
-        pthread_spin_unlock(&m_mutex);
+        int c = FREE;
+        if(m_state.compare_exchange_strong(c, LOCKED, std::memory_order_acquire)) {
+            if(m_stats) {
+                m_stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+        lockSlow();
+    }
+
+    bool tryLock() {
+        int c = FREE;
+        if(!m_state.compare_exchange_strong(c, LOCKED, std::memory_order_acquire)) {
+            return false;
+        }
+        if(m_stats) {
+            m_stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
     }
 
     void unlock() {
-        pthread_spin_unlock(&m_mutex);
+        if(m_state.exchange(FREE, std::memory_order_release) == SLEEPERS) {
+            wake();
+        }
     }
+
+    /**
+     * @brief Count contention under name, call before the lock is in use
+     */
+    void enableStats(const std::string& name) { m_stats = LockStats::Create(name); }
+    LockStats::ptr getStats() const { return m_stats; }
+private:
+    enum State {
+        FREE = 0,
+        LOCKED = 1,
+        /// locked, and someone may be asleep waiting
+        SLEEPERS = 2
+    };
+
+    void lockSlow();
+    void wake();
 private:
-    pthread_spinlock_t m_mutex;
+    std::atomic<int> m_state{FREE};
+    LockStats::ptr m_stats;
 };
 
 class CASLock {
@@ -0,0 +1,119 @@
+#ifndef __SYLAR_TIMER_H__
+#define __SYLAR_TIMER_H__
+
+#include <memory>
+#include <vector>
+#include <set>
+#include <functional>
+#include <atomic>
+#include "thread.h"
+
+namespace sylar {
+
+class TimerManager;
+
+/**
+ * @brief One-off or recurring timer, created by TimerManager
+ */
+class Timer : public std::enable_shared_from_this<Timer> {
+friend class TimerManager;
+public:
+    typedef std::shared_ptr<Timer> ptr;
+
+    /**
+     * @brief Remove the timer, its callback won't run
+     * @return false if it already fired or was cancelled
+     */
+    bool cancel();
+
+    /**
+     * @brief Restart the period from now
+     */
+    bool refresh();
+
+    /**
+     * @brief Change the period
+     * @param[in] ms New period in milliseconds
+     * @param[in] from_now Count from now instead of from the last start
+     */
+    bool reset(uint64_t ms, bool from_now);
+private:
+    Timer(uint64_t ms, std::function<void()> cb,
+          bool recurring, TimerManager* manager);
+private:
+    bool m_recurring = false;
+    /// period in milliseconds
+    uint64_t m_ms = 0;
+    /// absolute expiry, GetCurrentMS() clock
+    uint64_t m_next = 0;
+    std::function<void()> m_cb;
+    TimerManager* m_manager = nullptr;
+private:
+    struct Comparator {
+        bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
+    };
+};
+
+/**
+ * @brief Ordered set of timers
+ * @details The owner asks getNextTimer() how long it may sleep, collects due
+ *          callbacks with listExpiredCb() and runs them. It is told through
+ *          onTimerInsertedAtFront() when a new timer expires before all the
+ *          others, so a sleeping thread can be woken up.
+ */
+class TimerManager {
+friend class Timer;
+public:
+    typedef RWMutex RWMutexType;
+
+    TimerManager();
+    virtual ~TimerManager();
+
+    /**
+     * @brief Add a timer
+     * @param[in] ms Delay (and period if recurring) in milliseconds
+     * @param[in] cb Callback
+     * @param[in] recurring Run every ms milliseconds until cancelled
+     */
+    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb
+                        ,bool recurring = false);
+
+    /**
+     * @brief Add a timer that only fires while weak_cond is still alive
+     */
+    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb
+                        ,std::weak_ptr<void> weak_cond
+                        ,bool recurring = false);
+
+    /**
+     * @brief Milliseconds until the first timer is due
+     * @return 0 if one is already due, ~0ull if there are no timers
+     */
+    uint64_t getNextTimer();
+
+    /**
+     * @brief Take the callbacks of every due timer, re-queueing recurring ones
+     */
+    void listExpiredCb(std::vector<std::function<void()> >& cbs);
+
+    /**
+     * @brief Whether any timer is pending
+     */
+    bool hasTimer();
+protected:
+    /**
+     * @brief A timer was inserted ahead of all the others
+     */
+    virtual void onTimerInsertedAtFront() = 0;
+
+    void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
+private:
+    RWMutexType m_mutex;
+    std::set<Timer::ptr, Timer::Comparator> m_timers;
+    /// onTimerInsertedAtFront() already called since the last getNextTimer()
+    std::atomic<bool> m_tickled = {false};
+};
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "util.h"
 #include <execinfo.h>
+#include <time.h>
 #include "log.h"
 #include "fiber.h"
 namespace sylar {
@@ -41,4 +42,16 @@ std::string BacktraceToString(int size, int skip, const std::string& prefix){
     return ss.str();
 }
 
-}
\ No newline at end of file
+uint64_t GetCurrentMS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
+uint64_t GetCurrentUS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+}
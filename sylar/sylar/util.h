@@ -16,6 +16,10 @@ uint32_t GetFiberId();
 void Backtrace(std::vector<std::string>& bt, int size = 64, int skip = 1);
 std::string BacktraceToString(int size = 64, int skip = 2, const std::string& prefix = "");
 
+// monotonic clock, for measuring intervals
+uint64_t GetCurrentMS();
+uint64_t GetCurrentUS();
+
 }
 
 #endif
@@ -0,0 +1,292 @@
+#include "sylar/sylar.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::string s_path;
+
+static sylar::Logger::ptr make_logger(const std::string& name, const std::string& pattern) {
+    sylar::Logger::ptr logger(new sylar::Logger(name));
+    logger->setFormatter(pattern);
+    logger->setBinary(true);
+    return logger;
+}
+
+static std::vector<std::string> decode(uint64_t* dropped = nullptr) {
+    sylar::BinaryLogReader reader;
+    std::stringstream ss;
+    SYLAR_ASSERT2(reader.decode(s_path, ss), reader.getError());
+    if(dropped) {
+        *dropped = reader.getDropped();
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while(std::getline(ss, line)) {
+        lines.push_back(line);
+    }
+    SYLAR_ASSERT(lines.size() == reader.getRecords());
+    return lines;
+}
+
+static std::string sprintf_str(const char* fmt, ...) {
+    char buf[256];
+    va_list al;
+    va_start(al, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, al);
+    va_end(al);
+    return buf;
+}
+
+// the decoder prints what printf would have
+void test_roundtrip() {
+    auto logger = make_logger("binary", "%p %c %N %m%n");
+    SYLAR_ASSERT(sylar::BinaryLog::Open(s_path));
+    int i = -42;
+    unsigned long long big = 18446744073709551615ull;
+    double d = 3.14159;
+    std::string str = "hello";
+    char buf[] = "buffer";
+    void* p = &i;
+    enum Color { RED, GREEN };
+    SYLAR_LOG_FMT_INFO(logger, "int=%d big=%llu hex=%#x", i, big, 255);
+    SYLAR_LOG_FMT_WARN(logger, "double=%.2f %e %8.3g|", d, d, d);
+    SYLAR_LOG_FMT_ERROR(logger, "str=%s [%-8s] [%5s] %.3s", str.c_str(), buf, "ab", "abcdef");
+    SYLAR_LOG_FMT_DEBUG(logger, "char=%c 100%% width=%*d ptr=%p color=%d", 'x', 6, 7, p, GREEN);
+    SYLAR_LOG_FMT_INFO(logger, "short=%hd size=%zu bool=%d", (short)-3, sizeof(i), true);
+    // not binary any more: nothing goes to the file
+    logger->setBinary(false);
+    logger->clearAppenders();
+    SYLAR_LOG_FMT_INFO(logger, "text %d", 1);
+    logger->setBinary(true);
+    sylar::BinaryLog::Close();
+    // closed: logged as text instead
+    std::string text_path = s_path + ".txt";
+    logger->addAppender(sylar::LogAppender::ptr(new sylar::FileLogAppender(text_path)));
+    SYLAR_LOG_FMT_INFO(logger, "closed %d", 2);
+    logger->flush();
+    logger->clearAppenders();
+    std::ifstream text(text_path);
+    std::string text_line;
+    SYLAR_ASSERT(std::getline(text, text_line) && text_line == "INFO" + std::string(" binary ")
+                    + sylar::Thread::GetName() + " closed 2");
+    unlink(text_path.c_str());
+
+    auto lines = decode();
+    const std::string prefix = " binary " + sylar::Thread::GetName() + " ";
+    std::vector<std::string> expect = {
+        "INFO" + prefix + sprintf_str("int=%d big=%llu hex=%#x", i, big, 255),
+        "WARN" + prefix + sprintf_str("double=%.2f %e %8.3g|", d, d, d),
+        "ERROR" + prefix + sprintf_str("str=%s [%-8s] [%5s] %.3s", str.c_str(), buf, "ab", "abcdef"),
+        "DEBUG" + prefix + sprintf_str("char=%c 100%% width=%*d ptr=%p color=%d", 'x', 6, 7, p, GREEN),
+        "INFO" + prefix + sprintf_str("short=%hd size=%zu bool=%d", (short)-3, sizeof(i), true)
+    };
+    for(auto& l : lines) {
+        SYLAR_LOG_INFO(g_logger) << l;
+    }
+    SYLAR_ASSERT(lines == expect);
+}
+
+// level filtering happens before the binary path, the time stamps come
+// back as wall clock time
+void test_level_time() {
+    auto logger = make_logger("binary", "%d{%s} %m%n");
+    logger->setLevel(sylar::LogLevel::level::WARN);
+    SYLAR_ASSERT(sylar::BinaryLog::Open(s_path));
+    time_t before = time(0);
+    SYLAR_LOG_FMT_INFO(logger, "filtered %d", 1);
+    SYLAR_LOG_FMT_WARN(logger, "kept %d", 2);
+    time_t after = time(0);
+    sylar::BinaryLog::Flush();
+    // a round after the flush finds nothing new
+    SYLAR_LOG_FMT_ERROR(logger, "kept %d", 3);
+    sylar::BinaryLog::Close();
+
+    auto lines = decode();
+    SYLAR_ASSERT(lines.size() == 2);
+    time_t t = atoll(lines[0].c_str());
+    SYLAR_ASSERT(t >= before && t <= after);
+    SYLAR_ASSERT(lines[0].substr(lines[0].find(' ')) == " kept 2");
+    SYLAR_ASSERT(lines[1].substr(lines[1].find(' ')) == " kept 3");
+}
+
+static const int s_threads = 4;
+static const int s_per_thread = 100000;
+
+// records of every thread, each thread's in order, all in time order
+void test_threads() {
+    auto logger = make_logger("binary", "%d{%s}%m%n");
+    SYLAR_ASSERT(sylar::BinaryLog::Open(s_path));
+    std::vector<sylar::Thread::ptr> thrs;
+    for(int i = 0; i < s_threads; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger, i](){
+            for(int n = 0; n < s_per_thread; ++n) {
+                SYLAR_LOG_FMT_INFO(logger, " %d %d %s", i, n, "padding to make the rings wrap");
+            }
+        }, "binary_" + std::to_string(i))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    sylar::BinaryLog::Close();
+    auto stats = sylar::BinaryLog::GetStats();
+    SYLAR_LOG_INFO(g_logger) << stats.toString();
+
+    uint64_t dropped = 0;
+    auto lines = decode(&dropped);
+    SYLAR_ASSERT(dropped == 0);
+    SYLAR_ASSERT(lines.size() == (size_t)s_threads * s_per_thread);
+    std::vector<int> next(s_threads, 0);
+    for(auto& l : lines) {
+        int i = 0;
+        int n = 0;
+        SYLAR_ASSERT(sscanf(l.c_str(), "%*d %d %d", &i, &n) == 2);
+        SYLAR_ASSERT(i >= 0 && i < s_threads && next[i] == n);
+        ++next[i];
+    }
+}
+
+// a full ring in drop mode loses records, the file says how many
+void test_drop() {
+    auto ring_size = sylar::Config::Lookup<uint32_t>("log.binary.ring_size");
+    auto overflow = sylar::Config::Lookup<std::string>("log.binary.overflow");
+    auto interval = sylar::Config::Lookup<uint32_t>("log.binary.flush_interval");
+    ring_size->setValue(4096);
+    overflow->setValue("drop");
+    interval->setValue(1000);
+
+    auto logger = make_logger("binary", "%m%n");
+    SYLAR_ASSERT(sylar::BinaryLog::Open(s_path));
+    auto before = sylar::BinaryLog::GetStats();
+    // rings are sized when the thread first logs
+    sylar::Thread thr([logger](){
+        for(int n = 0; n < 10000; ++n) {
+            SYLAR_LOG_FMT_INFO(logger, "%d", n);
+        }
+    }, "binary_drop");
+    thr.join();
+    sylar::BinaryLog::Close();
+    auto stats = sylar::BinaryLog::GetStats();
+    SYLAR_LOG_INFO(g_logger) << stats.toString();
+
+    uint64_t dropped = 0;
+    auto lines = decode(&dropped);
+    SYLAR_ASSERT(dropped > 0 && dropped == stats.dropped - before.dropped);
+    SYLAR_ASSERT(lines.size() + dropped == 10000);
+
+    ring_size->setValue(1024 * 1024);
+    overflow->setValue("block");
+    interval->setValue(100);
+}
+
+// a small ring in block mode waits for the writer instead
+void test_block() {
+    auto ring_size = sylar::Config::Lookup<uint32_t>("log.binary.ring_size");
+    ring_size->setValue(4096);
+    auto logger = make_logger("binary", "%m%n");
+    SYLAR_ASSERT(sylar::BinaryLog::Open(s_path));
+    auto before = sylar::BinaryLog::GetStats();
+    sylar::Thread thr([logger](){
+        for(int n = 0; n < 10000; ++n) {
+            SYLAR_LOG_FMT_INFO(logger, "%d", n);
+        }
+    }, "binary_block");
+    thr.join();
+    sylar::BinaryLog::Close();
+    auto stats = sylar::BinaryLog::GetStats();
+    SYLAR_LOG_INFO(g_logger) << stats.toString();
+    SYLAR_ASSERT(stats.blocked > before.blocked);
+
+    auto lines = decode();
+    SYLAR_ASSERT(lines.size() == 10000);
+    for(int n = 0; n < 10000; ++n) {
+        SYLAR_ASSERT(lines[n] == std::to_string(n));
+    }
+    ring_size->setValue(1024 * 1024);
+}
+
+// the logs config and log.binary.file turn it on
+void test_yaml() {
+    YAML::Node root = YAML::Load(
+        "log:\n"
+        "  binary:\n"
+        "    file: " + s_path + "\n"
+        "logs:\n"
+        "  - name: binary_yaml\n"
+        "    level: info\n"
+        "    formatter: '%c %m%n'\n"
+        "    binary: true\n");
+    sylar::Config::LoadFromYaml(root);
+    SYLAR_ASSERT(sylar::BinaryLog::IsOpen());
+    auto logger = SYLAR_LOG_NAME("binary_yaml");
+    SYLAR_ASSERT(logger->getBinaryId() != 0);
+    SYLAR_LOG_FMT_INFO(logger, "from %s", "yaml");
+    sylar::Config::LoadFromYaml(YAML::Load("log:\n  binary:\n    file: ''\n"));
+    SYLAR_ASSERT(!sylar::BinaryLog::IsOpen());
+
+    auto lines = decode();
+    SYLAR_ASSERT(lines.size() == 1 && lines[0] == "binary_yaml from yaml");
+}
+
+// cost of a call on the logging thread, against the text path into a
+// file appender
+void bench() {
+    const int rounds = 5;
+    const int n = 200000;
+    auto ring_size = sylar::Config::Lookup<uint32_t>("log.binary.ring_size");
+    auto interval = sylar::Config::Lookup<uint32_t>("log.binary.flush_interval");
+    // a round fits in the ring, the writer only runs between rounds as
+    // this box may have a single cpu
+    ring_size->setValue(16 * 1024 * 1024);
+    interval->setValue(60 * 1000);
+    auto logger = make_logger("binary", "%d{%Y-%m-%d %H:%M:%S} %t %p %c %f:%l %m%n");
+    SYLAR_ASSERT(sylar::BinaryLog::Open(s_path));
+    uint64_t binary_ns = -1;
+    sylar::Thread thr([logger, &binary_ns](){
+        for(int r = 0; r < rounds; ++r) {
+            uint64_t start = sylar::GetCurrentUS();
+            for(int i = 0; i < n; ++i) {
+                SYLAR_LOG_FMT_INFO(logger, "request %d took %lu us from %s", i, (unsigned long)i * 3, "127.0.0.1");
+            }
+            binary_ns = std::min(binary_ns, (sylar::GetCurrentUS() - start) * 1000 / n);
+            sylar::BinaryLog::Flush();
+        }
+    }, "binary_bench");
+    thr.join();
+    sylar::BinaryLog::Close();
+    ring_size->setValue(1024 * 1024);
+    interval->setValue(100);
+    SYLAR_ASSERT(decode().size() == (size_t)rounds * n);
+
+    std::string text_path = s_path + ".txt";
+    logger->setBinary(false);
+    logger->addAppender(sylar::LogAppender::ptr(new sylar::FileLogAppender(text_path)));
+    uint64_t start = sylar::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        SYLAR_LOG_FMT_INFO(logger, "request %d took %lu us from %s", i, (unsigned long)i * 3, "127.0.0.1");
+    }
+    logger->flush();
+    uint64_t text_ns = (sylar::GetCurrentUS() - start) * 1000 / n;
+    unlink(text_path.c_str());
+    SYLAR_LOG_INFO(g_logger) << "binary: " << binary_ns << " ns/record, text: "
+        << text_ns << " ns/record";
+}
+
+int main(int argc, char** argv) {
+    char tmpl[] = "/tmp/sylar_binary_log_XXXXXX";
+    int fd = mkstemp(tmpl);
+    SYLAR_ASSERT(fd >= 0);
+    close(fd);
+    s_path = tmpl;
+
+    test_roundtrip();
+    test_level_time();
+    test_threads();
+    test_drop();
+    test_block();
+    test_yaml();
+    bench();
+    unlink(s_path.c_str());
+    return 0;
+}
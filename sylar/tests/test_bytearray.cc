@@ -0,0 +1,176 @@
+#include "sylar/bytearray.h"
+#include "sylar/sylar.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sstream>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// write random values, read them back, check both match; a tiny block size
+// makes most values straddle two blocks
+void test() {
+#define XX(type, len, write_fun, read_fun, base_len) {\
+    std::vector<type> vec; \
+    for(int i = 0; i < len; ++i) { \
+        vec.push_back((type)(((uint64_t)rand() << 32) | rand()) * (i % 2 ? 1 : -1)); \
+    } \
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(base_len)); \
+    for(auto& i : vec) { \
+        ba->write_fun(i); \
+    } \
+    ba->setPosition(0); \
+    for(size_t i = 0; i < vec.size(); ++i) { \
+        type v = ba->read_fun(); \
+        SYLAR_ASSERT(v == vec[i]); \
+    } \
+    SYLAR_ASSERT(ba->getReadSize() == 0); \
+    SYLAR_LOG_INFO(g_logger) << #write_fun "/" #read_fun \
+                    " (" #type " ) len=" << len \
+                    << " base_len=" << base_len \
+                    << " size=" << ba->getSize(); \
+}
+
+    XX(int8_t,  100, writeFint8, readFint8, 1);
+    XX(uint8_t, 100, writeFuint8, readFuint8, 1);
+    XX(int16_t,  100, writeFint16,  readFint16, 1);
+    XX(uint16_t, 100, writeFuint16, readFuint16, 1);
+    XX(int32_t,  100, writeFint32,  readFint32, 1);
+    XX(uint32_t, 100, writeFuint32, readFuint32, 1);
+    XX(int64_t,  100, writeFint64,  readFint64, 1);
+    XX(uint64_t, 100, writeFuint64, readFuint64, 1);
+
+    XX(int32_t,  100, writeInt32,  readInt32, 1);
+    XX(uint32_t, 100, writeUint32, readUint32, 1);
+    XX(int64_t,  100, writeInt64,  readInt64, 1);
+    XX(uint64_t, 100, writeUint64, readUint64, 1);
+
+    XX(int32_t,  1000, writeInt32,  readInt32, 7);
+    XX(int64_t,  1000, writeInt64,  readInt64, 7);
+    XX(uint64_t, 1000, writeUint64, readUint64, 4096);
+#undef XX
+
+    // zigzag keeps small negatives short
+    sylar::ByteArray ba(16);
+    ba.writeInt32(-1);
+    ba.writeInt64(-64);
+    SYLAR_ASSERT(ba.getSize() == 2);
+    ba.writeFuint32(0x01020304);
+    ba.setPosition(2);
+    SYLAR_ASSERT(ba.readFuint8() == 0x01);
+
+    ba.clear();
+    ba.writeFloat(1.5f);
+    ba.writeDouble(-2.25);
+    ba.writeStringF16("hello");
+    ba.writeStringVint(std::string(100, 'x'));
+    ba.setPosition(0);
+    SYLAR_ASSERT(ba.readFloat() == 1.5f);
+    SYLAR_ASSERT(ba.readDouble() == -2.25);
+    SYLAR_ASSERT(ba.readStringF16() == "hello");
+    SYLAR_ASSERT(ba.readStringVint() == std::string(100, 'x'));
+
+    bool thrown = false;
+    try {
+        ba.readFuint8();
+    } catch(std::out_of_range&) {
+        thrown = true;
+    }
+    SYLAR_ASSERT(thrown);
+}
+
+void test_file() {
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(3));
+    for(int i = 0; i < 1000; ++i) {
+        ba->writeInt64(i * 12345);
+    }
+    ba->setPosition(0);
+    std::string path = "/tmp/test_bytearray.dat";
+    SYLAR_ASSERT(ba->writeToFile(path));
+
+    sylar::ByteArray::ptr ba2(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(ba2->readFromFile(path));
+    ba2->setPosition(0);
+    SYLAR_ASSERT(ba->toString() == ba2->toString());
+    SYLAR_ASSERT(ba->getSize() == ba2->getSize());
+    for(int i = 0; i < 1000; ++i) {
+        SYLAR_ASSERT(ba2->readInt64() == i * 12345);
+    }
+    unlink(path.c_str());
+}
+
+// data goes out and comes back through the iovecs, nothing is copied in
+// user space
+void test_iovec() {
+    int fds[2];
+    SYLAR_ASSERT(!pipe(fds));
+    sylar::ByteArray out(10);
+    for(int i = 0; i < 100; ++i) {
+        out.writeFuint32(i);
+    }
+    out.setPosition(0);
+    std::vector<iovec> iovs;
+    SYLAR_ASSERT(out.getReadBuffers(iovs) == 400);
+    SYLAR_ASSERT(writev(fds[1], &iovs[0], iovs.size()) == 400);
+
+    sylar::ByteArray in(16);
+    iovs.clear();
+    SYLAR_ASSERT(in.getWriteBuffers(iovs, 400) == 400);
+    SYLAR_ASSERT(readv(fds[0], &iovs[0], iovs.size()) == 400);
+    in.setPosition(400);
+    in.setPosition(0);
+    for(int i = 0; i < 100; ++i) {
+        SYLAR_ASSERT(in.readFuint32() == (uint32_t)i);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// the same records through ByteArray and std::stringstream
+void bench() {
+    static const int N = 1000000;
+    uint64_t sum = 0;
+
+    uint64_t t0 = sylar::GetCurrentUS();
+    sylar::ByteArray ba;
+    for(int i = 0; i < N; ++i) {
+        ba.writeInt32(i);
+        ba.writeFuint64(i * 3ull);
+        ba.writeStringVint("abcdef");
+    }
+    uint64_t t1 = sylar::GetCurrentUS();
+    ba.setPosition(0);
+    for(int i = 0; i < N; ++i) {
+        sum += ba.readInt32();
+        sum += ba.readFuint64();
+        sum += ba.readStringVint().size();
+    }
+    uint64_t t2 = sylar::GetCurrentUS();
+
+    std::stringstream ss;
+    std::string str;
+    for(int i = 0; i < N; ++i) {
+        ss << i << ' ' << i * 3ull << ' ' << "abcdef" << ' ';
+    }
+    uint64_t t3 = sylar::GetCurrentUS();
+    for(int i = 0; i < N; ++i) {
+        int32_t a;
+        uint64_t b;
+        ss >> a >> b >> str;
+        sum += a + b + str.size();
+    }
+    uint64_t t4 = sylar::GetCurrentUS();
+
+    SYLAR_LOG_INFO(g_logger) << "records=" << N << " sum=" << sum;
+    SYLAR_LOG_INFO(g_logger) << "ByteArray     encode=" << (t1 - t0) / 1000.0
+        << "ms decode=" << (t2 - t1) / 1000.0 << "ms size=" << ba.getSize();
+    SYLAR_LOG_INFO(g_logger) << "stringstream  encode=" << (t3 - t2) / 1000.0
+        << "ms decode=" << (t4 - t3) / 1000.0 << "ms size=" << ss.str().size();
+}
+
+int main(int argc, char** argv) {
+    test();
+    test_file();
+    test_iovec();
+    bench();
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include "sylar/http/http_connection.h"
+#include "sylar/http/http_server.h"
+#include "sylar/sylar.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+using namespace sylar::http;
+
+static void sleep_ms(uint64_t ms) {
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    sylar::Fiber::ptr self = sylar::Fiber::GetThis();
+    iom->addTimer(ms, [iom, self](){ iom->schedule(self);});
+    sylar::Fiber::YieldToHold();
+}
+
+HttpServer::ptr make_server(sylar::IOManager* iom, bool keepalive) {
+    HttpServer::ptr server(new HttpServer(keepalive, iom, iom));
+    server->getServletDispatch()->addServlet("/hello"
+            , [](HttpRequest& req, HttpResponse& rsp, HttpSession& session){
+        rsp.setBody("hello " + req.getBody().str());
+        return 0;
+    });
+    SYLAR_ASSERT(server->bind(sylar::IPAddress::Create("127.0.0.1", 0)));
+    server->start();
+    return server;
+}
+
+std::string host_of(HttpServer::ptr server) {
+    auto addr = std::dynamic_pointer_cast<sylar::IPAddress>(
+            server->getSocks()[0]->getLocalAddress());
+    return "127.0.0.1:" + std::to_string(addr->getPort());
+}
+
+static const int s_fibers = 8;
+static const int s_requests = 200;
+
+// many fibers share max_total connections, the others wait for them
+void test_limits() {
+    sylar::IOManager iom(2, false, "pool");
+    auto server = make_server(&iom, true);
+    std::string host = host_of(server);
+
+    sylar::ConnectionPool::ptr pool(new sylar::ConnectionPool);
+    pool->setMaxTotal(2);
+    pool->setMaxIdle(2);
+    HttpConnectionPool::ptr client(new HttpConnectionPool(pool));
+
+    std::shared_ptr<std::atomic<int> > left(new std::atomic<int>(s_fibers));
+    for(int f = 0; f < s_fibers; ++f) {
+        iom.schedule([=](){
+            for(int i = 0; i < s_requests; ++i) {
+                auto r = client->doPost(host, "/hello", 3000, {}, "pool");
+                SYLAR_ASSERT2(r->result == HttpResult::Error::OK, r->toString());
+                SYLAR_ASSERT(r->response->getBody() == "hello pool");
+                SYLAR_ASSERT(pool->getTotal(host) <= 2);
+            }
+            if(--*left == 0) {
+                SYLAR_LOG_INFO(g_logger) << pool->toString();
+                SYLAR_ASSERT(pool->getConnectCount() == 2);
+                SYLAR_ASSERT(pool->getIdle(host) == 2);
+                pool->clear();
+                SYLAR_ASSERT(pool->getTotal(host) == 0);
+                server->stop();
+            }
+        });
+    }
+    iom.stop();
+}
+
+// acquire() gives up after its timeout when the host is at max_total
+void test_acquire_timeout() {
+    sylar::IOManager iom(1, false, "pool");
+    auto server = make_server(&iom, true);
+    std::string host = host_of(server);
+
+    sylar::ConnectionPool::ptr pool(new sylar::ConnectionPool);
+    pool->setMaxTotal(1);
+    iom.schedule([=](){
+        auto conn = pool->acquire(host, 100);
+        SYLAR_ASSERT(conn);
+
+        uint64_t start = sylar::GetCurrentMS();
+        SYLAR_ASSERT(!pool->acquire(host, 50));
+        uint64_t used = sylar::GetCurrentMS() - start;
+        SYLAR_ASSERT(used >= 40 && used < 500);
+
+        // released while another fiber waits: the waiter gets it
+        sylar::PooledConnection* raw = conn.get();
+        sylar::IOManager::GetThis()->schedule([conn](){
+            sleep_ms(20);
+        });
+        conn.reset();
+        auto again = pool->acquire(host, 1000);
+        SYLAR_ASSERT(again && again.get() == raw && again->getRequests() == 2);
+        again.reset();
+        SYLAR_ASSERT(pool->getConnectCount() == 1);
+        pool->clear();
+        server->stop();
+    });
+    iom.stop();
+}
+
+// max_requests, idle timeout and server side close all end in a new
+// connection instead of a failed request
+void test_eviction() {
+    sylar::IOManager iom(1, false, "pool");
+    auto server = make_server(&iom, true);
+    auto closing = make_server(&iom, false);
+    std::string host = host_of(server);
+    std::string closing_host = host_of(closing);
+
+    iom.schedule([=](){
+        sylar::ConnectionPool::ptr pool(new sylar::ConnectionPool);
+        HttpConnectionPool client(pool);
+
+        pool->setMaxRequests(3);
+        for(int i = 0; i < 10; ++i) {
+            SYLAR_ASSERT(client.doGet(host, "/hello", 1000)->result == HttpResult::Error::OK);
+        }
+        SYLAR_ASSERT(pool->getConnectCount() == 4);
+
+        pool->setMaxRequests(0);
+        pool->setIdleTimeout(20);
+        SYLAR_ASSERT(client.doGet(host, "/hello", 1000)->result == HttpResult::Error::OK);
+        sleep_ms(50);
+        SYLAR_ASSERT(client.doGet(host, "/hello", 1000)->result == HttpResult::Error::OK);
+        SYLAR_ASSERT(pool->getConnectCount() == 5);
+
+        // Connection: close responses are not pooled
+        for(int i = 0; i < 3; ++i) {
+            auto r = client.doGet(closing_host, "/hello", 1000);
+            SYLAR_ASSERT(r->result == HttpResult::Error::OK && r->response->isClose());
+        }
+        SYLAR_ASSERT(pool->getConnectCount() == 8);
+        SYLAR_ASSERT(pool->getIdle(closing_host) == 0);
+
+        // the peer closed an idle connection, acquire() notices
+        pool->setIdleTimeout(0);
+        auto conn = pool->acquire(host);
+        conn->getSocket()->close();
+        conn.reset();
+        SYLAR_ASSERT(client.doGet(host, "/hello", 1000)->result == HttpResult::Error::OK);
+
+        auto r = client.doGet("127.0.0.1:1", "/hello", 1000);
+        SYLAR_ASSERT(r->result == HttpResult::Error::POOL_GET_CONNECTION);
+        SYLAR_ASSERT(pool->getTotal("127.0.0.1:1") == 0);
+
+        server->stop();
+        closing->stop();
+    });
+    iom.stop();
+}
+
+static const int s_bench = 2000;
+
+// what pooling saves: the same requests with and without connection reuse
+void test_bench() {
+    sylar::IOManager iom(1, false, "pool");
+    auto server = make_server(&iom, true);
+    std::string host = host_of(server);
+
+    iom.schedule([=](){
+        for(int reuse = 0; reuse < 2; ++reuse) {
+            sylar::ConnectionPool::ptr pool(new sylar::ConnectionPool);
+            pool->setMaxIdle(reuse ? 8 : 0);
+            HttpConnectionPool client(pool);
+            uint64_t start = sylar::GetCurrentUS();
+            for(int i = 0; i < s_bench; ++i) {
+                SYLAR_ASSERT(client.doGet(host, "/hello", 1000)->result == HttpResult::Error::OK);
+            }
+            uint64_t used = sylar::GetCurrentUS() - start;
+            SYLAR_LOG_INFO(g_logger) << (reuse ? "pooled" : "new connection each")
+                << " requests=" << s_bench << " connects=" << pool->getConnectCount()
+                << " used=" << used / 1000 << "ms avg=" << used / s_bench << "us";
+        }
+        server->stop();
+    });
+    iom.stop();
+}
+
+int main(int argc, char** argv) {
+    sylar::LoggerMgr::GetInstance()->getLogger("system")->setLevel(sylar::LogLevel::level::FATAL);
+    auto enable = sylar::Config::Lookup<bool>("iomanager.io_uring.enable");
+    bool old = enable->getValue();
+    for(int i = 0; i < 2; ++i) {
+        enable->setValue(i == 0);
+        test_limits();
+        test_acquire_timeout();
+        test_eviction();
+        test_bench();
+    }
+    enable->setValue(old);
+    return 0;
+}
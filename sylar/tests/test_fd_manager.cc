@@ -0,0 +1,94 @@
+#include "sylar/sylar.h"
+#include "sylar/fd_manager.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static bool is_nonblock(int fd) {
+    return fcntl(fd, F_GETFL, 0) & O_NONBLOCK;
+}
+
+// a socket is put in O_NONBLOCK, whether the user asked for it is kept
+void test_socket_nonblock() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    SYLAR_ASSERT(fd >= 0 && !is_nonblock(fd));
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd, true);
+    SYLAR_ASSERT(ctx && ctx->isInit() && ctx->isSocket() && !ctx->isClose());
+    SYLAR_ASSERT(ctx->getSysNonblock() && !ctx->getUserNonblock());
+    SYLAR_ASSERT(is_nonblock(fd));
+    sylar::FdMgr::GetInstance()->del(fd);
+    close(fd);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    SYLAR_ASSERT(fd >= 0);
+    ctx = sylar::FdMgr::GetInstance()->get(fd, true);
+    SYLAR_ASSERT(ctx->getSysNonblock() && ctx->getUserNonblock());
+    SYLAR_ASSERT(is_nonblock(fd));
+    sylar::FdMgr::GetInstance()->del(fd);
+    close(fd);
+}
+
+// anything but a socket is left as it is
+void test_pipe_blocking() {
+    int fds[2];
+    SYLAR_ASSERT(pipe(fds) == 0);
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fds[0], true);
+    SYLAR_ASSERT(ctx && ctx->isInit() && !ctx->isSocket());
+    SYLAR_ASSERT(!ctx->getSysNonblock() && !ctx->getUserNonblock());
+    SYLAR_ASSERT(!is_nonblock(fds[0]));
+    sylar::FdMgr::GetInstance()->del(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void test_timeout() {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    SYLAR_ASSERT(fd >= 0);
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd, true);
+    SYLAR_ASSERT(ctx->getTimeout(SO_RCVTIMEO) == ~0ull);
+    SYLAR_ASSERT(ctx->getTimeout(SO_SNDTIMEO) == ~0ull);
+    ctx->setTimeout(SO_RCVTIMEO, 150);
+    ctx->setTimeout(SO_SNDTIMEO, 250);
+    SYLAR_ASSERT(ctx->getTimeout(SO_RCVTIMEO) == 150);
+    SYLAR_ASSERT(ctx->getTimeout(SO_SNDTIMEO) == 250);
+    // the same context on the next lookup
+    SYLAR_ASSERT(sylar::FdMgr::GetInstance()->get(fd) == ctx);
+    sylar::FdMgr::GetInstance()->del(fd);
+    close(fd);
+}
+
+// a closed fd is forgotten, the number handed out again gets a fresh
+// probe in the same context
+void test_reuse() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    SYLAR_ASSERT(fd >= 0);
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd, true);
+    ctx->setTimeout(SO_RCVTIMEO, 100);
+    sylar::FdMgr::GetInstance()->del(fd);
+    close(fd);
+    SYLAR_ASSERT(ctx->isClose());
+    SYLAR_ASSERT(sylar::FdMgr::GetInstance()->get(fd) == nullptr);
+
+    int fds[2];
+    SYLAR_ASSERT(pipe(fds) == 0);
+    SYLAR_ASSERT(fds[0] == fd);
+    sylar::FdCtx* again = sylar::FdMgr::GetInstance()->get(fd, true);
+    SYLAR_ASSERT(again == ctx);
+    SYLAR_ASSERT(again->isInit() && !again->isClose() && !again->isSocket());
+    SYLAR_ASSERT(again->getTimeout(SO_RCVTIMEO) == ~0ull);
+    SYLAR_ASSERT(!is_nonblock(fd));
+    sylar::FdMgr::GetInstance()->del(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(int argc, char** argv) {
+    test_socket_nonblock();
+    test_pipe_blocking();
+    test_timeout();
+    test_reuse();
+    SYLAR_LOG_INFO(g_logger) << "fd_manager ok";
+    return 0;
+}
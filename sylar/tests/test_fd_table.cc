@@ -0,0 +1,124 @@
+#include "sylar/sylar.h"
+#include "sylar/fd_table.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief Cache line aligned entry, allocated like IOManager::FdContext
+ */
+struct alignas(64) Entry {
+    int fd = 0;
+
+    static void* operator new(size_t size) {
+        void* ptr = nullptr;
+        if(posix_memalign(&ptr, alignof(Entry), size)) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+    static void operator delete(void* ptr) {
+        free(ptr);
+    }
+};
+
+static const size_t s_chunk = 64;
+static const size_t s_chunks = 64;
+typedef sylar::FdTable<Entry, s_chunk, s_chunks> Table;
+
+// nothing exists until it is asked for, and out of range fds never do
+void test_lazy() {
+    Table table;
+    std::atomic<int> created(0);
+    auto create = [&created](int fd) {
+        return [&created, fd](){
+            ++created;
+            Entry* e = new Entry;
+            e->fd = fd;
+            return e;
+        };
+    };
+    SYLAR_ASSERT(!table.get(0) && !table.get(s_chunk * 3));
+    Entry* e = table.getOrCreate(s_chunk * 3 + 1, create(s_chunk * 3 + 1));
+    SYLAR_ASSERT(e && e->fd == (int)s_chunk * 3 + 1 && created == 1);
+    // its chunk is there now, the neighbours still aren't
+    SYLAR_ASSERT(!table.get(s_chunk * 3) && !table.get(0));
+    SYLAR_ASSERT(table.getOrCreate(s_chunk * 3 + 1, create(-1)) == e && created == 1);
+    SYLAR_ASSERT(((uintptr_t)e % 64) == 0);
+
+    SYLAR_ASSERT(!table.get(-1) && !table.get(s_chunk * s_chunks));
+    SYLAR_ASSERT(!table.getOrCreate(-1, create(-1)));
+    SYLAR_ASSERT(!table.getOrCreate(s_chunk * s_chunks, create(-1)));
+    SYLAR_ASSERT(created == 1);
+}
+
+// one thread fills the table chunk after chunk while others look up:
+// they see either nothing or the final entry, which never moves
+void test_grow() {
+    static const int N = s_chunk * s_chunks;
+    Table table;
+    std::vector<std::atomic<Entry*> > seen(N);
+    for(auto& i : seen) {
+        i = nullptr;
+    }
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> hits(0);
+    std::atomic<int> started(0);
+    std::vector<sylar::Thread::ptr> readers;
+    for(int t = 0; t < 3; ++t) {
+        readers.push_back(sylar::Thread::ptr(new sylar::Thread([&, t](){
+            uint64_t n = 0;
+            unsigned seed = t;
+            ++started;
+            while(!stop) {
+                int fd = rand_r(&seed) % N;
+                Entry* e = table.get(fd);
+                if(!e) {
+                    continue;
+                }
+                SYLAR_ASSERT(e->fd == fd && ((uintptr_t)e % 64) == 0);
+                Entry* expect = nullptr;
+                if(!seen[fd].compare_exchange_strong(expect, e)) {
+                    SYLAR_ASSERT(expect == e);
+                }
+                ++n;
+            }
+            hits += n;
+        }, "fd_table_reader")));
+    }
+
+    while(started != 3) {
+        usleep(100);
+    }
+    std::vector<Entry*> entries(N);
+    for(int fd = 0; fd < N; ++fd) {
+        if(fd % s_chunk == 0) {
+            // a new chunk, give the readers time to run into the edge
+            usleep(1000);
+        }
+        entries[fd] = table.getOrCreate(fd, [fd](){
+            Entry* e = new Entry;
+            e->fd = fd;
+            return e;
+        });
+        SYLAR_ASSERT(entries[fd]);
+    }
+    stop = true;
+    for(auto& i : readers) {
+        i->join();
+    }
+    for(int fd = 0; fd < N; ++fd) {
+        SYLAR_ASSERT(table.get(fd) == entries[fd]);
+        SYLAR_ASSERT(!seen[fd] || seen[fd] == entries[fd]);
+    }
+    SYLAR_ASSERT(hits > 0);
+    SYLAR_LOG_INFO(g_logger) << "fd_table grew to " << N << " entries, "
+        << hits << " concurrent hits";
+}
+
+int main(int argc, char** argv) {
+    test_lazy();
+    test_grow();
+    return 0;
+}
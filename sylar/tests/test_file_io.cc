@@ -0,0 +1,115 @@
+#include "sylar/sylar.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::string s_path;
+
+// the syscalls, with the fiber back on its own scheduler afterwards
+void test_ops() {
+    sylar::FileIOPool pool(2);
+    sylar::IOManager iom(2, false, "file_io");
+    iom.schedule([&pool, &iom](){
+        int fd = pool.open(s_path, O_RDWR | O_CREAT | O_TRUNC);
+        SYLAR_ASSERT(fd >= 0);
+        SYLAR_ASSERT(sylar::Scheduler::GetThis() == &iom);
+
+        std::string data(1024 * 1024, 'x');
+        for(size_t i = 0; i < data.size(); ++i) {
+            data[i] = 'a' + i % 26;
+        }
+        SYLAR_ASSERT(pool.write(fd, data.data(), data.size()) == (ssize_t)data.size());
+        SYLAR_ASSERT(pool.pwrite(fd, "0123", 4, 10) == 4);
+        data.replace(10, 4, "0123");
+        SYLAR_ASSERT(pool.fsync(fd) == 0);
+        SYLAR_ASSERT(pool.fdatasync(fd) == 0);
+
+        struct stat st;
+        SYLAR_ASSERT(pool.stat(s_path, &st) == 0 && st.st_size == (off_t)data.size());
+
+        std::string buf(data.size(), '\0');
+        SYLAR_ASSERT(pool.pread(fd, &buf[0], buf.size(), 0) == (ssize_t)buf.size());
+        SYLAR_ASSERT(buf == data);
+        SYLAR_ASSERT(pool.close(fd) == 0);
+        SYLAR_ASSERT(sylar::Scheduler::GetThis() == &iom);
+
+        // errno comes back from the pool thread
+        SYLAR_ASSERT(pool.read(fd, &buf[0], 1) == -1 && errno == EBADF);
+        SYLAR_ASSERT(pool.open(s_path + ".missing", O_RDONLY) == -1 && errno == ENOENT);
+    });
+    iom.stop();
+    auto stats = pool.getStats();
+    SYLAR_LOG_INFO(g_logger) << stats.toString();
+    SYLAR_ASSERT(stats.submitted == 10 && stats.completed == 10 && stats.queueDepth == 0);
+}
+
+static void sleep_ms(uint64_t ms) {
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    sylar::Fiber::ptr self = sylar::Fiber::GetThis();
+    iom->addTimer(ms, [iom, self](){ iom->schedule(self);});
+    sylar::Fiber::YieldToHold();
+}
+
+// slow operations don't hold up the single worker, they queue up on the
+// pool's threads instead
+void test_offload() {
+    sylar::FileIOPool pool(2);
+    sylar::IOManager iom(1, false, "file_io");
+    std::shared_ptr<std::atomic<int> > left(new std::atomic<int>(8));
+    std::shared_ptr<int> ticks(new int(0));
+    uint64_t start = sylar::GetCurrentMS();
+    for(int i = 0; i < 8; ++i) {
+        iom.schedule([&pool, left](){
+            // stands in for a slow disk
+            SYLAR_ASSERT(pool.run([](){ usleep(50 * 1000); return 0;}) == 0);
+            --*left;
+        });
+    }
+    iom.schedule([left, ticks](){
+        while(*left > 0) {
+            sleep_ms(5);
+            ++*ticks;
+        }
+    });
+    iom.stop();
+    uint64_t used = sylar::GetCurrentMS() - start;
+
+    auto stats = pool.getStats();
+    SYLAR_LOG_INFO(g_logger) << "used=" << used << "ms ticks=" << *ticks << " " << stats.toString();
+    // 8 x 50ms on 2 threads
+    SYLAR_ASSERT(used >= 190 && used < 400);
+    SYLAR_ASSERT(*ticks >= 20);
+    SYLAR_ASSERT(stats.maxQueueDepth >= 6);
+    SYLAR_ASSERT(stats.maxWaitUs >= 140 * 1000);
+    SYLAR_ASSERT(stats.maxRunUs >= 50 * 1000);
+}
+
+// outside a scheduler the operation runs in place
+void test_inline() {
+    sylar::FileIOPool pool(1);
+    int tid = sylar::GetThreadId();
+    SYLAR_ASSERT(pool.run([tid](){ return (int64_t)(sylar::GetThreadId() == tid);}) == 1);
+    SYLAR_ASSERT(pool.getStats().submitted == 0);
+}
+
+int main(int argc, char** argv) {
+    char tmpl[] = "/tmp/sylar_file_io_XXXXXX";
+    int fd = mkstemp(tmpl);
+    SYLAR_ASSERT(fd >= 0);
+    close(fd);
+    s_path = tmpl;
+
+    auto enable = sylar::Config::Lookup<bool>("iomanager.io_uring.enable");
+    bool old = enable->getValue();
+    for(int i = 0; i < 2; ++i) {
+        enable->setValue(i == 0);
+        test_ops();
+        test_offload();
+    }
+    enable->setValue(old);
+    test_inline();
+    unlink(s_path.c_str());
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "sylar/http/http_parser.h"
+#include "sylar/sylar.h"
+#include <string.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+using namespace sylar::http;
+
+static const char s_request[] = "POST /path/to/x?a=1&b=2#frag HTTP/1.1\r\n"
+                                "Host: www.sylar.top\r\n"
+                                "Content-Length: 10\r\n"
+                                "X-Test:   spaces around  \r\n"
+                                "\r\n"
+                                "1234567890";
+
+void check_request(HttpRequest& req) {
+    SYLAR_ASSERT(req.getMethod() == HttpMethod::POST);
+    SYLAR_ASSERT(req.getVersion() == 0x11);
+    SYLAR_ASSERT(req.getUri() == "/path/to/x?a=1&b=2#frag");
+    SYLAR_ASSERT(req.getPath() == "/path/to/x");
+    SYLAR_ASSERT(req.getQuery() == "a=1&b=2");
+    SYLAR_ASSERT(req.getFragment() == "frag");
+    SYLAR_ASSERT(req.getHeader("host") == "www.sylar.top");
+    SYLAR_ASSERT(req.getHeader("x-test") == "spaces around");
+    SYLAR_ASSERT(req.getBody() == "1234567890");
+    SYLAR_ASSERT(!req.isClose());
+}
+
+// one byte at a time, the parser has to pick up where it stopped
+void test_partial() {
+    std::string data = s_request;
+    HttpRequestParser parser;
+    for(size_t i = 1; i < data.size(); ++i) {
+        SYLAR_ASSERT(!parser.execute(&data[0], i));
+        SYLAR_ASSERT(!parser.hasError());
+    }
+    SYLAR_ASSERT(parser.execute(&data[0], data.size()));
+    SYLAR_ASSERT(parser.getMessageLength() == data.size());
+    check_request(parser.getRequest());
+
+    // the views point into the buffer, nothing was copied
+    const char* base = data.c_str();
+    auto& req = parser.getRequest();
+    SYLAR_ASSERT(req.getPath().ptr >= base && req.getPath().ptr < base + data.size());
+    SYLAR_ASSERT(req.getBody().ptr == base + data.size() - 10);
+    SYLAR_LOG_INFO(g_logger) << "\n" << req;
+}
+
+// the buffer moves between calls, like a session compacting it
+void test_moved_buffer() {
+    std::string data = s_request;
+    HttpRequestParser parser;
+    std::string a = data.substr(0, 30);
+    SYLAR_ASSERT(!parser.execute(&a[0], a.size()));
+    std::string b = "xxxx" + data;
+    SYLAR_ASSERT(parser.execute(&b[4], data.size()));
+    check_request(parser.getRequest());
+}
+
+void test_chunked() {
+    std::string data = "POST /upload HTTP/1.1\r\n"
+                       "Transfer-Encoding: chunked\r\n"
+                       "\r\n"
+                       "5\r\nhello\r\n"
+                       "7;ext=1\r\n, world\r\n"
+                       "0\r\n"
+                       "Trailer: x\r\n"
+                       "\r\n";
+    size_t len = data.size();
+    std::string copy = data;
+    // fed in pieces of 3 bytes
+    HttpRequestParser parser;
+    for(size_t i = 3; i < len; i += 3) {
+        SYLAR_ASSERT(!parser.execute(&data[0], i));
+        SYLAR_ASSERT(!parser.hasError());
+    }
+    SYLAR_ASSERT(parser.execute(&data[0], len));
+    SYLAR_ASSERT(parser.getMessageLength() == len);
+    SYLAR_ASSERT(parser.getRequest().isChunked());
+    SYLAR_ASSERT(parser.getRequest().getBody() == "hello, world");
+
+    // all at once
+    parser.reset();
+    SYLAR_ASSERT(parser.execute(&copy[0], len));
+    SYLAR_ASSERT(parser.getRequest().getBody() == "hello, world");
+}
+
+void test_pipeline() {
+    std::string data = "GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+                       "GET /b HTTP/1.0\r\n\r\n"
+                       "GET /c HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n"
+                       "GET /d HTTP/1.1\r\nConnection: close\r\n\r\n";
+    const char* paths[] = {"/a", "/b", "/c", "/d"};
+    bool closes[] = {false, true, false, true};
+    HttpRequestParser parser;
+    size_t offset = 0;
+    for(int i = 0; i < 4; ++i) {
+        SYLAR_ASSERT(parser.execute(&data[offset], data.size() - offset));
+        SYLAR_ASSERT(parser.getRequest().getPath() == paths[i]);
+        SYLAR_ASSERT(parser.getRequest().isClose() == closes[i]);
+        offset += parser.getMessageLength();
+        parser.reset();
+    }
+    SYLAR_ASSERT(offset == data.size());
+}
+
+void test_errors() {
+    const char* bad[] = {
+        "FOO / HTTP/1.1\r\n\r\n",
+        "GET / HTTP/2.0\r\n\r\n",
+        "GET  HTTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1\r\nNo colon\r\n\r\n",
+        "GET / HTTP/1.1\r\nA: b\r\n folded\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nabc\r\n",
+    };
+    for(auto s : bad) {
+        std::string data = s;
+        HttpRequestParser parser;
+        SYLAR_ASSERT(!parser.execute(&data[0], data.size()));
+        SYLAR_ASSERT(parser.hasError());
+    }
+
+    std::string big = "GET / HTTP/1.1\r\nX: "
+        + std::string(HttpRequestParser::GetHttpRequestBufferSize(), 'a');
+    HttpRequestParser parser;
+    SYLAR_ASSERT(!parser.execute(&big[0], big.size()));
+    SYLAR_ASSERT(parser.getError() == HttpParser::HEAD_TOO_LARGE);
+
+    std::string large = "POST / HTTP/1.1\r\nContent-Length: 999999999999\r\n\r\n";
+    parser.reset();
+    SYLAR_ASSERT(!parser.execute(&large[0], large.size()));
+    SYLAR_ASSERT(parser.getError() == HttpParser::BODY_TOO_LARGE);
+}
+
+void test_response() {
+    std::string data = "HTTP/1.1 200 OK\r\n"
+                       "Content-Length: 5\r\n"
+                       "Set-Cookie: a=1\r\n"
+                       "\r\n"
+                       "hello"
+                       "HTTP/1.1 404 Not Found\r\n"
+                       "Transfer-Encoding: chunked\r\n"
+                       "\r\n"
+                       "3\r\nabc\r\n0\r\n\r\n"
+                       "HTTP/1.1 204 No Content\r\n\r\n"
+                       "HTTP/1.0 200 OK\r\n\r\n"
+                       "until close";
+    HttpResponseParser parser;
+    size_t offset = 0;
+    SYLAR_ASSERT(parser.execute(&data[offset], data.size() - offset));
+    auto rsp = parser.getResponse();
+    SYLAR_ASSERT(rsp->getStatus() == HttpStatus::OK);
+    SYLAR_ASSERT(rsp->getBody() == "hello");
+    SYLAR_ASSERT(rsp->getHeader("set-cookie") == "a=1");
+    SYLAR_ASSERT(!rsp->isClose());
+    offset += parser.getMessageLength();
+    parser.reset();
+
+    SYLAR_ASSERT(parser.execute(&data[offset], data.size() - offset));
+    rsp = parser.getResponse();
+    SYLAR_ASSERT(rsp->getStatus() == HttpStatus::NOT_FOUND);
+    SYLAR_ASSERT(rsp->getReason() == "Not Found");
+    SYLAR_ASSERT(rsp->getBody() == "abc");
+    offset += parser.getMessageLength();
+    parser.reset();
+
+    SYLAR_ASSERT(parser.execute(&data[offset], data.size() - offset));
+    SYLAR_ASSERT(parser.getResponse()->getStatus() == HttpStatus::NO_CONTENT);
+    offset += parser.getMessageLength();
+    parser.reset();
+
+    // no length, the body ends with the connection
+    SYLAR_ASSERT(!parser.execute(&data[offset], data.size() - offset));
+    SYLAR_ASSERT(!parser.hasError());
+    SYLAR_ASSERT(parser.finishOnEof(&data[offset]));
+    rsp = parser.getResponse();
+    SYLAR_ASSERT(rsp->getBody() == "until close");
+    SYLAR_ASSERT(rsp->isClose());
+
+    // HEAD responses have no body whatever Content-Length says
+    std::string head = "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n";
+    parser.reset();
+    parser.setHeadResponse(true);
+    SYLAR_ASSERT(parser.execute(&head[0], head.size()));
+    SYLAR_ASSERT(parser.getResponse()->getBody().empty());
+}
+
+void test_encode() {
+    HttpResponse rsp(0x11, false);
+    rsp.setHeader("Content-Type", "text/plain");
+    rsp.setHeader("Content-Length", "999");
+    rsp.setBody("hello world");
+    std::string out;
+    rsp.encode(out);
+    SYLAR_LOG_INFO(g_logger) << "\n" << out;
+
+    HttpResponseParser parser;
+    SYLAR_ASSERT(parser.execute(&out[0], out.size()));
+    SYLAR_ASSERT(parser.getResponse()->getBody() == "hello world");
+    SYLAR_ASSERT(parser.getResponse()->getHeader("content-type") == "text/plain");
+
+    rsp.setChunked(true);
+    rsp.setClose(true);
+    out.clear();
+    rsp.encode(out);
+    parser.reset();
+    SYLAR_ASSERT(parser.execute(&out[0], out.size()));
+    SYLAR_ASSERT(parser.getResponse()->getBody() == "hello world");
+    SYLAR_ASSERT(parser.getResponse()->isClose());
+}
+
+int main(int argc, char** argv) {
+    test_partial();
+    test_moved_buffer();
+    test_chunked();
+    test_pipeline();
+    test_errors();
+    test_response();
+    test_encode();
+    SYLAR_LOG_INFO(g_logger) << "test_http_parser ok";
+    return 0;
+}
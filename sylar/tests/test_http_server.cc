@@ -0,0 +1,196 @@
+#include "sylar/http/http_server.h"
+#include "sylar/sylar.h"
+#include <string.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+using namespace sylar::http;
+
+/**
+ * @brief Reads responses off a client socket
+ */
+class ResponseReader {
+public:
+    ResponseReader(sylar::Socket::ptr sock)
+        :m_sock(sock)
+        ,m_buf(64 * 1024)
+        ,m_begin(0)
+        ,m_end(0) {
+    }
+
+    HttpResponse::ptr next() {
+        m_begin += m_parser.getMessageLength();
+        m_parser.reset();
+        while(true) {
+            if(m_end > m_begin && m_parser.execute(&m_buf[m_begin], m_end - m_begin)) {
+                return m_parser.getResponse();
+            }
+            SYLAR_ASSERT(!m_parser.hasError());
+            if(m_end == m_buf.size()) {
+                memmove(&m_buf[0], &m_buf[m_begin], m_end - m_begin);
+                m_end -= m_begin;
+                m_begin = 0;
+            }
+            int rt = m_sock->recv(&m_buf[m_end], m_buf.size() - m_end);
+            if(rt <= 0) {
+                return m_parser.finishOnEof(&m_buf[m_begin]) ? m_parser.getResponse() : nullptr;
+            }
+            m_end += rt;
+        }
+    }
+private:
+    sylar::Socket::ptr m_sock;
+    HttpResponseParser m_parser;
+    std::vector<char> m_buf;
+    size_t m_begin;
+    size_t m_end;
+};
+
+static bool send_all(sylar::Socket::ptr sock, const std::string& data) {
+    size_t offset = 0;
+    while(offset < data.size()) {
+        int rt = sock->send(data.c_str() + offset, data.size() - offset);
+        if(rt <= 0) {
+            return false;
+        }
+        offset += rt;
+    }
+    return true;
+}
+
+HttpServer::ptr make_server(sylar::IOManager* iom) {
+    HttpServer::ptr server(new HttpServer(true, iom, iom));
+    auto sd = server->getServletDispatch();
+    sd->addServlet("/hello", [](HttpRequest& req, HttpResponse& rsp, HttpSession& session){
+        rsp.setHeader("Content-Type", "text/plain");
+        rsp.setBody("hello world");
+        return 0;
+    });
+    sd->addServlet("/echo", [](HttpRequest& req, HttpResponse& rsp, HttpSession& session){
+        rsp.setBody(req.getBody().str());
+        rsp.setChunked(true);
+        return 0;
+    });
+    sd->addGlobServlet("/static/*", [](HttpRequest& req, HttpResponse& rsp, HttpSession& session){
+        rsp.setBody("glob:" + req.getPath().str());
+        return 0;
+    });
+    SYLAR_ASSERT(server->bind(sylar::IPAddress::Create("127.0.0.1", 0)));
+    server->start();
+    return server;
+}
+
+// dispatch, chunked request and response, close handling
+void test_functions() {
+    sylar::IOManager iom(2, false, "http");
+    auto server = make_server(&iom);
+    auto addr = server->getSocks()[0]->getLocalAddress();
+
+    iom.schedule([server, addr](){
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+        SYLAR_ASSERT(sock->connect(addr));
+        ResponseReader reader(sock);
+
+        SYLAR_ASSERT(send_all(sock, "GET /hello HTTP/1.1\r\nHost: x\r\n\r\n"));
+        auto rsp = reader.next();
+        SYLAR_ASSERT(rsp && rsp->getStatus() == HttpStatus::OK);
+        SYLAR_ASSERT(rsp->getBody() == "hello world");
+        SYLAR_ASSERT(rsp->getHeader("server") == server->getName());
+
+        SYLAR_ASSERT(send_all(sock, "GET /static/a/b.css HTTP/1.1\r\n\r\n"));
+        rsp = reader.next();
+        SYLAR_ASSERT(rsp->getBody() == "glob:/static/a/b.css");
+
+        SYLAR_ASSERT(send_all(sock, "GET /nothing HTTP/1.1\r\n\r\n"));
+        rsp = reader.next();
+        SYLAR_ASSERT(rsp->getStatus() == HttpStatus::NOT_FOUND);
+
+        // sent in two pieces to go through a partial parse on the server
+        SYLAR_ASSERT(send_all(sock, "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nbody"));
+        sylar::IOManager* iom = sylar::IOManager::GetThis();
+        sylar::Fiber::ptr self = sylar::Fiber::GetThis();
+        iom->addTimer(20, [iom, self](){ iom->schedule(self);});
+        sylar::Fiber::YieldToHold();
+        SYLAR_ASSERT(send_all(sock, "\r\n0\r\n\r\n"));
+        rsp = reader.next();
+        SYLAR_ASSERT(rsp->getBody() == "body");
+        SYLAR_ASSERT(rsp->isChunked());
+
+        SYLAR_ASSERT(send_all(sock, "GET /hello HTTP/1.1\r\nConnection: close\r\n\r\n"));
+        rsp = reader.next();
+        SYLAR_ASSERT(rsp->isClose());
+        SYLAR_ASSERT(!reader.next());
+        sock->close();
+
+        // garbage gets a 400 and the connection is closed
+        sock = sylar::Socket::CreateTCP(addr);
+        SYLAR_ASSERT(sock->connect(addr));
+        ResponseReader reader2(sock);
+        SYLAR_ASSERT(send_all(sock, "GARBAGE\r\n\r\n"));
+        rsp = reader2.next();
+        SYLAR_ASSERT(rsp && rsp->getStatus() == HttpStatus::BAD_REQUEST);
+        SYLAR_ASSERT(!reader2.next());
+        sock->close();
+
+        server->stop();
+    });
+    iom.stop();
+    SYLAR_ASSERT(server->getConnectionCount() == 0);
+}
+
+static const int s_clients = 8;
+static const int s_requests = 5000;
+static const int s_depth = 16;
+
+// keep-alive clients with s_depth requests in flight each, wrk style
+void test_throughput() {
+    sylar::IOManager iom(1, true, "http");
+    auto server = make_server(&iom);
+    auto addr = server->getSocks()[0]->getLocalAddress();
+
+    std::string batch;
+    for(int i = 0; i < s_depth; ++i) {
+        batch += "GET /hello HTTP/1.1\r\nHost: 127.0.0.1\r\nUser-Agent: test\r\n\r\n";
+    }
+
+    std::shared_ptr<std::atomic<int> > left(new std::atomic<int>(s_clients));
+    uint64_t start = sylar::GetCurrentUS();
+    for(int c = 0; c < s_clients; ++c) {
+        iom.schedule([server, addr, left, batch](){
+            sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+            SYLAR_ASSERT(sock->connect(addr));
+            ResponseReader reader(sock);
+            for(int i = 0; i < s_requests / s_depth; ++i) {
+                SYLAR_ASSERT(send_all(sock, batch));
+                for(int j = 0; j < s_depth; ++j) {
+                    auto rsp = reader.next();
+                    SYLAR_ASSERT(rsp && rsp->getBody() == "hello world");
+                }
+            }
+            sock->close();
+            if(--*left == 0) {
+                server->stop();
+            }
+        });
+    }
+    iom.stop();
+    uint64_t used = sylar::GetCurrentUS() - start;
+    uint64_t total = (uint64_t)s_clients * (s_requests / s_depth) * s_depth;
+    SYLAR_LOG_INFO(g_logger) << "connections=" << s_clients << " depth=" << s_depth
+        << " requests=" << total << " used=" << used / 1000 << "ms"
+        << " qps=" << (uint64_t)(total * 1000000.0 / used);
+}
+
+int main(int argc, char** argv) {
+    sylar::LoggerMgr::GetInstance()->getLogger("system")->setLevel(sylar::LogLevel::level::WARN);
+    auto enable = sylar::Config::Lookup<bool>("iomanager.io_uring.enable");
+    bool old = enable->getValue();
+    for(int i = 0; i < 2; ++i) {
+        enable->setValue(i == 0);
+        SYLAR_LOG_INFO(g_logger) << "io_uring=" << enable->getValue();
+        test_functions();
+        test_throughput();
+    }
+    enable->setValue(old);
+    return 0;
+}
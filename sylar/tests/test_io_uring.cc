@@ -0,0 +1,159 @@
+#include "sylar/sylar.h"
+#include "sylar/iomanager.h"
+#include <atomic>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int s_clients = 8;
+static const int s_rounds = 5000;
+static const size_t s_msg = 64;
+
+static int listen_sock(uint16_t& port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(!bind(fd, (sockaddr*)&addr, sizeof(addr)));
+    SYLAR_ASSERT(!listen(fd, 128));
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static void set_nonblock(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// every client does s_rounds request/response round trips against an
+// echo server, the server side uses the multishot accept/recv helpers
+// when multishot is set
+void bench_echo(bool multishot) {
+    sylar::IOManager iom(2, false, "echo");
+    sylar::IOManager* p = &iom;
+    uint16_t port = 0;
+    int lfd = listen_sock(port);
+    std::atomic<int> done = {0};
+    sylar::Semaphore sem;
+    sylar::IOManager::MultishotAccept::ptr acceptor;
+    if(multishot) {
+        acceptor = iom.acceptMultishot(lfd);
+    }
+
+    iom.schedule([=, &done](){
+        for(int i = 0; i < s_clients; ++i) {
+            int fd = acceptor ? acceptor->accept() : p->accept(lfd);
+            SYLAR_ASSERT(fd >= 0);
+            set_nonblock(fd);
+            p->registerFile(fd);
+            p->schedule([=](){
+                char buf[s_msg];
+                sylar::IOManager::MultishotRecv::ptr rcv;
+                if(multishot) {
+                    rcv = p->recvMultishot(fd);
+                }
+                while(true) {
+                    ssize_t n = rcv ? rcv->recv(buf, sizeof(buf))
+                                    : p->recv(fd, buf, sizeof(buf));
+                    if(n <= 0) {
+                        break;
+                    }
+                    SYLAR_ASSERT(p->send(fd, buf, n) == n);
+                }
+                rcv.reset();
+                p->unregisterFile(fd);
+                close(fd);
+            });
+        }
+    });
+
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int i = 0; i < s_clients; ++i) {
+        iom.schedule([=, &done, &sem](){
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            SYLAR_ASSERT(!p->connect(fd, (sockaddr*)&addr, sizeof(addr)));
+            char out[s_msg];
+            char in[s_msg];
+            memset(out, 'a' + i, sizeof(out));
+            for(int j = 0; j < s_rounds; ++j) {
+                SYLAR_ASSERT(p->write(fd, out, sizeof(out)) == (ssize_t)sizeof(out));
+                size_t got = 0;
+                while(got < sizeof(in)) {
+                    ssize_t n = p->read(fd, in + got, sizeof(in) - got);
+                    SYLAR_ASSERT(n > 0);
+                    got += n;
+                }
+                SYLAR_ASSERT(!memcmp(in, out, sizeof(in)));
+            }
+            close(fd);
+            if(++done == s_clients) {
+                sem.notify();
+            }
+        });
+    }
+    sem.wait();
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "echo io_uring=" << iom.hasIOUring()
+        << " multishot=" << multishot
+        << " round_trips=" << s_clients * s_rounds
+        << " used=" << used / 1000 << "ms"
+        << " rate=" << (uint64_t)(s_clients * s_rounds * 1000000.0 / used) << "/s";
+    if(acceptor) {
+        acceptor->cancel();
+    }
+    iom.stop();
+    close(lfd);
+}
+
+// READ_FIXED/WRITE_FIXED over a pipe through a registered buffer
+void test_fixed() {
+    sylar::IOManager iom(1, false, "fixed");
+    if(!iom.hasIOUring()) {
+        return;
+    }
+    static char buf[4096];
+    std::vector<iovec> iovs(1);
+    iovs[0].iov_base = buf;
+    iovs[0].iov_len = sizeof(buf);
+    SYLAR_ASSERT(!iom.registerBuffers(iovs));
+
+    int fds[2];
+    SYLAR_ASSERT(!pipe(fds));
+    sylar::Semaphore sem;
+    iom.schedule([&](){
+        memcpy(buf, "hello io_uring", 15);
+        SYLAR_ASSERT(iom.writeFixed(fds[1], buf, 15, 0) == 15);
+        memset(buf, 0, sizeof(buf));
+        SYLAR_ASSERT(iom.readFixed(fds[0], buf + 100, 15, 0) == 15);
+        SYLAR_ASSERT(!strcmp(buf + 100, "hello io_uring"));
+        sem.notify();
+    });
+    sem.wait();
+    SYLAR_LOG_INFO(g_logger) << "fixed buffers ok";
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(int argc, char** argv) {
+    sylar::LoggerMgr::GetInstance()->getLogger("system")->setLevel(sylar::LogLevel::level::WARN);
+    auto enable = sylar::Config::Lookup<bool>("iomanager.io_uring.enable");
+    enable->setValue(false);
+    bench_echo(false);
+    enable->setValue(true);
+    bench_echo(false);
+    bench_echo(true);
+    test_fixed();
+    return 0;
+}
@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -43,7 +44,133 @@ void test1() {
     iom.schedule(&test_fiber);
 }
 
+void test_per_thread_epoll() {
+    sylar::Config::Lookup<bool>("iomanager.per_thread_epoll")->setValue(true);
+    static const int N = 8;
+    static int fds[N][2];
+    sylar::IOManager iom(3, false, "sharded");
+    std::atomic<int> resumed = {0};
+    for(int i = 0; i < N; ++i) {
+        SYLAR_ASSERT(pipe(fds[i]) == 0);
+        fcntl(fds[i][0], F_SETFL, O_NONBLOCK);
+        iom.schedule([i, &iom, &resumed](){
+            int fd = fds[i][0];
+            int before = sylar::GetThreadId();
+            sylar::IOManager::GetThis()->addEvent(fd, sylar::IOManager::READ);
+            sylar::Fiber::YieldToHold();
+            char c;
+            SYLAR_ASSERT(read(fd, &c, 1) == 1);
+            // every fd resumes on the thread owning its shard
+            int owner = iom.getOwnerThread(fd);
+            SYLAR_LOG_INFO(g_logger) << "fd=" << fd << " owner=" << owner
+                << " added on " << before << " resumed on " << sylar::GetThreadId();
+            SYLAR_ASSERT(owner != -1 && owner == sylar::GetThreadId());
+            close(fds[i][0]);
+            close(fds[i][1]);
+            ++resumed;
+        });
+    }
+    for(int i = 0; i < N; ++i) {
+        SYLAR_ASSERT(write(fds[i][1], "x", 1) == 1);
+    }
+    while(resumed != N) {
+        usleep(1000);
+    }
+    sylar::Config::Lookup<bool>("iomanager.per_thread_epoll")->setValue(false);
+}
+
+// lots of fds become ready at once: the batch should grow to take them in
+// a few epoll_wait calls, and the stats should show it
+void test_epoll_batch() {
+    static const int N = 1000;
+    sylar::IOManager iom(1, false, "batch");
+    std::vector<int> fds;
+    for(int i = 0; i < N; ++i) {
+        fds.push_back(eventfd(1, EFD_NONBLOCK));
+    }
+    std::atomic<int> fired = {0};
+    sylar::Semaphore sem;
+    iom.schedule([&](){
+        // all of them are readable already, they're reported together
+        // once this task is done and the thread goes back to epoll_wait
+        for(int fd : fds) {
+            sylar::IOManager::GetThis()->addEvent(fd, sylar::IOManager::READ, [&](){
+                if(++fired == N) {
+                    sem.notify();
+                }
+            });
+        }
+    });
+    sem.wait();
+    sylar::IOManager::EpollStats stats = iom.getEpollStats();
+    SYLAR_LOG_INFO(g_logger) << "epoll batch " << stats.toString();
+    SYLAR_ASSERT(stats.grows > 0);
+    for(int fd : fds) {
+        close(fd);
+    }
+}
+
+// ping-pong over two pipes in every registration mode, the epoll_ctl
+// counts show what each mode costs per wait
+void test_epoll_modes() {
+    static const int N = 10000;
+    auto mode = sylar::Config::Lookup<std::string>("iomanager.epoll.mode");
+    auto uring = sylar::Config::Lookup<bool>("iomanager.io_uring.enable");
+    bool uring_enabled = uring->getValue();
+    uring->setValue(false);
+    std::map<std::string, sylar::IOManager::EpollStats> stats;
+    for(auto& m : {"classic", "persistent", "oneshot"}) {
+        mode->setValue(m);
+        sylar::IOManager iom(2, false, m);
+        int ping[2];
+        int pong[2];
+        pipe2(ping, O_NONBLOCK);
+        pipe2(pong, O_NONBLOCK);
+        sylar::Semaphore sem;
+        uint64_t begin = sylar::GetCurrentUS();
+        iom.schedule([&](){
+            char c = 0;
+            for(int i = 0; i < N; ++i) {
+                SYLAR_ASSERT(iom.write(ping[1], &c, 1) == 1);
+                SYLAR_ASSERT(iom.read(pong[0], &c, 1) == 1);
+            }
+            sem.notify();
+        });
+        iom.schedule([&](){
+            char c = 0;
+            for(int i = 0; i < N; ++i) {
+                SYLAR_ASSERT(iom.read(ping[0], &c, 1) == 1);
+                SYLAR_ASSERT(iom.write(pong[1], &c, 1) == 1);
+            }
+        });
+        sem.wait();
+        uint64_t used = sylar::GetCurrentUS() - begin;
+        stats[m] = iom.getEpollStats();
+        SYLAR_LOG_INFO(g_logger) << "mode=" << m << " rounds=" << N
+            << " used=" << used / 1000 << "ms " << stats[m].toString();
+        for(int fd : {ping[0], ping[1], pong[0], pong[1]}) {
+            iom.cancelAll(fd);
+            close(fd);
+        }
+    }
+    mode->setValue("classic");
+    uring->setValue(uring_enabled);
+
+    // persistent registers each fd once and keeps it, oneshot re-arms with
+    // MOD; neither deletes per wait the way classic does
+    auto ctl = [](const sylar::IOManager::EpollStats& s) {
+        return s.ctlAdd + s.ctlMod + s.ctlDel;
+    };
+    SYLAR_ASSERT(stats["classic"].ctlDel > 0);
+    SYLAR_ASSERT(stats["persistent"].ctlDel == 0);
+    SYLAR_ASSERT(ctl(stats["persistent"]) * 100 < ctl(stats["classic"]));
+    SYLAR_ASSERT(stats["oneshot"].ctlDel == 0);
+}
+
 int main(int argc, char** argv) {
     test1();
+    test_per_thread_epoll();
+    test_epoll_batch();
+    test_epoll_modes();
     return 0;
 }
\ No newline at end of file
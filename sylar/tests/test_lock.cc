@@ -0,0 +1,108 @@
+#include "sylar/sylar.h"
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int s_threads = 4;
+static const int s_per_thread = 200000;
+
+// increments that aren't atomic only add up under a working lock
+template<class MutexType>
+void test_exclusion(const char* name) {
+    MutexType mutex;
+    mutex.enableStats(name);
+    // two words, a torn update shows up as a mismatch
+    volatile uint64_t a = 0;
+    volatile uint64_t b = 0;
+    std::vector<sylar::Thread::ptr> thrs;
+    for(int i = 0; i < s_threads; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([&mutex, &a, &b](){
+            for(int n = 0; n < s_per_thread; ++n) {
+                typename MutexType::Lock lock(mutex);
+                SYLAR_ASSERT(a == b);
+                a = a + 1;
+                b = b + 1;
+            }
+        }, std::string(name) + "_" + std::to_string(i))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    auto stats = mutex.getStats();
+    SYLAR_LOG_INFO(g_logger) << stats->toString();
+    SYLAR_ASSERT(a == (uint64_t)s_threads * s_per_thread && b == a);
+    SYLAR_ASSERT(stats->acquisitions == a);
+}
+
+// a waiter gets the lock once it is released, and its wait is counted
+template<class MutexType>
+void test_wait(const char* name) {
+    MutexType mutex;
+    mutex.enableStats(name);
+    mutex.lock();
+    SYLAR_ASSERT(!mutex.tryLock());
+    std::atomic<bool> got(false);
+    sylar::Thread thr([&mutex, &got](){
+        typename MutexType::Lock lock(mutex);
+        got = true;
+    }, name);
+    usleep(50 * 1000);
+    SYLAR_ASSERT(!got);
+    mutex.unlock();
+    thr.join();
+    SYLAR_ASSERT(got);
+    SYLAR_ASSERT(mutex.tryLock());
+    mutex.unlock();
+
+    auto stats = mutex.getStats();
+    SYLAR_LOG_INFO(g_logger) << stats->toString();
+    SYLAR_ASSERT(stats->acquisitions == 3 && stats->contended == 1);
+    // the waiter slept instead of burning the cpu for 50ms
+    SYLAR_ASSERT(stats->sleeps >= 1);
+    SYLAR_ASSERT(stats->waitNs >= 40 * 1000 * 1000);
+}
+
+// GetAll() lists what has stats, most wait first, and forgets dead locks
+void test_registry() {
+    sylar::Spinlock quiet;
+    quiet.enableStats("registry.quiet");
+    {
+        sylar::AdaptiveMutex gone;
+        gone.enableStats("registry.gone");
+    }
+    sylar::AdaptiveMutex busy;
+    busy.enableStats("registry.busy");
+    busy.getStats()->waitNs = 1000000;
+    auto all = sylar::LockStats::GetAll();
+    std::vector<std::string> names;
+    for(auto& i : all) {
+        names.push_back(i->name);
+    }
+    SYLAR_ASSERT(names.size() == 2 && names[0] == "registry.busy" && names[1] == "registry.quiet");
+}
+
+// uncontended lock()/unlock() pairs
+template<class MutexType>
+void bench(const char* name) {
+    const int n = 10000000;
+    MutexType mutex;
+    uint64_t start = sylar::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        mutex.lock();
+        mutex.unlock();
+    }
+    uint64_t used = sylar::GetCurrentUS() - start;
+    SYLAR_LOG_INFO(g_logger) << name << ": " << used * 1000.0 / n << " ns per lock/unlock";
+}
+
+int main(int argc, char** argv) {
+    test_exclusion<sylar::Spinlock>("spinlock");
+    test_exclusion<sylar::AdaptiveMutex>("adaptive");
+    test_wait<sylar::Spinlock>("spinlock_wait");
+    test_wait<sylar::AdaptiveMutex>("adaptive_wait");
+    test_registry();
+    bench<sylar::Spinlock>("Spinlock");
+    bench<sylar::AdaptiveMutex>("AdaptiveMutex");
+    bench<sylar::Mutex>("Mutex");
+    return 0;
+}
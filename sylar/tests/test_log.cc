@@ -0,0 +1,832 @@
+#include "sylar/sylar.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <dirent.h>
+#include <sys/time.h>
+#include <yaml-cpp/yaml.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// heap allocations made by this thread
+static thread_local uint64_t t_allocs = 0;
+
+void* operator new(size_t size) {
+    ++t_allocs;
+    void* p = malloc(size ? size : 1);
+    if(!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// this is the matching deallocation for the operator new above
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept {
+    free(p);
+}
+#pragma GCC diagnostic pop
+
+/**
+ * @brief Collects what it is given, taking delay ms per write() or log()
+ */
+class MemoryAppender : public sylar::LogAppender {
+public:
+    typedef std::shared_ptr<MemoryAppender> ptr;
+
+    MemoryAppender(uint32_t delay = 0)
+        :m_delay(delay) {
+    }
+
+    void log(std::shared_ptr<sylar::Logger> logger, sylar::LogLevel::level level
+             ,sylar::LogEvent::ptr event) override {
+        std::string str = m_formatter->format(logger, level, event);
+        if(m_delay) {
+            usleep(m_delay * 1000);
+        }
+        std::lock_guard<std::mutex> lock(m_dataMutex);
+        m_data += str;
+    }
+
+    void write(const iovec* iov, int iovcnt) override {
+        if(m_delay) {
+            usleep(m_delay * 1000);
+        }
+        std::lock_guard<std::mutex> lock(m_dataMutex);
+        for(int i = 0; i < iovcnt; ++i) {
+            m_data.append((const char*)iov[i].iov_base, iov[i].iov_len);
+        }
+        ++m_writes;
+    }
+
+    std::string toYamlString() override { return "type: MemoryAppender";}
+
+    std::string data() {
+        std::lock_guard<std::mutex> lock(m_dataMutex);
+        return m_data;
+    }
+
+    size_t lines() {
+        std::string d = data();
+        return std::count(d.begin(), d.end(), '\n');
+    }
+
+    uint64_t writes() const { return m_writes;}
+private:
+    uint32_t m_delay;
+    std::mutex m_dataMutex;
+    std::string m_data;
+    std::atomic<uint64_t> m_writes = {0};
+};
+
+/**
+ * @brief Keeps every event it is given, to look at later
+ */
+class KeepAppender : public sylar::LogAppender {
+public:
+    typedef std::shared_ptr<KeepAppender> ptr;
+
+    void log(std::shared_ptr<sylar::Logger> logger, sylar::LogLevel::level level
+             ,sylar::LogEvent::ptr event) override {
+        m_events.push_back(event);
+    }
+    void write(const iovec* iov, int iovcnt) override {}
+    std::string toYamlString() override { return "type: KeepAppender";}
+
+    const std::vector<sylar::LogEvent::ptr>& events() const { return m_events;}
+private:
+    std::vector<sylar::LogEvent::ptr> m_events;
+};
+
+static sylar::Logger::ptr make_logger(sylar::LogAppender::ptr appender) {
+    sylar::Logger::ptr logger(new sylar::Logger("test_log"));
+    logger->setFormatter("%m%n");
+    logger->addAppender(appender);
+    return logger;
+}
+
+static std::string temp_file() {
+    char tmpl[] = "/tmp/sylar_log_XXXXXX";
+    int fd = mkstemp(tmpl);
+    SYLAR_ASSERT(fd >= 0);
+    close(fd);
+    return tmpl;
+}
+
+static const int s_threads = 4;
+static const int s_per_thread = 50000;
+
+// many threads into one file: every record once, each thread's in order
+void test_file() {
+    std::string path = temp_file();
+    {
+        sylar::AsyncLogAppender::ptr async(new sylar::AsyncLogAppender(
+                    sylar::LogAppender::ptr(new sylar::FileLogAppender(path))
+                    ,sylar::AsyncLogAppender::Overflow::BLOCK, 64 * 1024, 4));
+        auto logger = make_logger(async);
+        std::vector<sylar::Thread::ptr> thrs;
+        for(int t = 0; t < s_threads; ++t) {
+            thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger, t](){
+                for(int i = 0; i < s_per_thread; ++i) {
+                    SYLAR_LOG_INFO(logger) << t << " " << i;
+                }
+            }, "log_" + std::to_string(t))));
+        }
+        for(auto& i : thrs) {
+            i->join();
+        }
+        SYLAR_LOG_INFO(g_logger) << "records=" << async->getRecords()
+            << " batches=" << async->getBatches() << " blocked=" << async->getBlocked();
+        SYLAR_ASSERT(async->getRecords() == s_threads * s_per_thread);
+        SYLAR_ASSERT(async->getDropped() == 0);
+        // the destructor writes out the rest
+    }
+
+    std::ifstream ifs(path);
+    std::vector<int> next(s_threads, 0);
+    int t, i, lines = 0;
+    while(ifs >> t >> i) {
+        SYLAR_ASSERT(t >= 0 && t < s_threads);
+        SYLAR_ASSERT(i == next[t]);
+        ++next[t];
+        ++lines;
+    }
+    SYLAR_ASSERT(lines == s_threads * s_per_thread);
+    unlink(path.c_str());
+}
+
+static const int s_burst = 20000;
+
+// a writer that can't keep up: DROP loses records but never waits, and
+// says how many it lost
+void test_drop() {
+    MemoryAppender::ptr slow(new MemoryAppender(20));
+    uint64_t start = sylar::GetCurrentMS();
+    {
+        sylar::AsyncLogAppender::ptr async(new sylar::AsyncLogAppender(slow
+                    ,sylar::AsyncLogAppender::Overflow::DROP, 4096, 2, 10));
+        auto logger = make_logger(async);
+        for(int i = 0; i < s_burst; ++i) {
+            SYLAR_LOG_INFO(logger) << "record " << i;
+        }
+        uint64_t used = sylar::GetCurrentMS() - start;
+        SYLAR_LOG_INFO(g_logger) << "drop: records=" << async->getRecords()
+            << " dropped=" << async->getDropped() << " used=" << used << "ms";
+        SYLAR_ASSERT(async->getDropped() > 0);
+        SYLAR_ASSERT(async->getBlocked() == 0);
+        SYLAR_ASSERT(async->getRecords() + async->getDropped() == s_burst);
+        SYLAR_ASSERT(used < 200);
+
+        async->flush();
+        // a notice after every round that dropped some
+        std::stringstream ss(slow->data());
+        std::string line;
+        uint64_t records = 0, notices = 0;
+        while(std::getline(ss, line)) {
+            if(line.find("record ") == 0) {
+                ++records;
+            } else {
+                SYLAR_ASSERT(line.find("AsyncLogAppender dropped ") == 0);
+                ++notices;
+            }
+        }
+        SYLAR_ASSERT(records == async->getRecords());
+        SYLAR_ASSERT(notices > 0);
+    }
+}
+
+// the same writer with BLOCK: the caller is held up, nothing is lost
+void test_block() {
+    MemoryAppender::ptr slow(new MemoryAppender(5));
+    {
+        sylar::AsyncLogAppender::ptr async(new sylar::AsyncLogAppender(slow
+                    ,sylar::AsyncLogAppender::Overflow::BLOCK, 4096, 2, 10));
+        auto logger = make_logger(async);
+        for(int i = 0; i < s_burst; ++i) {
+            SYLAR_LOG_INFO(logger) << "record " << i;
+        }
+        SYLAR_LOG_INFO(g_logger) << "block: records=" << async->getRecords()
+            << " blocked=" << async->getBlocked() << " batches=" << async->getBatches();
+        SYLAR_ASSERT(async->getDropped() == 0);
+        SYLAR_ASSERT(async->getBlocked() > 0);
+        SYLAR_ASSERT(async->getRecords() == s_burst);
+    }
+    SYLAR_ASSERT(slow->lines() == s_burst);
+    std::string data = slow->data();
+    SYLAR_ASSERT(data.find("record 0\n") == 0);
+    SYLAR_ASSERT(data.find("record 19999\n") == data.size() - 13);
+}
+
+// a FATAL record is written before the call returns, the ones before it
+// with it
+void test_fatal() {
+    MemoryAppender::ptr mem(new MemoryAppender);
+    sylar::AsyncLogAppender::ptr async(new sylar::AsyncLogAppender(mem
+                ,sylar::AsyncLogAppender::Overflow::BLOCK, 0, 0, 10000));
+    auto logger = make_logger(async);
+    SYLAR_LOG_INFO(logger) << "before";
+    SYLAR_ASSERT(mem->lines() == 0);
+    SYLAR_LOG_FATAL(logger) << "fatal";
+    SYLAR_ASSERT(mem->data() == "before\nfatal\n");
+    SYLAR_ASSERT(mem->writes() == 1);
+}
+
+// a quiet logger still gets written within flush_interval
+void test_interval() {
+    MemoryAppender::ptr mem(new MemoryAppender);
+    sylar::AsyncLogAppender::ptr async(new sylar::AsyncLogAppender(mem
+                ,sylar::AsyncLogAppender::Overflow::BLOCK, 0, 0, 20));
+    auto logger = make_logger(async);
+    SYLAR_LOG_INFO(logger) << "quiet";
+    usleep(200 * 1000);
+    SYLAR_ASSERT(mem->data() == "quiet\n");
+}
+
+// "async: true" in the logs config wraps the appender
+void test_yaml() {
+    std::string path = temp_file();
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "  - name: async_test\n"
+        "    level: info\n"
+        "    formatter: '%m%n'\n"
+        "    appenders:\n"
+        "      - type: FileLogAppender\n"
+        "        file: " + path + "\n"
+        "        async: true\n"
+        "        overflow: drop\n");
+    sylar::Config::LoadFromYaml(root);
+    auto logger = SYLAR_LOG_NAME("async_test");
+    std::string yaml = logger->ToYamlString();
+    SYLAR_LOG_INFO(g_logger) << yaml;
+    SYLAR_ASSERT(yaml.find("async: true") != std::string::npos);
+    SYLAR_ASSERT(yaml.find("overflow: drop") != std::string::npos);
+
+    SYLAR_LOG_INFO(logger) << "from yaml";
+    logger->flush();
+    std::ifstream ifs(path);
+    std::string line;
+    SYLAR_ASSERT(std::getline(ifs, line) && line == "from yaml");
+    logger->clearAppenders();
+    unlink(path.c_str());
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static std::vector<std::string> list_dir(const std::string& dir) {
+    std::vector<std::string> names;
+    DIR* d = opendir(dir.c_str());
+    while(dirent* e = readdir(d)) {
+        if(e->d_name[0] != '.') {
+            names.push_back(e->d_name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+static std::string temp_dir() {
+    char tmpl[] = "/tmp/sylar_log_dir_XXXXXX";
+    SYLAR_ASSERT(mkdtemp(tmpl));
+    return tmpl;
+}
+
+static void remove_dir(const std::string& dir) {
+    for(auto& i : list_dir(dir)) {
+        unlink((dir + "/" + i).c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+// an existing file is appended to, not truncated
+void test_append() {
+    std::string path = temp_file();
+    {
+        std::ofstream ofs(path);
+        ofs << "old\n";
+    }
+    {
+        sylar::FileLogAppender::ptr file(new sylar::FileLogAppender(path));
+        auto logger = make_logger(file);
+        SYLAR_LOG_INFO(logger) << "new";
+        SYLAR_ASSERT(file->reopen());
+        SYLAR_LOG_INFO(logger) << "after reopen";
+    }
+    SYLAR_ASSERT(read_file(path) == "old\nnew\nafter reopen\n");
+    unlink(path.c_str());
+}
+
+// size rotation keeps each file under max_size and only max_files of them
+void test_rotate_size() {
+    std::string dir = temp_dir();
+    std::string path = dir + "/app.log";
+    {
+        // not rotated away: another appender's file next to it
+        std::ofstream ofs(path + ".err");
+        ofs << "keep\n";
+    }
+    {
+        sylar::FileLogAppender::ptr file(new sylar::FileLogAppender(path));
+        file->setRotate(sylar::FileLogAppender::Rotate::SIZE, 1000, 3);
+        auto logger = make_logger(file);
+        for(int i = 0; i < 200; ++i) {
+            SYLAR_LOG_INFO(logger) << "size rotation record " << i;
+        }
+        SYLAR_LOG_INFO(g_logger) << file->toYamlString();
+    }
+
+    auto names = list_dir(dir);
+    SYLAR_ASSERT(names.size() == 5);
+    SYLAR_ASSERT(std::find(names.begin(), names.end(), "app.log.err") != names.end());
+    std::string all;
+    for(auto& i : names) {
+        if(i == "app.log.err") {
+            continue;
+        }
+        std::string data = read_file(dir + "/" + i);
+        SYLAR_ASSERT(data.size() <= 1000);
+        if(i != "app.log") {
+            all += data;
+        }
+    }
+    // the newest records survive, in order
+    all += read_file(path);
+    SYLAR_ASSERT(all.size() >= 2000);
+    SYLAR_ASSERT(all.find("size rotation record 199\n") == all.size() - 25);
+    remove_dir(dir);
+}
+
+// a file left from yesterday is rotated under yesterday's name
+void test_rotate_daily() {
+    std::string dir = temp_dir();
+    std::string path = dir + "/app.log";
+    time_t yesterday = time(0) - 24 * 3600;
+    {
+        std::ofstream ofs(path);
+        ofs << "yesterday\n";
+    }
+    struct timeval tv[2] = {{yesterday, 0}, {yesterday, 0}};
+    SYLAR_ASSERT(utimes(path.c_str(), tv) == 0);
+    {
+        sylar::FileLogAppender::ptr file(new sylar::FileLogAppender(path));
+        file->setRotate(sylar::FileLogAppender::Rotate::DAILY);
+        auto logger = make_logger(file);
+        SYLAR_LOG_INFO(logger) << "today";
+        SYLAR_LOG_INFO(logger) << "today again";
+    }
+    struct tm tm;
+    localtime_r(&yesterday, &tm);
+    char name[64];
+    strftime(name, sizeof(name), "app.log.%Y%m%d", &tm);
+    SYLAR_ASSERT(read_file(dir + "/" + name) == "yesterday\n");
+    SYLAR_ASSERT(read_file(path) == "today\ntoday again\n");
+    remove_dir(dir);
+}
+
+// logrotate moving the file away is noticed within check_interval
+void test_external_rotate() {
+    auto interval = sylar::Config::Lookup<uint32_t>("log.file.check_interval");
+    uint32_t old = interval->getValue();
+    interval->setValue(0);
+    std::string dir = temp_dir();
+    std::string path = dir + "/app.log";
+    {
+        sylar::FileLogAppender::ptr file(new sylar::FileLogAppender(path));
+        auto logger = make_logger(file);
+        SYLAR_LOG_ERROR(logger) << "before";
+        SYLAR_ASSERT(rename(path.c_str(), (path + ".1").c_str()) == 0);
+        SYLAR_LOG_ERROR(logger) << "after";
+    }
+    SYLAR_ASSERT(read_file(path + ".1") == "before\n");
+    SYLAR_ASSERT(read_file(path) == "after\n");
+    remove_dir(dir);
+    interval->setValue(old);
+}
+
+// what LogStream writes directly matches std::ostream, the rest still
+// goes through it
+void test_stream() {
+    sylar::LogStream ss(4);
+    ss << "a" << std::string("bc") << 'd' << (short)-5 << (unsigned short)6
+       << -2147483647 - 1 << 4294967295u << -9223372036854775807L - 1
+       << 18446744073709551615ull << (unsigned char)'e' << 1.5 << true;
+    std::stringstream ref;
+    ref << "a" << std::string("bc") << 'd' << (short)-5 << (unsigned short)6
+        << -2147483647 - 1 << 4294967295u << -9223372036854775807L - 1
+        << 18446744073709551615ull << (unsigned char)'e' << 1.5 << true;
+    SYLAR_ASSERT(ss.str() == ref.str());
+
+    ss.reset();
+    ss << std::hex << 255 << " " << std::setw(4) << 7 << "|" << std::setw(3) << "x";
+    SYLAR_ASSERT(ss.str() == "ff    7|  x");
+    // reset() brings the flags back
+    ss.reset();
+    ss << 255 << std::endl;
+    SYLAR_ASSERT(ss.str() == "255\n");
+
+    std::string big(5000, 'z');
+    ss.reset();
+    auto fmt = [&ss](const char* f, ...) {
+        va_list al;
+        va_start(al, f);
+        ss.format(f, al);
+        va_end(al);
+    };
+    fmt("%s-%d", big.c_str(), 42);
+    SYLAR_ASSERT(ss.str() == big + "-42");
+}
+
+// once warm, a log line allocates nothing in the calling thread
+void test_zero_alloc() {
+    sylar::FileLogAppender::ptr file(new sylar::FileLogAppender("/dev/null"));
+    sylar::Logger::ptr logger(new sylar::Logger("zero_alloc"));
+    logger->addAppender(file);
+    sylar::Logger::ptr json(new sylar::Logger("zero_alloc_json"));
+    json->setFormatter("json");
+    json->addAppender(file);
+    std::string name = "a string longer than the small string buffer";
+    auto run = [&](int n) {
+        for(int i = 0; i < n; ++i) {
+            SYLAR_LOG_INFO(logger) << "zero alloc " << i << " " << name << " " << 2.5 << " " << (void*)&name;
+            SYLAR_LOG_FMT_WARN(logger, "fmt %d %s", i, name.c_str());
+            SYLAR_LOG_INFO(json).kv("i", i).kv("name", name).kv("ratio", 2.5) << "zero \"alloc\"";
+        }
+    };
+    run(1000);
+    uint64_t before = t_allocs;
+    run(100000);
+    uint64_t allocs = t_allocs - before;
+    SYLAR_LOG_INFO(g_logger) << "allocations in 300000 records: " << allocs;
+    SYLAR_ASSERT(allocs == 0);
+}
+
+static std::string strftime_str(const char* fmt, time_t t) {
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char buf[128];
+    return std::string(buf, strftime(buf, sizeof(buf), fmt, &tm));
+}
+
+static std::string format_at(sylar::LogFormatter::ptr fmt, time_t sec, uint32_t usec) {
+    sylar::Logger::ptr logger(new sylar::Logger("datetime"));
+    sylar::LogEvent::ptr event(new sylar::LogEvent(logger, sylar::LogLevel::level::INFO
+                , __FILE__, __LINE__, 0, 0, 0, sec, "main"));
+    event->reset(logger, sylar::LogLevel::level::INFO, __FILE__, __LINE__, 0, 0, 0, sec, "main", usec);
+    return fmt->format(logger, sylar::LogLevel::level::INFO, event);
+}
+
+// %d with fractions, and the per-thread cache following the time
+void test_datetime() {
+    time_t t = 1700000000;
+    sylar::LogFormatter::ptr fmt(new sylar::LogFormatter("%d{%Y-%m-%d %H:%M:%S.%3N}|%d{%6N %N %%N %S}"));
+    SYLAR_ASSERT(!fmt->isError());
+    SYLAR_ASSERT(format_at(fmt, t, 123456)
+            == strftime_str("%Y-%m-%d %H:%M:%S", t) + ".123|123456 123456000 %N " + strftime_str("%S", t));
+    SYLAR_ASSERT(format_at(fmt, t, 7)
+            == strftime_str("%Y-%m-%d %H:%M:%S", t) + ".000|000007 000007000 %N " + strftime_str("%S", t));
+    SYLAR_ASSERT(format_at(fmt, t + 61, 999999)
+            == strftime_str("%Y-%m-%d %H:%M:%S", t + 61) + ".999|999999 999999000 %N " + strftime_str("%S", t + 61));
+
+    // more items than cache slots, used in turn
+    std::vector<sylar::LogFormatter::ptr> fmts;
+    for(int i = 0; i < 9; ++i) {
+        fmts.push_back(sylar::LogFormatter::ptr(new sylar::LogFormatter(
+                        "%d{" + std::to_string(i) + " %H:%M:%S}")));
+    }
+    for(int round = 0; round < 3; ++round) {
+        for(int i = 0; i < 9; ++i) {
+            time_t at = t + round * 3600 + i;
+            SYLAR_ASSERT(format_at(fmts[i], at, 0) == std::to_string(i) + strftime_str(" %H:%M:%S", at));
+        }
+    }
+
+    // the default is unchanged
+    sylar::LogFormatter::ptr def(new sylar::LogFormatter("%d"));
+    SYLAR_ASSERT(format_at(def, t, 5) == strftime_str("%Y-%m-%d %H:%M:%S", t));
+}
+
+/**
+ * @brief %d against localtime_r + strftime per record
+ */
+void bench_datetime() {
+    static const int s_count = 1000000;
+    sylar::Logger::ptr logger(new sylar::Logger("datetime"));
+    sylar::LogEvent::ptr event(new sylar::LogEvent(logger, sylar::LogLevel::level::INFO
+                , __FILE__, __LINE__, 0, 0, 0, time(0), "main"));
+    sylar::LogFormatter fmt("%d{%Y-%m-%d %H:%M:%S.%6N}");
+    sylar::LogStream ss;
+
+    uint64_t start = sylar::GetCurrentUS();
+    for(int i = 0; i < s_count; ++i) {
+        ss.reset();
+        event->reset(logger, sylar::LogLevel::level::INFO, __FILE__, __LINE__, 0, 0, 0
+                     ,event->getTime() + (i % 1000 == 0), "main", i % 1000000);
+        fmt.format(ss, logger, sylar::LogLevel::level::INFO, event);
+    }
+    uint64_t cached = sylar::GetCurrentUS() - start;
+
+    start = sylar::GetCurrentUS();
+    for(int i = 0; i < s_count; ++i) {
+        ss.reset();
+        struct tm tm;
+        time_t t = event->getTime() + (i % 1000 == 0);
+        localtime_r(&t, &tm);
+        char buf[64];
+        ss.append(buf, strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm));
+    }
+    uint64_t plain = sylar::GetCurrentUS() - start;
+    SYLAR_LOG_INFO(g_logger) << "%d cached: " << cached * 1000.0 / s_count
+        << "ns/record, localtime_r+strftime: " << plain * 1000.0 / s_count << "ns/record";
+}
+
+/**
+ * @brief Time and allocations per call writing to a file directly and
+ *        through AsyncLogAppender
+ */
+// appender changes while other threads log: every record goes to the
+// old list or the new one, exactly once
+void test_swap_appenders() {
+    MemoryAppender::ptr a(new MemoryAppender);
+    MemoryAppender::ptr b(new MemoryAppender);
+    auto logger = make_logger(a);
+    std::atomic<bool> stop(false);
+    std::vector<sylar::Thread::ptr> thrs;
+    for(int i = 0; i < s_threads; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger](){
+            for(int n = 0; n < 20000; ++n) {
+                SYLAR_LOG_INFO(logger) << n;
+            }
+        }, "swap_" + std::to_string(i))));
+    }
+    sylar::Thread swapper([logger, a, b, &stop](){
+        for(uint64_t n = 0; !stop; ++n) {
+            if(n % 2) {
+                logger->setAppenders({a});
+            } else {
+                logger->setAppenders({b});
+            }
+        }
+    }, "swap_appenders");
+    for(auto& i : thrs) {
+        i->join();
+    }
+    stop = true;
+    swapper.join();
+    SYLAR_LOG_INFO(g_logger) << "a=" << a->lines() << " b=" << b->lines();
+    SYLAR_ASSERT(a->lines() + b->lines() == (size_t)s_threads * 20000);
+    SYLAR_ASSERT(a->lines() > 0 && b->lines() > 0);
+
+    // no logger lock is held while an appender works
+    MemoryAppender::ptr slow(new MemoryAppender(200));
+    logger->setAppenders({slow});
+    sylar::Thread writer([logger](){
+        SYLAR_LOG_INFO(logger) << "slow";
+    }, "swap_slow");
+    usleep(50 * 1000);
+    uint64_t start = sylar::GetCurrentMS();
+    logger->setAppenders({a});
+    logger->addAppender(b);
+    logger->flush();
+    SYLAR_ASSERT(sylar::GetCurrentMS() - start < 100);
+    writer.join();
+    SYLAR_ASSERT(slow->data() == "slow\n");
+}
+
+// json and logfmt records, fields of every type, and what needs escaping
+void test_structured() {
+    MemoryAppender::ptr mem(new MemoryAppender);
+    auto logger = make_logger(mem);
+    logger->setFormatter("json");
+    std::string peer = "a \"b\"\n";
+    int fd = 3;
+    SYLAR_LOG_INFO(logger).kv("fd", fd).kv("neg", (int64_t)-2).kv("ratio", 0.1)
+        .kv("ok", true).kv("peer", peer).kv("bad", "x\xff").kv("nan", NAN)
+        << "tab\there \"q\" \x01 \xc3\xa9";
+    std::string line = mem->data();
+    SYLAR_LOG_INFO(g_logger) << line;
+    SYLAR_ASSERT(line.compare(0, 9, "{\"time\":\"") == 0);
+    SYLAR_ASSERT(line.find("\"level\":\"INFO\",\"logger\":\"test_log\"") != std::string::npos);
+    SYLAR_ASSERT(line.find("\"msg\":\"tab\\there \\\"q\\\" \\u0001 \xc3\xa9\",\"fd\":3,\"neg\":-2"
+                ",\"ratio\":0.1,\"ok\":true,\"peer\":\"a \\\"b\\\"\\n\",\"bad\":\"x\\ufffd\","
+                "\"nan\":null}\n") != std::string::npos);
+    // and it parses back (JSON is YAML)
+    YAML::Node node = YAML::Load(line);
+    SYLAR_ASSERT(node["msg"].as<std::string>() == "tab\there \"q\" \x01 \xc3\xa9");
+    SYLAR_ASSERT(node["peer"].as<std::string>() == peer);
+    SYLAR_ASSERT(node["fd"].as<int>() == 3 && node["line"].as<int>() > 0);
+
+    MemoryAppender::ptr fmt(new MemoryAppender);
+    logger = make_logger(fmt);
+    logger->setFormatter("logfmt");
+    SYLAR_LOG_WARN(logger).kv("fd", fd).kv("a key", "plain").kv("peer", peer)
+        .kv("empty", "") << "two words";
+    line = fmt->data();
+    SYLAR_LOG_INFO(g_logger) << line;
+    SYLAR_ASSERT(line.compare(0, 5, "time=") == 0);
+    SYLAR_ASSERT(line.find(" level=WARN logger=test_log ") != std::string::npos);
+    SYLAR_ASSERT(line.find(" msg=\"two words\" fd=3 a_key=plain peer=\"a \\\"b\\\"\\n\" empty=\"\"\n")
+                    != std::string::npos);
+
+    // a text pattern keeps the fields after the message
+    MemoryAppender::ptr text(new MemoryAppender);
+    logger = make_logger(text);
+    SYLAR_LOG_INFO(logger).kv("fd", fd).kv("ms", 1.5) << "closed";
+    SYLAR_LOG_INFO(logger) << "no fields";
+    SYLAR_ASSERT(text->data() == "closed fd=3 ms=1.5\nno fields\n");
+}
+
+// per call site: every nth, the first n, and a token bucket, with summaries
+void test_sampling() {
+    auto interval = sylar::Config::Lookup<uint32_t>("log.ratelimit.summary_interval");
+    interval->setValue(100);
+
+    MemoryAppender::ptr every(new MemoryAppender);
+    auto logger = make_logger(every);
+    for(int i = 0; i < 10; ++i) {
+        SYLAR_LOG_INFO_EVERY_N(logger, 3) << "every " << i;
+    }
+    SYLAR_ASSERT(every->data() == "every 0\nevery 3\nevery 6\nevery 9\n");
+
+    MemoryAppender::ptr first(new MemoryAppender);
+    logger = make_logger(first);
+    auto log_first = [logger](int i) {
+        SYLAR_LOG_INFO_FIRST_N(logger, 2) << "first " << i;
+    };
+    for(int i = 0; i < 10; ++i) {
+        log_first(i);
+    }
+    SYLAR_ASSERT(first->data() == "first 0\nfirst 1\n");
+    usleep(150 * 1000);
+    log_first(10);
+    SYLAR_LOG_INFO(g_logger) << first->data();
+    SYLAR_ASSERT(first->data() == "first 0\nfirst 1\nsuppressed 9 messages\n");
+
+    MemoryAppender::ptr limited(new MemoryAppender);
+    logger = make_logger(limited);
+    auto log_limited = [logger](int i) {
+        SYLAR_LOG_INFO_RATELIMITED(logger, 10) << "limited " << i;
+    };
+    for(int i = 0; i < 20; ++i) {
+        log_limited(i);
+    }
+    SYLAR_ASSERT(limited->lines() == 10);
+    // a token every 100ms, and the summary is due
+    usleep(250 * 1000);
+    log_limited(20);
+    SYLAR_LOG_INFO(g_logger) << limited->data();
+    SYLAR_ASSERT(limited->lines() == 12);
+    SYLAR_ASSERT(limited->data().find("limited 9\nsuppressed 10 messages\nlimited 20\n")
+                    != std::string::npos);
+
+    interval->setValue(10000);
+}
+
+// an event an appender keeps is not reused by the next record
+void test_kept_event() {
+    KeepAppender::ptr keep(new KeepAppender);
+    auto logger = make_logger(keep);
+    for(int i = 0; i < 40; ++i) {
+        SYLAR_LOG_INFO(logger) << "kept " << i;
+    }
+    SYLAR_ASSERT(keep->events().size() == 40);
+    for(int i = 0; i < 40; ++i) {
+        auto& e = keep->events()[i];
+        SYLAR_ASSERT(e->getContent() == "kept " + std::to_string(i));
+        SYLAR_ASSERT(e->getLogger() == logger && e->getLevel() == sylar::LogLevel::level::INFO);
+    }
+}
+
+// the count of a storm's last run comes out on flush, the line isn't
+// necessarily reached again
+void test_flush_summary() {
+    MemoryAppender::ptr first(new MemoryAppender);
+    auto logger = make_logger(first);
+    for(int i = 0; i < 5; ++i) {
+        SYLAR_LOG_INFO_FIRST_N(logger, 2) << "first " << i;
+    }
+    SYLAR_ASSERT(first->data() == "first 0\nfirst 1\n");
+    sylar::LoggerMgr::GetInstance()->flush();
+    SYLAR_ASSERT(first->data() == "first 0\nfirst 1\nsuppressed 3 messages\n");
+    sylar::LoggerMgr::GetInstance()->flush();
+    SYLAR_ASSERT(first->lines() == 3);
+
+    MemoryAppender::ptr limited(new MemoryAppender);
+    logger = make_logger(limited);
+    logger->setRateLimit(1);
+    for(int i = 0; i < 5; ++i) {
+        SYLAR_LOG_INFO(logger) << i;
+    }
+    SYLAR_ASSERT(limited->data() == "0\n");
+    logger->flush();
+    SYLAR_ASSERT(limited->data() == "0\nlogger test_log rate limit: suppressed 4 messages\n");
+    logger->flush();
+    SYLAR_ASSERT(limited->lines() == 2);
+}
+
+// rate_limit in the logs config caps the whole logger
+void test_logger_rate_limit() {
+    auto interval = sylar::Config::Lookup<uint32_t>("log.ratelimit.summary_interval");
+    interval->setValue(100);
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "  - name: rate_test\n"
+        "    level: info\n"
+        "    formatter: '%m%n'\n"
+        "    rate_limit: 5\n"
+        "    rate_burst: 2\n");
+    sylar::Config::LoadFromYaml(root);
+    auto logger = SYLAR_LOG_NAME("rate_test");
+    std::string yaml = logger->ToYamlString();
+    SYLAR_ASSERT(yaml.find("rate_limit: 5") != std::string::npos);
+    SYLAR_ASSERT(yaml.find("rate_burst: 2") != std::string::npos);
+
+    MemoryAppender::ptr mem(new MemoryAppender);
+    logger->addAppender(mem);
+    for(int i = 0; i < 10; ++i) {
+        SYLAR_LOG_INFO(logger) << i;
+    }
+    SYLAR_ASSERT(mem->data() == "0\n1\n");
+    // still no token (one per 200ms), but time for a summary
+    usleep(120 * 1000);
+    SYLAR_LOG_INFO(logger) << "late";
+    SYLAR_LOG_INFO(g_logger) << mem->data();
+    SYLAR_ASSERT(mem->data() == "0\n1\nlogger rate_test rate limit: suppressed 9 messages\n");
+    usleep(300 * 1000);
+    SYLAR_LOG_INFO(logger) << "after";
+    SYLAR_ASSERT(mem->data() == "0\n1\nlogger rate_test rate limit: suppressed 9 messages\nafter\n");
+
+    logger->setRateLimit(0);
+    for(int i = 0; i < 10; ++i) {
+        SYLAR_LOG_INFO(logger) << i;
+    }
+    SYLAR_ASSERT(mem->lines() == 14);
+    logger->clearAppenders();
+    interval->setValue(10000);
+}
+
+void bench(bool async) {
+    static const int s_bench = 200000;
+    std::string path = temp_file();
+    uint64_t max_us = 0;
+    uint64_t used = 0;
+    uint64_t allocs = 0;
+    {
+        sylar::LogAppender::ptr appender(new sylar::FileLogAppender(path));
+        if(async) {
+            appender.reset(new sylar::AsyncLogAppender(appender));
+        }
+        auto logger = make_logger(appender);
+        logger->setFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%p%T%f:%l%T%m%n");
+        for(int i = 0; i < 1000; ++i) {
+            SYLAR_LOG_INFO(logger) << "warm up " << i;
+        }
+        uint64_t before = t_allocs;
+        uint64_t start = sylar::GetCurrentUS();
+        for(int i = 0; i < s_bench; ++i) {
+            uint64_t s = sylar::GetCurrentUS();
+            SYLAR_LOG_INFO(logger) << "bench record " << i;
+            max_us = std::max(max_us, sylar::GetCurrentUS() - s);
+        }
+        used = sylar::GetCurrentUS() - start;
+        allocs = t_allocs - before;
+    }
+    SYLAR_LOG_INFO(g_logger) << (async ? "async" : "sync ") << " records=" << s_bench
+        << " used=" << used / 1000 << "ms "
+        << used * 1000.0 / s_bench << "ns/record max=" << max_us << "us"
+        << " allocations=" << allocs;
+    unlink(path.c_str());
+}
+
+int main(int argc, char** argv) {
+    test_file();
+    test_drop();
+    test_block();
+    test_fatal();
+    test_interval();
+    test_yaml();
+    test_append();
+    test_rotate_size();
+    test_rotate_daily();
+    test_external_rotate();
+    test_stream();
+    test_zero_alloc();
+    test_datetime();
+    test_swap_appenders();
+    test_structured();
+    test_sampling();
+    test_kept_event();
+    test_flush_summary();
+    test_logger_rate_limit();
+    bench(false);
+    bench(true);
+    bench_datetime();
+    return 0;
+}
@@ -0,0 +1,144 @@
+// everything below INFO is compiled out of this file
+#undef SYLAR_LOG_MIN_LEVEL
+#define SYLAR_LOG_MIN_LEVEL 2
+#include "sylar/sylar.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief Counts the records it is given
+ */
+class CountAppender : public sylar::LogAppender {
+public:
+    typedef std::shared_ptr<CountAppender> ptr;
+
+    void log(std::shared_ptr<sylar::Logger> logger, sylar::LogLevel::level level
+             ,sylar::LogEvent::ptr event) override {
+        ++m_count;
+    }
+    void write(const iovec* iov, int iovcnt) override {}
+    std::string toYamlString() override { return "type: CountAppender"; }
+
+    uint64_t count() const { return m_count; }
+private:
+    std::atomic<uint64_t> m_count{0};
+};
+
+static sylar::Logger::ptr make_logger(const std::string& name, sylar::LogAppender::ptr appender) {
+    auto logger = SYLAR_LOG_NAME(name);
+    logger->setLevel(sylar::LogLevel::level::DEBUG);
+    logger->setAppenders({appender});
+    return logger;
+}
+
+// DEBUG statements are gone, arguments included, whatever the logger's level
+void test_strip() {
+    CountAppender::ptr counter(new CountAppender);
+    auto logger = make_logger("level_strip", counter);
+    int evaluated = 0;
+    SYLAR_LOG_DEBUG(logger) << ++evaluated;
+    SYLAR_LOG_FMT_DEBUG(logger, "%d", ++evaluated);
+    SYLAR_LOG_DEBUG_EVERY_N(logger, 1) << ++evaluated;
+    SYLAR_LOG_DEBUG_RATELIMITED(logger, 100) << ++evaluated;
+    SYLAR_ASSERT(evaluated == 0 && counter->count() == 0);
+
+    SYLAR_LOG_INFO(logger) << ++evaluated;
+    SYLAR_LOG_FMT_WARN(logger, "%d", ++evaluated);
+    SYLAR_ASSERT(evaluated == 2 && counter->count() == 2);
+}
+
+static int s_lookups = 0;
+static sylar::Logger::ptr s_logger;
+
+static sylar::Logger::ptr lookup() {
+    ++s_lookups;
+    return s_logger;
+}
+
+// the logger expression is evaluated once per statement, and not at all
+// for a statement compiled out
+void test_once() {
+    CountAppender::ptr counter(new CountAppender);
+    s_logger = make_logger("level_once", counter);
+    SYLAR_LOG_INFO(lookup()) << "once";
+    SYLAR_LOG_FMT_INFO(lookup(), "%s", "once");
+    SYLAR_LOG_INFO_FIRST_N(lookup(), 1) << "once";
+    SYLAR_ASSERT(s_lookups == 3 && counter->count() == 3);
+    SYLAR_LOG_DEBUG(lookup()) << "never";
+    SYLAR_ASSERT(s_lookups == 3);
+
+    s_logger->setLevel(sylar::LogLevel::level::ERROR);
+    SYLAR_LOG_INFO(lookup()) << "filtered";
+    SYLAR_ASSERT(s_lookups == 4 && counter->count() == 3);
+    s_logger.reset();
+}
+
+// SYLAR_LOG_CACHED looks the name up once per call site
+void test_cached() {
+    CountAppender::ptr counter(new CountAppender);
+    auto logger = make_logger("level_cached", counter);
+    for(int i = 0; i < 3; ++i) {
+        SYLAR_ASSERT(SYLAR_LOG_CACHED("level_cached") == logger.get());
+        SYLAR_LOG_INFO(SYLAR_LOG_CACHED("level_cached")) << i;
+    }
+    SYLAR_ASSERT(counter->count() == 3);
+}
+
+// a level changed on one thread is seen by statements on another
+void test_runtime() {
+    CountAppender::ptr counter(new CountAppender);
+    auto logger = make_logger("level_runtime", counter);
+    std::atomic<bool> stop(false);
+    sylar::Thread thr([logger, &stop](){
+        while(!stop) {
+            SYLAR_LOG_INFO(logger) << "runtime";
+        }
+    }, "level_runtime");
+    usleep(10 * 1000);
+    logger->setLevel(sylar::LogLevel::level::ERROR);
+    usleep(10 * 1000);
+    uint64_t count = counter->count();
+    usleep(10 * 1000);
+    stop = true;
+    thr.join();
+    SYLAR_ASSERT(count > 0 && counter->count() == count);
+}
+
+// statements that don't log
+void bench() {
+    const int n = 100000000;
+    CountAppender::ptr counter(new CountAppender);
+    auto logger = make_logger("level_bench", counter);
+    logger->setLevel(sylar::LogLevel::level::ERROR);
+
+    uint64_t start = sylar::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        SYLAR_LOG_INFO(logger) << i;
+    }
+    uint64_t runtime = sylar::GetCurrentUS() - start;
+
+    start = sylar::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        SYLAR_LOG_INFO(SYLAR_LOG_CACHED("level_bench")) << i;
+    }
+    uint64_t cached = sylar::GetCurrentUS() - start;
+
+    start = sylar::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        SYLAR_LOG_DEBUG(logger) << i;
+    }
+    uint64_t stripped = sylar::GetCurrentUS() - start;
+    SYLAR_ASSERT(counter->count() == 0);
+    SYLAR_LOG_INFO(g_logger) << "disabled INFO: " << runtime * 1000.0 / n
+        << "ns, via SYLAR_LOG_CACHED: " << cached * 1000.0 / n
+        << "ns, compiled out DEBUG: " << stripped * 1000.0 / n << "ns";
+}
+
+int main(int argc, char** argv) {
+    test_strip();
+    test_once();
+    test_cached();
+    test_runtime();
+    bench();
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include "sylar/http/http_connection.h"
+#include "sylar/http/http_server.h"
+#include "sylar/http/static_file_servlet.h"
+#include "sylar/sylar.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+using namespace sylar::http;
+
+static std::string s_dir;
+
+static std::string random_data(size_t len) {
+    std::string data(len, '\0');
+    for(size_t i = 0; i < len; ++i) {
+        data[i] = (char)(rand() & 0xff);
+    }
+    return data;
+}
+
+static void write_file(const std::string& path, const std::string& data) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    SYLAR_ASSERT(fd >= 0);
+    SYLAR_ASSERT(write(fd, data.c_str(), data.size()) == (ssize_t)data.size());
+    close(fd);
+}
+
+/**
+ * @brief Connected socket pair over loopback, the sender with a small send
+ *        buffer so sendFile() has to wait for the reader
+ */
+static void socket_pair(sylar::Socket::ptr& sender, sylar::Socket::ptr& receiver) {
+    auto listener = sylar::Socket::CreateTCPSocket();
+    SYLAR_ASSERT(listener->bind(sylar::IPAddress::Create("127.0.0.1", 0)));
+    SYLAR_ASSERT(listener->listen());
+    auto addr = listener->getLocalAddress();
+    receiver = sylar::Socket::CreateTCP(addr);
+    SYLAR_ASSERT(receiver->connect(addr));
+    sender = listener->accept();
+    SYLAR_ASSERT(sender);
+    sender->setOption(SOL_SOCKET, SO_SNDBUF, 64 * 1024);
+}
+
+static void recv_all(sylar::Socket::ptr sock, std::string& out, size_t len) {
+    out.resize(len);
+    size_t got = 0;
+    while(got < len) {
+        int rt = sock->recv(&out[got], len - got);
+        SYLAR_ASSERT(rt > 0);
+        got += rt;
+    }
+}
+
+// regular file: sendfile from an offset; pipe: spliced through a pipe
+void test_socket_sendfile() {
+    sylar::IOManager iom(2, false, "sendfile");
+    iom.schedule([](){
+        std::string data = random_data(4 * 1024 * 1024 + 123);
+        std::string path = s_dir + "/big.bin";
+        write_file(path, data);
+
+        sylar::Socket::ptr sender, receiver;
+        socket_pair(sender, receiver);
+        int fd = open(path.c_str(), O_RDONLY);
+        SYLAR_ASSERT(fd >= 0);
+
+        uint64_t offset = 1000;
+        uint64_t length = data.size() - offset;
+        sylar::IOManager::GetThis()->schedule([sender, fd, offset, length](){
+            SYLAR_ASSERT(sender->sendFile(fd, offset, length) == (int64_t)length);
+            // asking for more than the file has stops at its end
+            SYLAR_ASSERT(sender->sendFile(fd, length, offset * 2) == (int64_t)offset);
+        });
+        std::string got;
+        recv_all(receiver, got, length);
+        SYLAR_ASSERT(got == data.substr(offset));
+        recv_all(receiver, got, offset);
+        SYLAR_ASSERT(got == data.substr(length));
+        close(fd);
+
+        int fds[2];
+        SYLAR_ASSERT(pipe2(fds, O_NONBLOCK) == 0);
+        std::string piped = random_data(1024 * 1024);
+        sylar::IOManager::GetThis()->schedule([fds, piped](){
+            size_t off = 0;
+            while(off < piped.size()) {
+                ssize_t rt = sylar::IOManager::GetThis()->write(fds[1], piped.c_str() + off
+                                , std::min((size_t)10000, piped.size() - off));
+                SYLAR_ASSERT(rt > 0);
+                off += rt;
+            }
+            close(fds[1]);
+        });
+        sylar::IOManager::GetThis()->schedule([sender, fds, piped](){
+            // the writer closes the pipe after piped.size() bytes
+            SYLAR_ASSERT(sender->sendFile(fds[0], 0, piped.size() * 2) == (int64_t)piped.size());
+            close(fds[0]);
+        });
+        recv_all(receiver, got, piped.size());
+        SYLAR_ASSERT(got == piped);
+    });
+    iom.stop();
+}
+
+void test_file_cache() {
+    sylar::ConfigVar<uint64_t>::ptr interval = sylar::Config::Lookup<uint64_t>("file_cache.check_interval");
+    uint64_t old = interval->getValue();
+    interval->setValue(0);
+
+    auto cache = sylar::FileCacheMgr::GetInstance();
+    std::string path = s_dir + "/cached.txt";
+    write_file(path, "version 1");
+    auto a = cache->open(path);
+    auto b = cache->open(path);
+    SYLAR_ASSERT(a && a == b && a->getSize() == 9);
+    SYLAR_ASSERT(cache->getHits() >= 1);
+
+    // replaced on disk: a new fd, the old one still reads the old content
+    std::string tmp = path + ".tmp";
+    write_file(tmp, "version two");
+    SYLAR_ASSERT(rename(tmp.c_str(), path.c_str()) == 0);
+    auto c = cache->open(path);
+    SYLAR_ASSERT(c && c != a && c->getSize() == 11);
+    char buf[16];
+    SYLAR_ASSERT(pread(a->getFd(), buf, sizeof(buf), 0) == 9);
+
+    unlink(path.c_str());
+    SYLAR_ASSERT(!cache->open(path) && errno == ENOENT);
+    SYLAR_ASSERT(!cache->open(s_dir) && errno == EISDIR);
+    interval->setValue(old);
+}
+
+HttpServer::ptr make_server(sylar::IOManager* iom) {
+    HttpServer::ptr server(new HttpServer(true, iom, iom));
+    auto sd = server->getServletDispatch();
+    sd->addGlobServlet("/static/*", std::make_shared<StaticFileServlet>(s_dir, "/static"));
+    // the same file read into the response body, to compare against
+    sd->addServlet("/copy/big.bin", [](HttpRequest& req, HttpResponse& rsp, HttpSession& session){
+        int fd = open((s_dir + "/big.bin").c_str(), O_RDONLY);
+        struct stat st;
+        fstat(fd, &st);
+        std::string body(st.st_size, '\0');
+        SYLAR_ASSERT(read(fd, &body[0], body.size()) == (ssize_t)body.size());
+        close(fd);
+        rsp.setBody(body);
+        return 0;
+    });
+    SYLAR_ASSERT(server->bind(sylar::IPAddress::Create("127.0.0.1", 0)));
+    server->start();
+    return server;
+}
+
+static const int s_rounds = 20;
+
+void test_static_servlet() {
+    sylar::IOManager iom(2, false, "static");
+    auto server = make_server(&iom);
+    auto addr = std::dynamic_pointer_cast<sylar::IPAddress>(server->getSocks()[0]->getLocalAddress());
+    std::string host = "127.0.0.1:" + std::to_string(addr->getPort());
+
+    iom.schedule([server, host](){
+        std::string data = random_data(8 * 1024 * 1024);
+        write_file(s_dir + "/big.bin", data);
+        write_file(s_dir + "/index.html", "<html>index</html>");
+        HttpConnectionPool client;
+
+        auto r = client.doGet(host, "/static/big.bin", 5000);
+        SYLAR_ASSERT(r->result == HttpResult::Error::OK);
+        SYLAR_ASSERT(r->response->getStatus() == HttpStatus::OK);
+        SYLAR_ASSERT(r->response->getBody() == data);
+        SYLAR_ASSERT(r->response->getHeader("content-type") == "application/octet-stream");
+        std::string last_modified = r->response->getHeader("last-modified");
+
+        r = client.doGet(host, "/static/", 1000);
+        SYLAR_ASSERT(r->response->getBody() == "<html>index</html>");
+        SYLAR_ASSERT(r->response->getHeader("content-type") == "text/html; charset=utf-8");
+
+        r = client.doRequest(HttpMethod::HEAD, host, "/static/big.bin", 1000);
+        SYLAR_ASSERT(r->result == HttpResult::Error::OK);
+        SYLAR_ASSERT(r->response->getBody().empty());
+        SYLAR_ASSERT(r->response->getHeader("content-length") == std::to_string(data.size()));
+
+        r = client.doGet(host, "/static/big.bin", 1000, {{"Range", "bytes=10-19"}});
+        SYLAR_ASSERT(r->response->getStatus() == HttpStatus::PARTIAL_CONTENT);
+        SYLAR_ASSERT(r->response->getBody() == data.substr(10, 10));
+        r = client.doGet(host, "/static/big.bin", 1000, {{"Range", "bytes=-5"}});
+        SYLAR_ASSERT(r->response->getBody() == data.substr(data.size() - 5));
+        r = client.doGet(host, "/static/big.bin", 1000, {{"Range", "bytes=99999999-"}});
+        SYLAR_ASSERT(r->response->getStatus() == HttpStatus::RANGE_NOT_SATISFIABLE);
+
+        r = client.doGet(host, "/static/big.bin", 1000, {{"If-Modified-Since", last_modified}});
+        SYLAR_ASSERT(r->response->getStatus() == HttpStatus::NOT_MODIFIED);
+
+        r = client.doGet(host, "/static/../../etc/passwd", 1000);
+        SYLAR_ASSERT(r->response->getStatus() == HttpStatus::FORBIDDEN);
+        r = client.doGet(host, "/static/%2e%2e/etc/passwd", 1000);
+        SYLAR_ASSERT(r->response->getStatus() == HttpStatus::FORBIDDEN);
+        r = client.doGet(host, "/static/nothing", 1000);
+        SYLAR_ASSERT(r->response->getStatus() == HttpStatus::NOT_FOUND);
+        r = client.doPost(host, "/static/big.bin", 1000);
+        SYLAR_ASSERT(r->response->getStatus() == HttpStatus::METHOD_NOT_ALLOWED);
+
+        const char* uris[] = {"/copy/big.bin", "/static/big.bin"};
+        for(auto uri : uris) {
+            uint64_t start = sylar::GetCurrentUS();
+            for(int i = 0; i < s_rounds; ++i) {
+                r = client.doGet(host, uri, 5000);
+                SYLAR_ASSERT(r->result == HttpResult::Error::OK && r->response->getBody().size() == data.size());
+            }
+            uint64_t used = sylar::GetCurrentUS() - start;
+            SYLAR_LOG_INFO(g_logger) << uri << " " << s_rounds << " x " << data.size() / 1024 / 1024
+                << "MB used=" << used / 1000 << "ms "
+                << (uint64_t)(data.size() * (double)s_rounds / used) << "MB/s";
+        }
+        client.getPool()->clear();
+        server->stop();
+    });
+    iom.stop();
+}
+
+int main(int argc, char** argv) {
+    sylar::LoggerMgr::GetInstance()->getLogger("system")->setLevel(sylar::LogLevel::level::WARN);
+    char tmpl[] = "/tmp/sylar_sendfile_XXXXXX";
+    SYLAR_ASSERT(mkdtemp(tmpl));
+    s_dir = tmpl;
+
+    test_file_cache();
+    auto enable = sylar::Config::Lookup<bool>("iomanager.io_uring.enable");
+    bool old = enable->getValue();
+    for(int i = 0; i < 2; ++i) {
+        enable->setValue(i == 0);
+        test_socket_sendfile();
+        test_static_servlet();
+    }
+    enable->setValue(old);
+
+    sylar::FileCacheMgr::GetInstance()->clear();
+    unlink((s_dir + "/big.bin").c_str());
+    unlink((s_dir + "/index.html").c_str());
+    rmdir(s_dir.c_str());
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "sylar/sylar.h"
+#include "sylar/iomanager.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+void test_address() {
+    std::vector<sylar::Address::ptr> addrs;
+    SYLAR_ASSERT(sylar::Address::Lookup(addrs, "localhost:8080", AF_UNSPEC, SOCK_STREAM));
+    for(auto& i : addrs) {
+        SYLAR_LOG_INFO(g_logger) << "localhost -> " << i->toString();
+    }
+
+    auto v4 = sylar::Address::LookupAnyIPAddress("127.0.0.1:80");
+    SYLAR_ASSERT(v4 && v4->toString() == "127.0.0.1:80");
+    auto v6 = sylar::Address::LookupAnyIPAddress("[::1]:443", AF_INET6);
+    SYLAR_ASSERT(v6 && v6->getPort() == 443);
+    SYLAR_LOG_INFO(g_logger) << "v6 " << v6->toString();
+
+    // second lookup of the same name is served from the cache
+    uint64_t t0 = sylar::GetCurrentUS();
+    sylar::Address::LookupAny("localhost:80");
+    uint64_t t1 = sylar::GetCurrentUS();
+    for(int i = 0; i < 1000; ++i) {
+        sylar::Address::LookupAny("localhost:80");
+    }
+    uint64_t t2 = sylar::GetCurrentUS();
+    SYLAR_LOG_INFO(g_logger) << "lookup first=" << (t1 - t0)
+        << "us cached=" << (t2 - t1) / 1000.0 << "us";
+
+    // cached results are copies, callers may change them freely
+    auto a = sylar::Address::LookupAnyIPAddress("localhost:80");
+    a->setPort(1);
+    auto b = sylar::Address::LookupAnyIPAddress("localhost:80");
+    SYLAR_ASSERT(b->getPort() == 80);
+    sylar::Address::ClearLookupCache();
+
+    sylar::UnixAddress::ptr un(new sylar::UnixAddress("/tmp/sylar.sock"));
+    SYLAR_ASSERT(un->getPath() == "/tmp/sylar.sock");
+}
+
+void test_echo() {
+    sylar::IOManager iom(2, false, "socket");
+    auto addr = sylar::IPAddress::Create("127.0.0.1", 0);
+    sylar::Socket::ptr server = sylar::Socket::CreateTCP(addr);
+    SYLAR_ASSERT(server->bind(addr));
+    SYLAR_ASSERT(server->listen());
+    auto local = server->getLocalAddress();
+    SYLAR_LOG_INFO(g_logger) << "listen " << *server;
+
+    iom.schedule([server](){
+        sylar::Socket::ptr client = server->accept();
+        SYLAR_ASSERT(client);
+        char buf[256];
+        int n;
+        while((n = client->recv(buf, sizeof(buf))) > 0) {
+            iovec iov[2];
+            iov[0].iov_base = buf;
+            iov[0].iov_len = n / 2;
+            iov[1].iov_base = buf + n / 2;
+            iov[1].iov_len = n - n / 2;
+            SYLAR_ASSERT(client->send(iov, 2) == n);
+        }
+    });
+
+    iom.schedule([local](){
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCP(local);
+        SYLAR_ASSERT(sock->connect(local));
+        for(int i = 0; i < 1000; ++i) {
+            std::string msg = "hello " + std::to_string(i);
+            SYLAR_ASSERT(sock->send(msg.c_str(), msg.size()) == (int)msg.size());
+            char buf[256];
+            int n = sock->recv(buf, sizeof(buf));
+            SYLAR_ASSERT(n == (int)msg.size() && !memcmp(buf, msg.c_str(), n));
+        }
+
+        // nobody writes back, the recv has to give up after the timeout
+        sock->setRecvTimeout(100);
+        char c;
+        uint64_t start = sylar::GetCurrentMS();
+        int rt = sock->recv(&c, 1);
+        uint64_t used = sylar::GetCurrentMS() - start;
+        SYLAR_ASSERT(rt < 0 && errno == ETIMEDOUT);
+        SYLAR_ASSERT(used >= 90 && used < 1000);
+        SYLAR_LOG_INFO(g_logger) << "recv timeout after " << used << "ms";
+        sock->close();
+    });
+}
+
+void test_connect_refused() {
+    sylar::IOManager iom(1, false, "refused");
+    iom.schedule([](){
+        // grab a free port and close it again, nobody listens on it after
+        auto addr = sylar::IPAddress::Create("127.0.0.1", 0);
+        sylar::Socket::ptr tmp = sylar::Socket::CreateTCP(addr);
+        tmp->bind(addr);
+        auto local = tmp->getLocalAddress();
+        tmp->close();
+
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCP(local);
+        SYLAR_ASSERT(!sock->connect(local, 1000));
+        SYLAR_ASSERT(!sock->isValid());
+    });
+}
+
+// datagrams between two bound Unix sockets, like the UDP ones no connect
+void test_unix_udp() {
+    sylar::IOManager iom(1, false, "unix_udp");
+    iom.schedule([](){
+        std::string server_path = "/tmp/sylar_udp_" + std::to_string(getpid()) + ".server";
+        std::string client_path = "/tmp/sylar_udp_" + std::to_string(getpid()) + ".client";
+        unlink(server_path.c_str());
+        unlink(client_path.c_str());
+        sylar::UnixAddress::ptr server_addr(new sylar::UnixAddress(server_path));
+        sylar::UnixAddress::ptr client_addr(new sylar::UnixAddress(client_path));
+        sylar::Socket::ptr server = sylar::Socket::CreateUnixUDPSocket();
+        sylar::Socket::ptr client = sylar::Socket::CreateUnixUDPSocket();
+        SYLAR_ASSERT(server->bind(server_addr));
+        SYLAR_ASSERT(client->bind(client_addr));
+
+        std::string msg = "unix datagram";
+        SYLAR_ASSERT(client->sendTo(msg.c_str(), msg.size(), server_addr) == (int)msg.size());
+        char buf[64];
+        sylar::UnixAddress::ptr from(new sylar::UnixAddress);
+        int n = server->recvFrom(buf, sizeof(buf), from);
+        SYLAR_ASSERT(n == (int)msg.size() && !memcmp(buf, msg.c_str(), n));
+        SYLAR_ASSERT(server->sendTo(buf, n, client_addr) == n);
+        n = client->recv(buf, sizeof(buf));
+        SYLAR_ASSERT(n == (int)msg.size() && !memcmp(buf, msg.c_str(), n));
+
+        server->close();
+        client->close();
+        unlink(server_path.c_str());
+        unlink(client_path.c_str());
+    });
+}
+
+int main(int argc, char** argv) {
+    test_address();
+    auto enable = sylar::Config::Lookup<bool>("iomanager.io_uring.enable");
+    bool old = enable->getValue();
+    enable->setValue(false);
+    test_echo();
+    test_connect_refused();
+    test_unix_udp();
+    enable->setValue(true);
+    test_echo();
+    test_connect_refused();
+    test_unix_udp();
+    enable->setValue(old);
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include "sylar/sylar.h"
+#include "sylar/iomanager.h"
+#include "sylar/tcp_server.h"
+#include <string.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+class EchoServer : public sylar::TcpServer {
+public:
+    EchoServer(sylar::IOManager* worker, sylar::IOManager* accept_worker)
+        :TcpServer(worker, accept_worker) {
+    }
+protected:
+    void handleClient(sylar::Socket::ptr client) override {
+        char buf[256];
+        int n;
+        while((n = client->recv(buf, sizeof(buf))) > 0) {
+            if(client->send(buf, n) != n) {
+                break;
+            }
+        }
+    }
+};
+
+static const int s_clients = 16;
+static const int s_rounds = 200;
+
+// clients do request/response round trips, the last one to finish stops
+// the server
+void run(bool reuse_port) {
+    sylar::IOManager accept_iom(2, false, "accept");
+    sylar::IOManager worker_iom(2, false, "worker");
+
+    std::shared_ptr<EchoServer> server(new EchoServer(&worker_iom, &accept_iom));
+    server->setReusePort(reuse_port);
+    SYLAR_ASSERT(server->bind(sylar::IPAddress::Create("127.0.0.1", 0)));
+    SYLAR_ASSERT(server->getSocks().size() == (reuse_port ? 2u : 1u));
+    auto addr = server->getSocks()[0]->getLocalAddress();
+    for(auto& i : server->getSocks()) {
+        SYLAR_ASSERT(*i->getLocalAddress() == *addr);
+    }
+    server->start();
+    SYLAR_LOG_INFO(g_logger) << server->toString();
+
+    std::shared_ptr<std::atomic<int> > left(new std::atomic<int>(s_clients));
+    uint64_t start = sylar::GetCurrentMS();
+    for(int c = 0; c < s_clients; ++c) {
+        worker_iom.schedule([server, addr, left](){
+            sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+            SYLAR_ASSERT(sock->connect(addr));
+            char buf[64];
+            memset(buf, 'a', sizeof(buf));
+            for(int i = 0; i < s_rounds; ++i) {
+                SYLAR_ASSERT(sock->send(buf, sizeof(buf)) == sizeof(buf));
+                size_t got = 0;
+                while(got < sizeof(buf)) {
+                    int n = sock->recv(buf + got, sizeof(buf) - got);
+                    SYLAR_ASSERT(n > 0);
+                    got += n;
+                }
+            }
+            sock->close();
+            if(--*left == 0) {
+                server->stop();
+            }
+        });
+    }
+    accept_iom.stop();
+    worker_iom.stop();
+    SYLAR_LOG_INFO(g_logger) << "reuse_port=" << reuse_port
+        << " connections=" << s_clients << " rounds=" << s_rounds
+        << " used=" << sylar::GetCurrentMS() - start << "ms";
+    SYLAR_ASSERT(server->getAcceptCount() == (uint64_t)s_clients);
+    SYLAR_ASSERT(server->getConnectionCount() == 0);
+    SYLAR_ASSERT(server->isStop());
+}
+
+// an idle connection keeps its handler in recv(); stop() has to get it out
+// once the grace period is over
+void test_graceful_stop() {
+    sylar::IOManager iom(2, false, "graceful");
+    std::shared_ptr<EchoServer> server(new EchoServer(&iom, &iom));
+    server->setStopTimeout(200);
+    SYLAR_ASSERT(server->bind(sylar::IPAddress::Create("127.0.0.1", 0)));
+    auto addr = server->getSocks()[0]->getLocalAddress();
+    server->start();
+
+    iom.schedule([server, addr](){
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+        SYLAR_ASSERT(sock->connect(addr));
+        SYLAR_ASSERT(sock->send("x", 1) == 1);
+        char c;
+        SYLAR_ASSERT(sock->recv(&c, 1) == 1);
+        SYLAR_ASSERT(server->getConnectionCount() == 1);
+
+        uint64_t start = sylar::GetCurrentMS();
+        server->stop();
+        // the server shuts the connection down, the peer sees EOF
+        SYLAR_ASSERT(sock->recv(&c, 1) == 0);
+        uint64_t used = sylar::GetCurrentMS() - start;
+        SYLAR_LOG_INFO(g_logger) << "connection shut down " << used << "ms after stop";
+        SYLAR_ASSERT(used >= 150);
+    });
+    iom.stop();
+    SYLAR_ASSERT(server->getConnectionCount() == 0);
+}
+
+int main(int argc, char** argv) {
+    sylar::LoggerMgr::GetInstance()->getLogger("system")->setLevel(sylar::LogLevel::level::WARN);
+    auto enable = sylar::Config::Lookup<bool>("iomanager.io_uring.enable");
+    bool old = enable->getValue();
+    for(int i = 0; i < 2; ++i) {
+        enable->setValue(i == 0);
+        run(false);
+        run(true);
+        test_graceful_stop();
+    }
+    enable->setValue(old);
+    return 0;
+}
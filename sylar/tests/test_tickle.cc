@@ -0,0 +1,66 @@
+#include "sylar/sylar.h"
+#include "sylar/iomanager.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int s_rounds = 20000;
+static const int s_producers = 4;
+static const int s_burst = 100000;
+
+// ping-pong: schedule one task from outside the scheduler and wait for it,
+// so every round pays for waking an idle worker out of epoll_wait
+void bench_latency(sylar::IOManager& iom) {
+    sylar::Semaphore sem;
+    uint64_t total = 0;
+    uint64_t max = 0;
+    for(int i = 0; i < s_rounds; ++i) {
+        uint64_t begin = sylar::GetCurrentUS();
+        uint64_t end = 0;
+        iom.schedule([&sem, &end](){
+            end = sylar::GetCurrentUS();
+            sem.notify();
+        });
+        sem.wait();
+        uint64_t used = end - begin;
+        total += used;
+        max = std::max(max, used);
+    }
+    SYLAR_LOG_INFO(g_logger) << "schedule-to-run latency rounds=" << s_rounds
+        << " avg=" << (double)total / s_rounds << "us max=" << max << "us";
+}
+
+// several threads schedule as fast as they can, stresses the wakeup path
+void bench_burst(sylar::IOManager& iom) {
+    std::atomic<int> done = {0};
+    sylar::Semaphore sem;
+    uint64_t begin = sylar::GetCurrentUS();
+    std::vector<sylar::Thread::ptr> thrs;
+    for(int i = 0; i < s_producers; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([&iom, &done, &sem](){
+            for(int j = 0; j < s_burst; ++j) {
+                iom.schedule([&done, &sem](){
+                    if(++done == s_producers * s_burst) {
+                        sem.notify();
+                    }
+                });
+            }
+        }, "producer_" + std::to_string(i))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    sem.wait();
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "burst tasks=" << s_producers * s_burst
+        << " used=" << used / 1000 << "ms"
+        << " rate=" << (uint64_t)(s_producers * s_burst * 1000000.0 / used) << "/s";
+}
+
+int main(int argc, char** argv) {
+    sylar::LoggerMgr::GetInstance()->getLogger("system")->setLevel(sylar::LogLevel::level::WARN);
+    sylar::IOManager iom(2, false, "bench");
+    bench_latency(iom);
+    bench_burst(iom);
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include "sylar/sylar.h"
+#include "sylar/timer.h"
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief TimerManager driven by hand, counting the front insertions
+ */
+class ManualTimers : public sylar::TimerManager {
+public:
+    /// run the callbacks of every due timer
+    size_t runExpired() {
+        std::vector<std::function<void()> > cbs;
+        listExpiredCb(cbs);
+        for(auto& i : cbs) {
+            i();
+        }
+        return cbs.size();
+    }
+
+    int fronts() const { return m_fronts;}
+protected:
+    void onTimerInsertedAtFront() override { ++m_fronts;}
+private:
+    std::atomic<int> m_fronts = {0};
+};
+
+// a one-off fires once, a cancelled one never
+void test_add_cancel() {
+    ManualTimers timers;
+    SYLAR_ASSERT(timers.getNextTimer() == ~0ull && !timers.hasTimer());
+    int fired = 0;
+    auto t1 = timers.addTimer(20, [&fired](){ ++fired; });
+    auto t2 = timers.addTimer(20, [&fired](){ fired += 100; });
+    SYLAR_ASSERT(timers.hasTimer());
+    uint64_t next = timers.getNextTimer();
+    SYLAR_ASSERT(next > 0 && next <= 20);
+    SYLAR_ASSERT(t2->cancel());
+    SYLAR_ASSERT(!t2->cancel());
+
+    SYLAR_ASSERT(timers.runExpired() == 0);
+    usleep(30 * 1000);
+    SYLAR_ASSERT(timers.getNextTimer() == 0);
+    SYLAR_ASSERT(timers.runExpired() == 1 && fired == 1);
+    SYLAR_ASSERT(!timers.hasTimer());
+    // already fired
+    SYLAR_ASSERT(!t1->cancel() && !t1->refresh() && !t1->reset(10, true));
+}
+
+// refresh() and reset() move the expiry
+void test_refresh_reset() {
+    ManualTimers timers;
+    int fired = 0;
+    auto t = timers.addTimer(50, [&fired](){ ++fired; });
+    usleep(30 * 1000);
+    SYLAR_ASSERT(t->refresh());
+    SYLAR_ASSERT(timers.getNextTimer() > 30);
+    usleep(30 * 1000);
+    // would have been due without the refresh
+    SYLAR_ASSERT(timers.runExpired() == 0 && fired == 0);
+
+    SYLAR_ASSERT(t->reset(1000, true));
+    SYLAR_ASSERT(timers.getNextTimer() > 900);
+    SYLAR_ASSERT(t->reset(10, true));
+    SYLAR_ASSERT(timers.getNextTimer() <= 10);
+    usleep(20 * 1000);
+    SYLAR_ASSERT(timers.runExpired() == 1 && fired == 1);
+}
+
+// a recurring timer comes back until cancelled
+void test_recurring() {
+    ManualTimers timers;
+    int fired = 0;
+    auto t = timers.addTimer(10, [&fired](){ ++fired; }, true);
+    for(int i = 1; i <= 3; ++i) {
+        usleep(15 * 1000);
+        SYLAR_ASSERT(timers.runExpired() == 1 && fired == i);
+        SYLAR_ASSERT(timers.hasTimer());
+    }
+    SYLAR_ASSERT(t->cancel());
+    usleep(15 * 1000);
+    SYLAR_ASSERT(timers.runExpired() == 0 && fired == 3 && !timers.hasTimer());
+}
+
+// only a timer ahead of all the others wakes the owner, once until it
+// asks getNextTimer() again
+void test_front() {
+    ManualTimers timers;
+    timers.addTimer(100, [](){});
+    SYLAR_ASSERT(timers.fronts() == 1);
+    timers.addTimer(200, [](){});
+    SYLAR_ASSERT(timers.fronts() == 1);
+    timers.addTimer(50, [](){});
+    // no getNextTimer() since the last one, the owner hasn't slept again
+    SYLAR_ASSERT(timers.fronts() == 1);
+    timers.getNextTimer();
+    timers.addTimer(10, [](){});
+    SYLAR_ASSERT(timers.fronts() == 2);
+}
+
+// the condition timer only fires while its condition is alive
+void test_condition() {
+    ManualTimers timers;
+    int fired = 0;
+    std::shared_ptr<int> cond(new int(0));
+    timers.addConditionTimer(5, [&fired](){ ++fired; }, cond);
+    timers.addConditionTimer(5, [&fired](){ fired += 100; }, std::shared_ptr<int>(new int(0)));
+    usleep(10 * 1000);
+    SYLAR_ASSERT(timers.runExpired() == 2 && fired == 1);
+}
+
+// adds from several threads while one thread keeps asking for the next
+void test_threads() {
+    ManualTimers timers;
+    std::atomic<bool> stop(false);
+    std::atomic<int> fired(0);
+    sylar::Thread reader([&timers, &stop](){
+        while(!stop) {
+            timers.getNextTimer();
+            timers.runExpired();
+        }
+    }, "timer_reader");
+    std::vector<sylar::Thread::ptr> writers;
+    for(int i = 0; i < 4; ++i) {
+        writers.push_back(sylar::Thread::ptr(new sylar::Thread([&timers, &fired](){
+            for(int j = 0; j < 1000; ++j) {
+                timers.addTimer(j % 5, [&fired](){ ++fired; });
+            }
+        }, "timer_writer")));
+    }
+    for(auto& i : writers) {
+        i->join();
+    }
+    while(fired != 4000) {
+        usleep(1000);
+    }
+    stop = true;
+    reader.join();
+    SYLAR_LOG_INFO(g_logger) << "timers fired=" << fired << " fronts=" << timers.fronts();
+}
+
+int main(int argc, char** argv) {
+    test_add_cancel();
+    test_refresh_reset();
+    test_recurring();
+    test_front();
+    test_condition();
+    test_threads();
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include "sylar/binary_log.h"
+#include <iostream>
+
+// binlog_decode <file>...: a BinaryLog file back to text, on stdout
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <binary log>..." << std::endl;
+        return 2;
+    }
+    int rt = 0;
+    for(int i = 1; i < argc; ++i) {
+        sylar::BinaryLogReader reader;
+        if(!reader.decode(argv[i], std::cout)) {
+            std::cerr << argv[i] << ": " << reader.getError() << std::endl;
+            rt = 1;
+        }
+        if(reader.getDropped()) {
+            std::cerr << argv[i] << ": " << reader.getDropped()
+                      << " records were dropped while logging" << std::endl;
+        }
+    }
+    return rt;
+}